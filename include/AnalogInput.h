@@ -0,0 +1,52 @@
+#ifndef ANALOGINPUT_H
+#define ANALOGINPUT_H
+
+#include <Arduino.h>
+
+#include <functional>
+
+// Per-component settings of the analog pipeline, all in raw ADC counts
+struct AnalogSettings {
+    uint16_t sampleMs;    // Time between samples; the ADC is left alone in between
+    uint8_t oversample;   // Reads averaged into one sample, a power of two up to 64
+    uint8_t emaShift;     // EMA weight of a new sample is 1/2^emaShift; 0 disables the filter
+    uint16_t high;        // Input turns on at or above this level
+    uint16_t low;         // and off again at or below this one
+
+    AnalogSettings() : sampleMs(100), oversample(4), emaShift(0), high(560), low(464) {}
+
+    bool isValid() const {
+        return sampleMs > 0 && oversample > 0 && oversample <= 64 && (oversample & (oversample - 1)) == 0 &&
+               emaShift <= 8 && low < high && high <= 1024;
+    }
+};
+
+// Oversampled, optionally EMA-filtered analog input with hysteresis. Sampling
+// the ESP8266 ADC disturbs the radio, so read() only touches it once every
+// sampleMs and otherwise returns the last decision. Levels are fixed-point
+// with kFractionBits below the ADC count, which keeps the resolution gained by
+// oversampling and the EMA without floats.
+class AnalogInput {
+   public:
+    static const int kFractionBits = 4;
+
+    explicit AnalogInput(const AnalogSettings& settings);
+
+    bool read(int pin);
+    // Filtered level in ADC counts
+    uint16_t level() const { return static_cast<uint16_t>(filtered >> kFractionBits); }
+    const AnalogSettings& settings() const { return config; }
+    // Called with every sample in ADC counts, before the filter, and the millis() on the sampling grid it was taken at
+    void onSample(std::function<void(uint16_t, unsigned long)> handler) { sampleHandler = handler; }
+
+   private:
+    AnalogSettings config;
+    uint8_t oversampleShift;
+    int32_t filtered = 0;
+    bool primed = false;
+    bool state = false;
+    unsigned long lastSample = 0;
+    std::function<void(uint16_t, unsigned long)> sampleHandler;
+};
+
+#endif  // ANALOGINPUT_H
@@ -0,0 +1,27 @@
+#ifndef APIFORMAT_H
+#define APIFORMAT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "HttpServer.h"
+
+#define MSGPACK_CONTENT_TYPE "application/msgpack"
+
+// JSON or MessagePack for the REST API. Responses follow the request's
+// Accept header and bodies their Content-Type; handlers build and read one
+// JsonDocument either way, so both formats go through the same code.
+class ApiFormat {
+   public:
+    // Accept lists application/msgpack (or the older application/x-msgpack)
+    static bool acceptsMsgPack(const HttpRequest* request);
+    // The body is MessagePack by its Content-Type
+    static bool sentMsgPack(const HttpRequest* request);
+    static void send(HttpRequest* request, int code, JsonVariantConst doc);
+    // A one-member object such as {"error":"Invalid JSON"}
+    static void sendMessage(HttpRequest* request, int code, const char* key, const char* message);
+    // The buffered body in whichever format it was sent
+    static DeserializationError parseBody(const HttpRequest* request, JsonDocument& doc);
+};
+
+#endif  // APIFORMAT_H
@@ -0,0 +1,52 @@
+#ifndef BOOTPROFILER_H
+#define BOOTPROFILER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "HttpServer.h"
+#include "OutputSnapshot.h"
+
+// Most phases recorded; later marks are dropped
+#ifndef BOOT_MAX_PHASES
+#define BOOT_MAX_PHASES 16
+#endif
+
+// Timestamps the phases of setup() with the CPU cycle counter, which costs
+// one instruction to read. The counter wraps after 53 s at 80 MHz, far
+// longer than setup() runs. GET /boot reports each phase's duration and
+// how long after reset the outputs were driven.
+class BootProfiler {
+   public:
+    // First call in setup(); micros() then is the time the SDK took to get there
+    static void begin();
+    // Ends the phase running since the previous mark; phase must be a literal
+    static void mark(const char* phase);
+    // The outputs hold their boot levels; SNAPSHOT_NONE when configureDevices() set them
+    static void outputsReady(SnapshotSource source);
+    static uint32_t outputsReadyUs();
+
+    static void print();
+    static void handleGetBoot(HttpRequest* request);
+
+   private:
+    BootProfiler() {}
+
+    // Microseconds since reset at a cycle count
+    static uint32_t sinceResetUs(uint32_t cycles);
+
+    struct Phase {
+        const char* name;
+        uint32_t cycles;  // Counter at the end of the phase
+    };
+
+    static uint32_t startCycles;
+    static uint32_t startUs;  // micros() at begin()
+    static Phase phases[BOOT_MAX_PHASES];
+    static size_t phaseCount;
+    static uint32_t outputsCycles;
+    static SnapshotSource outputsSource;
+    static bool outputsDriven;
+};
+
+#endif  // BOOTPROFILER_H
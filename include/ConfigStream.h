@@ -0,0 +1,77 @@
+#ifndef CONFIGSTREAM_H
+#define CONFIGSTREAM_H
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+// Longest component object accepted, in bytes of JSON text
+#ifndef CONFIG_MAX_COMPONENT
+#define CONFIG_MAX_COMPONENT 1024
+#endif
+
+// Deepest nesting accepted; a component's own objects sit at depth 6 and 7
+#ifndef CONFIG_MAX_DEPTH
+#define CONFIG_MAX_DEPTH 16
+#endif
+
+enum ConfigEvent {
+    CONFIG_DEVICE,      // An object in "devices" opened
+    CONFIG_COMPONENTS,  // Its "components" array opened
+    CONFIG_COMPONENT,   // One component object, complete
+    CONFIG_DEVICE_END,
+};
+
+// Splits a config as its text arrives in pieces, holding no more than one
+// component: each object in devices[].components[] is handed over as soon
+// as its closing brace is in, so it can be parsed and checked on its own.
+// Only strings, brackets and keys are tracked here; the text outside the
+// components is validated by whoever parses it next.
+class ConfigStream {
+   public:
+    // Returns an error message to stop the stream, or nullptr to go on; json
+    // is only set for CONFIG_COMPONENT
+    typedef std::function<const char*(ConfigEvent event, const char* json, size_t length)> Handler;
+
+    explicit ConfigStream(Handler handler) : handler(handler) {}
+
+    void begin();
+    // False once the text is malformed or the handler stopped it; later data is ignored
+    bool feed(const uint8_t* data, size_t length);
+    // True when the text ended balanced and had a "devices" array
+    bool finish();
+    // Stops the stream from outside, e.g. when the copy to flash fails
+    void fail(const char* message);
+    const char* error() const { return failure; }
+
+   private:
+    enum Role : uint8_t { ROLE_OTHER, ROLE_ROOT, ROLE_DEVICES, ROLE_DEVICE, ROLE_COMPONENTS, ROLE_COMPONENT };
+
+    struct Level {
+        Role role;
+        bool object;
+    };
+
+    void consume(char c);
+    void open(char c);
+    void close(char c);
+    bool keyIs(const char* name) const { return keyLength < sizeof(key) && strcmp(key, name) == 0; }
+
+    Handler handler;
+    Level stack[CONFIG_MAX_DEPTH];
+    size_t depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    bool expectKey = false;
+    bool readingKey = false;
+    char key[16];
+    size_t keyLength = 0;  // sizeof(key) once the key is too long to be one we look for
+    std::vector<char> component;  // Text of the component being received; reserved for the stream only
+    size_t componentDepth = 0;  // Depth of its opening brace, 0 when outside one
+    bool sawDevices = false;
+    bool ended = false;  // The root object closed
+    const char* failure = nullptr;
+};
+
+#endif  // CONFIGSTREAM_H
@@ -3,15 +3,61 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <ESP8266WebServer.h>
 #include <LittleFS.h>
 
 #include <functional>
+#include <memory>
 #include <vector>
 
+#include "AnalogInput.h"
+#include "ConfigStream.h"
+#include "FadeEngine.h"
 #include "FileUtils.h"
+#include "GpioScene.h"
+#include "HttpServer.h"
+#include "MsgPackStream.h"
+#include "OutputSnapshot.h"
+#include "RulesEngine.h"
+#include "StringArena.h"
+#include "Telemetry.h"
 #include "TimeManagement.h"
 
+// Poll period of components that do not set "pollMs"; analog inputs default to their sampleMs
+#ifndef DEFAULT_POLL_MS
+#define DEFAULT_POLL_MS 10
+#endif
+
+// Longest accepted "pollMs", and the longest taskReadSensors sleeps when nothing is configured
+#ifndef MAX_POLL_MS
+#define MAX_POLL_MS 60000
+#endif
+
+// Print the raw config while loading or receiving it; at 115200 baud a 2 KB config adds about 175 ms to boot
+#ifndef CONFIG_DUMP
+#define CONFIG_DUMP 0
+#endif
+
+// Groups a component can be in, for group control over UDP
+#ifndef COMPONENT_MAX_GROUPS
+#define COMPONENT_MAX_GROUPS 4
+#endif
+
+#define CONFIG_FILE "/config.json"
+// Where an upload is written while it streams in; renamed to CONFIG_FILE once it is accepted
+#define CONFIG_UPLOAD_FILE "/config.tmp"
+
+enum ComponentType : uint8_t { COMPONENT_UNKNOWN, COMPONENT_DIGITAL, COMPONENT_ANALOG };
+
+enum ActionType : uint8_t { ACTION_UNKNOWN, ACTION_DIGITAL, ACTION_PWM };
+
+// Bits of ComponentConfig::behaviors
+enum Behavior : uint8_t {
+    BEHAVIOR_TOGGLE = 1,
+    BEHAVIOR_PULSE = 2,
+    BEHAVIOR_TIMED = 4,
+    BEHAVIOR_SCHEDULED = 8,
+};
+
 // Structure to define a schedule
 struct Schedule {
     int startHour;
@@ -32,20 +78,22 @@ struct StateEntry {
 // Structure to track the state of a component
 struct ComponentState {
     bool currentState;
+    uint8_t level;  // Output level the component was last set to, 0-255
     bool scheduledState;
     bool manualOverride;
     bool previousSensorState;       // Track previous state of the sensor
     unsigned long lastStateChange;  // Timestamp of the last state change
     unsigned long lastScheduledStateChange;  // Timestamp of the last scheduled state change
     unsigned long lastManualOverride;  // Timestamp of the last manual override
-    std::vector<StateEntry> stateHistory;     // History of states
-    size_t historyIndex;                      // Index for the circular buffer
     static const size_t maxHistorySize = 10;  // Maximum size of state history
+    StateEntry stateHistory[maxHistorySize];  // History of states, inline so a component is one block
+    size_t historyIndex;                      // Index for the circular buffer
     int errorCode;            // Error code to indicate any issues
     float energyConsumption;  // Energy consumption or runtime (if applicable)
 
     ComponentState()
         : currentState(false),
+          level(0),
           scheduledState(false),
           manualOverride(false),
           previousSensorState(false),
@@ -54,9 +102,7 @@ struct ComponentState {
           lastManualOverride(0),
           historyIndex(0),
           errorCode(0),
-          energyConsumption(0.0f) {
-        stateHistory.resize(maxHistorySize);
-    }
+          energyConsumption(0.0f) {}
 
     void updateState(bool newState) {
         currentState = newState;
@@ -84,15 +130,25 @@ struct ComponentState {
 
 // Structure to define a component configuration
 struct ComponentConfig {
-    String componentName;
-    String componentType;
+    StringRef componentName = 0; // In DeviceManager's arena
+    ComponentType componentType = COMPONENT_UNKNOWN;
+    StringRef componentTypeName = 0; // Only for an unknown type, so the config round-trips
     int componentPin;
-    String actionType;
+    ActionType actionType = ACTION_UNKNOWN;
+    StringRef actionTypeName = 0; // Only for an unknown type
     int actionPin;
-    std::vector<String> behaviors;
+    uint8_t behaviors = 0; // Behavior bits
+    RuleOp manualAction = RULE_NONE; // What behaviors do on a rising input edge or a /control action
+    uint16_t index = 0; // Position across all devices; rules refer to components by it
     Schedule schedule;
+    unsigned long pollMs = DEFAULT_POLL_MS; // Time between reads of componentPin
+    AnalogSettings analog; // Sampling and thresholds for analog components
+    std::shared_ptr<AnalogInput> analogInput; // Filter state, shared by copies of the config
+    std::shared_ptr<TelemetrySeries> telemetry; // Samples and rollups of an analog input
     std::function<bool(int)> readDevice; // Function pointer to read device state
-    std::function<void(int, bool)> performAction; // Function pointer to perform action
+    bool gamma = false; // Perceptual brightness curve on PWM outputs
+    uint16_t groups[COMPONENT_MAX_GROUPS] = {}; // Group ids from "groups", 0 in unused slots
+    std::function<void(int, uint8_t, unsigned long)> performAction; // Drives actionPin to a level, fading over the given ms
     ComponentState state; // Add state to each component
 };
 
@@ -100,31 +156,128 @@ struct Device {
     std::vector<ComponentConfig> components;
 };
 
+// Indices rather than a pointer, so references survive handleConfig
+// restoring a backup of the devices vector
+struct ComponentRef {
+    uint16_t device;
+    uint16_t component;
+};
+
+// Components sharing a poll period
+struct PollBucket {
+    unsigned long periodMs;
+    unsigned long nextDue;
+    std::vector<ComponentRef> members;
+};
+
 class DeviceManager {
    public:
     DeviceManager();
     void loadConfig();
-    void saveConfig(JsonDocument& doc);
+    // Drives the action pins of the last run from a snapshot, before the
+    // config is parsed; configureDevices() then keeps those levels
+    bool restoreOutputs(SnapshotSource from);
     void configureDevices();
     void handleManualBehavior(const ComponentConfig& config, ComponentState& state);
     void handleScheduledBehavior(const ComponentConfig& config, ComponentState& state);
     void checkScheduler();
-    void readSensorsAndHandleBehaviors();
+    unsigned long readSensorsAndHandleBehaviors();
     bool shouldHandleManualBehavior(const ComponentConfig& config, const ComponentState& state);
-    void handleConfig(ESP8266WebServer* server);
-    void handleControl(ESP8266WebServer* server);
-    void handleGetDevices(ESP8266WebServer* server);
+    // Body handler of POST /config, JSON or MessagePack; handleConfig() then applies what it staged
+    void handleConfigBody(HttpRequest* request, const uint8_t* data, size_t len, size_t index, size_t);
+    void handleConfig(HttpRequest* request);
+    void handleControl(HttpRequest* request);
+    void handleGetDevices(HttpRequest* request);
+    // Streams the samples or rollups of an analog component within a range of seconds
+    void handleGetTelemetry(HttpRequest* request);
+    // Does to every component in the group what /control does to one: sets
+    // the level when direct, else runs the component's behavior. Group 0 is
+    // every component. Returns how many there were
+    size_t controlGroup(uint16_t group, bool direct, uint8_t level, unsigned long fadeMs);
+    // Digital outputs written between these switch together on commit;
+    // scheduler edges, rule passes, pulse ends and groups are each a scene
+    void beginScene() { scene.begin(); }
+    void commitScene() { scene.commit(); }
     void populateFunctionPointers();
+    bool updateFades();
+    unsigned long endPulses();
+    void spillTelemetry();
+    // Pins of digital inputs, for waking from sleep on their edges
+    std::vector<int> inputPins() const;
+    // Makes every poll bucket due, e.g. after an input edge woke the chip
+    void pollNow();
+    size_t componentCount() const;
+    // CRC of each component's name, action pin and output level; a fade counts at its target
+    uint32_t stateHash() const;
+    // Called after an output is written or the devices are configured; the level may be unchanged
+    void onOutputChange(std::function<void()> handler) { outputChangeHandler = handler; }
 
    private:
     bool readDigitalSensor(int pin);
-    bool readAnalogSensor(int pin);
     void controlDigitalActuator(int pin, bool state);
-    void controlAnalogActuator(int pin, bool state);
+    void controlAnalogActuator(int pin, uint8_t level, unsigned long fadeMs);
     void toggleDigitalActuator(int pin);
-    void pulseDigitalActuator(int pin, int duration);
+    void startPulse(const ComponentConfig& config, uint16_t durationMs);
+    void controlComponent(ComponentConfig& component, bool direct, uint8_t level, unsigned long fadeMs);
+    void driveOutput(const ComponentConfig& config, uint8_t level, unsigned long fadeMs = 0);
+    void pollComponent(ComponentConfig& component);
+    void buildPollBuckets();
+    bool compileRules(JsonArray rulesJson);
+    void applyAction(const ComponentConfig& config, ComponentState& state, RuleOp op, bool condition,
+                     uint16_t durationMs);
+
+    void storeUpload(const uint8_t* data, size_t len);
+    void discardUpload();
+    void beginStaging(bool strict);
+    const char* stageEvent(ConfigEvent event, const char* json, size_t length);
+    const char* stageComponent(JsonObject componentJson);
+    const char* commitStaged(const char* path);
+    void parseComponent(JsonObject componentJson, ComponentConfig& component, StringArena& arena);
+    void writeComponent(JsonObject componentJson, const ComponentConfig& component) const;
+    const char* nameOf(const ComponentConfig& component) const { return names.get(component.componentName); }
 
     std::vector<Device> devices;
+    StringArena names; // Names of the components, and unknown types
+    std::vector<PollBucket> pollBuckets; // Sorted by period
+    FadeEngine fades;
+    GpioScene scene;
+    RulesEngine rules;
+    OutputSnapshot snapshot; // Action pins and levels, in RTC memory and /outputs.bin
+    bool restoring = false; // Until configureDevices() takes over the restored levels
+    std::vector<ComponentRef> componentRefs; // By ComponentConfig::index
+    std::vector<std::shared_ptr<TelemetrySeries>> telemetry; // Of the analog components; a new config keeps those of the names it keeps
+
+    // A config being received or loaded, built a component at a time
+    ConfigStream configStream;
+    std::vector<Device> staged;
+    StringArena stagedNames;
+    bool stagingStrict = false; // Reject settings out of range instead of defaulting them
+    bool stagedComponents = false; // The current device has a "components" array
+    HttpRequest* uploader = nullptr; // Whose upload is being staged; cleared if its client goes away
+    File upload; // CONFIG_UPLOAD_FILE while it is written
+
+    // The JSON text of a MessagePack upload, passed on to storeUpload() in pieces
+    class UploadText : public Print {
+       public:
+        explicit UploadText(DeviceManager& manager) : manager(manager) {}
+        size_t write(uint8_t c) override;
+        void flush() override;
+
+       private:
+        DeviceManager& manager;
+        uint8_t buffer[64];
+        size_t used = 0;
+    };
+    MsgPackToJson uploadDecoder;
+    UploadText uploadText{*this};
+    bool uploadMsgPack = false;
+
+    struct PendingPulse {
+        uint16_t component;
+        unsigned long offAt;
+    };
+    std::vector<PendingPulse> pulses;
+    std::function<void()> outputChangeHandler;
 };
 
 extern DeviceManager deviceManager;
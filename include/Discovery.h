@@ -0,0 +1,45 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <Arduino.h>
+
+// Reported in the "fw" TXT record and on /status; override from build_flags for a release
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "1.0.0"
+#endif
+
+// The hostname is this followed by the chip ID in hex, e.g. intellios-1a2b3c
+#ifndef DISCOVERY_HOST_PREFIX
+#define DISCOVERY_HOST_PREFIX "intellios-"
+#endif
+
+// Least time between two announcements of a changed state
+#ifndef DISCOVERY_ANNOUNCE_MS
+#define DISCOVERY_ANNOUNCE_MS 1000
+#endif
+
+// Advertises the device as _intellios._tcp under a hostname of its own, with
+// TXT records a controller can act on without any HTTP request: "fw", the
+// firmware version, "components", how many are configured, and "state", a
+// hash of the config and every output level. Answers carry the values last
+// passed to update(), which also announces them to the network when they
+// changed, so a controller browsing the service sees which devices changed
+// and can skip the others.
+class Discovery {
+   public:
+    // Sets the DHCP and mDNS hostname and registers the service; the hostname
+    // only reaches DHCP if this runs before the station connects
+    static void begin(uint16_t port);
+    static const char* hostname() { return host; }
+    // Records the summary and announces it if it changed; false if it had not
+    static bool update(size_t components, uint32_t state);
+    static uint32_t state() { return stateHash; }
+
+   private:
+    static char host[sizeof(DISCOVERY_HOST_PREFIX) + 8];
+    static size_t componentCount;
+    static uint32_t stateHash;
+    static char stateText[9];  // stateHash in hex, as the TXT record carries it
+};
+
+#endif  // DISCOVERY_H
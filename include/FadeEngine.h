@@ -0,0 +1,69 @@
+#ifndef FADEENGINE_H
+#define FADEENGINE_H
+
+#include <Arduino.h>
+
+#include <vector>
+
+// PWM counts written for full brightness; the ESP8266 core defaults to 255
+#ifndef PWM_RANGE
+#define PWM_RANGE 1023
+#endif
+
+// Time between fade steps, 50 Hz is smooth to the eye
+#ifndef FADE_STEP_MS
+#define FADE_STEP_MS 20
+#endif
+
+// Longest accepted fade
+#ifndef FADE_MAX_MS
+#define FADE_MAX_MS 60000
+#endif
+
+// Drives every PWM output from one update() call. Levels run 0-255 and are
+// interpolated in Q8 fixed point from the fade's start time, so a late step
+// catches up instead of stretching the fade. A PWM pin is only written when
+// the value derived from its level differs from the last one written.
+class FadeEngine {
+   public:
+    FadeEngine();
+
+    // Registers a PWM output at a level, off unless restoring one
+    void attach(int pin, bool gamma, uint8_t level = 0);
+    void clear();
+
+    // Starts a fade from the current level; 0 ms sets the level at once and
+    // always rewrites the pin, in case something else drove it meanwhile
+    void fadeTo(int pin, uint8_t level, unsigned long durationMs);
+    // Advances all fades; false once none is left running
+    bool update();
+
+    bool active() const { return activeFades > 0; }
+    uint8_t level(int pin) const;
+    // Level the pin is fading to, or its level when no fade runs
+    uint8_t target(int pin) const;
+
+   private:
+    struct Output {
+        int pin;
+        bool gamma;
+        uint16_t from;  // Q8 levels
+        uint16_t to;
+        uint16_t current;
+        uint16_t written;  // Last PWM value
+        unsigned long start;
+        unsigned long duration;
+        bool fading;
+    };
+
+    Output* find(int pin);
+    const Output* find(int pin) const;
+    uint16_t pwmValue(const Output& output) const;
+    void write(Output& output, bool force);
+
+    std::vector<Output> outputs;
+    size_t activeFades = 0;
+    uint16_t gammaTable[257];  // Level to PWM counts; entry 256 is an end point for interpolation
+};
+
+#endif  // FADEENGINE_H
@@ -0,0 +1,38 @@
+#ifndef GPIOSCENE_H
+#define GPIOSCENE_H
+
+#include <Arduino.h>
+
+#include <vector>
+
+// Digital output changes gathered while a scene is open, then written
+// together: one GPOS write for the pins 0-15 going high, one GPOC write for
+// those going low, and GP16O for GPIO16, which is not on those registers.
+// The outputs switch in the same instant and a commit costs the same for
+// one pin as for sixteen. Pins above 16 have no register and fall back to
+// digitalWrite(). Scenes nest; the outermost commit writes.
+class GpioScene {
+   public:
+    void begin() { depth++; }
+    // Writes the pending changes once the outermost scene ends
+    void commit();
+    bool open() const { return depth > 0; }
+
+    // Stages the level while a scene is open, else writes it at once
+    void write(uint8_t pin, bool level);
+    // The level staged for the pin, else its latch
+    bool level(uint8_t pin) const;
+
+   private:
+    uint8_t depth = 0;
+    uint32_t setMask = 0;
+    uint32_t clearMask = 0;
+    int8_t gpio16 = -1;  // Staged GPIO16 level, -1 when unchanged
+    struct Other {
+        uint8_t pin;
+        bool level;
+    };
+    std::vector<Other> others;  // Staged pins above 16, in order
+};
+
+#endif  // GPIOSCENE_H
@@ -0,0 +1,119 @@
+#ifndef GROUPCONTROL_H
+#define GROUPCONTROL_H
+
+#include <Arduino.h>
+#include <ESPAsyncUDP.h>
+
+#include <functional>
+
+#include "DeviceManagement.h"
+
+// Multicast group every device listens on for group control
+#ifndef GROUP_MULTICAST_ADDRESS
+#define GROUP_MULTICAST_ADDRESS "239.255.42.1"
+#endif
+
+#ifndef GROUP_PORT
+#define GROUP_PORT 4210
+#endif
+
+// Frames remembered to drop the repeats a controller sends against packet loss
+#ifndef GROUP_RECENT_FRAMES
+#define GROUP_RECENT_FRAMES 16
+#endif
+
+// Frames received but not yet applied by loop(); more are dropped
+#ifndef GROUP_QUEUE_SIZE
+#define GROUP_QUEUE_SIZE 8
+#endif
+
+#define GROUP_FRAME_SIZE 14
+#define GROUP_ACK_SIZE 18
+
+// Frame layout, multi-byte fields big-endian:
+//   0  'I' 'G'    magic
+//   2  version    GROUP_VERSION
+//   3  op         GroupOp
+//   4  group      uint16, 0 for every component
+//   6  seq        uint32, chosen by the controller; repeats of a frame keep it
+//   10 level      0-255, for GROUP_OP_SET
+//   11 flags      GROUP_FLAG_ACK
+//   12 fadeMs     uint16, for GROUP_OP_SET on PWM outputs
+// An ack is the frame with op GROUP_OP_ACK, level set to how many components
+// it reached and flags and fadeMs cleared, followed by the chip ID as a uint32.
+#define GROUP_VERSION 1
+
+enum GroupOp : uint8_t {
+    GROUP_OP_SET = 1,     // Like /control with "action": "control"
+    GROUP_OP_ACTION = 2,  // Like /control with any other action: each component's behavior
+    GROUP_OP_ACK = 0x80,
+};
+
+enum GroupFlags : uint8_t { GROUP_FLAG_ACK = 1 };
+
+struct GroupFrame {
+    GroupOp op;
+    uint16_t group;
+    uint32_t seq;
+    uint8_t level;
+    uint8_t flags;
+    uint16_t fadeMs;
+};
+
+// Group control over UDP multicast: one frame from a controller switches a
+// group of components on every device at once, instead of one /control
+// request per device. Frames are queued from lwIP context and applied from
+// loop() through DeviceManager::controlGroup(), the same path as /control.
+// A controller repeats a frame to ride out packet loss; repeats from the same
+// sender and seq are acked again but not applied again.
+class GroupControl {
+   public:
+    explicit GroupControl(DeviceManager& devices) : devices(devices) {}
+
+    bool begin();
+    // Applies the queued frames and sends the acks they ask for
+    void handlePackets();
+    bool busy() const { return queued > 0; }
+    // Runs in lwIP context whenever a frame is queued
+    void onActivity(std::function<void()> handler) { activityHandler = handler; }
+
+    static bool decode(const uint8_t* data, size_t length, GroupFrame& frame);
+    static size_t encode(const GroupFrame& frame, uint8_t* data);
+
+    unsigned long received() const { return receivedCount; }
+    unsigned long duplicates() const { return duplicateCount; }
+    // Malformed, or arrived while the queue was full
+    unsigned long dropped() const { return droppedCount; }
+
+   private:
+    struct Pending {
+        GroupFrame frame;
+        IPAddress sender;
+        uint16_t port;
+    };
+
+    struct Recent {
+        uint32_t sender;
+        uint32_t seq;
+        uint8_t reached;  // Components the frame reached, for the acks of repeats
+    };
+
+    void onPacket(AsyncUDPPacket& packet);
+    const Recent* findRecent(uint32_t sender, uint32_t seq) const;
+    void sendAck(const Pending& pending, uint8_t reached);
+
+    DeviceManager& devices;
+    AsyncUDP udp;
+    std::function<void()> activityHandler;
+    Pending queue[GROUP_QUEUE_SIZE];
+    volatile size_t head = 0;
+    volatile size_t queued = 0;
+    Recent recent[GROUP_RECENT_FRAMES] = {};
+    size_t recentCount = 0;
+    size_t recentNext = 0;
+    unsigned long receivedCount = 0;
+    unsigned long duplicateCount = 0;
+    unsigned long droppedCount = 0;
+};
+
+#endif  // GROUPCONTROL_H
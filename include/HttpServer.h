@@ -0,0 +1,205 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Longest request or header line accepted, in bytes
+#ifndef HTTP_MAX_LINE
+#define HTTP_MAX_LINE 512
+#endif
+
+// Largest body buffered for handlers without a body callback
+#ifndef HTTP_MAX_BODY
+#define HTTP_MAX_BODY 16384
+#endif
+
+// Concurrent connections; lwIP on the ESP8266 core has 5 TCP pcbs in total
+#ifndef HTTP_MAX_CONNECTIONS
+#define HTTP_MAX_CONNECTIONS 4
+#endif
+
+// Seconds an idle keep-alive connection is held open
+#ifndef HTTP_KEEP_ALIVE_TIMEOUT
+#define HTTP_KEEP_ALIVE_TIMEOUT 5
+#endif
+
+// Connections kept open after a response; beyond them responses carry
+// Connection: close, so a slot stays free for the next client
+#ifndef HTTP_KEEP_ALIVE_CONNECTIONS
+#define HTTP_KEEP_ALIVE_CONNECTIONS (HTTP_MAX_CONNECTIONS - 1)
+#endif
+
+// Milliseconds a keep-alive connection must sit idle before it is closed to
+// let a waiting client in; its next request may already be on its way
+#ifndef HTTP_EVICT_IDLE_MS
+#define HTTP_EVICT_IDLE_MS 500
+#endif
+
+enum HttpMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+class HttpServer;
+
+// Prints the next piece of a streamed response body; returns false once the
+// body is complete
+typedef std::function<bool(Print& out)> HttpFiller;
+
+class HttpRequest {
+   public:
+    HttpMethod method() const { return requestMethod; }
+    const String& url() const { return requestUrl; }
+
+    // Query and form arguments; a non-form body is exposed as "plain". Both
+    // lookups return an empty string when missing, valid until the response
+    // is sent
+    bool hasArg(const String& name) const;
+    const String& arg(const String& name) const;
+    bool hasHeader(const String& name) const;
+    const String& header(const String& name) const;
+
+    // Adds a response header; call before send() or beginResponse()
+    void addHeader(const String& name, const String& value);
+    void send(int code, const char* contentType, const String& content);
+    // Starts a response whose body is printed into the returned stream,
+    // e.g. with serializeJson(); it is sent once the handler returns
+    Print& beginResponse(int code, const char* contentType);
+    // Starts a response whose body filler prints a piece at a time, each
+    // piece once the previous one is queued, so the body never has to fit in
+    // RAM. Sent chunked unless its length is given
+    void beginStream(int code, const char* contentType, HttpFiller filler, long length = -1);
+    // Runs if the request ends before its handler does, because the client
+    // went away or the server gave up on it; a body handler cleans up here
+    void onDisconnect(std::function<void()> handler) { disconnectHandler = handler; }
+
+   private:
+    friend class HttpServer;
+
+    // Grows the body geometrically; serializers print a byte at a time and
+    // String would otherwise reallocate for each one
+    class ResponseBody : public Print {
+       public:
+        explicit ResponseBody(String& target) : target(target) {}
+        size_t write(uint8_t c) override { return grow(1) && target.concat(static_cast<char>(c)) ? 1 : 0; }
+        size_t write(const uint8_t* buffer, size_t size) override {
+            return grow(size) && target.concat(reinterpret_cast<const char*>(buffer), size) ? size : 0;
+        }
+        void restart() { reserved = 0; }
+
+       private:
+        bool grow(size_t size);
+
+        String& target;
+        size_t reserved = 0;
+    };
+
+    void reset();
+
+    HttpMethod requestMethod = HTTP_ANY;
+    String requestUrl;
+    std::vector<std::pair<String, String>> args;
+    std::vector<std::pair<String, String>> headers;
+    String body;
+    bool formBody = false;
+
+    int responseCode = 0;
+    String responseType;
+    String responseHeaders;
+    String responseBody;
+    ResponseBody responseStream{responseBody};
+    HttpFiller responseFiller;  // Of a streamed body, until it is complete
+    long responseLength = -1;   // Of a streamed body, or -1 to send it chunked
+    std::function<void()> disconnectHandler;
+};
+
+typedef std::function<void(HttpRequest* request)> HttpHandler;
+// Receives the body in pieces as it arrives instead of buffering it; index is
+// the offset of data within the body and total its Content-Length, or 0 for
+// a chunked body whose length is not known until it ends
+typedef std::function<void(HttpRequest* request, const uint8_t* data, size_t len, size_t index, size_t total)>
+    HttpBodyHandler;
+
+// HTTP/1.1 server on ESPAsyncTCP with keep-alive and several concurrent
+// connections. lwIP callbacks only queue received bytes and hold back the
+// TCP window; parsing, handlers and response writes all run from
+// handleClients() in loop(), one bounded step per connection per call and at
+// most one handler per call, so no client can stall the scheduler. Clients
+// beyond HTTP_MAX_CONNECTIONS wait, their bytes held in the TCP window, until
+// a slot frees; on the device lwIP's pool of pcbs bounds how many can.
+class HttpServer {
+   public:
+    explicit HttpServer(uint16_t port = 80);
+    ~HttpServer();
+
+    void on(const char* uri, HttpMethod method, HttpHandler handler, HttpBodyHandler bodyHandler = nullptr);
+    void onNotFound(HttpHandler handler) { notFoundHandler = handler; }
+    void begin();
+    void handleClients();
+    // Connections being served, not counting clients waiting for a slot
+    size_t connectionCount() const;
+    // True while a request or response is part-way through and handleClients() has more to do
+    bool busy() const;
+    // Runs in lwIP context whenever a client connects or sends data
+    void onActivity(std::function<void()> handler) { activityHandler = handler; }
+
+   private:
+    enum State { REQUEST_LINE, HEADERS, BODY, CHUNK_SIZE, CHUNK_TRAILER, READY, RESPONDING, CLOSING };
+
+    struct Route {
+        String uri;
+        HttpMethod method;
+        HttpHandler handler;
+        HttpBodyHandler bodyHandler;
+    };
+
+    struct Connection {
+        AsyncClient* client;
+        HttpServer* server;
+        String received;  // Bytes not yet parsed; bounded by the TCP window
+        String line;      // The line being parsed
+        State state = REQUEST_LINE;
+        HttpRequest request;
+        const Route* route = nullptr;
+        size_t contentLength = 0;
+        size_t bodyReceived = 0;
+        bool chunked = false;  // Transfer-Encoding: chunked
+        size_t chunkLeft = 0;
+        bool keepAlive = true;
+        String head;
+        size_t headSent = 0;
+        size_t bodySent = 0;
+        bool disconnected = false;
+        bool waiting = true;           // For a slot, in incoming
+        unsigned long idleSince = 0;   // millis() at the end of the last response
+    };
+
+    void accept(AsyncClient* client);
+    void admit();
+    bool evictIdle();
+    bool advance(Connection* connection, bool mayDispatch);
+    bool parseRequestLine(Connection* connection, const String& line);
+    void parseHeader(Connection* connection, const String& line);
+    void headersComplete(Connection* connection);
+    void parseChunkSize(Connection* connection, const String& line);
+    void bodyComplete(Connection* connection);
+    void abandon(Connection* connection);
+    void dispatch(Connection* connection);
+    void fail(Connection* connection, int code);
+    void finishResponse(Connection* connection);
+    void fillBody(Connection* connection);
+    bool pump(Connection* connection);
+    void consume(Connection* connection, size_t length);
+
+    AsyncServer tcpServer;
+    std::vector<Route> routes;
+    HttpHandler notFoundHandler;
+    std::function<void()> activityHandler;
+    std::vector<Connection*> connections;
+    std::vector<Connection*> incoming;  // Accepted in lwIP context, waiting for handleClients() to admit them
+    size_t nextDispatch = 0;
+};
+
+#endif  // HTTPSERVER_H
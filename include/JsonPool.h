@@ -0,0 +1,62 @@
+#ifndef JSONPOOL_H
+#define JSONPOOL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Bytes reserved at boot for the JsonDocuments of one request; documents
+// that outgrow it spill to the heap and are counted in overflows()
+#ifndef JSON_POOL_SIZE
+#define JSON_POOL_SIZE 8192
+#endif
+
+// Bump allocator behind every JsonDocument, so a request parses and builds
+// its JSON without touching the heap and leaves no holes in it. Blocks are
+// carved off the top of one static buffer; the top block grows and shrinks
+// in place, which is how ArduinoJson builds strings and trims its slot pool.
+// The buffer starts over once the last block is released, i.e. as soon as
+// the request's documents go out of scope. Handlers run one at a time from
+// loop(), so there is nothing to lock.
+class JsonPool : public ArduinoJson::Allocator {
+   public:
+    // The shared pool, on a buffer of JSON_POOL_SIZE bytes
+    static JsonPool* instance();
+
+    JsonPool(void* buffer, size_t size);
+
+    void* allocate(size_t size) override;
+    void deallocate(void* pointer) override;
+    void* reallocate(void* pointer, size_t size) override;
+
+    size_t capacity() const { return size; }
+    // Bytes handed out since the pool last started over, headers included
+    size_t used() const { return top; }
+    // Most bytes in use at once since boot
+    size_t peak() const { return highWater; }
+    // Starts peak() over from what is in use now, to size one kind of request
+    void resetPeak() { highWater = top; }
+    // Allocations that did not fit and went to the heap instead
+    uint32_t overflows() const { return heapAllocations; }
+    // Blocks not yet released, heap ones included
+    size_t liveBlocks() const { return live + heapLive; }
+
+   private:
+    struct Header {
+        size_t size;  // Requested bytes
+    };
+
+    bool owns(const void* pointer) const { return pointer >= buffer && pointer < buffer + size; }
+    Header* headerOf(void* pointer) const;
+    // Bytes a block of this size takes from the buffer, header included
+    static size_t stride(size_t size);
+
+    uint8_t* buffer;
+    size_t size;
+    size_t top = 0;
+    size_t live = 0;
+    size_t highWater = 0;
+    size_t heapLive = 0;
+    uint32_t heapAllocations = 0;
+};
+
+#endif  // JSONPOOL_H
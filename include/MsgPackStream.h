@@ -0,0 +1,55 @@
+#ifndef MSGPACKSTREAM_H
+#define MSGPACKSTREAM_H
+
+#include <Arduino.h>
+
+// Deepest nesting accepted, as for a JSON config
+#ifndef MSGPACK_MAX_DEPTH
+#define MSGPACK_MAX_DEPTH 16
+#endif
+
+// Rewrites MessagePack arriving in pieces as the same value in JSON text, so
+// a MessagePack /config goes through the config stream and is saved just as
+// a JSON one is. Only the open containers and one partly received header are
+// held. Binary and extension types have no JSON form and are refused, as are
+// map keys other than strings; floats keep six decimals.
+class MsgPackToJson {
+   public:
+    void begin(Print& out);
+    // False once the input is malformed; later data is ignored
+    bool feed(const uint8_t* data, size_t length);
+    // True when exactly one whole value came in
+    bool finish() const { return !failed && done; }
+
+   private:
+    struct Level {
+        uint32_t left;  // Items still to come; a map counts keys and values
+        bool map;
+        bool first;
+    };
+
+    void consume(uint8_t c);
+    int headerBytes(uint8_t type) const;
+    void decode();
+    void separator();
+    void open(bool map, uint32_t count);
+    void beginString(uint32_t length);
+    void stringByte(uint8_t c);
+    void writeUnsigned(uint64_t value);
+    void writeSigned(int64_t value);
+    void writeFloat(double value);
+    void completed();
+    bool atKey() const { return depth > 0 && stack[depth - 1].map && stack[depth - 1].left % 2 == 0; }
+
+    Print* out = nullptr;
+    Level stack[MSGPACK_MAX_DEPTH];
+    size_t depth = 0;
+    uint8_t head[9];  // Type byte and its big-endian length or value
+    uint8_t headLength = 0;
+    uint8_t headNeeded = 0;
+    uint32_t stringLeft = 0;
+    bool done = false;
+    bool failed = false;
+};
+
+#endif  // MSGPACKSTREAM_H
@@ -0,0 +1,73 @@
+#ifndef OUTPUTSNAPSHOT_H
+#define OUTPUTSNAPSHOT_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+// Most outputs restored at boot
+#ifndef OUTPUT_SNAPSHOT_MAX
+#define OUTPUT_SNAPSHOT_MAX 16
+#endif
+
+// Word offset in RTC user memory; OTA updates use the first 128 bytes
+#ifndef OUTPUT_SNAPSHOT_RTC_OFFSET
+#define OUTPUT_SNAPSHOT_RTC_OFFSET 32
+#endif
+
+#define OUTPUT_SNAPSHOT_FILE "/outputs.bin"
+
+enum SnapshotSource { SNAPSHOT_NONE, SNAPSHOT_RTC, SNAPSHOT_FLASH };
+
+// OUTPUT_PULSE marks an output that is on only until its pulse ends; nothing
+// would end it after a reset, so it is restored off
+enum OutputFlags : uint8_t { OUTPUT_PWM = 1, OUTPUT_GAMMA = 2, OUTPUT_PULSE = 4 };
+
+struct OutputEntry {
+    uint8_t pin;
+    uint8_t level;  // 0-255, as in ComponentState::level
+    uint8_t flags;
+    uint8_t reserved;
+};
+
+// The action pins of the config and their levels, kept where setup() can
+// read them long before the config is parsed. RTC user memory holds the
+// levels and survives a reset or a crash, not a power cycle; the file holds
+// only which pins are outputs, with every level off, so it is rewritten
+// when the config changes rather than on every output change.
+class OutputSnapshot {
+   public:
+    OutputSnapshot();
+
+    bool loadRtc();
+    bool loadFile();
+    void saveRtc();
+    // Skips the write when the file already holds the same outputs
+    bool saveFile();
+
+    void clear();
+    void add(int pin, uint8_t level, uint8_t flags);
+    const OutputEntry* find(int pin) const;
+    // Records a new level in RTC memory if it changed
+    void setLevel(int pin, uint8_t level);
+    // Sets or clears OUTPUT_PULSE in RTC memory if it changed
+    void setPulsing(int pin, bool pulsing);
+
+    size_t size() const { return image.count; }
+    const OutputEntry* begin() const { return image.entries; }
+    const OutputEntry* end() const { return image.entries + image.count; }
+
+   private:
+    struct Image {
+        uint32_t magic;
+        uint32_t crc;  // Of count and entries
+        uint32_t count;
+        OutputEntry entries[OUTPUT_SNAPSHOT_MAX];
+    };
+
+    static uint32_t checksum(const Image& image);
+    bool valid() const;
+
+    Image image;
+};
+
+#endif  // OUTPUTSNAPSHOT_H
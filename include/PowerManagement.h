@@ -0,0 +1,113 @@
+#ifndef POWERMANAGEMENT_H
+#define POWERMANAGEMENT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP8266WiFi.h>
+#include <TaskSchedulerDeclarations.h>
+
+#include <functional>
+#include <vector>
+
+#include "FileUtils.h"
+#include "HttpServer.h"
+
+// Mode used until /power.json or POST /power picks another
+#ifndef POWER_DEFAULT_MODE
+#define POWER_DEFAULT_MODE POWER_MODEM_SLEEP
+#endif
+
+// Shortest idle gap worth handing to the SDK; shorter ones just return to loop()
+#ifndef POWER_IDLE_MIN_MS
+#define POWER_IDLE_MIN_MS 2
+#endif
+
+// Shortest idle gap worth light sleep; waking costs a few ms and the next beacon
+#ifndef POWER_LIGHT_MIN_MS
+#define POWER_LIGHT_MIN_MS 100
+#endif
+
+// Longest single sleep, so work outside the scheduler still runs every so often
+#ifndef POWER_IDLE_MAX_MS
+#define POWER_IDLE_MAX_MS 1000
+#endif
+
+enum PowerMode { POWER_ALWAYS_ON, POWER_MODEM_SLEEP, POWER_LIGHT_SLEEP };
+
+// How loop() spends an idle gap: not at all, waiting with the radio fully on
+// (the soft AP cannot sleep), or with the radio off between beacons, and in
+// light sleep the CPU too
+enum SleepType { SLEEP_NONE, SLEEP_WAIT, SLEEP_MODEM, SLEEP_LIGHT, SLEEP_TYPE_COUNT };
+
+enum WakeReason { WAKE_NONE, WAKE_DEADLINE, WAKE_GPIO, WAKE_NETWORK, WAKE_REASON_COUNT };
+
+// What the sleep decision depends on
+struct IdleState {
+    long untilDeadlineMs;  // Until the next watched task runs, -1 if none is enabled
+    bool busy;             // Work outside the scheduler is pending
+    bool softAP;           // Clients depend on our beacons
+};
+
+struct SleepPlan {
+    SleepType type;
+    unsigned long durationMs;
+};
+
+// Sleeps through the gaps between scheduled work. After each loop() pass it
+// asks the scheduler how long until the next watched task is due and waits
+// that long in esp_delay(), with the radio in modem or light sleep as the
+// mode allows. An edge on an input pin or network activity ends the wait
+// early; idle time and wake reasons are counted for /power.
+class PowerManager {
+   public:
+    explicit PowerManager(Scheduler& scheduler);
+    ~PowerManager();
+
+    void loadConfig();
+    void setMode(PowerMode mode);
+    PowerMode mode() const { return powerMode; }
+    // Tasks whose next run bounds the sleep
+    void watch(Task& task);
+    // Digital inputs whose edges end a sleep; pins without an interrupt are skipped
+    void setWakePins(const std::vector<int>& pins);
+    // Runs after a GPIO wake, before loop() continues
+    void onGpioWake(std::function<void()> handler) { gpioWakeHandler = handler; }
+
+    // Decides how to spend an idle gap; no side effects, so it can be tested on its own
+    SleepPlan plan(const IdleState& state) const;
+    // Called at the end of loop(); returns how the wait ended, WAKE_NONE if it did not sleep
+    WakeReason idle(bool busy);
+    // Ends a sleep in progress; in IRAM, so safe from interrupts during flash access, and from lwIP callbacks
+    void IRAM_ATTR wake(WakeReason reason);
+
+    unsigned long idleMs(SleepType type) const { return idleTotals[type]; }
+    unsigned long wakeCount(WakeReason reason) const { return wakeCounts[reason]; }
+    void resetStats();
+
+    void handleGetPower(HttpRequest* request);
+    void handleSetPower(HttpRequest* request);
+
+   private:
+    static void IRAM_ATTR onPinEdge();
+    static void IRAM_ATTR onWakeLevel();
+    long untilDeadline();
+    void applySleepType(WiFiSleepType_t type);
+    void armWakePins(bool light);
+
+    static PowerManager* instance;  // For the pin interrupt
+
+    Scheduler& runner;
+    PowerMode powerMode = POWER_DEFAULT_MODE;
+    std::vector<Task*> watched;
+    std::vector<int> wakePins;
+    std::function<void()> gpioWakeHandler;
+    volatile WakeReason wakeReason = WAKE_NONE;
+    unsigned long idleTotals[SLEEP_TYPE_COUNT] = {};
+    unsigned long sleepCounts[SLEEP_TYPE_COUNT] = {};
+    unsigned long wakeCounts[WAKE_REASON_COUNT] = {};
+    unsigned long statsSince = 0;
+};
+
+extern PowerManager powerManager;
+
+#endif  // POWERMANAGEMENT_H
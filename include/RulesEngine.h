@@ -0,0 +1,97 @@
+#ifndef RULESENGINE_H
+#define RULESENGINE_H
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+// Limits that keep one rule's evaluation cost fixed
+#ifndef RULE_MAX_INPUTS
+#define RULE_MAX_INPUTS 8
+#endif
+
+#ifndef RULE_MAX_TARGETS
+#define RULE_MAX_TARGETS 8
+#endif
+
+
+enum RuleTrigger : uint8_t { RULE_ON_RISE, RULE_ON_FALL, RULE_ON_CHANGE };
+
+enum RuleOp : uint8_t {
+    RULE_NONE,
+    RULE_TOGGLE,   // Flip each target
+    RULE_ON,
+    RULE_OFF,
+    RULE_PULSE,    // On for durationMs, then off
+    RULE_FOLLOW,   // Targets track the condition
+    RULE_REFRESH,  // Rewrite the target's current state, the legacy "timed" behavior
+};
+
+// Minutes since midnight; a window whose start is after its end wraps past midnight
+struct RuleWindow {
+    uint16_t start;
+    uint16_t end;
+};
+
+// Rules compiled into flat tables. Each rule ANDs up to RULE_MAX_INPUTS input
+// states and applies one op to up to RULE_MAX_TARGETS components when the
+// condition edge matches its trigger. Inputs and targets are component
+// indices. An input changing only re-evaluates the rules listing it, so the
+// cost of a tick depends on what changed, not on how many rules exist.
+class RulesEngine {
+   public:
+    // Called once per target when a rule fires
+    typedef std::function<void(uint16_t target, RuleOp op, bool condition, uint16_t durationMs)> ActionHandler;
+    // Minutes since midnight, or -1 while the time is unknown
+    typedef std::function<int()> Clock;
+
+    RulesEngine();
+
+    void onAction(ActionHandler handler) { actionHandler = handler; }
+    void setClock(Clock source) { clock = source; }
+
+    // Rebuilds the tables: begin(), addRule() for each rule, then end()
+    void begin(uint16_t inputCount);
+    bool addRule(const uint16_t* inputs, uint8_t inputCount, const uint16_t* targets, uint8_t targetCount,
+                 RuleTrigger trigger, RuleOp op, uint16_t durationMs = 0, const RuleWindow* window = nullptr);
+    void end();
+
+    // Records an input's new state; evaluate() acts on everything recorded since the last call
+    void setInput(uint16_t input, bool state);
+    void evaluate();
+
+    size_t ruleCount() const { return rules.size(); }
+
+   private:
+    struct Rule {
+        uint16_t firstInput;  // Into inputList
+        uint16_t firstTarget;  // Into targetList
+        uint16_t durationMs;
+        uint16_t stamp;  // Last evaluate() pass that looked at this rule
+        int16_t window;  // Into windows, or -1
+        uint8_t inputCount;
+        uint8_t targetCount;
+        RuleTrigger trigger;
+        RuleOp op;
+        bool condition;
+    };
+
+    bool inputState(uint16_t input) const { return inputBits[input >> 5] & (1UL << (input & 31)); }
+    bool inWindow(const RuleWindow& window, int minute) const;
+
+    std::vector<Rule> rules;
+    std::vector<uint16_t> inputList;
+    std::vector<uint16_t> targetList;
+    std::vector<RuleWindow> windows;
+    std::vector<uint16_t> dependentStart;  // Rules listing input i are dependents[dependentStart[i]..dependentStart[i + 1]]
+    std::vector<uint16_t> dependents;
+    std::vector<uint32_t> inputBits;
+    std::vector<uint16_t> changed;
+    uint16_t inputs = 0;
+    uint16_t generation = 0;
+    ActionHandler actionHandler;
+    Clock clock;
+};
+
+#endif  // RULESENGINE_H
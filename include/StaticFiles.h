@@ -0,0 +1,52 @@
+#ifndef STATICFILES_H
+#define STATICFILES_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include <vector>
+
+#include "HttpServer.h"
+
+// Directory of the web UI in the LittleFS image, written by scripts/build_web.py
+#ifndef WEB_ROOT
+#define WEB_ROOT "/www"
+#endif
+
+// Bytes read from flash per piece of a response
+#ifndef WEB_CHUNK_BYTES
+#define WEB_CHUNK_BYTES 512
+#endif
+
+// Assets carry a content hash in their name, so a new build never reuses one
+#define WEB_ASSET_CACHE "public, max-age=31536000, immutable"
+// Pages keep their names and are revalidated against their ETag on every load
+#define WEB_PAGE_CACHE "no-cache"
+
+// Serves the gzip files under WEB_ROOT as they are, with Content-Encoding:
+// gzip, an ETag and Cache-Control, streamed from flash a piece at a time.
+// A revalidation costs one file open and a 304 without a body; ETags are
+// a CRC of each file, computed on its first request after boot.
+class StaticFiles {
+   public:
+    explicit StaticFiles(const char* root = WEB_ROOT) : root(root) {}
+
+    // Answers a GET or HEAD of url from "<root><url>.gz", a directory from
+    // its index.html; false when there is no such file
+    bool serve(HttpRequest* request);
+
+   private:
+    struct Etag {
+        String path;
+        size_t size;
+        uint32_t crc;
+    };
+
+    static const char* contentType(const String& url);
+    uint32_t etagOf(const String& path, File& file);
+
+    const char* root;
+    std::vector<Etag> etags;
+};
+
+#endif  // STATICFILES_H
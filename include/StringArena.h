@@ -0,0 +1,32 @@
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <Arduino.h>
+
+#include <vector>
+
+// Offset of a string in a StringArena; 0 is always the empty string
+typedef uint16_t StringRef;
+
+// The strings of a config packed back to back in one allocation, instead of
+// a heap block per String. It grows as strings are interned, and
+// shrinkToFit() trims it to one exact block once a config is complete.
+// Offsets survive copies and moves of the arena.
+class StringArena {
+   public:
+    void clear();
+    // Copies str in; the empty string, or anything past 64 KB, is 0
+    StringRef intern(const char* str);
+    // Gives back the room growth left unused
+    void shrinkToFit() { data.shrink_to_fit(); }
+
+    const char* get(StringRef ref) const { return ref < data.size() ? data.data() + ref : ""; }
+    bool equals(StringRef ref, const char* str) const { return strcmp(get(ref), str ? str : "") == 0; }
+    size_t size() const { return data.size(); }
+    size_t capacity() const { return data.capacity(); }
+
+   private:
+    std::vector<char> data;  // Empty, or data[0] ends the empty string
+};
+
+#endif  // STRINGARENA_H
@@ -6,5 +6,11 @@
 extern Scheduler runner;
 extern Task taskReadSensors;
 extern Task taskReconnectWiFi;
+extern Task taskConnectWiFi;
+extern Task taskFade;
+extern Task taskPulse;
+extern Task taskSchedule;
+extern Task taskAnnounce;
+extern Task taskTelemetry;
 
 #endif // TASKDEFINITIONS_H
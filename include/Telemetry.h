@@ -0,0 +1,173 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include <memory>
+
+// Raw samples are kept in this many blocks per analog input; the oldest block goes when a new one starts
+#ifndef TELEMETRY_RAW_BLOCKS
+#define TELEMETRY_RAW_BLOCKS 8
+#endif
+
+// Bytes per raw block, 8 of them header; a slowly moving input packs two samples in a byte
+#ifndef TELEMETRY_BLOCK_BYTES
+#define TELEMETRY_BLOCK_BYTES 32
+#endif
+
+// 1-minute rollups kept in RAM
+#ifndef TELEMETRY_MINUTES
+#define TELEMETRY_MINUTES 60
+#endif
+
+// 15-minute rollups kept in RAM
+#ifndef TELEMETRY_QUARTERS
+#define TELEMETRY_QUARTERS 96
+#endif
+
+// Hourly rollups kept on flash, 8 bytes each, in two files of half as many
+#ifndef TELEMETRY_FLASH_HOURS
+#define TELEMETRY_FLASH_HOURS 336
+#endif
+
+// Closed hours held in RAM until spill() appends them to flash; the oldest goes when they are not written in time
+#ifndef TELEMETRY_PENDING_HOURS
+#define TELEMETRY_PENDING_HOURS 4
+#endif
+
+// Points printed per piece of a /telemetry response
+#ifndef TELEMETRY_POINTS_PER_PIECE
+#define TELEMETRY_POINTS_PER_PIECE 16
+#endif
+
+// Hourly rollups of a series are appended to "<prefix><id>.bin", which is
+// renamed to ".old" when it holds half of TELEMETRY_FLASH_HOURS
+#define TELEMETRY_FILE_PREFIX "/tl-"
+
+enum TelemetryResolution : uint8_t { TELEMETRY_RAW, TELEMETRY_MINUTE, TELEMETRY_QUARTER, TELEMETRY_HOUR };
+
+// Samples of one analog input at several resolutions. Raw samples sit in
+// fixed-size blocks: the first in full, the rest as zigzag deltas from their
+// predecessor in one nibble, or in four when the step is beyond 7 counts, with
+// times implied by the sampling grid. Every sample also goes into a
+// min/max/avg bucket per resolution; closed 1- and 15-minute buckets go into
+// rings in RAM and closed hours wait in RAM for spill(), which appends them
+// to flash once the clock is set. About 1 KB of RAM holds the last minute or so of samples, an hour of
+// minutes and a day of quarters; the 2.7 KB files, two weeks of hours.
+class TelemetrySeries {
+   public:
+    TelemetrySeries(const char* name, uint16_t sampleMs);
+
+    static uint32_t idOf(const char* name);
+    uint32_t id() const { return seriesId; }
+    uint16_t sampleMs() const { return rawSampleMs; }
+    // Raw blocks assume the grid; a new period drops them
+    void setSampleMs(uint16_t ms);
+
+    // A sample in ADC counts taken at millis() at; now is
+    // TimeManagement::getCurrentTimestamp(), which buckets are aligned to.
+    // Returns true while closed hours wait for spill().
+    bool add(uint16_t value, unsigned long at, unsigned long now);
+    // Appends the closed hours to flash; kept off the sampling path, which
+    // runs inside the input poll
+    void spill();
+
+    // Raw samples held
+    size_t rawSamples() const;
+    String filePath(bool old) const;
+    // For a series the config no longer has
+    void removeFiles() const;
+
+    // Seconds per point, 0 for raw
+    static uint32_t seconds(TelemetryResolution resolution);
+    static const char* resolutionName(TelemetryResolution resolution);
+    static bool parseResolution(const char* name, TelemetryResolution& resolution);
+
+   private:
+    friend class TelemetryCursor;
+
+    static const size_t kBlockNibbles = (TELEMETRY_BLOCK_BYTES - 8) * 2;
+
+    struct RawBlock {
+        uint32_t start;   // millis() of the first sample
+        uint16_t first;   // In ADC counts
+        uint8_t count;    // Samples, the first included
+        uint8_t nibbles;  // Of data in use
+        uint8_t data[TELEMETRY_BLOCK_BYTES - 8];
+    };
+
+    struct Hour {
+        uint32_t start;
+        uint32_t packed;
+    };
+
+    struct Bucket {
+        uint32_t start;  // Seconds, a multiple of the resolution
+        uint32_t count;
+        uint32_t sum;
+        uint16_t min;
+        uint16_t max;
+    };
+
+    // One resolution. Rings hold a bucket per step from the oldest to end,
+    // the skipped ones empty, so a bucket's slot follows from its start
+    struct Level {
+        uint32_t seconds;
+        uint32_t* slots;  // Packed buckets, nullptr for the level kept on flash
+        uint16_t size;
+        uint16_t used;
+        uint16_t next;  // Slot the next closed bucket goes in
+        uint32_t end;   // Start of the bucket after the newest in the ring
+        Bucket open;    // Filling; count 0 before the first sample
+    };
+
+    // Min in bits 0-9, max in 10-19, avg in 20-29; bit 31 marks a bucket that had samples
+    static uint32_t pack(const Bucket& bucket);
+    void addRaw(uint16_t value, unsigned long at);
+    void putNibble(RawBlock& block, uint8_t nibble);
+    void close(Level& level);
+    void append(const Hour& hour);
+    uint32_t packedAt(const Level& level, uint32_t start) const;
+    uint32_t oldest(const Level& level) const;
+
+    uint32_t seriesId;
+    uint16_t rawSampleMs;
+    uint16_t lastValue = 0;
+    uint32_t blocksStarted = 0;  // The newest block is (blocksStarted - 1) % TELEMETRY_RAW_BLOCKS
+    RawBlock blocks[TELEMETRY_RAW_BLOCKS];
+    uint32_t minutes[TELEMETRY_MINUTES];
+    uint32_t quarters[TELEMETRY_QUARTERS];
+    Level levels[3];  // Minute, quarter and hour
+    Hour pending[TELEMETRY_PENDING_HOURS];  // Closed hours for spill(), the oldest first
+    uint8_t pendingHours = 0;
+};
+
+// Walks the points of a series that overlap [from, to) seconds at one
+// resolution, printing them as JSON arrays a piece at a time: [t, value]
+// for raw samples, t with milliseconds, and [t, min, max, avg] for buckets,
+// t their start. Holds the series, so a new config cannot free it mid-walk.
+class TelemetryCursor {
+   public:
+    TelemetryCursor(std::shared_ptr<TelemetrySeries> series, TelemetryResolution resolution, unsigned long from,
+                    unsigned long to);
+
+    // Prints the next points, comma separated; returns false after the last
+    bool print(Print& out);
+
+   private:
+    bool printRaw(Print& out);
+    bool printRing(Print& out);
+    bool printSpilled(Print& out);
+    void printBucket(Print& out, uint32_t start, uint32_t packed);
+
+    std::shared_ptr<TelemetrySeries> series;
+    TelemetryResolution resolution;
+    unsigned long from;
+    unsigned long to;
+    uint32_t next;  // Raw: block number; in RAM: bucket start; on flash: record in file
+    uint8_t file = 0;  // On flash: 0 the old file, 1 the current one, 2 the pending hours and open bucket
+    size_t printed = 0;
+};
+
+#endif  // TELEMETRY_H
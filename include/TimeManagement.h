@@ -2,16 +2,79 @@
 #define TIMEMANAGEMENT_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <time.h>
 
+#include "FileUtils.h"
+#include "HttpServer.h"
+
+// POSIX TZ string used until /time.json or POST /time sets one
+#ifndef TIME_DEFAULT_TZ
+#define TIME_DEFAULT_TZ "UTC0"
+#endif
+
+#ifndef TIME_NTP_SERVER_1
+#define TIME_NTP_SERVER_1 "pool.ntp.org"
+#endif
+
+#ifndef TIME_NTP_SERVER_2
+#define TIME_NTP_SERVER_2 "time.nist.gov"
+#endif
+
+// Least time between saves of an SNTP time to flash; SNTP resyncs hourly
+#ifndef TIME_SAVE_INTERVAL_S
+#define TIME_SAVE_INTERVAL_S 21600
+#endif
+
+// Earliest epoch accepted as a real time (2020-09-13)
+#define TIME_MIN_VALID 1600000000UL
+
+enum TimeSource { TIME_NONE, TIME_SAVED, TIME_MANUAL, TIME_NTP };
+
+// Wall time from an offset to millis(): SNTP runs in the background and each
+// answer re-anchors the offset, so a timestamp is an add instead of a call
+// into the C library. Until the first answer the time saved in /time.json
+// stands in, so schedules work across a reboot without network.
 class TimeManagement {
    public:
+    // Restores the saved time and zone and starts SNTP; does not wait for it
+    static void begin();
+    // Epoch seconds, or seconds since boot while no time is known
     static unsigned long getCurrentTimestamp();
+    // The same in milliseconds at an earlier millis() reading, within 24 days
+    static uint64_t timestampMillis(unsigned long at);
     static String formatTimestamp(unsigned long timestamp);
-    static void initializeTime(const char* ntpServer, long gmtOffset_sec, int daylightOffset_sec);
+    static bool isValid() { return timeSource != TIME_NONE; }
+    static TimeSource source() { return timeSource; }
+    // Broken-down local time, recomputed only when the minute changes, so
+    // tm_sec is that of the minute's first call; nullptr while no time is known
+    static const struct tm* localTime();
+    // Minutes since local midnight, -1 while no time is known
+    static int minuteOfDay();
+    // Until the next wall-clock minute starts, a full minute while no time is known
+    static unsigned long millisUntilNextMinute();
+
+    static void setTime(time_t epoch, TimeSource source);
+    static void setTimezone(const String& tz);
+    static bool saveTime();
+
+    static void handleGetTime(HttpRequest* request);
+    static void handleSetTime(HttpRequest* request);
 
    private:
     TimeManagement() {}
+
+    static void anchor(TimeSource source);
+    static void onTimeSet(bool fromSntp);
+
+    static unsigned long anchorEpoch;   // Epoch seconds at anchorMillis
+    static unsigned long anchorMillis;
+    static TimeSource timeSource;
+    static String timeZone;
+    static struct tm cachedTime;
+    static unsigned long cachedMinute;  // Epoch of cachedTime's minute
+    static bool cacheValid;
+    static unsigned long lastSave;
 };
 
 #endif // TIMEMANAGEMENT_H
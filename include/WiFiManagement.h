@@ -3,33 +3,86 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <ESP8266WebServer.h>
 #include <ESP8266WiFi.h>
 #include <LittleFS.h>
 
 #include "ESP8266mDNS.h"
 #include "FileUtils.h"
+#include "HttpServer.h"
+
+// First retry delay after a failed connection attempt; doubles with each further failure
+#ifndef WIFI_RETRY_MIN_MS
+#define WIFI_RETRY_MIN_MS 2000
+#endif
+
+// Longest retry delay
+#ifndef WIFI_RETRY_MAX_MS
+#define WIFI_RETRY_MAX_MS 300000
+#endif
+
+// An attempt that has not connected after this long counts as failed
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#endif
+
+// How often a working connection is checked
+#ifndef WIFI_CHECK_MS
+#define WIFI_CHECK_MS 5000
+#endif
+
+// Failed reconnects in a row before the soft AP comes back, so the device can be set up again
+#ifndef WIFI_AP_AFTER_FAILURES
+#define WIFI_AP_AFTER_FAILURES 3
+#endif
+
+// The contents of /wifi.json, loaded once
+struct WiFiCredentials {
+    String ssid;
+    String password;
+    int32_t channel = 0;  // Of the last access point joined, 0 if none yet
+    uint8_t bssid[6] = {0};
+    IPAddress ip;  // Static address when set, DHCP otherwise
+    IPAddress gateway;
+    IPAddress subnet;
+    IPAddress dns;
+};
 
 class WiFiManager {
    public:
     WiFiManager();
+    // The setup AP runs until the station joins a network; it keeps the radio from sleeping
     void startAPMode();
-    void reconnectWiFi();
+    void stopAPMode();
+    // Runs from taskReconnectWiFi; returns the ms until it wants to run again
+    unsigned long reconnectWiFi();
     bool saveWiFiCredentials(const char* ssid, const char* password);
-    bool loadWiFiCredentials(String& ssid, String& password);
+    bool loadWiFiCredentials();
 
-    void handleRoot(ESP8266WebServer* server);
-    void handleScan(ESP8266WebServer* server);
-    void handleConnect(ESP8266WebServer* server);
-    void handleStatus(ESP8266WebServer* server);
+    void handleRoot(HttpRequest* request);
+    void handleScan(HttpRequest* request);
+    void handleConnect(HttpRequest* request);
+    void handleStatus(HttpRequest* request);
+    void checkConnection();
     void begin();
 
    private:
-    unsigned long lastReconnectAttempt = 0;
-    const unsigned long reconnectInterval = 10000;  // 10 seconds
-    int reconnectCounter = 0;
-    const int maxReconnectAttempts = 20;
-    bool reconnecting = false;
+    void startAttempt();
+    unsigned long retryDelay();
+    void applyStaticIp(const WiFiCredentials& config);
+    bool parseStaticIp(HttpRequest* request, WiFiCredentials& config);
+
+    WiFiCredentials credentials;
+    bool credentialsLoaded = false;  // Read /wifi.json already, whatever it held
+    bool attempting = false;
+    bool fastAttempt = false;  // Current attempt skips the scan using the saved channel and BSSID
+    bool skipFastPath = false;  // The last fast attempt failed; the AP may have moved
+    unsigned long attemptStart = 0;
+    unsigned long failures = 0;  // Consecutive failed attempts
+    unsigned long reconnects = 0;
+    unsigned long lastConnectMs = 0;  // Duration of the last successful attempt
+    String pendingSsid;
+    String pendingPassword;
+    WiFiCredentials pendingConfig;
 };
 
 extern WiFiManager wifiManager;
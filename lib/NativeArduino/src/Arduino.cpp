@@ -0,0 +1,633 @@
+#include "Arduino.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "NativeMock.h"
+#include "coredecls.h"
+#include "esp8266_peri.h"
+#include "gpio.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+
+struct PinState {
+    uint8_t mode = INPUT;
+    int input = LOW;
+    int analogInput = 0;
+    int output = LOW;
+    int pwm = 0;
+    void (*isr)() = nullptr;
+    int isrMode = 0;     // Interrupt type, 0 while disabled
+    int wakeLevel = -1;  // Armed by a _WE interrupt type or gpio_pin_wakeup_enable()
+};
+
+uint64_t clockMicros = 0;
+uint64_t blockedMicrosTotal = 0;
+uint64_t idleMicrosTotal = 0;
+int64_t epochMicros = 0;  // Wall clock minus clockMicros; 0 until settimeofday(), as before SNTP on the device
+std::function<void(bool)> timeSetCallback;
+std::string sntpServerName;
+std::function<void(uint64_t)> delayHook;
+std::function<void(int, int)> pinWriteHook;
+std::vector<PinState> pins(native::kPinCount);
+unsigned long pinWriteCount = 0;
+unsigned long digitalReadCount = 0;
+unsigned long analogReadCount = 0;
+unsigned long serialByteCount = 0;
+bool serialEcho = false;
+bool serialTimed = false;
+uint32_t rtcMemory[128];
+uint32_t chipId = 0x00C0FFEE;
+uint32_t pwmRange = 255;
+std::mt19937 rng;
+
+PinState* pinAt(uint8_t pin) {
+    return pin < pins.size() ? &pins[pin] : nullptr;
+}
+
+void pass(uint64_t us) {
+    clockMicros += us;
+    if (delayHook) {
+        delayHook(us);
+    }
+}
+
+void block(uint64_t us) {
+    blockedMicrosTotal += us;
+    pass(us);
+}
+
+void resetVolatile() {
+    clockMicros = 0;
+    blockedMicrosTotal = 0;
+    idleMicrosTotal = 0;
+    epochMicros = 0;
+    timeSetCallback = nullptr;
+    sntpServerName.clear();
+    pins.assign(native::kPinCount, PinState());
+    pinWriteCount = 0;
+    digitalReadCount = 0;
+    analogReadCount = 0;
+    serialByteCount = 0;
+    serialTimed = false;
+    pwmRange = 255;
+}
+
+// Allocation header; keeps the payload 16-byte aligned like malloc's
+struct alignas(16) HeapHeader {
+    size_t size;
+};
+
+std::atomic<size_t> heapLiveBlocks(0);
+std::atomic<size_t> heapLiveBytes(0);
+std::atomic<size_t> heapBlockBytes(0);
+std::atomic<unsigned long> heapAllocations(0);
+
+size_t ummBlockBytes(size_t size) {
+    return (size + 4 + 7) / 8 * 8;
+}
+
+void* heapAllocate(size_t size) {
+    HeapHeader* header = static_cast<HeapHeader*>(malloc(sizeof(HeapHeader) + size));
+    if (!header) {
+        return nullptr;
+    }
+    header->size = size;
+    heapLiveBlocks++;
+    heapLiveBytes += size;
+    heapBlockBytes += ummBlockBytes(size);
+    heapAllocations++;
+    return header + 1;
+}
+
+void heapFree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    HeapHeader* header = static_cast<HeapHeader*>(ptr) - 1;
+    heapLiveBlocks--;
+    heapLiveBytes -= header->size;
+    heapBlockBytes -= ummBlockBytes(header->size);
+    free(header);
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    void* ptr = heapAllocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return heapAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return heapAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    heapFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    heapFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    heapFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    heapFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    heapFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    heapFree(ptr);
+}
+
+unsigned long millis() {
+    return static_cast<unsigned long>(clockMicros / 1000);
+}
+
+unsigned long micros() {
+    return static_cast<unsigned long>(clockMicros);
+}
+
+void delay(unsigned long ms) {
+    block(static_cast<uint64_t>(ms) * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    block(us);
+}
+
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (PinState* state = pinAt(pin)) {
+        state->mode = mode;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    pinWriteCount++;
+    if (PinState* state = pinAt(pin)) {
+        state->output = val ? HIGH : LOW;
+        state->pwm = val ? static_cast<int>(pwmRange) : 0;
+    }
+    if (pinWriteHook) {
+        pinWriteHook(pin, val ? HIGH : LOW);
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    digitalReadCount++;
+    PinState* state = pinAt(pin);
+    if (!state) {
+        return LOW;
+    }
+    return state->mode == OUTPUT ? state->output : state->input;
+}
+
+int analogRead(uint8_t pin) {
+    analogReadCount++;
+    PinState* state = pinAt(pin);
+    return state ? state->analogInput : 0;
+}
+
+void analogWrite(uint8_t pin, int val) {
+    pinWriteCount++;
+    if (PinState* state = pinAt(pin)) {
+        state->pwm = val;
+        state->output = val > 0 ? HIGH : LOW;
+    }
+    if (pinWriteHook) {
+        pinWriteHook(pin, val);
+    }
+}
+
+// One register write changes every pin in the mask at once, and counts as one write
+native::GpioRegister& native::GpioRegister::operator=(uint32_t value) {
+    pinWriteCount++;
+    int first = kind == GPIO16 ? 16 : 0;
+    int last = kind == GPIO16 ? 16 : 15;
+    for (int pin = first; pin <= last; pin++) {
+        uint32_t bit = kind == GPIO16 ? 1 : 1u << pin;
+        if (kind != GPIO16 && !(value & bit)) {
+            continue;
+        }
+        int level = kind == SET || (kind == GPIO16 && (value & bit)) ? HIGH : LOW;
+        pins[pin].output = level;
+        pins[pin].pwm = level ? static_cast<int>(pwmRange) : 0;
+        if (pinWriteHook) {
+            pinWriteHook(pin, level);
+        }
+    }
+    return *this;
+}
+
+uint32_t native::GpioRegister::read() const {
+    if (kind == GPIO16) {
+        return pins[16].output == HIGH ? 1 : 0;
+    }
+    uint32_t latches = 0;
+    for (int pin = 0; pin < 16; pin++) {
+        latches |= pins[pin].output == HIGH ? 1u << pin : 0;
+    }
+    return latches;
+}
+
+native::GpioRegister GPOS(native::GpioRegister::SET);
+native::GpioRegister GPOC(native::GpioRegister::CLEAR);
+native::GpioRegister GP16O(native::GpioRegister::GPIO16);
+
+void analogWriteRange(uint32_t range) {
+    pwmRange = range;
+}
+
+void analogWriteFreq(uint32_t) {}
+
+// A level interrupt fires at once when the pin already sits at the level
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {
+    if (PinState* state = pinAt(pin)) {
+        state->isr = handler;
+        state->isrMode = mode;
+        state->wakeLevel = mode & 0x08 ? (mode & 1) : -1;
+        if ((mode & 0x04) && state->input == (mode & 1)) {
+            handler();
+        }
+    }
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (PinState* state = pinAt(pin)) {
+        state->isr = nullptr;
+        state->isrMode = 0;
+        state->wakeLevel = -1;
+    }
+}
+
+void esp_schedule() {}
+
+void esp_delay(uint32_t timeout_ms, const std::function<bool()>& blocked) {
+    // Idles in 1 ms slices so a wake from the delay hook or an interrupt ends it early
+    uint64_t end = clockMicros + static_cast<uint64_t>(timeout_ms) * 1000;
+    while (clockMicros < end && blocked()) {
+        uint64_t us = std::min<uint64_t>(1000, end - clockMicros);
+        idleMicrosTotal += us;
+        pass(us);
+    }
+}
+
+// Like the SDK, these rewrite the pin's interrupt type: an edge interrupt
+// becomes a level one, and disabling leaves the armed pins with none
+extern "C" void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE level) {
+    if (PinState* state = pinAt(pin)) {
+        state->wakeLevel = level == GPIO_PIN_INTR_HILEVEL ? HIGH : LOW;
+        state->isrMode = state->wakeLevel == HIGH ? ONHIGH_WE : ONLOW_WE;
+    }
+}
+
+extern "C" void gpio_pin_wakeup_disable() {
+    for (auto& state : pins) {
+        if (state.wakeLevel >= 0) {
+            state.wakeLevel = -1;
+            state.isrMode = 0;
+        }
+    }
+}
+
+long random(long max) {
+    return max > 0 ? static_cast<long>(rng() % static_cast<unsigned long>(max)) : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    rng.seed(seed);
+}
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char* server1, const char*, const char*) {
+    (void)gmtOffset_sec;
+    (void)daylightOffset_sec;
+    sntpServerName = server1 ? server1 : "";
+}
+
+void configTime(const char* tz, const char* server1, const char*, const char*) {
+    setenv("TZ", tz, 1);
+    tzset();
+    sntpServerName = server1 ? server1 : "";
+}
+
+void settimeofday_cb(const std::function<void(bool from_sntp)>& cb) {
+    timeSetCallback = cb;
+}
+
+// The wall clock follows the virtual clock, so time() and gettimeofday() stand
+// in for the C library's throughout the program
+time_t time(time_t* t) noexcept {
+    time_t now = static_cast<time_t>((static_cast<int64_t>(clockMicros) + epochMicros) / 1000000);
+    if (t) {
+        *t = now;
+    }
+    return now;
+}
+
+int gettimeofday(struct timeval* tv, void*) noexcept {
+    int64_t now = static_cast<int64_t>(clockMicros) + epochMicros;
+    tv->tv_sec = static_cast<time_t>(now / 1000000);
+    tv->tv_usec = static_cast<suseconds_t>(now % 1000000);
+    return 0;
+}
+
+int settimeofday(const struct timeval* tv, const struct timezone*) noexcept {
+    if (tv) {
+        epochMicros = static_cast<int64_t>(tv->tv_sec) * 1000000 + tv->tv_usec - static_cast<int64_t>(clockMicros);
+    }
+    return 0;
+}
+
+bool getLocalTime(struct tm* info, uint32_t) {
+    time_t now = time(nullptr);
+    if (now < 1000000000) {
+        return false;
+    }
+    localtime_r(&now, info);
+    return true;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::write(const char* str) {
+    return str ? write(reinterpret_cast<const uint8_t*>(str), strlen(str)) : 0;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    if (static_cast<size_t>(length) < sizeof(buffer)) {
+        return write(buffer, length);
+    }
+    std::vector<char> large(length + 1);
+    va_start(args, format);
+    vsnprintf(large.data(), large.size(), format, args);
+    va_end(args);
+    return write(large.data(), length);
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = read();
+        if (c < 0) {
+            break;
+        }
+        buffer[count++] = static_cast<char>(c);
+    }
+    return count;
+}
+
+String Stream::readString() {
+    String result;
+    int c;
+    while ((c = read()) >= 0) {
+        result += static_cast<char>(c);
+    }
+    return result;
+}
+
+String Stream::readStringUntil(char terminator) {
+    String result;
+    int c;
+    while ((c = read()) >= 0 && c != terminator) {
+        result += static_cast<char>(c);
+    }
+    return result;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    serialByteCount += size;
+    if (serialTimed && baud) {
+        block(size * 10 * 1000000ULL / baud);  // Start, 8 data and stop bits
+    }
+    if (serialEcho) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+uint32_t EspClass::getChipId() {
+    return chipId;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return 80 * 1024;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+    return getFreeHeap();
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+    return 0;
+}
+
+uint32_t EspClass::getCycleCount() {
+    return static_cast<uint32_t>(clockMicros * getCpuFreqMHz());
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtcMemory)) {
+        return false;
+    }
+    memcpy(data, reinterpret_cast<uint8_t*>(rtcMemory) + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtcMemory)) {
+        return false;
+    }
+    memcpy(reinterpret_cast<uint8_t*>(rtcMemory) + offset * 4, data, size);
+    return true;
+}
+
+// A reset keeps the flash image and RTC memory
+void EspClass::restart() {
+    resetVolatile();
+}
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (length--) {
+        crc ^= *bytes++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+namespace native {
+
+void setMicros(uint64_t us) {
+    clockMicros = us;
+}
+
+void advanceMillis(unsigned long ms) {
+    clockMicros += static_cast<uint64_t>(ms) * 1000;
+}
+
+void advanceMicros(uint64_t us) {
+    clockMicros += us;
+}
+
+uint64_t blockedMicros() {
+    return blockedMicrosTotal;
+}
+
+uint64_t idleMicros() {
+    return idleMicrosTotal;
+}
+
+void sntpSync(time_t epoch) {
+    struct timeval tv = {epoch, 0};
+    settimeofday(&tv, nullptr);
+    if (timeSetCallback) {
+        timeSetCallback(true);
+    }
+}
+
+const char* sntpServer() {
+    return sntpServerName.c_str();
+}
+
+void setDelayHook(std::function<void(uint64_t us)> hook) {
+    delayHook = hook;
+}
+
+void setDigitalInput(int pin, int level) {
+    if (pin < 0 || pin >= kPinCount) {
+        return;
+    }
+    PinState& state = pins[pin];
+    int previous = state.input;
+    state.input = level ? HIGH : LOW;
+    bool rising = previous == LOW && state.input == HIGH;
+    bool falling = previous == HIGH && state.input == LOW;
+    if (!state.isr) {
+        return;
+    }
+    if (state.isrMode & 0x04) {
+        if (state.input == (state.isrMode & 1)) {
+            state.isr();  // A level interrupt keeps firing while the level holds
+        }
+    } else if ((rising && (state.isrMode & RISING)) || (falling && (state.isrMode & FALLING))) {
+        state.isr();
+    }
+}
+
+int gpioWakeLevel(int pin) {
+    return pin >= 0 && pin < kPinCount ? pins[pin].wakeLevel : -1;
+}
+
+void setAnalogInput(int pin, int value) {
+    if (pin >= 0 && pin < kPinCount) {
+        pins[pin].analogInput = value;
+    }
+}
+
+int pinMode(int pin) {
+    return pin >= 0 && pin < kPinCount ? pins[pin].mode : INPUT;
+}
+
+int digitalOutput(int pin) {
+    return pin >= 0 && pin < kPinCount ? pins[pin].output : LOW;
+}
+
+int analogOutput(int pin) {
+    return pin >= 0 && pin < kPinCount ? pins[pin].pwm : 0;
+}
+
+unsigned long pinWrites() {
+    return pinWriteCount;
+}
+
+unsigned long digitalReads() {
+    return digitalReadCount;
+}
+
+unsigned long analogReads() {
+    return analogReadCount;
+}
+
+void setPinWriteHook(std::function<void(int pin, int value)> hook) {
+    pinWriteHook = hook;
+}
+
+void setSerialEcho(bool echo) {
+    serialEcho = echo;
+}
+
+HeapStats heapStats() {
+    return HeapStats{heapLiveBlocks, heapLiveBytes, heapBlockBytes, heapAllocations};
+}
+
+void setSerialTiming(bool timed) {
+    serialTimed = timed;
+}
+
+unsigned long serialBytes() {
+    return serialByteCount;
+}
+
+void setChipId(uint32_t id) {
+    chipId = id & 0xFFFFFF;
+}
+
+void reset() {
+    resetVolatile();
+    memset(rtcMemory, 0, sizeof(rtcMemory));
+    fsReset();
+}
+
+}  // namespace native
@@ -0,0 +1,94 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host stand-in for the ESP8266 Arduino core. Only the subset used by the
+// firmware is provided; GPIO, clock and flash are simulated in RAM and can be
+// driven from tests through NativeMock.h.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <time.h>
+
+#include "Stream.h"
+#include "WString.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+
+#define A0 17
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+// Level interrupts; the _WE variants also wake the chip from light sleep
+#define ONLOW 0x04
+#define ONHIGH 0x05
+#define ONLOW_WE 0x0C
+#define ONHIGH_WE 0x0D
+
+#define digitalPinToInterrupt(p) (p)
+
+#define PROGMEM
+#define F(str) (str)
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void analogWriteRange(uint32_t range);
+void analogWriteFreq(uint32_t freq);
+
+// Handlers run synchronously from native::setDigitalInput() when the edge matches
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char* server1,
+                const char* server2 = nullptr, const char* server3 = nullptr);
+void configTime(const char* tz, const char* server1, const char* server2 = nullptr,
+                const char* server3 = nullptr);
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+class EspClass {
+   public:
+    uint32_t getChipId();
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize();
+    uint8_t getHeapFragmentation();
+    uint32_t getCycleCount();
+    uint8_t getCpuFreqMHz() { return 80; }
+    // 512 bytes kept across restart() but not native::reset(), as RTC
+    // memory survives a reset but not a power cycle; offset is in words
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+    // Clock, pins and serial back to power-on; flash and RTC memory stay
+    void restart();
+    void reset() { restart(); }
+};
+
+extern EspClass ESP;
+
+#endif  // NATIVE_ARDUINO_H
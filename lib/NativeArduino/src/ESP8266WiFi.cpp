@@ -0,0 +1,266 @@
+#include "ESP8266WiFi.h"
+
+#include <cstdio>
+
+ESP8266WiFiClass WiFi;
+
+namespace {
+
+struct AccessPoint {
+    String ssid;
+    String password;
+    int32_t channel;
+    int32_t rssi;
+    uint8_t bssid[6];
+};
+
+// A full active scan over 14 channels takes about this long on the device
+const unsigned long kScanMs = 2100;
+// begin() with a channel probes only that one
+const unsigned long kChannelProbeMs = 60;
+// Authentication and association
+const unsigned long kJoinMs = 180;
+// DHCP lease, skipped with a static address from config()
+const unsigned long kDhcpMs = 450;
+
+std::vector<AccessPoint> accessPoints;
+unsigned long beginCount = 0;
+bool apsOnline = true;
+
+}  // namespace
+
+struct NativeWiFiAccess {
+    static void drop() { WiFi.currentStatus = WL_CONNECTION_LOST; }
+    static void clearScan() {
+        WiFi.scanRunning = false;
+        WiFi.scanDelete();
+        WiFi.staticIp = 0;
+    }
+};
+
+bool IPAddress::fromString(const char* str) {
+    unsigned int a, b, c, d;
+    if (!str || sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+        return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+}
+
+String IPAddress::toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buffer);
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t mode) {
+    currentMode = mode;
+    return true;
+}
+
+bool ESP8266WiFiClass::softAP(const char*, const char*, int, int, int) {
+    return currentMode == WIFI_AP || currentMode == WIFI_AP_STA;
+}
+
+bool ESP8266WiFiClass::softAPdisconnect(bool wifioff) {
+    if (wifioff) {
+        currentMode = static_cast<WiFiMode_t>(currentMode & ~WIFI_AP);
+    }
+    return true;
+}
+
+// Connects in the background like the SDK: status() reports WL_DISCONNECTED
+// until the scan, join and DHCP would have finished
+wl_status_t ESP8266WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                                    const uint8_t* bssid, bool connect) {
+    beginCount++;
+    connectedSsid = String();
+    currentStatus = WL_DISCONNECTED;
+    connecting = connect;
+    if (!connect) {
+        return currentStatus;
+    }
+    pendingStatus = WL_NO_SSID_AVAIL;
+    pendingAp = -1;
+    unsigned long latency = channel != 0 ? kChannelProbeMs : kScanMs;
+    for (size_t i = 0; apsOnline && i < accessPoints.size(); i++) {
+        const AccessPoint& ap = accessPoints[i];
+        if (ap.ssid != ssid) {
+            continue;
+        }
+        if (channel != 0 && channel != ap.channel) {
+            continue;
+        }
+        if (bssid && memcmp(bssid, ap.bssid, sizeof(ap.bssid)) != 0) {
+            continue;
+        }
+        latency += kJoinMs;
+        if (ap.password != (passphrase ? passphrase : "")) {
+            pendingStatus = WL_WRONG_PASSWORD;
+            break;
+        }
+        latency += staticIp ? 0 : kDhcpMs;
+        pendingStatus = WL_CONNECTED;
+        pendingAp = static_cast<int>(i);
+        break;
+    }
+    connectAtMs = millis() + latency;
+    return currentStatus;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local_ip, IPAddress, IPAddress, IPAddress, IPAddress) {
+    staticIp = local_ip;
+    return true;
+}
+
+bool ESP8266WiFiClass::disconnect(bool) {
+    connecting = false;
+    currentStatus = WL_DISCONNECTED;
+    connectedSsid = String();
+    return true;
+}
+
+bool ESP8266WiFiClass::reconnect() {
+    return false;
+}
+
+bool ESP8266WiFiClass::setAutoReconnect(bool) {
+    return true;
+}
+
+bool ESP8266WiFiClass::persistent(bool) {
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+    if (connecting && (long)(millis() - connectAtMs) >= 0) {
+        connecting = false;
+        currentStatus = pendingStatus;
+        if (pendingAp >= 0 && static_cast<size_t>(pendingAp) < accessPoints.size()) {
+            const AccessPoint& ap = accessPoints[pendingAp];
+            connectedSsid = ap.ssid;
+            currentChannel = ap.channel;
+            memcpy(currentBssid, ap.bssid, sizeof(currentBssid));
+        }
+    }
+    return currentStatus;
+}
+
+uint8_t* ESP8266WiFiClass::BSSID() {
+    return currentBssid;
+}
+
+String ESP8266WiFiClass::BSSIDstr() {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", currentBssid[0], currentBssid[1],
+             currentBssid[2], currentBssid[3], currentBssid[4], currentBssid[5]);
+    return String(buffer);
+}
+
+IPAddress ESP8266WiFiClass::localIP() const {
+    if (currentStatus != WL_CONNECTED) {
+        return IPAddress();
+    }
+    return staticIp ? IPAddress(staticIp) : IPAddress(192, 168, 1, 50);
+}
+
+bool ESP8266WiFiClass::hostname(const char* name) {
+    hostName = name;
+    return true;
+}
+
+int8_t ESP8266WiFiClass::scanNetworks(bool async, bool) {
+    scanResults.clear();
+    scanDone = false;
+    scanRunning = true;
+    scanStartedMs = millis();
+    if (async) {
+        return WIFI_SCAN_RUNNING;
+    }
+    delay(kScanMs);
+    return scanComplete();
+}
+
+int8_t ESP8266WiFiClass::scanComplete() {
+    if (scanRunning && millis() - scanStartedMs >= kScanMs) {
+        scanRunning = false;
+        scanDone = true;
+        for (const auto& ap : apsOnline ? accessPoints : std::vector<AccessPoint>()) {
+            Network network;
+            network.ssid = ap.ssid;
+            network.rssi = ap.rssi;
+            network.encryption = ap.password.isEmpty() ? 7 : 4;
+            network.channel = ap.channel;
+            memcpy(network.bssid, ap.bssid, sizeof(network.bssid));
+            scanResults.push_back(network);
+        }
+    }
+    if (scanRunning) {
+        return WIFI_SCAN_RUNNING;
+    }
+    return scanDone ? static_cast<int8_t>(scanResults.size()) : WIFI_SCAN_FAILED;
+}
+
+void ESP8266WiFiClass::scanDelete() {
+    scanResults.clear();
+    scanDone = false;
+}
+
+String ESP8266WiFiClass::SSID(uint8_t networkItem) const {
+    return networkItem < scanResults.size() ? scanResults[networkItem].ssid : String();
+}
+
+int32_t ESP8266WiFiClass::RSSI(uint8_t networkItem) const {
+    return networkItem < scanResults.size() ? scanResults[networkItem].rssi : 0;
+}
+
+uint8_t ESP8266WiFiClass::encryptionType(uint8_t networkItem) const {
+    return networkItem < scanResults.size() ? scanResults[networkItem].encryption : 0;
+}
+
+int32_t ESP8266WiFiClass::channel(uint8_t networkItem) const {
+    return networkItem < scanResults.size() ? scanResults[networkItem].channel : 0;
+}
+
+uint8_t* ESP8266WiFiClass::BSSID(uint8_t networkItem) {
+    return networkItem < scanResults.size() ? scanResults[networkItem].bssid : nullptr;
+}
+
+namespace native {
+
+void wifiAddNetwork(const String& ssid, const String& password, int32_t channel, int32_t rssi) {
+    AccessPoint ap;
+    ap.ssid = ssid;
+    ap.password = password;
+    ap.channel = channel;
+    ap.rssi = rssi;
+    uint8_t index = static_cast<uint8_t>(accessPoints.size());
+    uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, static_cast<uint8_t>(channel), index};
+    memcpy(ap.bssid, bssid, sizeof(bssid));
+    accessPoints.push_back(ap);
+}
+
+void wifiClearNetworks() {
+    accessPoints.clear();
+    beginCount = 0;
+    apsOnline = true;
+    NativeWiFiAccess::clearScan();
+    WiFi.disconnect();
+}
+
+unsigned long wifiBeginCount() {
+    return beginCount;
+}
+
+void wifiDropConnection() {
+    NativeWiFiAccess::drop();
+}
+
+void wifiSetOnline(bool online) {
+    apsOnline = online;
+    if (!online) {
+        NativeWiFiAccess::drop();
+    }
+}
+
+}  // namespace native
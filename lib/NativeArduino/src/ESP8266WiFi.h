@@ -0,0 +1,126 @@
+#ifndef NATIVE_ESP8266WIFI_H
+#define NATIVE_ESP8266WIFI_H
+
+#include <vector>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+typedef enum {
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_WRONG_PASSWORD = 6,
+    WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+typedef enum { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 } WiFiSleepType_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class ESP8266WiFiClass {
+   public:
+    bool mode(WiFiMode_t mode);
+    WiFiMode_t getMode() const { return currentMode; }
+
+    bool softAP(const char* ssid, const char* passphrase = nullptr, int channel = 1, int ssid_hidden = 0,
+                int max_connection = 4);
+    IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+    // With wifioff the AP interface goes down too, leaving the station alone
+    bool softAPdisconnect(bool wifioff = false);
+
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    wl_status_t begin(const String& ssid, const String& passphrase = String(), int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true) {
+        return begin(ssid.c_str(), passphrase.c_str(), channel, bssid, connect);
+    }
+    bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+                IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifioff = false);
+    bool reconnect();
+    bool setAutoReconnect(bool autoReconnect);
+    bool persistent(bool persistent);
+    bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0) {
+        (void)listenInterval;
+        sleepType = type;
+        return true;
+    }
+    WiFiSleepType_t getSleepMode() const { return sleepType; }
+    bool isConnected() { return status() == WL_CONNECTED; }
+
+    wl_status_t status();
+    String SSID() const { return connectedSsid; }
+    uint8_t* BSSID();
+    String BSSIDstr();
+    int32_t channel() const { return currentChannel; }
+    int32_t RSSI() const { return -55; }
+    IPAddress localIP() const;
+    IPAddress gatewayIP() const { return IPAddress(192, 168, 1, 1); }
+    IPAddress subnetMask() const { return IPAddress(255, 255, 255, 0); }
+    String macAddress() const { return String("5C:CF:7F:C0:FF:EE"); }
+    String hostname() const { return hostName; }
+    bool hostname(const char* name);
+
+    // Synchronous scans block for the scan time; async scans report
+    // WIFI_SCAN_RUNNING from scanComplete() until that much virtual time has passed
+    int8_t scanNetworks(bool async = false, bool show_hidden = false);
+    int8_t scanComplete();
+    void scanDelete();
+    String SSID(uint8_t networkItem) const;
+    int32_t RSSI(uint8_t networkItem) const;
+    uint8_t encryptionType(uint8_t networkItem) const;
+    int32_t channel(uint8_t networkItem) const;
+    uint8_t* BSSID(uint8_t networkItem);
+
+   private:
+    struct Network {
+        String ssid;
+        int32_t rssi;
+        uint8_t encryption;
+        int32_t channel;
+        uint8_t bssid[6];
+    };
+    friend struct NativeWiFiAccess;
+
+    WiFiMode_t currentMode = WIFI_OFF;
+    WiFiSleepType_t sleepType = WIFI_MODEM_SLEEP;
+    wl_status_t currentStatus = WL_DISCONNECTED;
+    wl_status_t pendingStatus = WL_DISCONNECTED;  // Reported once connectAtMs passes
+    unsigned long connectAtMs = 0;
+    bool connecting = false;
+    int pendingAp = -1;
+    String connectedSsid;
+    String hostName = "ESP-C0FFEE";
+    int32_t currentChannel = 0;
+    uint8_t currentBssid[6] = {0};
+    uint32_t staticIp = 0;
+    std::vector<Network> scanResults;
+    bool scanRunning = false;
+    bool scanDone = false;
+    unsigned long scanStartedMs = 0;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+namespace native {
+
+// Programs the simulated access points seen by scans and accepted by begin()
+void wifiAddNetwork(const String& ssid, const String& password, int32_t channel, int32_t rssi = -60);
+void wifiClearNetworks();
+// Number of begin() calls since the last reset
+unsigned long wifiBeginCount();
+void wifiDropConnection();
+// Takes the access points off the air (an outage) or back on
+void wifiSetOnline(bool online);
+
+}  // namespace native
+
+#endif  // NATIVE_ESP8266WIFI_H
@@ -0,0 +1,129 @@
+#include "ESP8266mDNS.h"
+
+#include <algorithm>
+
+MDNSResponder MDNS;
+
+bool MDNSResponder::begin(const char* hostname) {
+    end();
+    hostName = hostname;
+    return true;
+}
+
+void MDNSResponder::end() {
+    hostName = String();
+    for (Service* service : serviceList) {
+        delete service;
+    }
+    serviceList.clear();
+    announceCount = 0;
+}
+
+MDNSResponder::hMDNSService MDNSResponder::addService(const char* name, const char* service, const char* protocol,
+                                                      uint16_t port) {
+    if (!isRunning()) {
+        return nullptr;
+    }
+    Service* added = new Service();
+    added->name = name ? String(name) : hostName;
+    added->type = String("_") + service + "._" + protocol;
+    added->port = port;
+    serviceList.push_back(added);
+    return added;
+}
+
+// Handles are the services themselves; TXT handles only need to be non-null
+MDNSResponder::Service* MDNSResponder::serviceOf(hMDNSService service) {
+    return const_cast<Service*>(static_cast<const Service*>(service));
+}
+
+MDNSResponder::hMDNSTxt MDNSResponder::addServiceTxt(const hMDNSService service, const char* key, const char* value) {
+    Service* target = serviceOf(service);
+    if (!target) {
+        return nullptr;
+    }
+    target->txts.push_back({key, value, false});
+    return &target->txts.back();
+}
+
+bool MDNSResponder::setDynamicServiceTxtCallback(const hMDNSService service,
+                                                 MDNSDynamicServiceTxtCallbackFunc callback) {
+    Service* target = serviceOf(service);
+    if (!target) {
+        return false;
+    }
+    target->dynamicCallback = callback;
+    return true;
+}
+
+MDNSResponder::hMDNSTxt MDNSResponder::addDynamicServiceTxt(hMDNSService service, const char* key,
+                                                            const char* value) {
+    Service* target = serviceOf(service);
+    if (!target) {
+        return nullptr;
+    }
+    target->txts.push_back({key, value, true});
+    return &target->txts.back();
+}
+
+MDNSResponder::hMDNSTxt MDNSResponder::addDynamicServiceTxt(hMDNSService service, const char* key, uint32_t value) {
+    return addDynamicServiceTxt(service, key, String(value).c_str());
+}
+
+bool MDNSResponder::announce() {
+    if (!isRunning()) {
+        return false;
+    }
+    announceCount++;
+    return true;
+}
+
+std::vector<String> MDNSResponder::services() const {
+    std::vector<String> types;
+    for (const Service* service : serviceList) {
+        types.push_back(service->type);
+    }
+    return types;
+}
+
+uint16_t MDNSResponder::port(const char* service) const {
+    const Service* found = find(service);
+    return found ? found->port : 0;
+}
+
+String MDNSResponder::instanceName(const char* service) const {
+    const Service* found = find(service);
+    return found ? found->name : String();
+}
+
+// Rebuilds the dynamic records the way an answer would
+String MDNSResponder::txt(const char* service, const char* key) {
+    Service* found = find(service);
+    if (!found) {
+        return String();
+    }
+    std::vector<Txt>& txts = found->txts;
+    txts.erase(std::remove_if(txts.begin(), txts.end(), [](const Txt& txt) { return txt.dynamic; }), txts.end());
+    if (found->dynamicCallback) {
+        found->dynamicCallback(found);
+    }
+    for (const Txt& txt : txts) {
+        if (txt.key == key) {
+            return txt.value;
+        }
+    }
+    return String();
+}
+
+MDNSResponder::Service* MDNSResponder::find(const char* type) {
+    for (Service* service : serviceList) {
+        if (service->type == type) {
+            return service;
+        }
+    }
+    return nullptr;
+}
+
+const MDNSResponder::Service* MDNSResponder::find(const char* type) const {
+    return const_cast<MDNSResponder*>(this)->find(type);
+}
@@ -0,0 +1,68 @@
+#ifndef NATIVE_ESP8266MDNS_H
+#define NATIVE_ESP8266MDNS_H
+
+#include <functional>
+#include <vector>
+
+#include "Arduino.h"
+
+// mDNS is a no-op on the host; the hostname, services and TXT records are
+// kept so tests can inspect what a query would be answered with
+class MDNSResponder {
+   public:
+    typedef const void* hMDNSService;
+    typedef const void* hMDNSTxt;
+    typedef std::function<void(const hMDNSService service)> MDNSDynamicServiceTxtCallbackFunc;
+
+    // Starts over, as after end()
+    bool begin(const char* hostname);
+    bool begin(const String& hostname) { return begin(hostname.c_str()); }
+    bool isRunning() const { return !hostName.isEmpty(); }
+    bool update() { return true; }
+    void end();
+    const String& hostname() const { return hostName; }
+
+    // A null name stands for the hostname, as on the device
+    hMDNSService addService(const char* name, const char* service, const char* protocol, uint16_t port);
+    hMDNSTxt addServiceTxt(const hMDNSService service, const char* key, const char* value);
+    // The callback runs for every answer and adds the records that change
+    bool setDynamicServiceTxtCallback(const hMDNSService service, MDNSDynamicServiceTxtCallbackFunc callback);
+    hMDNSTxt addDynamicServiceTxt(hMDNSService service, const char* key, const char* value);
+    hMDNSTxt addDynamicServiceTxt(hMDNSService service, const char* key, uint32_t value);
+    bool announce();
+
+    // Host only: "_service._protocol" of each service, and what a query for
+    // one would return; txt() is empty for a key it does not carry
+    std::vector<String> services() const;
+    uint16_t port(const char* service) const;
+    String instanceName(const char* service) const;
+    String txt(const char* service, const char* key);
+    unsigned long announcements() const { return announceCount; }
+
+   private:
+    struct Txt {
+        String key;
+        String value;
+        bool dynamic;
+    };
+
+    struct Service {
+        String name;
+        String type;  // "_service._protocol"
+        uint16_t port;
+        std::vector<Txt> txts;
+        MDNSDynamicServiceTxtCallbackFunc dynamicCallback;
+    };
+
+    static Service* serviceOf(hMDNSService service);
+    Service* find(const char* type);
+    const Service* find(const char* type) const;
+
+    String hostName;
+    std::vector<Service*> serviceList;
+    unsigned long announceCount = 0;
+};
+
+extern MDNSResponder MDNS;
+
+#endif  // NATIVE_ESP8266MDNS_H
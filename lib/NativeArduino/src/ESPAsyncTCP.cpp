@@ -0,0 +1,378 @@
+#include "ESPAsyncTCP.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ESPAsyncUDP.h"
+#include "NativeMock.h"
+
+namespace native {
+
+// lwIP defaults on the ESP8266 core: TCP_WND and TCP_SND_BUF are both 2 * TCP_MSS
+const size_t kReceiveWindow = 2 * 1460;
+const size_t kSendBuffer = 2 * 1460;
+const unsigned long kPollIntervalMs = 500;
+
+struct TcpTransport {
+    int fd = -1;
+    uint16_t devicePort = 0;
+    std::string toServer;
+    std::string toClient;
+    bool peerClosed = false;
+    bool serverClosed = false;
+    bool readable = false;  // Set by pollNetwork() so idle sockets cost no recv()
+};
+
+namespace {
+
+int listenPort = 0;
+std::vector<AsyncServer*> servers;
+std::vector<AsyncClient*> clients;
+std::vector<std::shared_ptr<TcpTransport>> pendingLoopback;
+
+bool registered(AsyncClient* client) {
+    return std::find(clients.begin(), clients.end(), client) != clients.end();
+}
+
+}  // namespace
+
+struct NetworkAccess {
+    static void accept(AsyncServer* server, std::shared_ptr<TcpTransport> transport) {
+        AsyncClient* client = new AsyncClient(transport);
+        if (server->clientCb) {
+            server->clientCb(server->clientArg, client);
+        } else {
+            delete client;
+        }
+    }
+
+    static void acceptPending(AsyncServer* server) {
+        if (server->listenFd >= 0) {
+            int fd;
+            while ((fd = ::accept(server->listenFd, nullptr, nullptr)) >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                int noDelay = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                auto transport = std::make_shared<TcpTransport>();
+                transport->fd = fd;
+                transport->devicePort = server->port;
+                accept(server, transport);
+            }
+        }
+        for (auto it = pendingLoopback.begin(); it != pendingLoopback.end();) {
+            if ((*it)->devicePort == server->port) {
+                auto transport = *it;
+                it = pendingLoopback.erase(it);
+                accept(server, transport);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static void poll(AsyncClient* client) { client->poll(); }
+    static TcpTransport* transport(AsyncClient* client) { return client->transport.get(); }
+    static bool listening(AsyncServer* server) { return server->listening; }
+};
+
+void pollNetwork() {
+    pollDatagrams();
+    std::vector<AsyncServer*> serverSnapshot = servers;
+    for (AsyncServer* server : serverSnapshot) {
+        if (std::find(servers.begin(), servers.end(), server) != servers.end() &&
+            NetworkAccess::listening(server)) {
+            NetworkAccess::acceptPending(server);
+        }
+    }
+    std::vector<pollfd> sockets;
+    for (AsyncClient* client : clients) {
+        TcpTransport* transport = NetworkAccess::transport(client);
+        if (transport->fd >= 0) {
+            sockets.push_back(pollfd{transport->fd, POLLIN, 0});
+        }
+    }
+    if (!sockets.empty()) {
+        ::poll(sockets.data(), sockets.size(), 0);
+        size_t next = 0;
+        for (AsyncClient* client : clients) {
+            TcpTransport* transport = NetworkAccess::transport(client);
+            if (transport->fd >= 0) {
+                transport->readable = sockets[next++].revents != 0;
+            }
+        }
+    }
+
+    // Callbacks may delete any client, including ones later in the snapshot
+    std::vector<AsyncClient*> clientSnapshot = clients;
+    for (AsyncClient* client : clientSnapshot) {
+        if (registered(client)) {
+            NetworkAccess::poll(client);
+        }
+    }
+}
+
+void setHttpPort(int port) {
+    listenPort = port;
+}
+
+int httpPort() {
+    return listenPort;
+}
+
+LoopbackClient::LoopbackClient(uint16_t port) : transport(std::make_shared<TcpTransport>()) {
+    transport->devicePort = port;
+    pendingLoopback.push_back(transport);
+}
+
+bool LoopbackClient::connected() const {
+    return !transport->peerClosed && !transport->serverClosed;
+}
+
+void LoopbackClient::send(const std::string& data) {
+    if (!transport->peerClosed) {
+        transport->toServer += data;
+    }
+}
+
+std::string LoopbackClient::receive() {
+    std::string data;
+    data.swap(transport->toClient);
+    return data;
+}
+
+void LoopbackClient::close() {
+    transport->peerClosed = true;
+    pendingLoopback.erase(std::remove(pendingLoopback.begin(), pendingLoopback.end(), transport),
+                          pendingLoopback.end());
+}
+
+std::string httpExchange(const std::string& request, const std::function<void()>& serve, int passes) {
+    LoopbackClient client;
+    client.send(request);
+    std::string raw;
+    for (int i = 0; i < passes; i++) {
+        pollNetwork();
+        serve();
+        raw += client.receive();
+    }
+    return raw;
+}
+
+std::string dechunk(const std::string& raw) {
+    std::string body;
+    size_t at = raw.find("\r\n\r\n") + 4;
+    while (true) {
+        size_t size = strtoul(raw.c_str() + at, nullptr, 16);
+        at = raw.find("\r\n", at) + 2;
+        if (size == 0) {
+            return body;
+        }
+        body += raw.substr(at, size);
+        at += size + 2;
+    }
+}
+
+}  // namespace native
+
+AsyncClient::AsyncClient(std::shared_ptr<native::TcpTransport> transport)
+    : transport(transport), lastRx(millis()), lastPoll(millis()) {
+    native::clients.push_back(this);
+}
+
+AsyncClient::~AsyncClient() {
+    native::clients.erase(std::remove(native::clients.begin(), native::clients.end(), this), native::clients.end());
+    close(true);
+}
+
+bool AsyncClient::connected() const {
+    return !closing && !transport->peerClosed;
+}
+
+void AsyncClient::close(bool now) {
+    if (closing) {
+        return;
+    }
+    if (!now) {
+        send();
+    }
+    closing = true;
+    transport->serverClosed = true;
+    if (transport->fd >= 0) {
+        ::close(transport->fd);
+        transport->fd = -1;
+    }
+}
+
+size_t AsyncClient::space() const {
+    if (!connected()) {
+        return 0;
+    }
+    size_t used = txQueue.size() + inFlight;
+    return used < native::kSendBuffer ? native::kSendBuffer - used : 0;
+}
+
+size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
+    (void)apiflags;
+    size_t accepted = std::min(size, space());
+    txQueue.append(data, accepted);
+    return accepted;
+}
+
+bool AsyncClient::send() {
+    if (txQueue.empty() || closing) {
+        return false;
+    }
+    if (transport->fd >= 0) {
+        const char* data = txQueue.data();
+        size_t length = txQueue.size();
+        while (length > 0) {
+            ssize_t sent = ::send(transport->fd, data, length, MSG_NOSIGNAL);
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                usleep(100);
+                continue;
+            }
+            if (sent <= 0) {
+                transport->peerClosed = true;
+                return false;
+            }
+            data += sent;
+            length -= sent;
+        }
+    } else if (!transport->peerClosed) {
+        transport->toClient += txQueue;
+    }
+    inFlight += txQueue.size();
+    txQueue.clear();
+    return true;
+}
+
+size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
+    size_t accepted = add(data, size, apiflags);
+    if (!accepted || !send()) {
+        return 0;
+    }
+    return accepted;
+}
+
+size_t AsyncClient::ack(size_t len) {
+    len = std::min(len, unacked);
+    unacked -= len;
+    return len;
+}
+
+void AsyncClient::poll() {
+    if (closing || transport->peerClosed) {
+        if (!disconnectDelivered) {
+            disconnectDelivered = true;
+            closing = true;
+            if (disconnectCb) {
+                disconnectCb(disconnectArg, this);  // Usually deletes this
+            }
+        }
+        return;
+    }
+
+    if (inFlight > 0) {
+        size_t acked = inFlight;
+        inFlight = 0;
+        if (ackCb) {
+            ackCb(ackArg, this, acked, 0);
+        }
+        if (closing) {
+            return;
+        }
+    }
+
+    size_t window = unacked < native::kReceiveWindow ? native::kReceiveWindow - unacked : 0;
+    if (window > 0) {
+        std::string received;
+        if (transport->fd >= 0 && transport->readable) {
+            transport->readable = false;
+            received.resize(window);
+            ssize_t length = recv(transport->fd, &received[0], window, 0);
+            if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                transport->peerClosed = true;
+                return;
+            }
+            received.resize(length > 0 ? length : 0);
+        } else if (transport->fd < 0) {
+            received = transport->toServer.substr(0, window);
+            transport->toServer.erase(0, received.size());
+        }
+        if (!received.empty()) {
+            lastRx = millis();
+            deferAck = false;
+            if (dataCb) {
+                dataCb(dataArg, this, &received[0], received.size());
+            }
+            if (deferAck) {
+                unacked += received.size();
+            }
+            if (closing) {
+                return;
+            }
+        }
+    }
+
+    unsigned long now = millis();
+    if (rxTimeoutSeconds && now - lastRx >= rxTimeoutSeconds * 1000UL) {
+        lastRx = now;
+        if (timeoutCb) {
+            timeoutCb(timeoutArg, this, rxTimeoutSeconds * 1000);
+        }
+        if (closing) {
+            return;
+        }
+    }
+    if (now - lastPoll >= native::kPollIntervalMs) {
+        lastPoll = now;
+        if (pollCb) {
+            pollCb(pollArg, this);
+        }
+    }
+}
+
+void AsyncServer::begin() {
+    if (listening) {
+        return;
+    }
+    listening = true;
+    native::servers.push_back(this);
+    if (native::listenPort <= 0 || port != 80) {
+        return;
+    }
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(native::listenPort);
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 16) < 0) {
+        perror("AsyncServer: listen");
+        ::close(listenFd);
+        listenFd = -1;
+        return;
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+}
+
+void AsyncServer::end() {
+    listening = false;
+    native::servers.erase(std::remove(native::servers.begin(), native::servers.end(), this), native::servers.end());
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        listenFd = -1;
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef NATIVE_ESPASYNCTCP_H
+#define NATIVE_ESPASYNCTCP_H
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+// Host stand-in for ESPAsyncTCP. Callbacks are delivered by native::pollNetwork(),
+// which plays the role of lwIP running between loop() passes on the device.
+// Connections come either from real sockets (a server on port 80 listens on
+// native::httpPort() when set) or from in-memory native::LoopbackClient peers.
+
+class AsyncClient;
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, void* data, size_t len)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+namespace native {
+struct TcpTransport;
+struct NetworkAccess;
+}  // namespace native
+
+class AsyncClient {
+   public:
+    ~AsyncClient();
+
+    bool connected() const;
+    bool disconnected() const { return !connected(); }
+    bool freeable() const { return !connected(); }
+    void close(bool now = false);
+    void abort() { close(true); }
+
+    size_t space() const;
+    bool canSend() const { return space() > 0; }
+    size_t add(const char* data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    bool send();
+    size_t write(const char* data) { return write(data, strlen(data)); }
+    size_t write(const char* data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
+    // Received data is acknowledged when onData returns unless ackLater() was
+    // called inside the callback; the receive window stays closed until ack()
+    void ackLater() { deferAck = true; }
+    size_t ack(size_t len);
+
+    void setRxTimeout(uint32_t timeout) { rxTimeoutSeconds = timeout; }
+    uint32_t getRxTimeout() const { return rxTimeoutSeconds; }
+    void setNoDelay(bool) {}
+    IPAddress remoteIP() const { return IPAddress(127, 0, 0, 1); }
+    uint16_t remotePort() const { return 0; }
+
+    void onConnect(AcConnectHandler cb, void* arg = nullptr) { (void)cb, (void)arg; }
+    void onDisconnect(AcConnectHandler cb, void* arg = nullptr) { disconnectCb = cb, disconnectArg = arg; }
+    void onAck(AcAckHandler cb, void* arg = nullptr) { ackCb = cb, ackArg = arg; }
+    void onError(AcErrorHandler cb, void* arg = nullptr) { errorCb = cb, errorArg = arg; }
+    void onData(AcDataHandler cb, void* arg = nullptr) { dataCb = cb, dataArg = arg; }
+    void onTimeout(AcTimeoutHandler cb, void* arg = nullptr) { timeoutCb = cb, timeoutArg = arg; }
+    void onPoll(AcConnectHandler cb, void* arg = nullptr) { pollCb = cb, pollArg = arg; }
+
+   private:
+    friend struct native::NetworkAccess;
+    explicit AsyncClient(std::shared_ptr<native::TcpTransport> transport);
+    void poll();
+
+    std::shared_ptr<native::TcpTransport> transport;
+    std::string txQueue;
+    size_t inFlight = 0;
+    size_t unacked = 0;
+    bool deferAck = false;
+    bool closing = false;
+    bool disconnectDelivered = false;
+    uint32_t rxTimeoutSeconds = 0;
+    unsigned long lastRx = 0;
+    unsigned long lastPoll = 0;
+
+    AcConnectHandler disconnectCb;
+    void* disconnectArg = nullptr;
+    AcAckHandler ackCb;
+    void* ackArg = nullptr;
+    AcErrorHandler errorCb;
+    void* errorArg = nullptr;
+    AcDataHandler dataCb;
+    void* dataArg = nullptr;
+    AcTimeoutHandler timeoutCb;
+    void* timeoutArg = nullptr;
+    AcConnectHandler pollCb;
+    void* pollArg = nullptr;
+};
+
+class AsyncServer {
+   public:
+    explicit AsyncServer(uint16_t port) : port(port) {}
+    ~AsyncServer() { end(); }
+
+    void onClient(AcConnectHandler cb, void* arg) { clientCb = cb, clientArg = arg; }
+    void begin();
+    void end();
+    void setNoDelay(bool) {}
+    uint8_t status() const { return listening ? 1 : 0; }
+
+   private:
+    friend struct native::NetworkAccess;
+
+    uint16_t port;
+    bool listening = false;
+    int listenFd = -1;
+    AcConnectHandler clientCb;
+    void* clientArg = nullptr;
+};
+
+namespace native {
+
+// Delivers pending connections, data, acks, timeouts and disconnects, and UDP datagrams
+void pollNetwork();
+
+// In-memory TCP peer connected to the AsyncServer listening on the given device port
+class LoopbackClient {
+   public:
+    explicit LoopbackClient(uint16_t port = 80);
+    ~LoopbackClient() { close(); }
+
+    bool connected() const;
+    void send(const std::string& data);
+    // Returns and clears everything the server has written so far
+    std::string receive();
+    void close();
+
+   private:
+    std::shared_ptr<TcpTransport> transport;
+};
+
+}  // namespace native
+
+#endif  // NATIVE_ESPASYNCTCP_H
@@ -0,0 +1,184 @@
+#include "ESPAsyncUDP.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace native {
+
+namespace {
+
+std::vector<AsyncUDP*> sockets;
+
+bool isMulticast(uint32_t address) {
+    return (ntohl(address) & 0xF0000000) == 0xE0000000;
+}
+
+// Multicast leaves and arrives on loopback, where every instance on the host hears it
+void useLoopback(int fd) {
+    in_addr loopback = {htonl(INADDR_LOOPBACK)};
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    int loop = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+}
+
+sockaddr_in socketAddress(uint32_t address, uint16_t port) {
+    sockaddr_in socketAddress = {};
+    socketAddress.sin_family = AF_INET;
+    socketAddress.sin_addr.s_addr = address;  // IPAddress keeps network byte order, as lwIP does
+    socketAddress.sin_port = htons(port);
+    return socketAddress;
+}
+
+}  // namespace
+
+struct DatagramAccess {
+    static void receive(AsyncUDP* udp) { udp->receive(); }
+};
+
+void pollDatagrams() {
+    std::vector<AsyncUDP*> snapshot = sockets;
+    for (AsyncUDP* udp : snapshot) {
+        if (std::find(sockets.begin(), sockets.end(), udp) != sockets.end()) {
+            DatagramAccess::receive(udp);
+        }
+    }
+}
+
+UdpPeer::UdpPeer() {
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = socketAddress(htonl(INADDR_LOOPBACK), 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        perror("UdpPeer: bind");
+        return;
+    }
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    localPort = ntohs(address.sin_port);
+    useLoopback(fd);
+}
+
+UdpPeer::~UdpPeer() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool UdpPeer::send(IPAddress address, uint16_t port, const std::string& data) {
+    sockaddr_in to = socketAddress(address, port);
+    return sendto(fd, data.data(), data.size(), 0, reinterpret_cast<sockaddr*>(&to), sizeof(to)) ==
+           static_cast<ssize_t>(data.size());
+}
+
+std::vector<std::string> UdpPeer::receive(unsigned long timeoutMs) {
+    std::vector<std::string> datagrams;
+    pollfd waiting = {fd, POLLIN, 0};
+    if (::poll(&waiting, 1, timeoutMs) <= 0) {
+        return datagrams;
+    }
+    char buffer[1500];
+    ssize_t length;
+    while ((length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0) {
+        datagrams.emplace_back(buffer, length);
+    }
+    return datagrams;
+}
+
+}  // namespace native
+
+bool AsyncUDP::listen(uint16_t port) {
+    return open(port, 0);
+}
+
+bool AsyncUDP::listenMulticast(const IPAddress addr, uint16_t port, uint8_t ttl) {
+    (void)ttl;
+    return native::isMulticast(addr) && open(port, addr);
+}
+
+bool AsyncUDP::open(uint16_t port, uint32_t group) {
+    close();
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+    sockaddr_in address = native::socketAddress(htonl(INADDR_ANY), port);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        perror("AsyncUDP: bind");
+        close();
+        return false;
+    }
+    native::useLoopback(fd);
+    if (group) {
+        ip_mreq membership = {};
+        membership.imr_multiaddr.s_addr = group;
+        membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+            perror("AsyncUDP: join");
+            close();
+            return false;
+        }
+        int info = 1;
+        setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &info, sizeof(info));
+    }
+    int others = 0;  // Only the group joined here, not every group some socket on the host joined
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &others, sizeof(others));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    multicastGroup = group;
+    native::sockets.push_back(this);
+    return true;
+}
+
+void AsyncUDP::close() {
+    native::sockets.erase(std::remove(native::sockets.begin(), native::sockets.end(), this), native::sockets.end());
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    multicastGroup = 0;
+}
+
+size_t AsyncUDP::writeTo(const uint8_t* data, size_t len, const IPAddress addr, uint16_t port) {
+    if (fd < 0) {
+        return 0;
+    }
+    sockaddr_in to = native::socketAddress(addr, port);
+    ssize_t sent = sendto(fd, data, len, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to));
+    return sent < 0 ? 0 : sent;
+}
+
+// One datagram per recvmsg(); the destination address tells multicast from unicast
+void AsyncUDP::receive() {
+    uint8_t buffer[1500];
+    char control[64];
+    while (fd >= 0) {
+        sockaddr_in from = {};
+        iovec data = {buffer, sizeof(buffer)};
+        msghdr message = {};
+        message.msg_name = &from;
+        message.msg_namelen = sizeof(from);
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t length = recvmsg(fd, &message, MSG_DONTWAIT);
+        if (length < 0) {
+            return;
+        }
+        bool multicast = false;
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == IPPROTO_IP && header->cmsg_type == IP_PKTINFO) {
+                multicast = native::isMulticast(reinterpret_cast<in_pktinfo*>(CMSG_DATA(header))->ipi_addr.s_addr);
+            }
+        }
+        if (handler) {
+            AsyncUDPPacket packet(buffer, length, IPAddress(from.sin_addr.s_addr), ntohs(from.sin_port), multicast);
+            handler(packet);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef NATIVE_ESPASYNCUDP_H
+#define NATIVE_ESPASYNCUDP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+// Host stand-in for ESPAsyncUDP on real sockets. Multicast is joined and
+// sent on the loopback interface and the port is shared, so several
+// simulators on one machine form a fleet. Packets are delivered by
+// native::pollNetwork(), as lwIP would between loop() passes.
+
+class AsyncUDPPacket {
+   public:
+    AsyncUDPPacket(uint8_t* data, size_t length, IPAddress remoteIP, uint16_t remotePort, bool multicast)
+        : bytes(data), size(length), remoteAddress(remoteIP), port(remotePort), multicast(multicast) {}
+
+    uint8_t* data() { return bytes; }
+    size_t length() const { return size; }
+    IPAddress remoteIP() const { return remoteAddress; }
+    uint16_t remotePort() const { return port; }
+    bool isMulticast() const { return multicast; }
+
+   private:
+    uint8_t* bytes;
+    size_t size;
+    IPAddress remoteAddress;
+    uint16_t port;
+    bool multicast;
+};
+
+typedef std::function<void(AsyncUDPPacket& packet)> AuPacketHandlerFunction;
+
+namespace native {
+struct DatagramAccess;
+}  // namespace native
+
+class AsyncUDP {
+   public:
+    AsyncUDP() {}
+    ~AsyncUDP() { close(); }
+    AsyncUDP(const AsyncUDP&) = delete;
+    AsyncUDP& operator=(const AsyncUDP&) = delete;
+
+    bool listen(uint16_t port);
+    bool listenMulticast(const IPAddress addr, uint16_t port, uint8_t ttl = 1);
+    void onPacket(AuPacketHandlerFunction cb) { handler = cb; }
+    size_t writeTo(const uint8_t* data, size_t len, const IPAddress addr, uint16_t port);
+    void close();
+    bool connected() const { return fd >= 0; }
+
+   private:
+    friend struct native::DatagramAccess;
+    bool open(uint16_t port, uint32_t group);
+    void receive();
+
+    int fd = -1;
+    uint32_t multicastGroup = 0;
+    AuPacketHandlerFunction handler;
+};
+
+namespace native {
+
+// Delivers the datagrams waiting on every AsyncUDP; pollNetwork() calls it
+void pollDatagrams();
+
+// A host on the network, e.g. a controller, with a socket of its own on loopback
+class UdpPeer {
+   public:
+    UdpPeer();
+    ~UdpPeer();
+
+    // To a unicast address, or a multicast group on loopback
+    bool send(IPAddress address, uint16_t port, const std::string& data);
+    // Datagrams received since the last call, after waiting up to timeoutMs for the first
+    std::vector<std::string> receive(unsigned long timeoutMs = 0);
+    uint16_t port() const { return localPort; }
+
+   private:
+    int fd = -1;
+    uint16_t localPort = 0;
+};
+
+}  // namespace native
+
+#endif  // NATIVE_ESPASYNCUDP_H
@@ -0,0 +1,87 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Arduino.h"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// File handle over a RAM-backed flash image entry
+class File : public Stream {
+   public:
+    File() {}
+    File(std::shared_ptr<std::string> data, const String& path, bool writable);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t* buffer, size_t size);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const { return pos; }
+    size_t size() const;
+    void close();
+    const char* name() const;
+    const char* fullName() const { return path.c_str(); }
+    bool isFile() const { return static_cast<bool>(data); }
+    bool isDirectory() const { return false; }
+
+    explicit operator bool() const { return static_cast<bool>(data); }
+
+   private:
+    std::shared_ptr<std::string> data;
+    String path;
+    size_t pos = 0;
+    bool writable = false;
+};
+
+struct FSInfo {
+    size_t totalBytes;
+    size_t usedBytes;
+    size_t blockSize;
+    size_t pageSize;
+    size_t maxOpenFiles;
+    size_t maxPathLength;
+};
+
+class FS {
+   public:
+    bool begin();
+    void end();
+    bool format();
+    bool info(FSInfo& info);
+
+    File open(const char* path, const char* mode);
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* pathFrom, const char* pathTo);
+    bool mkdir(const char* path);
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+    bool rmdir(const char* path);
+
+   private:
+    bool mounted = false;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::FSInfo;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
+
+#endif  // NATIVE_FS_H
@@ -0,0 +1,27 @@
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include "Arduino.h"
+
+class IPAddress : public Printable {
+   public:
+    IPAddress() : address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address(static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) |
+                  (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24)) {}
+    IPAddress(uint32_t address) : address(address) {}
+
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return (address >> (8 * index)) & 0xFF; }
+    bool isSet() const { return address != 0; }
+
+    bool fromString(const char* str);
+    bool fromString(const String& str) { return fromString(str.c_str()); }
+    String toString() const;
+    size_t printTo(Print& p) const override { return p.print(toString()); }
+
+   private:
+    uint32_t address;
+};
+
+#endif  // NATIVE_IPADDRESS_H
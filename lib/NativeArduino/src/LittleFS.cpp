@@ -0,0 +1,192 @@
+#include "LittleFS.h"
+
+#include "NativeMock.h"
+
+fs::FS LittleFS;
+
+namespace {
+
+std::map<std::string, std::shared_ptr<std::string>> image;
+bool mountable = true;
+
+}  // namespace
+
+namespace fs {
+
+File::File(std::shared_ptr<std::string> data, const String& path, bool writable)
+    : data(std::move(data)), path(path), writable(writable) {}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+    if (!data || !writable) {
+        return 0;
+    }
+    if (pos > data->size()) {
+        data->resize(pos);
+    }
+    data->replace(pos, std::min(size, data->size() - pos), reinterpret_cast<const char*>(buffer), size);
+    pos += size;
+    return size;
+}
+
+int File::available() {
+    return data && pos < data->size() ? static_cast<int>(data->size() - pos) : 0;
+}
+
+int File::read() {
+    if (!data || pos >= data->size()) {
+        return -1;
+    }
+    return static_cast<unsigned char>((*data)[pos++]);
+}
+
+int File::peek() {
+    if (!data || pos >= data->size()) {
+        return -1;
+    }
+    return static_cast<unsigned char>((*data)[pos]);
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+    if (!data || pos >= data->size()) {
+        return 0;
+    }
+    size_t count = std::min(size, data->size() - pos);
+    memcpy(buffer, data->data() + pos, count);
+    pos += count;
+    return count;
+}
+
+bool File::seek(uint32_t offset, SeekMode mode) {
+    if (!data) {
+        return false;
+    }
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? pos : data->size();
+    if (base + offset > data->size()) {
+        return false;
+    }
+    pos = base + offset;
+    return true;
+}
+
+size_t File::size() const {
+    return data ? data->size() : 0;
+}
+
+void File::close() {
+    data.reset();
+    pos = 0;
+}
+
+const char* File::name() const {
+    int slash = path.lastIndexOf('/');
+    return path.c_str() + (slash + 1);
+}
+
+bool FS::begin() {
+    mounted = mountable;
+    return mounted;
+}
+
+void FS::end() {
+    mounted = false;
+}
+
+bool FS::format() {
+    image.clear();
+    return true;
+}
+
+bool FS::info(FSInfo& info) {
+    size_t used = 0;
+    for (const auto& entry : image) {
+        used += entry.second->size();
+    }
+    info.totalBytes = 1024 * 1024;
+    info.usedBytes = used;
+    info.blockSize = 8192;
+    info.pageSize = 256;
+    info.maxOpenFiles = 5;
+    info.maxPathLength = 32;
+    return mounted;
+}
+
+File FS::open(const char* path, const char* mode) {
+    if (!mounted || !path || !mode) {
+        return File();
+    }
+    auto it = image.find(path);
+    if (mode[0] == 'r') {
+        if (it == image.end()) {
+            return File();
+        }
+        return File(it->second, path, mode[1] == '+');
+    }
+    if (it == image.end()) {
+        it = image.emplace(path, std::make_shared<std::string>()).first;
+    }
+    File file(it->second, path, true);
+    if (mode[0] == 'w') {
+        it->second->clear();
+    } else if (mode[0] == 'a') {
+        file.seek(0, SeekEnd);
+    }
+    return file;
+}
+
+bool FS::exists(const char* path) {
+    return mounted && image.count(path) > 0;
+}
+
+bool FS::remove(const char* path) {
+    return mounted && image.erase(path) > 0;
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo) {
+    auto it = image.find(pathFrom);
+    if (!mounted || it == image.end()) {
+        return false;
+    }
+    image[pathTo] = it->second;
+    image.erase(pathFrom);
+    return true;
+}
+
+bool FS::mkdir(const char*) {
+    return mounted;
+}
+
+bool FS::rmdir(const char*) {
+    return mounted;
+}
+
+}  // namespace fs
+
+namespace native {
+
+void fsReset() {
+    image.clear();
+    mountable = true;
+}
+
+void fsSetMountable(bool value) {
+    mountable = value;
+}
+
+void fsWrite(const std::string& path, const std::string& content) {
+    image[path] = std::make_shared<std::string>(content);
+}
+
+bool fsRead(const std::string& path, std::string& content) {
+    auto it = image.find(path);
+    if (it == image.end()) {
+        return false;
+    }
+    content = *it->second;
+    return true;
+}
+
+}  // namespace native
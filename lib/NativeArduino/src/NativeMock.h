@@ -0,0 +1,104 @@
+#ifndef NATIVE_MOCK_H
+#define NATIVE_MOCK_H
+
+// Test hooks for the host stand-ins. Nothing here exists on the device.
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+
+namespace native {
+
+const int kPinCount = 512;
+
+// Virtual clock. millis()/micros() only advance through these calls or delay().
+void setMicros(uint64_t us);
+void advanceMillis(unsigned long ms);
+void advanceMicros(uint64_t us);
+// Total virtual time spent inside delay()/delayMicroseconds() since the last reset
+uint64_t blockedMicros();
+// Total virtual time spent idle in esp_delay()
+uint64_t idleMicros();
+// An SNTP answer: sets the wall clock and runs the settimeofday_cb() callback
+void sntpSync(time_t epoch);
+// First server passed to configTime(), empty until it is called
+const char* sntpServer();
+// Called after delay()/delayMicroseconds()/esp_delay() advance the clock, e.g. to pace a simulator in real time
+void setDelayHook(std::function<void(uint64_t us)> hook);
+
+// GPIO. Pins configured as OUTPUT read back their latch; inputs read the driven level.
+void setDigitalInput(int pin, int level);
+void setAnalogInput(int pin, int value);
+int pinMode(int pin);
+// Level armed with gpio_pin_wakeup_enable(), or -1
+int gpioWakeLevel(int pin);
+int digitalOutput(int pin);
+int analogOutput(int pin);
+// Number of digitalWrite()/analogWrite() calls and GPOS/GPOC/GP16O writes since the last reset
+unsigned long pinWrites();
+// Number of digitalRead()/analogRead() calls since the last reset
+unsigned long digitalReads();
+unsigned long analogReads();
+// Called on every digitalWrite()/analogWrite() with the written value, and
+// for each pin a GPOS/GPOC/GP16O write drives
+void setPinWriteHook(std::function<void(int pin, int value)> hook);
+
+// Serial output is captured; set echo to mirror it to stdout
+void setSerialEcho(bool echo);
+// Charges every byte written its transmit time at the Serial.begin() baud
+// rate, as blocked time, like the device waiting on the UART FIFO; off by default
+void setSerialTiming(bool timed);
+unsigned long serialBytes();
+
+// Every operator new since the program started. On the device umm_malloc
+// rounds an allocation up to 8-byte blocks after a 4-byte header, which
+// blockBytes applies to the host sizes; host strings and the device's use
+// similar small-string buffers, so allocation counts carry over too.
+struct HeapStats {
+    size_t liveBlocks;
+    size_t liveBytes;
+    size_t blockBytes;
+    unsigned long allocations;
+};
+HeapStats heapStats();
+
+// LittleFS RAM image
+void fsReset();
+void fsSetMountable(bool mountable);
+void fsWrite(const std::string& path, const std::string& content);
+bool fsRead(const std::string& path, std::string& content);
+
+// Writes json, when given, to /config.json and brings a DeviceManager up
+// from the file the way setup() does
+template <typename Manager>
+void bootConfig(Manager& manager, const char* json = nullptr) {
+    if (json) {
+        fsWrite("/config.json", json);
+    }
+    manager.loadConfig();
+    manager.configureDevices();
+    manager.populateFunctionPointers();
+}
+
+// When non-zero, an AsyncServer on port 80 also accepts real sockets on this
+// host TCP port; see ESPAsyncTCP.h for native::pollNetwork() and LoopbackClient
+void setHttpPort(int port);
+int httpPort();
+
+// Sends request to port 80 over a new LoopbackClient, then runs
+// pollNetwork() and serve(), e.g. the server's handleClients(), passes
+// times; returns everything written back
+std::string httpExchange(const std::string& request, const std::function<void()>& serve, int passes = 16);
+// Joins the chunks of the chunked body that follows the head of raw
+std::string dechunk(const std::string& raw);
+
+// ESP.getChipId(), 24 bits as on the device; kept across reset() like the chip itself
+void setChipId(uint32_t id);
+
+// Restores clock, pins, serial counters, RTC memory and flash image to power-on defaults
+void reset();
+
+}  // namespace native
+
+#endif  // NATIVE_MOCK_H
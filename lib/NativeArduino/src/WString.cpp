@@ -0,0 +1,220 @@
+#include "WString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+template <typename T>
+std::string formatInteger(T value, unsigned char base) {
+    if (base == 10) {
+        return std::to_string(value);
+    }
+    const char* digits = "0123456789abcdef";
+    bool negative = value < 0;
+    unsigned long long magnitude = negative ? 0ULL - static_cast<unsigned long long>(value)
+                                            : static_cast<unsigned long long>(value);
+    std::string result;
+    do {
+        result.insert(result.begin(), digits[magnitude % base]);
+        magnitude /= base;
+    } while (magnitude > 0);
+    if (negative) {
+        result.insert(result.begin(), '-');
+    }
+    return result;
+}
+
+std::string formatFloat(double value, unsigned char decimalPlaces) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimalPlaces, value);
+    return buffer;
+}
+
+}  // namespace
+
+String::String(unsigned char value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(int value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(unsigned int value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(long value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(unsigned long value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(long long value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : buffer(formatInteger(value, base)) {}
+String::String(float value, unsigned char decimalPlaces) : buffer(formatFloat(value, decimalPlaces)) {}
+String::String(double value, unsigned char decimalPlaces) : buffer(formatFloat(value, decimalPlaces)) {}
+
+String& String::operator=(const char* cstr) {
+    if (cstr) {
+        buffer = cstr;
+    } else {
+        buffer.clear();
+    }
+    return *this;
+}
+
+bool String::reserve(unsigned int size) {
+    buffer.reserve(size);
+    return true;
+}
+
+bool String::concat(const String& str) {
+    buffer += str.buffer;
+    return true;
+}
+
+bool String::concat(const char* cstr) {
+    if (!cstr) {
+        return false;
+    }
+    buffer += cstr;
+    return true;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+    if (!cstr) {
+        return false;
+    }
+    buffer.append(cstr, length);
+    return true;
+}
+
+bool String::concat(char c) {
+    buffer += c;
+    return true;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+    if (buffer.length() != other.buffer.length()) {
+        return false;
+    }
+    for (size_t i = 0; i < buffer.length(); i++) {
+        if (tolower(static_cast<unsigned char>(buffer[i])) != tolower(static_cast<unsigned char>(other.buffer[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::startsWith(const String& prefix) const {
+    return buffer.compare(0, prefix.buffer.length(), prefix.buffer) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return buffer.length() >= suffix.buffer.length() &&
+           buffer.compare(buffer.length() - suffix.buffer.length(), suffix.buffer.length(), suffix.buffer) == 0;
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const {
+    size_t pos = buffer.find(c, fromIndex);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::indexOf(const String& str, unsigned int fromIndex) const {
+    size_t pos = buffer.find(str.buffer, fromIndex);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(char c) const {
+    size_t pos = buffer.rfind(c);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+String String::substring(unsigned int beginIndex) const {
+    return substring(beginIndex, length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+    if (beginIndex > endIndex) {
+        std::swap(beginIndex, endIndex);
+    }
+    if (beginIndex >= buffer.length()) {
+        return String();
+    }
+    endIndex = std::min<unsigned int>(endIndex, length());
+    return String(buffer.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::replace(const String& find, const String& replace) {
+    if (find.buffer.empty()) {
+        return;
+    }
+    size_t pos = 0;
+    while ((pos = buffer.find(find.buffer, pos)) != std::string::npos) {
+        buffer.replace(pos, find.buffer.length(), replace.buffer);
+        pos += replace.buffer.length();
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index < buffer.length()) {
+        buffer.erase(index, count);
+    }
+}
+
+void String::toLowerCase() {
+    for (auto& c : buffer) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+}
+
+void String::toUpperCase() {
+    for (auto& c : buffer) {
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    }
+}
+
+void String::trim() {
+    size_t begin = buffer.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        buffer.clear();
+        return;
+    }
+    size_t end = buffer.find_last_not_of(" \t\r\n");
+    buffer = buffer.substr(begin, end - begin + 1);
+}
+
+long String::toInt() const {
+    return strtol(buffer.c_str(), nullptr, 10);
+}
+
+float String::toFloat() const {
+    return strtof(buffer.c_str(), nullptr);
+}
+
+String operator+(const String& lhs, const String& rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String& lhs, const char* rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String& lhs, char rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String& lhs, int rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String& lhs, unsigned long rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
@@ -0,0 +1,17 @@
+#ifndef NATIVE_COREDECLS_H
+#define NATIVE_COREDECLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Ends a pending esp_delay() early; on the host the delay polls its predicate instead
+void esp_schedule();
+// Delays up to timeout_ms while blocked() returns true
+void esp_delay(uint32_t timeout_ms, const std::function<bool()>& blocked);
+// Runs after the clock is set; from_sntp is false for settimeofday() calls
+void settimeofday_cb(const std::function<void(bool from_sntp)>& cb);
+// CRC-32 as computed by the core, without the final inversion
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0xffffffff);
+
+#endif  // NATIVE_COREDECLS_H
@@ -0,0 +1,34 @@
+#ifndef NATIVE_ESP8266_PERI_H
+#define NATIVE_ESP8266_PERI_H
+
+#include <cstdint>
+
+// GPIO output registers of the ESP8266. A write to GPOS drives high every
+// pin 0-15 whose bit is set, GPOC drives them low, all in the same instant;
+// bit 0 of GP16O is the latch of GPIO16. Reads return the latches.
+
+namespace native {
+
+class GpioRegister {
+   public:
+    enum Kind { SET, CLEAR, GPIO16 };
+
+    explicit GpioRegister(Kind kind) : kind(kind) {}
+    GpioRegister& operator=(uint32_t value);
+    GpioRegister& operator|=(uint32_t value) { return *this = read() | value; }
+    GpioRegister& operator&=(uint32_t value) { return *this = read() & value; }
+    operator uint32_t() const { return read(); }
+
+   private:
+    uint32_t read() const;
+
+    Kind kind;
+};
+
+}  // namespace native
+
+extern native::GpioRegister GPOS;
+extern native::GpioRegister GPOC;
+extern native::GpioRegister GP16O;
+
+#endif  // NATIVE_ESP8266_PERI_H
@@ -0,0 +1,24 @@
+#ifndef NATIVE_GPIO_H
+#define NATIVE_GPIO_H
+
+#include <cstdint>
+
+// Light-sleep GPIO wakeup from the ESP8266 SDK. Only GPIO 0-15 can wake the chip.
+
+#define GPIO_ID_PIN(n) (n)
+
+typedef enum {
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_POSEDGE = 1,
+    GPIO_PIN_INTR_NEGEDGE = 2,
+    GPIO_PIN_INTR_ANYEDGE = 3,
+    GPIO_PIN_INTR_LOLEVEL = 4,
+    GPIO_PIN_INTR_HILEVEL = 5
+} GPIO_INT_TYPE;
+
+extern "C" {
+void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE level);
+void gpio_pin_wakeup_disable();
+}
+
+#endif  // NATIVE_GPIO_H
@@ -0,0 +1,99 @@
+#include "LatencyRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+
+uint64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void LatencyRecorder::addProbe(int inputPin, int outputPin, Edge edge) {
+    std::lock_guard<std::mutex> lock(mutex);
+    probes.push_back(Probe{inputPin, outputPin, edge, false, 0});
+}
+
+void LatencyRecorder::inputChanged(int pin, int level, uint64_t virtualMicros) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& probe : probes) {
+        if (probe.inputPin != pin) {
+            continue;
+        }
+        bool matches = probe.edge == EDGE_BOTH || (probe.edge == EDGE_RISING) == (level != 0);
+        if (!matches) {
+            continue;
+        }
+        if (probe.pending) {
+            missed++;  // The previous edge never reached the output
+        }
+        probe.pending = true;
+        probe.edgeMicros = virtualMicros;
+    }
+}
+
+void LatencyRecorder::outputWritten(int pin, uint64_t virtualMicros, uint64_t wallMicros) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& probe : probes) {
+        if (probe.pending && probe.outputPin == pin) {
+            inputLatencies.push_back(virtualMicros - probe.edgeMicros);
+            probe.pending = false;
+        }
+    }
+    for (auto& entry : expectations) {
+        Expectation& expectation = entry.second;
+        if (expectation.result < 0 &&
+            std::find(expectation.pins.begin(), expectation.pins.end(), pin) != expectation.pins.end()) {
+            expectation.result = static_cast<int64_t>(wallMicros - expectation.sentMicros);
+        }
+    }
+}
+
+int LatencyRecorder::expectWrite(const std::vector<int>& pins, uint64_t wallMicros) {
+    std::lock_guard<std::mutex> lock(mutex);
+    int ticket = nextTicket++;
+    expectations[ticket] = Expectation{pins, wallMicros, -1};
+    return ticket;
+}
+
+int64_t LatencyRecorder::takeResult(int ticket) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = expectations.find(ticket);
+    if (it == expectations.end()) {
+        return -1;
+    }
+    int64_t result = it->second.result;
+    if (result >= 0) {
+        expectations.erase(it);
+    }
+    return result;
+}
+
+void LatencyRecorder::abandon(int ticket) {
+    std::lock_guard<std::mutex> lock(mutex);
+    expectations.erase(ticket);
+}
+
+LatencyStats LatencyRecorder::inputStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return summarize(inputLatencies);
+}
+
+size_t LatencyRecorder::missedInputs() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return missed;
+}
+
+LatencyStats LatencyRecorder::summarize(std::vector<uint64_t> samples) {
+    LatencyStats stats;
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    stats.count = samples.size();
+    stats.min = samples.front();
+    stats.p50 = samples[samples.size() / 2];
+    stats.p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    stats.max = samples.back();
+    return stats;
+}
@@ -0,0 +1,69 @@
+#ifndef LATENCY_RECORDER_H
+#define LATENCY_RECORDER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Monotonic host time, used for everything measured by real clients
+uint64_t wallMicros();
+
+// Summary of one latency series, in microseconds
+struct LatencyStats {
+    size_t count = 0;
+    uint64_t min = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t max = 0;
+};
+
+// Correlates stimuli (input edges, HTTP requests) with the first following
+// write to the output pin they are expected to drive. Thread-safe: writes are
+// reported from the device loop while load generator threads register requests.
+class LatencyRecorder {
+   public:
+    enum Edge { EDGE_RISING, EDGE_FALLING, EDGE_BOTH };  // RISING and FALLING are Arduino macros
+
+    // Input edges on inputPin are expected to produce a write on outputPin
+    void addProbe(int inputPin, int outputPin, Edge edge);
+
+    // Called when the simulator drives an input; time is virtual microseconds
+    void inputChanged(int pin, int level, uint64_t virtualMicros);
+    // Called from the pin write hook with both clocks
+    void outputWritten(int pin, uint64_t virtualMicros, uint64_t wallMicros);
+
+    // Registers an HTTP request that should change any of pins; returns a ticket
+    int expectWrite(const std::vector<int>& pins, uint64_t wallMicros);
+    // Wall microseconds from expectWrite() to the first matching write, or -1 if none yet
+    int64_t takeResult(int ticket);
+    void abandon(int ticket);
+
+    LatencyStats inputStats() const;
+    size_t missedInputs() const;
+    static LatencyStats summarize(std::vector<uint64_t> samples);
+
+   private:
+    struct Probe {
+        int inputPin;
+        int outputPin;
+        Edge edge;
+        bool pending;
+        uint64_t edgeMicros;
+    };
+    struct Expectation {
+        std::vector<int> pins;
+        uint64_t sentMicros;
+        int64_t result;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Probe> probes;
+    std::vector<uint64_t> inputLatencies;
+    size_t missed = 0;
+    std::map<int, Expectation> expectations;
+    int nextTicket = 0;
+};
+
+#endif  // LATENCY_RECORDER_H
@@ -0,0 +1,305 @@
+#include "LoadGenerator.h"
+
+#include <ArduinoJson.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+const uint64_t kWriteWaitMicros = 1000000;
+
+// Minimal blocking HTTP/1.1 client holding one keep-alive connection
+class HttpClient {
+   public:
+    HttpClient(int port, int gapMs) : port(port), gapMs(gapMs) {}
+    ~HttpClient() { disconnect(); }
+
+    // Retries on a fresh connection when a reused one fails, as browsers do:
+    // the server may have closed it while the request was on its way. A
+    // request that fails on a fresh connection is an error
+    bool request(const char* method, const std::string& path, const std::string& body, int& status,
+                 std::string& responseBody) {
+        while (true) {
+            bool reused = fd >= 0;
+            if (!reused && !connectSocket()) {
+                return false;
+            }
+            std::string request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: localhost\r\n";
+            if (!body.empty()) {
+                request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+            }
+            request += "\r\n" + body;
+            if (sendRequest(request) && readResponse(status, responseBody)) {
+                return true;
+            }
+            disconnect();
+            if (!reused) {
+                return false;
+            }
+            retryCount++;
+        }
+    }
+
+    size_t connects() const { return connectCount; }
+    size_t retries() const { return retryCount; }
+
+   private:
+    bool sendAll(const char* data, size_t length) {
+        return send(fd, data, length, MSG_NOSIGNAL) == static_cast<ssize_t>(length);
+    }
+
+    bool sendRequest(const std::string& request) {
+        if (gapMs <= 0) {
+            return sendAll(request.data(), request.size());
+        }
+        size_t half = request.size() / 2;
+        if (!sendAll(request.data(), half)) {
+            return false;
+        }
+        usleep(gapMs * 1000);
+        return sendAll(request.data() + half, request.size() - half);
+    }
+
+    bool connectSocket() {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            disconnect();
+            return false;
+        }
+        buffered.clear();
+        connectCount++;
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    bool fill() {
+        char buffer[4096];
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffered.append(buffer, received);
+        return true;
+    }
+
+    bool readResponse(int& status, std::string& responseBody) {
+        size_t headerEnd;
+        while ((headerEnd = buffered.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        if (buffered.compare(0, 9, "HTTP/1.1 ") != 0) {
+            return false;
+        }
+        std::string head = buffered.substr(0, headerEnd);
+        status = atoi(head.c_str() + 9);
+        bool closing = head.find("Connection: close") != std::string::npos;
+        size_t lengthHeader = head.find("Content-Length: ");
+        size_t bodyStart = headerEnd + 4;
+
+        if (lengthHeader == std::string::npos) {
+            while (fill()) {
+            }
+            responseBody = buffered.substr(bodyStart);
+            buffered.clear();
+            disconnect();
+            return true;
+        }
+        size_t length = strtoul(head.c_str() + lengthHeader + 16, nullptr, 10);
+        while (buffered.size() < bodyStart + length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        responseBody = buffered.substr(bodyStart, length);
+        buffered.erase(0, bodyStart + length);
+        if (closing) {
+            disconnect();
+        }
+        return true;
+    }
+
+    int port;
+    int gapMs;
+    int fd = -1;
+    std::string buffered;
+    size_t connectCount = 0;
+    size_t retryCount = 0;
+};
+
+void printStats(const char* name, const LatencyStats& stats) {
+    printf("  %-24s n=%-7zu min=%-9.3f p50=%-9.3f p99=%-9.3f max=%.3f ms\n", name, stats.count, stats.min / 1000.0,
+           stats.p50 / 1000.0, stats.p99 / 1000.0, stats.max / 1000.0);
+}
+
+}  // namespace
+
+LoadGenerator::~LoadGenerator() {
+    if (coordinator.joinable()) {
+        coordinator.join();
+    }
+}
+
+void LoadGenerator::start() {
+    coordinator = std::thread([this]() { run(); });
+}
+
+bool LoadGenerator::discover(std::vector<Target>& targets) {
+    HttpClient client(port, gapMs);
+    int status = 0;
+    std::string body;
+    if (!client.request("GET", "/devices", "", status, body) || status != 200) {
+        fprintf(stderr, "load: GET /devices failed (status %d)\n", status);
+        return false;
+    }
+    JsonDocument doc;
+    if (deserializeJson(doc, body.c_str())) {
+        fprintf(stderr, "load: /devices returned invalid JSON\n");
+        return false;
+    }
+    for (JsonObject device : doc["devices"].as<JsonArray>()) {
+        for (JsonObject component : device["components"].as<JsonArray>()) {
+            Target target;
+            target.name = component["componentName"].as<const char*>();
+            target.pins.push_back(component["componentPin"].as<int>());
+            target.pins.push_back(component["actionPin"].as<int>());
+            targets.push_back(target);
+        }
+    }
+    return !targets.empty();
+}
+
+void LoadGenerator::run() {
+    std::vector<Target> targets;
+    if (!discover(targets)) {
+        failed = true;
+        done = true;
+        return;
+    }
+    if (clients > static_cast<int>(targets.size())) {
+        printf("load: %d clients share %zu components; write latencies may be misattributed\n", clients,
+               targets.size());
+    }
+
+    std::vector<std::thread> pollerThreads;
+    for (int i = 0; i < pollers; i++) {
+        pollerThreads.emplace_back([this]() { runPoller(); });
+    }
+
+    uint64_t start = wallMicros();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; i++) {
+        const Target& target = targets[i % targets.size()];
+        threads.emplace_back([this, &target]() { runClient(target); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    elapsedMicros = wallMicros() - start;
+    controlDone = true;
+    for (auto& thread : pollerThreads) {
+        thread.join();
+    }
+    done = true;
+}
+
+void LoadGenerator::runClient(const Target& target) {
+    HttpClient client(port, gapMs);
+    for (int i = 0; i < requestsPerClient; i++) {
+        std::string body = "{\"componentName\":\"" + target.name + "\",\"action\":\"control\",\"state\":" +
+                           (i % 2 == 0 ? "true" : "false") + "}";
+        uint64_t sent = wallMicros();
+        int ticket = recorder.expectWrite(target.pins, sent);
+        int status = 0;
+        std::string response;
+        bool ok = client.request("POST", "/control", body, status, response);
+        uint64_t answered = wallMicros();
+
+        int64_t writeLatency = recorder.takeResult(ticket);
+        while (writeLatency < 0 && wallMicros() - sent < kWriteWaitMicros) {
+            usleep(100);
+            writeLatency = recorder.takeResult(ticket);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok || status != 200) {
+            errors++;
+        } else {
+            responseLatencies.push_back(answered - sent);
+        }
+        if (writeLatency >= 0) {
+            writeLatencies.push_back(writeLatency);
+        } else {
+            recorder.abandon(ticket);
+            unmatched++;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    connects += client.connects();
+    retries += client.retries();
+}
+
+void LoadGenerator::runPoller() {
+    HttpClient client(port, gapMs);
+    while (!controlDone) {
+        int status = 0;
+        std::string response;
+        uint64_t sent = wallMicros();
+        bool ok = client.request("GET", "/devices", "", status, response);
+        uint64_t answered = wallMicros();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok || status != 200) {
+            pollErrors++;
+            usleep(1000);
+        } else {
+            pollLatencies.push_back(answered - sent);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    connects += client.connects();
+    retries += client.retries();
+}
+
+void LoadGenerator::printReport() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failed) {
+        printf("HTTP load: discovery failed, no requests sent\n");
+        return;
+    }
+    size_t total = responseLatencies.size() + errors;
+    double seconds = elapsedMicros / 1e6;
+    printf("HTTP load: %d clients x %d requests to /control, %d /devices pollers, %d ms segment gap\n", clients,
+           requestsPerClient, pollers, gapMs);
+    printf("  requests=%zu errors=%zu no_pin_write=%zu elapsed=%.3f s rps=%.1f connections=%zu retries=%zu\n", total,
+           errors, unmatched, seconds, seconds > 0 ? total / seconds : 0.0, connects, retries);
+    printStats("request->response", LatencyRecorder::summarize(responseLatencies));
+    printStats("request->pin write", LatencyRecorder::summarize(writeLatencies));
+    if (pollers > 0) {
+        printf("  polls=%zu errors=%zu rps=%.1f\n", pollLatencies.size(), pollErrors,
+               seconds > 0 ? pollLatencies.size() / seconds : 0.0);
+        printStats("/devices poll", LatencyRecorder::summarize(pollLatencies));
+    }
+}
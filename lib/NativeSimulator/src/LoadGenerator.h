@@ -0,0 +1,72 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LatencyRecorder.h"
+
+// Concurrent HTTP clients hammering the simulator's own /control endpoint.
+// Each client owns one component (discovered through GET /devices) and
+// alternates its state, so every request should produce a pin write that can
+// be attributed to it. Pollers model open dashboards: they fetch /devices
+// back to back until the control clients are done. Every client keeps one
+// keep-alive connection and reconnects whenever the server closes it,
+// retrying a request that failed on the connection it reused. A gap
+// splits every request into two segments sent that far apart, as a client
+// behind a real WiFi link would.
+class LoadGenerator {
+   public:
+    LoadGenerator(int port, int clients, int requestsPerClient, int pollers, int gapMs, LatencyRecorder& recorder)
+        : port(port),
+          clients(clients),
+          requestsPerClient(requestsPerClient),
+          pollers(pollers),
+          gapMs(gapMs),
+          recorder(recorder) {}
+    ~LoadGenerator();
+
+    void start();
+    bool finished() const { return done.load(); }
+    void printReport() const;
+
+   private:
+    struct Target {
+        std::string name;
+        std::vector<int> pins;
+    };
+
+    void run();
+    void runClient(const Target& target);
+    void runPoller();
+    bool discover(std::vector<Target>& targets);
+
+    int port;
+    int clients;
+    int requestsPerClient;
+    int pollers;
+    int gapMs;
+    LatencyRecorder& recorder;
+
+    std::thread coordinator;
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> controlDone{false};
+
+    mutable std::mutex mutex;
+    std::vector<uint64_t> responseLatencies;
+    std::vector<uint64_t> writeLatencies;
+    std::vector<uint64_t> pollLatencies;
+    size_t errors = 0;
+    size_t pollErrors = 0;
+    size_t connects = 0;
+    size_t retries = 0;  // On a fresh connection after a reused one failed
+    size_t unmatched = 0;
+    uint64_t elapsedMicros = 0;
+};
+
+#endif  // LOAD_GENERATOR_H
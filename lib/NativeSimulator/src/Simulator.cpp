@@ -0,0 +1,254 @@
+// Entry point of the env:simulator build: runs the firmware's real setup() and
+// loop() on Linux.
+//
+//   .pio/build/simulator/program --port 8080 --config config.json --script input.wave
+//   .pio/build/simulator/program --port 8080 --config config.json --clients 8 --requests 200 --pollers 4
+//   .pio/build/simulator/program --port 8081 --config config.json --chip-id 2
+//   .pio/build/simulator/program --port 8080 --config config.json --fs data
+//
+// With --port the virtual clock follows wall time (scaled by --speed), delay()
+// really sleeps and HTTP is served on a local socket, so curl and the
+// examples in rest.http work against http://localhost:<port>. Network
+// callbacks are delivered between loop() passes and inside delay(), as lwIP
+// does on the device. Every instance joins group control on loopback
+// multicast, so simulators started with their own --port and --chip-id
+// make a fleet that one UDP frame reaches. --fs data serves the web UI
+// that scripts/build_web.py compresses into data/www. Without --port
+// the clock advances --step-us per loop() pass and the run ends once the
+// script has played out.
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "LatencyRecorder.h"
+#include "LoadGenerator.h"
+#include "Waveform.h"
+
+void setup();
+void loop();
+
+namespace {
+
+struct Options {
+    int port = 0;
+    double speed = 1.0;
+    unsigned long stepMicros = 100;
+    unsigned long durationMs = 0;
+    std::string configPath;
+    std::string fsDir;
+    std::string scriptPath;
+    int clients = 0;
+    int requests = 100;
+    int pollers = 0;
+    int gapMs = 0;
+    bool echo = false;
+    uint32_t chipId = 0;
+};
+
+std::atomic<bool> stopRequested{false};
+
+void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --port N         serve HTTP on localhost:N and run in real time\n"
+            "  --speed X        virtual time runs X times faster than wall time (default 1)\n"
+            "  --step-us N      virtual time per loop() pass without --port (default 100)\n"
+            "  --duration MS    stop after MS virtual milliseconds\n"
+            "  --config FILE    preload FILE as /config.json\n"
+            "  --fs DIR         preload the files under DIR into the flash image, e.g. data with the web UI\n"
+            "  --script FILE    play a GPIO waveform script\n"
+            "  --clients N      run N concurrent /control clients (requires --port)\n"
+            "  --requests N     requests per client (default 100)\n"
+            "  --pollers N      fetch /devices on N more connections while the clients run\n"
+            "  --gap-ms N       send each request in two segments N ms apart\n"
+            "  --chip-id HEX    ESP.getChipId(), to tell simulators apart in mDNS and group control acks\n"
+            "  --echo           mirror Serial output to stdout\n",
+            program);
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    static const option longOptions[] = {
+        {"port", required_argument, nullptr, 'p'},     {"speed", required_argument, nullptr, 's'},
+        {"step-us", required_argument, nullptr, 't'},  {"duration", required_argument, nullptr, 'd'},
+        {"config", required_argument, nullptr, 'c'},   {"fs", required_argument, nullptr, 'f'},
+        {"script", required_argument, nullptr, 'w'},   {"clients", required_argument, nullptr, 'n'},
+        {"requests", required_argument, nullptr, 'r'}, {"pollers", required_argument, nullptr, 'o'},
+        {"gap-ms", required_argument, nullptr, 'g'},   {"echo", no_argument, nullptr, 'e'},
+        {"chip-id", required_argument, nullptr, 'i'},  {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'p': options.port = atoi(optarg); break;
+            case 's': options.speed = atof(optarg); break;
+            case 't': options.stepMicros = strtoul(optarg, nullptr, 10); break;
+            case 'd': options.durationMs = strtoul(optarg, nullptr, 10); break;
+            case 'c': options.configPath = optarg; break;
+            case 'f': options.fsDir = optarg; break;
+            case 'w': options.scriptPath = optarg; break;
+            case 'n': options.clients = atoi(optarg); break;
+            case 'r': options.requests = atoi(optarg); break;
+            case 'o': options.pollers = atoi(optarg); break;
+            case 'g': options.gapMs = atoi(optarg); break;
+            case 'e': options.echo = true; break;
+            case 'i': options.chipId = strtoul(optarg, nullptr, 16); break;
+            default: return false;
+        }
+    }
+    if (options.clients > 0 && options.port == 0) {
+        fprintf(stderr, "--clients requires --port\n");
+        return false;
+    }
+    return options.speed > 0;
+}
+
+bool preloadFile(const std::string& hostPath, const std::string& flashPath) {
+    std::ifstream file(hostPath, std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "cannot read %s\n", hostPath.c_str());
+        return false;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    native::fsWrite(flashPath, content.str());
+    return true;
+}
+
+// Subdirectories keep their place: DIR/www/index.html.gz is /www/index.html.gz
+bool preloadDirectory(const std::string& dir, const std::string& prefix = "") {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        fprintf(stderr, "cannot open %s\n", dir.c_str());
+        return false;
+    }
+    while (dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        std::string path = dir + "/" + name;
+        struct stat info;
+        if (name == "." || name == ".." || stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        if (S_ISREG(info.st_mode)) {
+            preloadFile(path, prefix + "/" + name);
+        } else if (S_ISDIR(info.st_mode)) {
+            preloadDirectory(path, prefix + "/" + name);
+        }
+    }
+    closedir(handle);
+    return true;
+}
+
+void printStats(const char* name, const LatencyStats& stats) {
+    printf("  %-24s n=%-7zu min=%-9.3f p50=%-9.3f p99=%-9.3f max=%.3f ms\n", name, stats.count, stats.min / 1000.0,
+           stats.p50 / 1000.0, stats.p99 / 1000.0, stats.max / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    native::reset();
+    native::setSerialEcho(options.echo);
+    if (options.chipId) {
+        native::setChipId(options.chipId);
+    }
+    if (!options.fsDir.empty() && !preloadDirectory(options.fsDir)) {
+        return 1;
+    }
+    if (!options.configPath.empty() && !preloadFile(options.configPath, "/config.json")) {
+        return 1;
+    }
+
+    LatencyRecorder recorder;
+    Waveform waveform;
+    if (!options.scriptPath.empty() && !waveform.load(options.scriptPath, recorder)) {
+        return 1;
+    }
+
+    bool realtime = options.port > 0;
+    uint64_t wallStart = wallMicros();
+    native::setPinWriteHook(
+        [&recorder](int pin, int) { recorder.outputWritten(pin, micros(), wallMicros()); });
+    if (realtime) {
+        native::setHttpPort(options.port);
+        // A blocked device must look blocked to real clients too
+        native::setDelayHook([&options](uint64_t us) {
+            std::this_thread::sleep_for(std::chrono::microseconds(static_cast<uint64_t>(us / options.speed)));
+            native::pollNetwork();
+        });
+    } else {
+        // Inputs keep changing while the firmware blocks or sleeps; an edge wakes it through its interrupt
+        native::setDelayHook([&waveform, &recorder](uint64_t) { waveform.applyDue(micros(), recorder); });
+    }
+    signal(SIGINT, [](int) { stopRequested = true; });
+    signal(SIGTERM, [](int) { stopRequested = true; });
+
+    setup();
+    // SNTP answers with the host's time, as it would once the device joins a network
+    native::sntpSync(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    if (realtime) {
+        printf("simulator: serving http://localhost:%d (Ctrl-C to stop)\n", options.port);
+    }
+
+    std::unique_ptr<LoadGenerator> load;
+    if (options.clients > 0) {
+        load.reset(new LoadGenerator(options.port, options.clients, options.requests, options.pollers,
+                                     options.gapMs, recorder));
+        load->start();
+    }
+
+    uint64_t endMicros = options.durationMs ? static_cast<uint64_t>(options.durationMs) * 1000
+                         : realtime         ? UINT64_MAX
+                                            : waveform.endMicros() + 1000000;
+    unsigned long loops = 0;
+    while (!stopRequested && static_cast<uint64_t>(micros()) < endMicros) {
+        if (realtime) {
+            uint64_t target = static_cast<uint64_t>((wallMicros() - wallStart) * options.speed);
+            if (target > micros()) {
+                native::setMicros(target);
+            }
+        } else {
+            native::advanceMicros(options.stepMicros);
+        }
+        waveform.applyDue(micros(), recorder);
+        native::pollNetwork();
+        loop();
+        loops++;
+        if (load && load->finished() && !options.durationMs) {
+            break;
+        }
+    }
+
+    printf("\nsimulator: %lu loop passes over %.3f s virtual, %.3f s blocked in delay(), %.3f s idle\n", loops,
+           micros() / 1e6, native::blockedMicros() / 1e6, native::idleMicros() / 1e6);
+    if (!options.scriptPath.empty()) {
+        printf("GPIO input edge -> actuator write (virtual time), %zu edges never answered\n",
+               recorder.missedInputs());
+        printStats("edge->write", recorder.inputStats());
+    }
+    if (load) {
+        load->printReport();
+    }
+    return 0;
+}
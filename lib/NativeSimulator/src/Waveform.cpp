@@ -0,0 +1,93 @@
+#include "Waveform.h"
+
+#include <NativeMock.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+bool Waveform::load(const std::string& path, LatencyRecorder& recorder) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "waveform: cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream in(line);
+        std::string first;
+        if (!(in >> first) || first[0] == '#') {
+            continue;
+        }
+
+        if (first == "probe") {
+            int inputPin, outputPin;
+            std::string edge = "rising";
+            if (!(in >> inputPin >> outputPin)) {
+                fprintf(stderr, "waveform:%d: probe needs <inputPin> <outputPin>\n", lineNumber);
+                return false;
+            }
+            in >> edge;
+            recorder.addProbe(inputPin, outputPin,
+                              edge == "both" ? LatencyRecorder::EDGE_BOTH
+                              : edge == "falling" ? LatencyRecorder::EDGE_FALLING
+                                                  : LatencyRecorder::EDGE_RISING);
+            continue;
+        }
+
+        uint64_t at = std::stoull(first) * 1000;
+        std::string command;
+        int pin;
+        if (!(in >> command >> pin)) {
+            fprintf(stderr, "waveform:%d: expected <t> <command> <pin>\n", lineNumber);
+            return false;
+        }
+        if (command == "set" || command == "analog") {
+            int value;
+            if (!(in >> value)) {
+                fprintf(stderr, "waveform:%d: missing value\n", lineNumber);
+                return false;
+            }
+            events.push_back(Event{at, pin, command == "analog", value});
+        } else if (command == "square") {
+            uint64_t periodMs, highMs, cycles;
+            if (!(in >> periodMs >> highMs >> cycles) || highMs >= periodMs) {
+                fprintf(stderr, "waveform:%d: square needs <periodMs> <highMs> <cycles> with highMs < periodMs\n",
+                        lineNumber);
+                return false;
+            }
+            for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+                uint64_t start = at + cycle * periodMs * 1000;
+                events.push_back(Event{start, pin, false, 1});
+                events.push_back(Event{start + highMs * 1000, pin, false, 0});
+            }
+        } else {
+            fprintf(stderr, "waveform:%d: unknown command '%s'\n", lineNumber, command.c_str());
+            return false;
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.micros < b.micros; });
+    return true;
+}
+
+size_t Waveform::applyDue(uint64_t nowMicros, LatencyRecorder& recorder) {
+    size_t applied = 0;
+    while (next < events.size() && events[next].micros <= nowMicros) {
+        const Event& event = events[next++];
+        if (event.analog) {
+            native::setAnalogInput(event.pin, event.value);
+        } else {
+            native::setDigitalInput(event.pin, event.value);
+            // Latency is measured from when the edge was scheduled, so time spent
+            // waiting for the loop to come around counts against the firmware
+            recorder.inputChanged(event.pin, event.value, event.micros);
+        }
+        applied++;
+    }
+    return applied;
+}
@@ -0,0 +1,39 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LatencyRecorder.h"
+
+// Scripted GPIO input. One command per line, times in virtual milliseconds:
+//
+//   probe <inputPin> <outputPin> [rising|falling|both]
+//   <t> set <pin> <0|1>
+//   <t> analog <pin> <value>
+//   <t> square <pin> <periodMs> <highMs> <cycles>
+//
+// Lines starting with '#' are comments.
+class Waveform {
+   public:
+    bool load(const std::string& path, LatencyRecorder& recorder);
+
+    // Drives every event due at or before nowMicros; returns how many were applied
+    size_t applyDue(uint64_t nowMicros, LatencyRecorder& recorder);
+    bool finished() const { return next >= events.size(); }
+    uint64_t endMicros() const { return events.empty() ? 0 : events.back().micros; }
+
+   private:
+    struct Event {
+        uint64_t micros;
+        int pin;
+        bool analog;
+        int value;
+    };
+
+    std::vector<Event> events;
+    size_t next = 0;
+};
+
+#endif  // WAVEFORM_H
@@ -0,0 +1,70 @@
+"""Builds the web UI in web/ into data/www/ for the LittleFS image.
+
+Every file is stored gzip-compressed as <name>.gz and served as is with
+Content-Encoding: gzip. Files other than HTML get a content hash in their
+name, and the HTML refers to them by it, so the device can let browsers
+cache them for a year; HTML is revalidated with its ETag instead.
+
+Runs before every PlatformIO build (extra_scripts = pre:scripts/build_web.py)
+and by hand for the simulator:
+
+    python3 scripts/build_web.py
+    .pio/build/simulator/program --port 8080 --fs data
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+
+def build(project_dir):
+    source = os.path.join(project_dir, "web")
+    target = os.path.join(project_dir, "data", "www")
+    if not os.path.isdir(source):
+        return
+    os.makedirs(target, exist_ok=True)
+
+    names = sorted(n for n in os.listdir(source) if os.path.isfile(os.path.join(source, n)))
+    contents = {}
+    for name in names:
+        with open(os.path.join(source, name), "rb") as f:
+            contents[name] = f.read()
+
+    renamed = {}
+    for name in names:
+        if not name.endswith(".html"):
+            stem, ext = os.path.splitext(name)
+            digest = hashlib.sha1(contents[name]).hexdigest()[:8]
+            renamed[name] = "%s.%s%s" % (stem, digest, ext)
+
+    written = set()
+    total = 0
+    for name in names:
+        data = contents[name]
+        if name.endswith(".html"):
+            text = data.decode("utf-8")
+            for old, new in renamed.items():
+                text = text.replace('"%s"' % old, '"%s"' % new)
+            data = text.encode("utf-8")
+        output = renamed.get(name, name) + ".gz"
+        # mtime 0 keeps the bytes, and so the ETag, the same across builds
+        packed = gzip.compress(data, compresslevel=9, mtime=0)
+        path = os.path.join(target, output)
+        if not os.path.exists(path) or open(path, "rb").read() != packed:
+            with open(path, "wb") as f:
+                f.write(packed)
+        written.add(output)
+        total += len(packed)
+        print("web: %-28s %6d -> %5d bytes" % (output, len(data), len(packed)))
+
+    for stale in set(os.listdir(target)) - written:
+        os.remove(os.path.join(target, stale))
+    print("web: %d bytes in %s" % (total, target))
+
+
+if __name__ == "__main__":
+    build(os.path.dirname(os.path.dirname(os.path.abspath(sys.argv[0]))))
+else:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+    build(env.subst("$PROJECT_DIR"))  # noqa: F821
@@ -0,0 +1,39 @@
+#include "AnalogInput.h"
+
+AnalogInput::AnalogInput(const AnalogSettings& settings) : config(settings), oversampleShift(0) {
+    while ((1u << oversampleShift) < config.oversample) {
+        oversampleShift++;
+    }
+}
+
+bool AnalogInput::read(int pin) {
+    unsigned long now = millis();
+    if (primed && now - lastSample < config.sampleMs) {
+        return state;
+    }
+    // Stay on the sampling grid so one late poll does not make the next sample look early
+    lastSample = primed && now - lastSample < 2UL * config.sampleMs ? lastSample + config.sampleMs : now;
+
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < config.oversample; i++) {
+        sum += analogRead(pin);
+    }
+    int32_t sample = static_cast<int32_t>((sum << kFractionBits) >> oversampleShift);
+    if (sampleHandler) {
+        sampleHandler(static_cast<uint16_t>(sample >> kFractionBits), lastSample);
+    }
+
+    if (!primed || config.emaShift == 0) {
+        filtered = sample;
+        primed = true;
+    } else {
+        filtered += (sample - filtered) / (1 << config.emaShift);
+    }
+
+    if (filtered >= static_cast<int32_t>(config.high) << kFractionBits) {
+        state = true;
+    } else if (filtered <= static_cast<int32_t>(config.low) << kFractionBits) {
+        state = false;
+    }
+    return state;
+}
@@ -0,0 +1,39 @@
+#include "ApiFormat.h"
+
+#include "JsonPool.h"
+
+static bool isMsgPackType(const String& type) {
+    return type.indexOf(MSGPACK_CONTENT_TYPE) >= 0 || type.indexOf("application/x-msgpack") >= 0;
+}
+
+bool ApiFormat::acceptsMsgPack(const HttpRequest* request) {
+    return isMsgPackType(request->header("Accept"));
+}
+
+bool ApiFormat::sentMsgPack(const HttpRequest* request) {
+    return isMsgPackType(request->header("Content-Type"));
+}
+
+// Caches between a gateway and the device must keep the two formats apart
+void ApiFormat::send(HttpRequest* request, int code, JsonVariantConst doc) {
+    request->addHeader("Vary", "Accept");
+    if (acceptsMsgPack(request)) {
+        serializeMsgPack(doc, request->beginResponse(code, MSGPACK_CONTENT_TYPE));
+    } else {
+        serializeJson(doc, request->beginResponse(code, "application/json"));
+    }
+}
+
+void ApiFormat::sendMessage(HttpRequest* request, int code, const char* key, const char* message) {
+    JsonDocument doc(JsonPool::instance());
+    doc[key] = message;
+    send(request, code, doc);
+}
+
+DeserializationError ApiFormat::parseBody(const HttpRequest* request, JsonDocument& doc) {
+    const String& body = request->arg("plain");
+    if (sentMsgPack(request)) {
+        return deserializeMsgPack(doc, body.c_str(), body.length());
+    }
+    return deserializeJson(doc, body);
+}
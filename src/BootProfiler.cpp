@@ -0,0 +1,91 @@
+#include "BootProfiler.h"
+
+#include "JsonPool.h"
+
+namespace {
+
+const char* const kSourceNames[] = {"config", "rtc", "flash"};
+
+}  // namespace
+
+uint32_t BootProfiler::startCycles = 0;
+uint32_t BootProfiler::startUs = 0;
+BootProfiler::Phase BootProfiler::phases[BOOT_MAX_PHASES];
+size_t BootProfiler::phaseCount = 0;
+uint32_t BootProfiler::outputsCycles = 0;
+SnapshotSource BootProfiler::outputsSource = SNAPSHOT_NONE;
+bool BootProfiler::outputsDriven = false;
+
+void BootProfiler::begin() {
+    startCycles = ESP.getCycleCount();
+    startUs = micros();
+    phaseCount = 0;
+    outputsDriven = false;
+}
+
+void BootProfiler::mark(const char* phase) {
+    if (phaseCount < BOOT_MAX_PHASES) {
+        phases[phaseCount++] = Phase{phase, ESP.getCycleCount()};
+    }
+}
+
+void BootProfiler::outputsReady(SnapshotSource source) {
+    if (!outputsDriven) {
+        outputsCycles = ESP.getCycleCount();
+        outputsSource = source;
+        outputsDriven = true;
+    }
+}
+
+uint32_t BootProfiler::sinceResetUs(uint32_t cycles) {
+    return startUs + (cycles - startCycles) / ESP.getCpuFreqMHz();
+}
+
+uint32_t BootProfiler::outputsReadyUs() {
+    return outputsDriven ? sinceResetUs(outputsCycles) : 0;
+}
+
+void BootProfiler::print() {
+    Serial.print("Boot: SDK ");
+    Serial.print(startUs);
+    Serial.print(" us");
+    uint32_t previous = startCycles;
+    for (size_t i = 0; i < phaseCount; i++) {
+        Serial.print(", ");
+        Serial.print(phases[i].name);
+        Serial.print(" ");
+        Serial.print((phases[i].cycles - previous) / ESP.getCpuFreqMHz());
+        Serial.print(" us");
+        previous = phases[i].cycles;
+    }
+    Serial.println();
+    if (outputsDriven) {
+        Serial.print("Outputs ready ");
+        Serial.print(outputsReadyUs());
+        Serial.print(" us after reset, from ");
+        Serial.println(kSourceNames[outputsSource]);
+    }
+}
+
+// {"cpuMHz", "sdkUs", "phases": [{"name", "us", "endUs"}], "setupUs",
+// "outputsReadyUs", "outputsSource"}; times after the SDK are since reset
+void BootProfiler::handleGetBoot(HttpRequest* request) {
+    JsonDocument doc(JsonPool::instance());
+    doc["cpuMHz"] = ESP.getCpuFreqMHz();
+    doc["sdkUs"] = startUs;
+    JsonArray phasesJson = doc["phases"].to<JsonArray>();
+    uint32_t previous = startCycles;
+    for (size_t i = 0; i < phaseCount; i++) {
+        JsonObject phaseJson = phasesJson.add<JsonObject>();
+        phaseJson["name"] = phases[i].name;
+        phaseJson["us"] = (phases[i].cycles - previous) / ESP.getCpuFreqMHz();
+        phaseJson["endUs"] = sinceResetUs(phases[i].cycles);
+        previous = phases[i].cycles;
+    }
+    doc["setupUs"] = (previous - startCycles) / ESP.getCpuFreqMHz();
+    if (outputsDriven) {
+        doc["outputsReadyUs"] = outputsReadyUs();
+        doc["outputsSource"] = kSourceNames[outputsSource];
+    }
+    serializeJson(doc, request->beginResponse(200, "application/json"));
+}
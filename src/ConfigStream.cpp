@@ -0,0 +1,163 @@
+#include "ConfigStream.h"
+
+void ConfigStream::begin() {
+    depth = 0;
+    inString = false;
+    escaped = false;
+    expectKey = false;
+    readingKey = false;
+    key[0] = '\0';
+    keyLength = 0;
+    component.clear();
+    component.reserve(CONFIG_MAX_COMPONENT);
+    componentDepth = 0;
+    sawDevices = false;
+    ended = false;
+    failure = nullptr;
+}
+
+bool ConfigStream::feed(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length && !failure; i++) {
+        consume(static_cast<char>(data[i]));
+    }
+    return !failure;
+}
+
+bool ConfigStream::finish() {
+    if (!failure && (!ended || inString)) {
+        fail("Invalid JSON");
+    } else if (!failure && !sawDevices) {
+        fail("Invalid JSON structure");
+    }
+    std::vector<char>().swap(component);
+    return !failure;
+}
+
+void ConfigStream::fail(const char* message) {
+    if (!failure) {
+        failure = message;
+    }
+    std::vector<char>().swap(component);
+    componentDepth = 0;
+}
+
+void ConfigStream::consume(char c) {
+    if (componentDepth) {
+        if (component.size() >= CONFIG_MAX_COMPONENT) {
+            fail("Component too large");
+            return;
+        }
+        component.push_back(c);
+    }
+
+    if (inString) {
+        if (escaped) {
+            escaped = false;
+        } else if (c == '\\') {
+            escaped = true;
+        } else if (c == '"') {
+            inString = false;
+        } else if (readingKey && keyLength < sizeof(key) - 1) {
+            key[keyLength++] = c;
+            key[keyLength] = '\0';
+        } else if (readingKey) {
+            keyLength = sizeof(key);  // Longer than any key we look for
+        }
+        return;
+    }
+
+    switch (c) {
+        case '"':
+            inString = true;
+            readingKey = expectKey;
+            if (readingKey) {
+                key[0] = '\0';
+                keyLength = 0;
+            }
+            break;
+        case ':':
+            expectKey = false;
+            break;
+        case ',':
+            expectKey = depth > 0 && stack[depth - 1].object;
+            break;
+        case '{':
+        case '[':
+            open(c);
+            break;
+        case '}':
+        case ']':
+            close(c);
+            break;
+        default:
+            break;  // Numbers, literals and whitespace
+    }
+}
+
+// A container's role follows from its parent's and, in an object, the key it is the value of
+void ConfigStream::open(char c) {
+    bool object = c == '{';
+    Role parent = depth ? stack[depth - 1].role : ROLE_OTHER;
+    Role role = ROLE_OTHER;
+    if (depth == CONFIG_MAX_DEPTH) {
+        fail("Config nested too deeply");
+        return;
+    }
+    if (depth == 0) {
+        role = ROLE_ROOT;
+    } else if (parent == ROLE_ROOT && keyIs("devices")) {
+        role = ROLE_DEVICES;
+        sawDevices = true;
+    } else if (parent == ROLE_DEVICES && object) {
+        role = ROLE_DEVICE;
+    } else if (parent == ROLE_DEVICE && keyIs("components")) {
+        role = ROLE_COMPONENTS;
+    } else if (parent == ROLE_COMPONENTS && object) {
+        role = ROLE_COMPONENT;
+    }
+    bool wantsArray = role == ROLE_DEVICES || role == ROLE_COMPONENTS;
+    if ((wantsArray && object) || (role == ROLE_ROOT && (!object || ended))) {
+        fail("Invalid JSON structure");  // "devices" or "components" is not an array, or the root not an object
+        return;
+    }
+
+    stack[depth++] = Level{role, object};
+    expectKey = object;
+    if (role == ROLE_COMPONENT) {
+        componentDepth = depth;
+        component.clear();
+        component.push_back(c);
+    }
+
+    const char* error = nullptr;
+    if (role == ROLE_DEVICE) {
+        error = handler(CONFIG_DEVICE, nullptr, 0);
+    } else if (role == ROLE_COMPONENTS) {
+        error = handler(CONFIG_COMPONENTS, nullptr, 0);
+    }
+    if (error) {
+        fail(error);
+    }
+}
+
+void ConfigStream::close(char c) {
+    if (depth == 0 || stack[depth - 1].object != (c == '}')) {
+        fail("Invalid JSON");
+        return;
+    }
+    Role role = stack[--depth].role;
+    expectKey = false;
+
+    const char* error = nullptr;
+    if (role == ROLE_COMPONENT) {
+        componentDepth = 0;
+        error = handler(CONFIG_COMPONENT, component.data(), component.size());
+    } else if (role == ROLE_DEVICE) {
+        error = handler(CONFIG_DEVICE_END, nullptr, 0);
+    } else if (role == ROLE_ROOT) {
+        ended = true;
+    }
+    if (error) {
+        fail(error);
+    }
+}
@@ -1,214 +1,842 @@
 #include "DeviceManagement.h"
 
-DeviceManager::DeviceManager() {}
+#include <coredecls.h>
+
+#include <algorithm>
+
+#include "ApiFormat.h"
+#include "JsonPool.h"
+#include "TaskDefinitions.h"
+
+// A setting may be left out, but one that is given must be an integer its field can hold
+template <typename T>
+static bool parseSetting(JsonObject json, const char* key, T& value) {
+    JsonVariant field = json[key];
+    if (field.isNull()) {
+        return true;
+    }
+    if (!field.is<T>()) {
+        return false;
+    }
+    value = field.as<T>();
+    return true;
+}
+
+// Reads the optional "analog" object of a component; missing fields keep their defaults
+static bool parseAnalogSettings(JsonObject componentJson, AnalogSettings& settings) {
+    settings = AnalogSettings();
+    JsonVariant analogJson = componentJson["analog"];
+    if (analogJson.isNull()) {
+        return true;
+    }
+    JsonObject json = analogJson.as<JsonObject>();
+    return !json.isNull() && parseSetting(json, "sampleMs", settings.sampleMs) &&
+           parseSetting(json, "oversample", settings.oversample) && parseSetting(json, "emaShift", settings.emaShift) &&
+           parseSetting(json, "high", settings.high) && parseSetting(json, "low", settings.low) && settings.isValid();
+}
+
+static void writeAnalogSettings(JsonObject componentJson, const AnalogSettings& settings) {
+    JsonObject analogJson = componentJson["analog"].to<JsonObject>();
+    analogJson["sampleMs"] = settings.sampleMs;
+    analogJson["oversample"] = settings.oversample;
+    analogJson["emaShift"] = settings.emaShift;
+    analogJson["high"] = settings.high;
+    analogJson["low"] = settings.low;
+}
+
+// Reads the optional "pollMs" of a component; analog inputs default to one poll per sample
+static bool parsePollMs(JsonObject componentJson, ComponentConfig& component) {
+    unsigned long defaultMs = component.componentType == COMPONENT_ANALOG ? component.analog.sampleMs : DEFAULT_POLL_MS;
+    component.pollMs = componentJson["pollMs"] | defaultMs;
+    return component.pollMs > 0 && component.pollMs <= MAX_POLL_MS;
+}
+
+// "groups" is optional; ids are 1-65535, at most COMPONENT_MAX_GROUPS of them
+static bool parseGroups(JsonObject componentJson, ComponentConfig& component) {
+    memset(component.groups, 0, sizeof(component.groups));
+    JsonVariant groupsJson = componentJson["groups"];
+    if (groupsJson.isNull()) {
+        return true;
+    }
+    JsonArray groups = groupsJson.as<JsonArray>();
+    if (groups.isNull() || groups.size() > COMPONENT_MAX_GROUPS) {
+        return false;
+    }
+    size_t slot = 0;
+    for (JsonVariant groupJson : groups) {
+        long group = groupJson | 0L;
+        if (!groupJson.is<long>() || group < 1 || group > 0xFFFF) {
+            memset(component.groups, 0, sizeof(component.groups));
+            return false;
+        }
+        component.groups[slot++] = group;
+    }
+    return true;
+}
+
+static bool inGroup(const ComponentConfig& component, uint16_t group) {
+    if (group == 0) {
+        return true;
+    }
+    for (uint16_t member : component.groups) {
+        if (member == group) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Analog components always drove their action pin with analogWrite; "pwm" opts any component in
+static bool isPwmOutput(const ComponentConfig& component) {
+    return component.actionType == ACTION_PWM || component.componentType == COMPONENT_ANALOG;
+}
+
+// Pulse length of the legacy "pulse" behavior and the default for pulse rules
+static const uint16_t kDefaultPulseMs = 500;
+
+static bool hasBehavior(const ComponentConfig& component, Behavior behavior) {
+    return (component.behaviors & behavior) != 0;
+}
+
+// Legacy behaviors compile to one implicit rule each, with the precedence the old string dispatch had
+static RuleOp manualActionFor(const ComponentConfig& component) {
+    if (hasBehavior(component, BEHAVIOR_TOGGLE)) {
+        return RULE_TOGGLE;
+    } else if (hasBehavior(component, BEHAVIOR_PULSE)) {
+        return RULE_PULSE;
+    } else if (hasBehavior(component, BEHAVIOR_TIMED)) {
+        return RULE_REFRESH;
+    }
+    return RULE_NONE;
+}
+
+// Names of the enums as they appear in the config; index 0 stands for unknown
+static const char* const kComponentTypes[] = {"", "digital", "analog"};
+static const char* const kActionTypes[] = {"", "digital", "pwm"};
+// By bit of Behavior
+static const char* const kBehaviors[] = {"toggle", "pulse", "timed", "scheduled"};
+
+template <size_t N>
+static uint8_t lookupName(const char* const (&table)[N], const char* name) {
+    for (size_t i = 1; i < N; i++) {
+        if (strcmp(table[i], name) == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// Config name of a type; an unknown type keeps the name it was configured with
+template <size_t N>
+static const char* typeName(const StringArena& arena, const char* const (&table)[N], uint8_t type, StringRef unknown) {
+    return type ? table[type] : arena.get(unknown);
+}
+
+static RuleOp parseRuleOp(const String& name) {
+    if (name == "toggle") {
+        return RULE_TOGGLE;
+    } else if (name == "on") {
+        return RULE_ON;
+    } else if (name == "off") {
+        return RULE_OFF;
+    } else if (name == "pulse") {
+        return RULE_PULSE;
+    } else if (name == "follow") {
+        return RULE_FOLLOW;
+    }
+    return RULE_NONE;
+}
+
+// A rule as read from the config, checked before anything is compiled
+struct RuleSpec {
+    uint16_t inputs[RULE_MAX_INPUTS];
+    uint16_t targets[RULE_MAX_TARGETS];
+    uint8_t inputCount = 0;
+    uint8_t targetCount = 0;
+    RuleTrigger trigger = RULE_ON_RISE;
+    RuleOp op = RULE_NONE;
+    uint16_t durationMs = kDefaultPulseMs;
+    bool hasWindow = false;
+    RuleWindow window;
+};
+
+// Resolves a list of component names; false on an unknown name or too many names
+static bool resolveNames(JsonArray names, const std::vector<Device>& devices, const StringArena& arena,
+                         uint16_t* indices, uint8_t& count, uint8_t maxCount) {
+    count = 0;
+    for (JsonVariant name : names) {
+        bool found = false;
+        for (const auto& device : devices) {
+            for (const auto& component : device.components) {
+                if (arena.equals(component.componentName, name | "")) {
+                    found = true;
+                    if (count == maxCount) {
+                        return false;
+                    }
+                    indices[count++] = component.index;
+                    break;
+                }
+            }
+            if (found) {
+                break;
+            }
+        }
+        if (!found) {
+            Serial.print("Unknown component in rule: ");
+            Serial.println(name.as<String>());
+            return false;
+        }
+    }
+    return count > 0;
+}
+
+static bool parseRule(JsonObject ruleJson, const std::vector<Device>& devices, const StringArena& arena,
+                      RuleSpec& rule) {
+    if (!resolveNames(ruleJson["when"].as<JsonArray>(), devices, arena, rule.inputs, rule.inputCount,
+                      RULE_MAX_INPUTS) ||
+        !resolveNames(ruleJson["targets"].as<JsonArray>(), devices, arena, rule.targets, rule.targetCount,
+                      RULE_MAX_TARGETS)) {
+        return false;
+    }
+    rule.op = parseRuleOp(ruleJson["do"].as<String>());
+    String trigger = ruleJson["on"] | "rise";
+    if (trigger == "fall") {
+        rule.trigger = RULE_ON_FALL;
+    } else if (trigger == "change") {
+        rule.trigger = RULE_ON_CHANGE;
+    } else if (trigger != "rise") {
+        return false;
+    }
+    long durationMs = ruleJson["ms"] | static_cast<long>(kDefaultPulseMs);
+    if (durationMs <= 0 || durationMs > 65535) {
+        return false;
+    }
+    rule.durationMs = durationMs;
+    if (ruleJson["schedule"].is<JsonObject>()) {
+        JsonObject scheduleJson = ruleJson["schedule"];
+        rule.hasWindow = true;
+        rule.window.start = scheduleJson["startTime"]["hour"].as<int>() * 60 + scheduleJson["startTime"]["minute"].as<int>();
+        rule.window.end = scheduleJson["endTime"]["hour"].as<int>() * 60 + scheduleJson["endTime"]["minute"].as<int>();
+    }
+    return rule.op != RULE_NONE;
+}
+
+DeviceManager::DeviceManager()
+    : configStream([this](ConfigEvent event, const char* json, size_t length) {
+          return stageEvent(event, json, length);
+      }) {
+    rules.onAction([this](uint16_t target, RuleOp op, bool condition, uint16_t durationMs) {
+        if (target < componentRefs.size()) {
+            ComponentConfig& component = devices[componentRefs[target].device].components[componentRefs[target].component];
+            applyAction(component, component.state, op, condition, durationMs);
+        }
+    });
+}
 
 bool DeviceManager::readDigitalSensor(int pin) {
     return digitalRead(pin) == HIGH;
 }
 
-bool DeviceManager::readAnalogSensor(int pin) {
-    return analogRead(pin) > 512;
+// Staged when a scene is open
+void DeviceManager::controlDigitalActuator(int pin, bool state) {
+    scene.write(pin, state);
+    snapshot.setLevel(pin, state ? 255 : 0);
+    if (outputChangeHandler) {
+        outputChangeHandler();
+    }
 }
 
-void DeviceManager::controlDigitalActuator(int pin, bool state) {
-    digitalWrite(pin, state ? HIGH : LOW);
+// A fade is recorded at its target level
+void DeviceManager::controlAnalogActuator(int pin, uint8_t level, unsigned long fadeMs) {
+    fades.fadeTo(pin, level, fadeMs);
+    snapshot.setLevel(pin, level);
+    if (fades.active()) {
+        taskFade.enableIfNot();
+    }
+    if (outputChangeHandler) {
+        outputChangeHandler();
+    }
 }
 
-void DeviceManager::controlAnalogActuator(int pin, bool state) {
-    analogWrite(pin, state ? 255 : 0);
+// Runs from taskFade, which disables itself once every fade has finished
+bool DeviceManager::updateFades() {
+    return fades.update();
+}
+
+// Runs from taskTelemetry once an input has closed an hour, so the flash
+// writes stay out of the input poll
+void DeviceManager::spillTelemetry() {
+    for (const auto& series : telemetry) {
+        series->spill();
+    }
+}
+
+// Sets actionPin to a level, 0-255; digital outputs are on for any non-zero level
+void DeviceManager::driveOutput(const ComponentConfig& config, uint8_t level, unsigned long fadeMs) {
+    if (config.performAction) {
+        config.performAction(config.actionPin, level, fadeMs);
+    } else {
+        controlDigitalActuator(config.actionPin, level > 0);
+    }
 }
 
 void DeviceManager::toggleDigitalActuator(int pin) {
-    digitalWrite(pin, !digitalRead(pin));
+    controlDigitalActuator(pin, !scene.level(pin));
 }
 
-void DeviceManager::pulseDigitalActuator(int pin, int duration) {
-    digitalWrite(pin, HIGH);
-    delay(duration);
-    digitalWrite(pin, LOW);
+// Switches the output on and leaves switching it off to taskPulse; the
+// snapshot knows before the pin does, so a reset mid-pulse restores it off
+void DeviceManager::startPulse(const ComponentConfig& config, uint16_t durationMs) {
+    snapshot.setPulsing(config.actionPin, true);
+    driveOutput(config, 255);
+    unsigned long offAt = millis() + durationMs;
+    bool pending = false;
+    for (auto& pulse : pulses) {
+        if (pulse.component == config.index) {
+            pulse.offAt = offAt;  // Retriggered, extend
+            pending = true;
+        }
+    }
+    if (!pending) {
+        pulses.push_back({config.index, offAt});
+    }
+    unsigned long now = millis();
+    unsigned long wait = durationMs;
+    for (const auto& pulse : pulses) {
+        wait = std::min(wait, (long)(pulse.offAt - now) > 0 ? pulse.offAt - now : 1UL);
+    }
+    taskPulse.restartDelayed(wait);
+}
+
+// Ends the pulses that are due; returns the ms until the next one ends, or 0 when none is left
+unsigned long DeviceManager::endPulses() {
+    unsigned long now = millis();
+    unsigned long wait = 0;
+    beginScene();
+    for (auto it = pulses.begin(); it != pulses.end();) {
+        if ((long)(now - it->offAt) >= 0) {
+            if (it->component < componentRefs.size()) {
+                const ComponentRef& ref = componentRefs[it->component];
+                const ComponentConfig& component = devices[ref.device].components[ref.component];
+                driveOutput(component, 0);
+                snapshot.setPulsing(component.actionPin, false);
+            }
+            it = pulses.erase(it);
+        } else {
+            wait = wait ? std::min(wait, it->offAt - now) : it->offAt - now;
+            ++it;
+        }
+    }
+    commitScene();
+    return wait;
 }
 
 void DeviceManager::populateFunctionPointers() {
+    std::vector<std::shared_ptr<TelemetrySeries>> previous;
+    previous.swap(telemetry);
     for (auto& device : devices) {
         for (auto& component : device.components) {
-            if (component.componentType == "digital") {
+            if (component.componentType == COMPONENT_DIGITAL) {
                 component.readDevice = [this](int pin) { return this->readDigitalSensor(pin); };
-                component.performAction = [this](int pin, bool state) { this->controlDigitalActuator(pin, state); };
-            } else if (component.componentType == "analog") {
-                component.readDevice = [this](int pin) { return this->readAnalogSensor(pin); };
-                component.performAction = [this](int pin, bool state) { this->controlAnalogActuator(pin, state); };
+            } else if (component.componentType == COMPONENT_ANALOG) {
+                // The component holds the input and its series, so the handlers
+                // capture plain pointers, which keeps them off the heap
+                component.analogInput = std::make_shared<AnalogInput>(component.analog);
+                AnalogInput* input = component.analogInput.get();
+                component.readDevice = [input](int pin) { return input->read(pin); };
+
+                uint32_t id = TelemetrySeries::idOf(nameOf(component));
+                auto kept = std::find_if(previous.begin(), previous.end(),
+                                         [id](const std::shared_ptr<TelemetrySeries>& series) { return series->id() == id; });
+                std::shared_ptr<TelemetrySeries> series =
+                    kept != previous.end() ? *kept : std::make_shared<TelemetrySeries>(nameOf(component), component.analog.sampleMs);
+                series->setSampleMs(component.analog.sampleMs);
+                TelemetrySeries* samples = series.get();
+                input->onSample([samples](uint16_t value, unsigned long at) {
+                    if (samples->add(value, at, TimeManagement::getCurrentTimestamp()) && !taskTelemetry.isEnabled()) {
+                        taskTelemetry.restart();
+                    }
+                });
+                component.telemetry = series;
+                telemetry.push_back(series);
+            }
+            if (isPwmOutput(component)) {
+                component.performAction = [this](int pin, uint8_t level, unsigned long fadeMs) {
+                    this->controlAnalogActuator(pin, level, fadeMs);
+                };
+            } else {
+                component.performAction = [this](int pin, uint8_t level, unsigned long) {
+                    this->controlDigitalActuator(pin, level > 0);
+                };
             }
         }
     }
+    // A renamed or removed input starts over, so its hours on flash would only take up room
+    for (const auto& series : previous) {
+        if (std::find(telemetry.begin(), telemetry.end(), series) == telemetry.end()) {
+            series->removeFiles();
+        }
+    }
+    buildPollBuckets();
+}
+
+// Groups components by pollMs. All buckets start due now, so a bucket whose
+// period is a multiple of another's always comes due on the same pass.
+void DeviceManager::buildPollBuckets() {
+    pollBuckets.clear();
+    unsigned long now = millis();
+    for (size_t d = 0; d < devices.size(); d++) {
+        for (size_t c = 0; c < devices[d].components.size(); c++) {
+            const ComponentConfig& component = devices[d].components[c];
+            if (!component.readDevice) {
+                continue;  // Unknown componentType, nothing to read
+            }
+            auto bucket = std::lower_bound(pollBuckets.begin(), pollBuckets.end(), component.pollMs,
+                                           [](const PollBucket& b, unsigned long period) { return b.periodMs < period; });
+            if (bucket == pollBuckets.end() || bucket->periodMs != component.pollMs) {
+                bucket = pollBuckets.insert(bucket, PollBucket{component.pollMs, now, {}});
+            }
+            bucket->members.push_back({static_cast<uint16_t>(d), static_cast<uint16_t>(c)});
+        }
+    }
+}
+
+std::vector<int> DeviceManager::inputPins() const {
+    std::vector<int> pins;
+    for (const auto& device : devices) {
+        for (const auto& component : device.components) {
+            if (component.componentType == COMPONENT_DIGITAL) {
+                pins.push_back(component.componentPin);
+            }
+        }
+    }
+    return pins;
+}
+
+void DeviceManager::pollNow() {
+    unsigned long now = millis();
+    for (auto& bucket : pollBuckets) {
+        bucket.nextDue = now;
+    }
+}
+
+size_t DeviceManager::componentCount() const {
+    size_t count = 0;
+    for (const auto& device : devices) {
+        count += device.components.size();
+    }
+    return count;
+}
+
+uint32_t DeviceManager::stateHash() const {
+    uint32_t crc = 0xffffffff;
+    for (const auto& device : devices) {
+        for (const auto& component : device.components) {
+            const char* name = nameOf(component);
+            uint8_t output[2] = {static_cast<uint8_t>(component.actionPin), 0};
+            if (isPwmOutput(component)) {
+                output[1] = fades.target(component.actionPin);
+            } else {
+                output[1] = digitalRead(component.actionPin) == HIGH ? 255 : 0;
+            }
+            crc = crc32(name, strlen(name) + 1, crc);
+            crc = crc32(output, sizeof(output), crc);
+        }
+    }
+    return crc;
 }
 
 void DeviceManager::handleManualBehavior(const ComponentConfig& config, ComponentState& state) {
-    if (std::find(config.behaviors.begin(), config.behaviors.end(), "toggle") != config.behaviors.end()) {
-        toggleDigitalActuator(config.actionPin);
-        state.updateState(!state.currentState);
-        state.updateManualOverride(true);
-    } else if (std::find(config.behaviors.begin(), config.behaviors.end(), "pulse") != config.behaviors.end()) {
-        pulseDigitalActuator(config.actionPin, 500);
-    } else if (std::find(config.behaviors.begin(), config.behaviors.end(), "timed") != config.behaviors.end()) {
-        controlDigitalActuator(config.actionPin, state.currentState);
-        state.updateState(state.currentState);
+    applyAction(config, state, config.manualAction, true, kDefaultPulseMs);
+}
+
+void DeviceManager::applyAction(const ComponentConfig& config, ComponentState& state, RuleOp op, bool condition,
+                                uint16_t durationMs) {
+    switch (op) {
+        case RULE_TOGGLE:
+            if (isPwmOutput(config)) {
+                driveOutput(config, state.currentState ? 0 : 255);
+            } else {
+                toggleDigitalActuator(config.actionPin);
+            }
+            state.level = state.currentState ? 0 : 255;
+            state.updateState(!state.currentState);
+            state.updateManualOverride(true);
+            break;
+        case RULE_ON:
+        case RULE_OFF:
+        case RULE_FOLLOW: {
+            bool on = op == RULE_ON || (op == RULE_FOLLOW && condition);
+            driveOutput(config, on ? 255 : 0);
+            state.level = on ? 255 : 0;
+            state.updateState(on);
+            state.updateManualOverride(true);
+            break;
+        }
+        case RULE_PULSE:
+            startPulse(config, durationMs);
+            break;
+        case RULE_REFRESH:
+            driveOutput(config, state.currentState ? 255 : 0);
+            state.updateState(state.currentState);
+            break;
+        case RULE_NONE:
+            break;
+    }
+}
+
+// Indexes the components, then compiles their behaviors and the config's rules.
+// Nothing changes unless every rule is valid.
+bool DeviceManager::compileRules(JsonArray rulesJson) {
+    std::vector<ComponentRef> refs;
+    for (size_t d = 0; d < devices.size(); d++) {
+        for (size_t c = 0; c < devices[d].components.size(); c++) {
+            devices[d].components[c].index = refs.size();
+            devices[d].components[c].manualAction = manualActionFor(devices[d].components[c]);
+            refs.push_back({static_cast<uint16_t>(d), static_cast<uint16_t>(c)});
+        }
+    }
+
+    std::vector<RuleSpec> specs;
+    for (JsonObject ruleJson : rulesJson) {
+        RuleSpec spec;
+        if (!parseRule(ruleJson, devices, names, spec)) {
+            Serial.print("Invalid rule #");
+            Serial.println(specs.size());
+            return false;
+        }
+        specs.push_back(spec);
+    }
+
+    componentRefs = refs;
+    pulses.clear();
+    rules.begin(refs.size());
+    for (const auto& device : devices) {
+        for (const auto& component : device.components) {
+            if (component.manualAction != RULE_NONE) {
+                rules.addRule(&component.index, 1, &component.index, 1, RULE_ON_RISE, component.manualAction,
+                              kDefaultPulseMs);
+            }
+        }
     }
+    for (const auto& spec : specs) {
+        if (!rules.addRule(spec.inputs, spec.inputCount, spec.targets, spec.targetCount, spec.trigger, spec.op,
+                           spec.durationMs, spec.hasWindow ? &spec.window : nullptr)) {
+            Serial.println("Rule tables full, the rest are ignored");
+            break;
+        }
+    }
+    rules.end();
+    Serial.print("Compiled rules: ");
+    Serial.println(rules.ruleCount());
+    return true;
 }
 
 void DeviceManager::handleScheduledBehavior(const ComponentConfig& config, ComponentState& state) {
-    if (std::find(config.behaviors.begin(), config.behaviors.end(), "scheduled") != config.behaviors.end() && !state.manualOverride) {
-        controlDigitalActuator(config.actionPin, state.scheduledState);
+    if (hasBehavior(config, BEHAVIOR_SCHEDULED) && !state.manualOverride) {
+        driveOutput(config, state.scheduledState ? 255 : 0);
+        state.level = state.scheduledState ? 255 : 0;
         state.updateState(state.scheduledState);
     }
 }
 
-// Method to load configuration from LittleFS
-void DeviceManager::loadConfig() {
-    Serial.println("Loading config from LittleFS...");
+// The fields every component has; names go into the arena
+void DeviceManager::parseComponent(JsonObject componentJson, ComponentConfig& component, StringArena& arena) {
+    const char* type = componentJson["componentType"] | "";
+    const char* action = componentJson["actionType"] | "";
+    component.componentName = arena.intern(componentJson["componentName"] | "");
+    component.componentType = static_cast<ComponentType>(lookupName(kComponentTypes, type));
+    component.componentTypeName = component.componentType ? 0 : arena.intern(type);
+    component.componentPin = componentJson["componentPin"];
+    component.actionType = static_cast<ActionType>(lookupName(kActionTypes, action));
+    component.actionTypeName = component.actionType ? 0 : arena.intern(action);
+    component.actionPin = componentJson["actionPin"];
+
+    component.behaviors = 0;
+    for (JsonVariant behaviorJson : componentJson["behaviors"].as<JsonArray>()) {
+        const char* behavior = behaviorJson | "";
+        uint8_t bits = component.behaviors;
+        for (size_t bit = 0; bit < sizeof(kBehaviors) / sizeof(kBehaviors[0]); bit++) {
+            if (strcmp(kBehaviors[bit], behavior) == 0) {
+                component.behaviors |= 1 << bit;
+            }
+        }
+        if (bits == component.behaviors) {
+            Serial.print("Ignoring unknown behavior ");
+            Serial.println(behavior);
+        }
+    }
+}
 
-    // Read the configuration file
-    String configFile = readFile("/config.json");
+void DeviceManager::writeComponent(JsonObject componentJson, const ComponentConfig& component) const {
+    componentJson["componentName"] = nameOf(component);
+    componentJson["componentType"] = typeName(names, kComponentTypes, component.componentType, component.componentTypeName);
+    componentJson["componentPin"] = component.componentPin;
+    componentJson["actionType"] = typeName(names, kActionTypes, component.actionType, component.actionTypeName);
+    componentJson["actionPin"] = component.actionPin;
+
+    JsonArray behaviorsJson = componentJson["behaviors"].to<JsonArray>();
+    for (size_t bit = 0; bit < sizeof(kBehaviors) / sizeof(kBehaviors[0]); bit++) {
+        if (component.behaviors & (1 << bit)) {
+            behaviorsJson.add(kBehaviors[bit]);
+        }
+    }
+}
 
-    // Print the configuration file content
-    Serial.println("Config File Content:");
-    Serial.println(configFile);
+// Method to load configuration from LittleFS. The file goes through the
+// same stream as an upload, so a config too big to parse whole still boots;
+// settings out of range fall back to their defaults instead of failing.
+void DeviceManager::loadConfig() {
+    Serial.println("Loading config from LittleFS...");
 
-    // Define a JsonDocumentan appropriate size
-    JsonDocument doc;  // Adjust size as needed
-    DeserializationError error = deserializeJson(doc, configFile);
-    if (error) {
+    File file = LittleFS.open(CONFIG_FILE, "r");
+    if (!file) {
         Serial.println("Failed to read config file");
-        Serial.println(error.c_str());
         return;
     }
 
-    // Print the entire parsed JSON document
-    serializeJson(doc, Serial);
-    Serial.println();
+    beginStaging(false);
+    uint8_t buffer[128];
+    size_t length;
+    while ((length = file.read(buffer, sizeof(buffer))) > 0) {
+#if CONFIG_DUMP
+        Serial.write(buffer, length);
+#endif
+        if (!configStream.feed(buffer, length)) {
+            break;
+        }
+    }
+    file.close();
 
-    // Get the array of devices from the JSON document
-    JsonArray devicesJsonArray = doc["devices"].as<JsonArray>();
-    if (devicesJsonArray.isNull()) {
-        Serial.println("Invalid config structure");
+    const char* error = configStream.finish() ? commitStaged(CONFIG_FILE) : configStream.error();
+    if (error) {
+        Serial.println("Failed to read config file");
+        Serial.println(error);
         return;
     }
+    Serial.println("Config loaded from LittleFS.");
+}
 
-    // Clear the current devices vector to prepare for new configuration
-    devices.clear();
+void DeviceManager::beginStaging(bool strict) {
+    staged.clear();
+    stagedNames.clear();
+    stagingStrict = strict;
+    configStream.begin();
+}
 
-    // Loop through each device in the JSON array and populate the devices vector
-    for (JsonObject deviceJson : devicesJsonArray) {
-        Device device;
+// Builds the staged config from the stream's events while the live one keeps running
+const char* DeviceManager::stageEvent(ConfigEvent event, const char* json, size_t length) {
+    switch (event) {
+        case CONFIG_DEVICE:
+            staged.emplace_back();
+            stagedComponents = false;
+            return nullptr;
+        case CONFIG_COMPONENTS:
+            stagedComponents = true;
+            return nullptr;
+        case CONFIG_COMPONENT: {
+            JsonDocument doc(JsonPool::instance());
+            DeserializationError error = deserializeJson(doc, json, length);
+            if (error) {
+                Serial.print("JSON deserialization failed: ");
+                Serial.println(error.c_str());
+                return "Invalid JSON";
+            }
+            return stageComponent(doc.as<JsonObject>());
+        }
+        case CONFIG_DEVICE_END: {
+            if (stagingStrict && !stagedComponents) {
+                Serial.println("Invalid JSON structure: 'components' is not an array");
+                return "Invalid JSON structure";
+            }
+            std::vector<ComponentConfig>& components = staged.back().components;
+            components.shrink_to_fit();
+            Serial.print("Added device with components: ");
+            for (const auto& component : components) {
+                Serial.print(stagedNames.get(component.componentName));
+                Serial.print(" ");
+            }
+            Serial.println();
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
 
-        // Loop through each component for the device
-        for (JsonObject componentJson : deviceJson["components"].as<JsonArray>()) {
-            ComponentConfig component;
-            component.componentName = componentJson["componentName"].as<String>();
-            component.componentType = componentJson["componentType"].as<String>();
-            component.componentPin = componentJson["componentPin"];
-            component.actionType = componentJson["actionType"].as<String>();
-            component.actionPin = componentJson["actionPin"];
+// Strict for uploads; a config already on flash keeps what it can
+const char* DeviceManager::stageComponent(JsonObject componentJson) {
+    if (stagingStrict && (!componentJson.containsKey("componentName") ||
+                          !componentJson.containsKey("componentType") ||
+                          !componentJson.containsKey("componentPin") ||
+                          !componentJson.containsKey("actionType") ||
+                          !componentJson.containsKey("actionPin") ||
+                          !componentJson.containsKey("behaviors"))) {
+        Serial.println("Error: JSON missing fields");
+        return "Missing fields";
+    }
 
-            // Add behaviors to the configuration
-            for (JsonVariant behavior : componentJson["behaviors"].as<JsonArray>()) {
-                component.behaviors.push_back(behavior.as<String>());
-            }
+    // Config
+    ComponentConfig component;
+    parseComponent(componentJson, component, stagedNames);
+    const char* name = stagedNames.get(component.componentName);
+
+    // Schedule
+    if (componentJson["schedule"].is<JsonObject>()) {
+        JsonObject scheduleJson = componentJson["schedule"];
+        component.schedule.startHour = scheduleJson["startTime"]["hour"];
+        component.schedule.startMinute = scheduleJson["startTime"]["minute"];
+        component.schedule.endHour = scheduleJson["endTime"]["hour"];
+        component.schedule.endMinute = scheduleJson["endTime"]["minute"];
+    } else if (stagingStrict && hasBehavior(component, BEHAVIOR_SCHEDULED)) {
+        Serial.println("Error: Invalid schedule format");
+        return "Invalid schedule format";
+    }
 
-            // Add schedule if it exists
-            if (componentJson.containsKey("schedule")) {
-                JsonObject scheduleJson = componentJson["schedule"];
-                component.schedule.startHour = scheduleJson["startTime"]["hour"];
-                component.schedule.startMinute = scheduleJson["startTime"]["minute"];
-                component.schedule.endHour = scheduleJson["endTime"]["hour"];
-                component.schedule.endMinute = scheduleJson["endTime"]["minute"];
-            }
+    // Analog sampling
+    if (!parseAnalogSettings(componentJson, component.analog)) {
+        if (stagingStrict) {
+            Serial.println("Error: Invalid analog settings");
+            return "Invalid analog settings";
+        }
+        Serial.print("Invalid analog settings, using defaults for ");
+        Serial.println(name);
+        component.analog = AnalogSettings();
+    }
 
-            // Initialize the component state
-            component.state = ComponentState();
+    component.gamma = componentJson["gamma"] | false;
 
-            // Add the component to the device's components vector
-            device.components.push_back(component);
+    // Group control
+    if (!parseGroups(componentJson, component)) {
+        if (stagingStrict) {
+            Serial.println("Error: Invalid groups");
+            return "Invalid groups";
         }
+        Serial.print("Invalid groups, ignoring them for ");
+        Serial.println(name);
+    }
 
-        // Add the device to the devices vector
-        devices.push_back(device);
+    // Polling
+    if (!parsePollMs(componentJson, component)) {
+        if (stagingStrict) {
+            Serial.println("Error: Invalid pollMs");
+            return "Invalid pollMs";
+        }
+        Serial.print("Invalid pollMs, using the default for ");
+        Serial.println(name);
+        componentJson.remove("pollMs");
+        parsePollMs(componentJson, component);
     }
 
-    Serial.println("Config loaded from LittleFS.");
+    staged.back().components.push_back(std::move(component));
+    return nullptr;
 }
 
-// Method to save configuration to LittleFS
-void DeviceManager::saveConfig(JsonDocument& doc) {
-    Serial.println("Saving config to LittleFS...");
-    JsonArray devicesJsonArray = doc["devices"].to<JsonArray>();
-
-    for (const auto& device : devices) {
-        JsonObject deviceJson = devicesJsonArray.add<JsonObject>();
-
-        JsonArray componentsJsonArray = deviceJson["components"].to<JsonArray>();
-        for (const auto& component : device.components) {
-            JsonObject componentJson = componentsJsonArray.add<JsonObject>();
-            componentJson["componentName"] = component.componentName;
-            componentJson["componentType"] = component.componentType;
-            componentJson["componentPin"] = component.componentPin;
-            componentJson["actionType"] = component.actionType;
-            componentJson["actionPin"] = component.actionPin;
-
-            JsonArray behaviorsJsonArray = componentJson["behaviors"].to<JsonArray>();
-            for (const auto& behavior : component.behaviors) {
-                behaviorsJsonArray.add(behavior);
-            }
+// Swaps the staged config in and compiles the rules, read back from the
+// config text at path with everything else filtered out. The text is parsed
+// whole here, so this also catches malformed JSON outside the components.
+// Nothing changes on an error.
+const char* DeviceManager::commitStaged(const char* path) {
+    // Backup current configuration; moved rather than copied, so the backup allocates nothing
+    std::vector<Device> backupDevices = std::move(devices);
+    StringArena backupNames = std::move(names);
+    // Staging grew these as components streamed in; trimmed to exact blocks now the total is known
+    devices = std::move(staged);
+    devices.shrink_to_fit();
+    names = std::move(stagedNames);
+    names.shrinkToFit();
+    staged.clear();
+    stagedNames.clear();
+    auto restoreBackup = [&]() {
+        devices = std::move(backupDevices);
+        names = std::move(backupNames);
+    };
+
+    JsonDocument filter(JsonPool::instance());
+    filter["rules"] = true;
+    JsonDocument doc(JsonPool::instance());
+    File file = LittleFS.open(path, "r");
+    DeserializationError error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
+    file.close();
+    if (error) {
+        Serial.print("JSON deserialization failed: ");
+        Serial.println(error.c_str());
+        restoreBackup();
+        return "Invalid JSON";
+    }
 
-            if (std::find(component.behaviors.begin(), component.behaviors.end(), "scheduled") != component.behaviors.end()) {
-                JsonObject scheduleJson = componentJson["schedule"].to<JsonObject>();
-                scheduleJson["startTime"]["hour"] = component.schedule.startHour;
-                scheduleJson["startTime"]["minute"] = component.schedule.startMinute;
-                scheduleJson["endTime"]["hour"] = component.schedule.endHour;
-                scheduleJson["endTime"]["minute"] = component.schedule.endMinute;
-            }
+    if (!compileRules(doc["rules"].as<JsonArray>())) {
+        if (stagingStrict) {
+            Serial.println("Error: Invalid rules");
+            restoreBackup();
+            return "Invalid rules";
         }
+        Serial.println("Invalid rules, keeping only component behaviors");
+        compileRules(JsonArray());
     }
+    return nullptr;
+}
 
-    // Convert the document to JsonObject
-    JsonObject jsonObject = doc.as<JsonObject>();
-
-    // Save the JSON object to the file
-    bool result = writeFileJson("/config.json", jsonObject);
-    if (result) {
-        Serial.println("Config saved to LittleFS.");
-    } else {
-        Serial.println("Failed to save config to LittleFS.");
+// RTC memory after a reset, or /outputs.bin with every output off after a power cycle
+bool DeviceManager::restoreOutputs(SnapshotSource from) {
+    bool loaded = from == SNAPSHOT_RTC ? snapshot.loadRtc() : snapshot.loadFile();
+    if (!loaded) {
+        return false;
     }
+    analogWriteRange(PWM_RANGE);
+    for (const OutputEntry& entry : snapshot) {
+        uint8_t level = entry.flags & OUTPUT_PULSE ? 0 : entry.level;
+        pinMode(entry.pin, OUTPUT);
+        if (entry.flags & OUTPUT_PWM) {
+            fades.attach(entry.pin, entry.flags & OUTPUT_GAMMA, level);
+        } else {
+            digitalWrite(entry.pin, level ? HIGH : LOW);
+        }
+    }
+    restoring = true;
+    return true;
 }
 
 void DeviceManager::configureDevices() {
     Serial.println("Configuring devices...");
+    analogWriteRange(PWM_RANGE);
+    fades.clear();
+    OutputSnapshot restored = snapshot;
+    snapshot.clear();
     for (auto& device : devices) {
         for (auto& component : device.components) {
             Serial.print("Component ");
-            Serial.print(component.componentName);  // Print the component name for better identification
+            Serial.print(nameOf(component));  // Print the component name for better identification
             Serial.print(": componentPin=");
             Serial.print(component.componentPin);
             Serial.print(", actionPin=");
             Serial.print(component.actionPin);
             Serial.print(", componentType=");
-            Serial.print(component.componentType);
+            Serial.print(typeName(names, kComponentTypes, component.componentType, component.componentTypeName));
             Serial.print(", actionType=");
-            Serial.println(component.actionType);
+            Serial.println(typeName(names, kActionTypes, component.actionType, component.actionTypeName));
+
+            // A pin restored with the same output type keeps its level, anything
+            // else starts off, as does a pin that was on for a pulse
+            uint8_t flags = (isPwmOutput(component) ? OUTPUT_PWM : 0) | (component.gamma ? OUTPUT_GAMMA : 0);
+            const OutputEntry* entry = restoring ? restored.find(component.actionPin) : nullptr;
+            uint8_t level = entry && entry->flags == flags ? entry->level : 0;  // OUTPUT_PULSE never matches
 
             pinMode(component.componentPin, INPUT);
             pinMode(component.actionPin, OUTPUT);
-            if (component.componentType == "digital") {
-                digitalWrite(component.actionPin, LOW);
-            } else if (component.componentType == "analog") {
-                analogWrite(component.actionPin, 0);
+            if (isPwmOutput(component)) {
+                fades.attach(component.actionPin, component.gamma, level);
+            } else {
+                digitalWrite(component.actionPin, level ? HIGH : LOW);
             }
+            snapshot.add(component.actionPin, level, flags);
 
             // Initialize the component state
             component.state = ComponentState();
+            component.state.level = level;
+            component.state.currentState = level > 0;
 
             Serial.print("Initialized component state for component ");
-            Serial.print(component.componentName);
+            Serial.print(nameOf(component));
             Serial.print(": currentState=");
             Serial.print(component.state.currentState);
             Serial.print(", scheduledState=");
@@ -217,24 +845,31 @@ void DeviceManager::configureDevices() {
             Serial.println(component.state.manualOverride);
         }
     }
+    restoring = false;
+    snapshot.saveRtc();
+    snapshot.saveFile();
     Serial.println("Devices configured.");
+    if (outputChangeHandler) {
+        outputChangeHandler();
+    }
 }
 
 void DeviceManager::checkScheduler() {
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) {
+    const struct tm* timeinfo = TimeManagement::localTime();
+    if (!timeinfo) {
         Serial.println("Failed to obtain time");
         return;
     }
 
-    int currentHour = timeinfo.tm_hour;
-    int currentMinute = timeinfo.tm_min;
+    int currentHour = timeinfo->tm_hour;
+    int currentMinute = timeinfo->tm_min;
 
+    beginScene();  // Everything switching on this edge switches at once
     for (auto& device : devices) {
         for (auto& component : device.components) {
             auto& state = component.state;
 
-            if (std::find(component.behaviors.begin(), component.behaviors.end(), "scheduled") != component.behaviors.end()) {
+            if (hasBehavior(component, BEHAVIOR_SCHEDULED)) {
                 bool isInSchedule =
                     (currentHour > component.schedule.startHour ||
                      (currentHour == component.schedule.startHour && currentMinute >= component.schedule.startMinute)) &&
@@ -244,8 +879,9 @@ void DeviceManager::checkScheduler() {
                 if (isInSchedule != state.scheduledState) {
                     state.scheduledState = isInSchedule;
                     state.manualOverride = false;
-                    controlDigitalActuator(component.actionPin, state.scheduledState);
+                    driveOutput(component, state.scheduledState ? 255 : 0);
                     state.currentState = state.scheduledState;
+                    state.level = state.scheduledState ? 255 : 0;
                     Serial.println(state.scheduledState
                                        ? "Component turned ON based on schedule"
                                        : "Component turned OFF based on schedule");
@@ -253,181 +889,238 @@ void DeviceManager::checkScheduler() {
             }
         }
     }
+    commitScene();
 }
 
 bool DeviceManager::shouldHandleManualBehavior(const ComponentConfig& config, const ComponentState& state) {
     // Add specific conditions to decide if manual behavior should be handled
-    if (std::find(config.behaviors.begin(), config.behaviors.end(), "toggle") != config.behaviors.end()) {
+    if (hasBehavior(config, BEHAVIOR_TOGGLE)) {
         // Example condition: manual override not already active
         return !state.manualOverride;
-    } else if (std::find(config.behaviors.begin(), config.behaviors.end(), "pulse") != config.behaviors.end()) {
+    } else if (hasBehavior(config, BEHAVIOR_PULSE)) {
         // Example condition: some other specific condition
         return true;  // Adjust as needed
-    } else if (std::find(config.behaviors.begin(), config.behaviors.end(), "timed") != config.behaviors.end()) {
+    } else if (hasBehavior(config, BEHAVIOR_TIMED)) {
         // Example condition: another specific condition
         return true;  // Adjust as needed
     }
     return false;  // Default to not handling if no conditions are met
 }
 
-void DeviceManager::readSensorsAndHandleBehaviors() {
-    for (auto& device : devices) {
-        for (auto& component : device.components) {
-            bool sensorState = component.readDevice(component.componentPin);
+void DeviceManager::pollComponent(ComponentConfig& component) {
+    bool sensorState = component.readDevice(component.componentPin);
 
-            if (sensorState != component.state.previousSensorState) {  // Edge detection
-                if (sensorState) {  // Only act on rising edge
-                    handleManualBehavior(component, component.state);
-                }
-                component.state.previousSensorState = sensorState;  // Update previous state
-            }
+    if (sensorState != component.state.previousSensorState) {  // Edge detection
+        rules.setInput(component.index, sensorState);
+        component.state.previousSensorState = sensorState;  // Update previous state
+    }
+}
+
+// Polls the buckets that are due and returns the milliseconds until the next
+// one is, so taskReadSensors only wakes when some input needs sampling.
+unsigned long DeviceManager::readSensorsAndHandleBehaviors() {
+    unsigned long now = millis();
+    for (auto& bucket : pollBuckets) {
+        if ((long)(now - bucket.nextDue) < 0) {
+            continue;
+        }
+        for (const auto& member : bucket.members) {
+            pollComponent(devices[member.device].components[member.component]);
+        }
+        // Periods missed while the loop was blocked are dropped, not caught up
+        bucket.nextDue += ((now - bucket.nextDue) / bucket.periodMs + 1) * bucket.periodMs;
+    }
+    beginScene();
+    rules.evaluate();  // One pass over the rules of inputs that changed
+    commitScene();
+
+    unsigned long wait = MAX_POLL_MS;
+    for (const auto& bucket : pollBuckets) {
+        if ((long)(now - bucket.nextDue) >= 0) {
+            return 0;
         }
+        wait = std::min(wait, bucket.nextDue - now);
     }
+    return wait;
 }
 
-void DeviceManager::handleConfig(ESP8266WebServer* server) {
-    Serial.println("Handling /config request...");
-    if (!server->hasArg("plain")) {
-        server->send(400, "application/json", "{\"error\":\"No body\"}");
+// The body streams to CONFIG_UPLOAD_FILE and through the config stream as
+// it arrives, so neither the text nor a document of all of it is ever in
+// RAM. A MessagePack body is rewritten as JSON text on the way, so the file
+// and the staging are the same for both. An upload whose client goes away
+// is discarded; a new one takes over from an upload still in progress.
+void DeviceManager::handleConfigBody(HttpRequest* request, const uint8_t* data, size_t len, size_t index,
+                                     size_t) {
+    if (index == 0) {
+        Serial.println("Receiving /config upload...");
+        uploader = request;
+        request->onDisconnect([this, request]() {
+            if (uploader == request) {
+                Serial.println("Config upload abandoned");
+                discardUpload();
+            }
+        });
+        beginStaging(true);
+        uploadMsgPack = ApiFormat::sentMsgPack(request);
+        if (uploadMsgPack) {
+            uploadDecoder.begin(uploadText);
+        }
+        upload = LittleFS.open(CONFIG_UPLOAD_FILE, "w");
+        if (!upload) {
+            configStream.fail("Failed to save config");
+        }
+    }
+    if (request != uploader || configStream.error()) {
         return;
     }
-
-    String body = server->arg("plain");
-    Serial.print("Request body: ");
-    Serial.println(body);
-
-    JsonDocument doc;  // Adjust size as needed
-    DeserializationError error = deserializeJson(doc, body);
-    if (error) {
-        server->send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
-        Serial.print("JSON deserialization failed: ");
-        Serial.println(error.c_str());
+    if (!uploadMsgPack) {
+        storeUpload(data, len);
         return;
     }
+    bool decoded = uploadDecoder.feed(data, len);
+    uploadText.flush();
+    if (!decoded) {
+        configStream.fail("Invalid MessagePack");
+    }
+}
 
-    // Backup current configuration
-    auto backupDevices = devices;
-
-    devices.clear();
-
-    JsonArray devicesArray = doc["devices"].as<JsonArray>();
-    if (devicesArray.isNull()) {
-        server->send(400, "application/json", "{\"error\":\"Invalid JSON structure\"}");
-        Serial.println("Invalid JSON structure: 'devices' is not an array");
-        devices = backupDevices;  // Restore backup
+void DeviceManager::storeUpload(const uint8_t* data, size_t len) {
+    if (configStream.error()) {
         return;
     }
+#if CONFIG_DUMP
+    Serial.write(data, len);
+#endif
+    if (upload.write(data, len) != len) {
+        configStream.fail("Failed to save config");
+        return;
+    }
+    configStream.feed(data, len);
+}
 
-    for (JsonObject deviceJson : devicesArray) {
-        Device newDevice;
-
-        JsonArray componentsArray = deviceJson["components"].as<JsonArray>();
-        if (componentsArray.isNull()) {
-            server->send(400, "application/json", "{\"error\":\"Invalid JSON structure\"}");
-            Serial.println("Invalid JSON structure: 'components' is not an array");
-            devices = backupDevices;  // Restore backup
-            return;
-        }
-
-        for (JsonObject componentJson : componentsArray) {
-            ComponentConfig component;
-            if (!componentJson.containsKey("componentName") ||
-                !componentJson.containsKey("componentType") ||
-                !componentJson.containsKey("componentPin") ||
-                !componentJson.containsKey("actionType") ||
-                !componentJson.containsKey("actionPin") ||
-                !componentJson.containsKey("behaviors")) {
-                server->send(400, "application/json", "{\"error\":\"Missing fields\"}");
-                Serial.println("Error: JSON missing fields");
-                devices = backupDevices;  // Restore backup
-                return;
-            }
-
-            // Config
-            component.componentName = componentJson["componentName"].as<String>();
-            component.componentType = componentJson["componentType"].as<String>();
-            component.componentPin = componentJson["componentPin"];
-            component.actionType = componentJson["actionType"].as<String>();
-            component.actionPin = componentJson["actionPin"];
-            for (String behavior : componentJson["behaviors"].as<JsonArray>()) {
-                component.behaviors.push_back(behavior);
-            }
+// Drops a partial upload: the staged config, the open file and the file itself
+void DeviceManager::discardUpload() {
+    uploader = nullptr;
+    upload.close();
+    staged.clear();
+    stagedNames.clear();
+    LittleFS.remove(CONFIG_UPLOAD_FILE);
+}
 
-            // Schedule
-            if (std::find(component.behaviors.begin(), component.behaviors.end(), "scheduled") != component.behaviors.end()) {
-                if (!componentJson["schedule"].is<JsonObject>()) {
-                    server->send(400, "application/json", "{\"error\":\"Invalid schedule format\"}");
-                    Serial.println("Error: Invalid schedule format");
-                    devices = backupDevices;  // Restore backup
-                    return;
-                }
-                JsonObject scheduleJson = componentJson["schedule"];
-                component.schedule.startHour = scheduleJson["startTime"]["hour"];
-                component.schedule.startMinute = scheduleJson["startTime"]["minute"];
-                component.schedule.endHour = scheduleJson["endTime"]["hour"];
-                component.schedule.endMinute = scheduleJson["endTime"]["minute"];
-            }
+size_t DeviceManager::UploadText::write(uint8_t c) {
+    if (used == sizeof(buffer)) {
+        flush();
+    }
+    buffer[used++] = c;
+    return 1;
+}
 
-            newDevice.components.push_back(component);
-        }
+void DeviceManager::UploadText::flush() {
+    manager.storeUpload(buffer, used);
+    used = 0;
+}
 
-        devices.push_back(newDevice);
+void DeviceManager::handleConfig(HttpRequest* request) {
+    Serial.println("Handling /config request...");
+    if (request != uploader) {
+        ApiFormat::sendMessage(request, 400, "error", "No body");
+        return;
+    }
+    uploader = nullptr;
+    upload.close();
 
-        Serial.print("Added device with components: ");
-        for (const auto& component : newDevice.components) {
-            Serial.print(component.componentName);
-            Serial.print(" ");
-        }
-        Serial.println();
+    if (uploadMsgPack && !configStream.error() && !uploadDecoder.finish()) {
+        configStream.fail("Invalid MessagePack");
+    }
+    const char* error = configStream.finish() ? commitStaged(CONFIG_UPLOAD_FILE) : configStream.error();
+    if (error) {
+        discardUpload();
+        ApiFormat::sendMessage(request, 400, "error", error);
+        Serial.print("Config rejected: ");
+        Serial.println(error);
+        return;
+    }
+    if (LittleFS.rename(CONFIG_UPLOAD_FILE, CONFIG_FILE)) {
+        Serial.println("Config saved to LittleFS.");
+    } else {
+        Serial.println("Failed to save config to LittleFS.");
     }
 
-    saveConfig(doc);
     configureDevices();
     populateFunctionPointers();
-    server->send(200, "application/json", "{\"status\":\"Config updated\"}");
+    taskReadSensors.forceNextIteration();  // New buckets are due now, not when the old schedule wakes
+    ApiFormat::sendMessage(request, 200, "status", "Config updated");
     Serial.println("Config updated successfully.");
 }
 
-void DeviceManager::handleControl(ESP8266WebServer* server) {
+// What /control and group control do to one component; either way it is now under manual control
+void DeviceManager::controlComponent(ComponentConfig& component, bool direct, uint8_t level, unsigned long fadeMs) {
+    component.state.updateManualOverride(true);
+    if (direct) {
+        driveOutput(component, level, fadeMs);
+        component.state.level = level;
+        component.state.updateState(level > 0);
+    } else {
+        handleManualBehavior(component, component.state);
+    }
+}
+
+size_t DeviceManager::controlGroup(uint16_t group, bool direct, uint8_t level, unsigned long fadeMs) {
+    size_t count = 0;
+    beginScene();
+    for (auto& device : devices) {
+        for (auto& component : device.components) {
+            if (inGroup(component, group)) {
+                controlComponent(component, direct, level, fadeMs);
+                count++;
+            }
+        }
+    }
+    commitScene();
+    return count;
+}
+
+void DeviceManager::handleControl(HttpRequest* request) {
     Serial.println("Handling /control request...");
-    if (!server->hasArg("plain")) {
-        server->send(400, "application/json", "{\"error\":\"No body\"}");
+    if (!request->hasArg("plain")) {
+        ApiFormat::sendMessage(request, 400, "error", "No body");
         return;
     }
 
-    String body = server->arg("plain");
-    Serial.print("Request body: ");
-    Serial.println(body);
-
-    JsonDocument doc;  // Adjust size as needed
-    DeserializationError error = deserializeJson(doc, body);
+    JsonDocument doc(JsonPool::instance());
+    DeserializationError error = ApiFormat::parseBody(request, doc);
     if (error) {
-        server->send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
-        Serial.println("Invalid JSON");
+        const char* message = ApiFormat::sentMsgPack(request) ? "Invalid MessagePack" : "Invalid JSON";
+        ApiFormat::sendMessage(request, 400, "error", message);
+        Serial.println(message);
         return;
     }
+    Serial.print("Request body: ");
+    serializeJson(doc, Serial);  // As JSON whichever format it came in
+    Serial.println();
 
-    String componentName = doc["componentName"];
-    String action = doc["action"];
+    // Point into the document instead of copying to the heap
+    const char* componentName = doc["componentName"] | "";
+    const char* action = doc["action"] | "";
     bool state = doc["state"];
+    // "level" (0-255) takes precedence over "state"; "fadeMs" applies to PWM outputs
+    long level = doc["level"] | (state ? 255L : 0L);
+    unsigned long fadeMs = doc["fadeMs"] | 0UL;
+    if (level < 0 || level > 255 || fadeMs > FADE_MAX_MS) {
+        ApiFormat::sendMessage(request, 400, "error", "Invalid level or fadeMs");
+        Serial.println("Invalid level or fadeMs");
+        return;
+    }
 
     bool componentFound = false;
 
     // Loop through the devices to find the component with the matching name
     for (auto& device : devices) {
         for (auto& component : device.components) {
-            if (component.componentName == componentName) {
+            if (names.equals(component.componentName, componentName)) {
                 componentFound = true;
-                // Perform the control action on the component
-                if (action == "control") {
-                    if (component.componentType == "digital") {
-                        controlDigitalActuator(component.componentPin, state);
-                    } else if (component.componentType == "analog") {
-                        controlAnalogActuator(component.componentPin, state);
-                    }
-                }
-                component.state.updateManualOverride(true);
-                handleManualBehavior(component, component.state);
+                // "control" sets the output directly; any other action runs the component's behavior
+                controlComponent(component, strcmp(action, "control") == 0, level, fadeMs);
                 break;
             }
         }
@@ -437,17 +1130,81 @@ void DeviceManager::handleControl(ESP8266WebServer* server) {
     }
 
     if (componentFound) {
-        server->send(200, "application/json", "{\"status\":\"Action performed\"}");
+        ApiFormat::sendMessage(request, 200, "status", "Action performed");
         Serial.println("Action performed successfully.");
     } else {
-        server->send(400, "application/json", "{\"error\":\"Invalid component name\"}");
+        ApiFormat::sendMessage(request, 400, "error", "Invalid component name");
         Serial.println("Invalid component name");
     }
 }
 
-void DeviceManager::handleGetDevices(ESP8266WebServer* server) {
+void DeviceManager::handleGetTelemetry(HttpRequest* request) {
+    Serial.println("Handling /telemetry request...");
+    TelemetryResolution resolution = TELEMETRY_MINUTE;
+    if (request->hasArg("resolution") &&
+        !TelemetrySeries::parseResolution(request->arg("resolution").c_str(), resolution)) {
+        ApiFormat::sendMessage(request, 400, "error", "Invalid resolution");
+        return;
+    }
+    // Seconds as in TimeManagement::getCurrentTimestamp(); by default all there is
+    unsigned long from = strtoul(request->arg("from").c_str(), nullptr, 10);
+    unsigned long to = request->hasArg("to") ? strtoul(request->arg("to").c_str(), nullptr, 10)
+                                             : TimeManagement::getCurrentTimestamp() + 1;
+    if (from >= to) {
+        ApiFormat::sendMessage(request, 400, "error", "Invalid range");
+        return;
+    }
+
+    String componentName = request->arg("component");
+    const ComponentConfig* found = nullptr;
+    for (const auto& device : devices) {
+        for (const auto& component : device.components) {
+            if (!found && names.equals(component.componentName, componentName.c_str())) {
+                found = &component;
+            }
+        }
+    }
+    if (!found) {
+        ApiFormat::sendMessage(request, 400, "error", "Invalid component name");
+        return;
+    }
+    if (!found->telemetry) {
+        ApiFormat::sendMessage(request, 400, "error", "Not an analog component");
+        return;
+    }
+
+    // The points are printed as the response goes out, so a long range never sits in RAM
+    JsonDocument doc(JsonPool::instance());
+    doc["component"] = componentName;
+    doc["resolution"] = TelemetrySeries::resolutionName(resolution);
+    if (resolution == TELEMETRY_RAW) {
+        doc["sampleMs"] = found->telemetry->sampleMs();
+    }
+    doc["from"] = from;
+    doc["to"] = to;
+    String head;
+    serializeJson(doc, head);
+    head.remove(head.length() - 1);
+    head += ",\"points\":[";
+
+    std::shared_ptr<TelemetryCursor> cursor =
+        std::make_shared<TelemetryCursor>(found->telemetry, resolution, from, to);
+    request->beginStream(200, "application/json", [cursor, head](Print& out) mutable {
+        if (head.length()) {
+            out.print(head);
+            head = String();
+        }
+        if (cursor->print(out)) {
+            return true;
+        }
+        out.print("]}");
+        return false;
+    });
+}
+
+void DeviceManager::handleGetDevices(HttpRequest* request) {
     Serial.println("Handling /devices request...");
-    JsonDocument doc;
+    JsonDocument doc(JsonPool::instance());
     JsonArray devicesArray = doc["devices"].to<JsonArray>();
 
     for (const auto& device : devices) {
@@ -456,16 +1213,7 @@ void DeviceManager::handleGetDevices(ESP8266WebServer* server) {
 
         for (const auto& component : device.components) {
             JsonObject componentJson = componentsArray.add<JsonObject>();
-            componentJson["componentName"] = component.componentName;
-            componentJson["componentType"] = component.componentType;
-            componentJson["componentPin"] = component.componentPin;
-            componentJson["actionType"] = component.actionType;
-            componentJson["actionPin"] = component.actionPin;
-
-            JsonArray behaviorsArray = componentJson["behaviors"].to<JsonArray>();
-            for (const auto& behavior : component.behaviors) {
-                behaviorsArray.add(behavior);
-            }
+            writeComponent(componentJson, component);
 
             JsonObject scheduleJson = componentJson["schedule"].to<JsonObject>();
             scheduleJson["startTime"]["hour"] = component.schedule.startHour;
@@ -473,15 +1221,36 @@ void DeviceManager::handleGetDevices(ESP8266WebServer* server) {
             scheduleJson["endTime"]["hour"] = component.schedule.endHour;
             scheduleJson["endTime"]["minute"] = component.schedule.endMinute;
 
+            componentJson["pollMs"] = component.pollMs;
+            if (component.componentType == COMPONENT_ANALOG) {
+                writeAnalogSettings(componentJson, component.analog);
+            }
+            // Analog inputs drive their output with PWM whatever their actionType, so clients go by this
+            bool pwm = isPwmOutput(component);
+            componentJson["pwm"] = pwm;
+            if (pwm) {
+                componentJson["gamma"] = component.gamma;
+            }
+            if (component.groups[0]) {
+                JsonArray groupsJson = componentJson["groups"].to<JsonArray>();
+                for (uint16_t group : component.groups) {
+                    if (group) {
+                        groupsJson.add(group);
+                    }
+                }
+            }
+
             JsonObject stateJson = componentJson["state"].to<JsonObject>();
             stateJson["currentState"] = component.state.currentState;
             stateJson["scheduledState"] = component.state.scheduledState;
             stateJson["manualOverride"] = component.state.manualOverride;
+            stateJson["outputLevel"] = component.state.level;
+            if (component.analogInput) {
+                stateJson["level"] = component.analogInput->level();
+            }
         }
     }
 
-    String response;
-    serializeJson(doc, response);
-    server->send(200, "application/json", response);
+    ApiFormat::send(request, 200, doc);
     Serial.println("Device configurations and states sent.");
 }
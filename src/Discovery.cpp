@@ -0,0 +1,43 @@
+#include "Discovery.h"
+
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+
+char Discovery::host[sizeof(DISCOVERY_HOST_PREFIX) + 8] = "";
+size_t Discovery::componentCount = 0;
+uint32_t Discovery::stateHash = 0;
+char Discovery::stateText[9] = "00000000";
+
+void Discovery::begin(uint16_t port) {
+    snprintf(host, sizeof(host), DISCOVERY_HOST_PREFIX "%06x", ESP.getChipId());
+    WiFi.hostname(host);
+    if (!MDNS.begin(host)) {
+        Serial.println("Error starting mDNS");
+        return;
+    }
+
+    MDNSResponder::hMDNSService service = MDNS.addService(nullptr, "intellios", "tcp", port);
+    MDNS.addServiceTxt(service, "fw", FIRMWARE_VERSION);
+    // Added to each answer as it is built, so they are never stale
+    MDNS.setDynamicServiceTxtCallback(service, [](const MDNSResponder::hMDNSService service) {
+        MDNS.addDynamicServiceTxt(service, "components", static_cast<uint32_t>(componentCount));
+        MDNS.addDynamicServiceTxt(service, "state", stateText);
+    });
+
+    Serial.print("Address: http://");
+    Serial.print(host);
+    Serial.println(".local");
+}
+
+bool Discovery::update(size_t components, uint32_t state) {
+    if (components == componentCount && state == stateHash) {
+        return false;
+    }
+    componentCount = components;
+    stateHash = state;
+    snprintf(stateText, sizeof(stateText), "%08x", stateHash);
+    if (MDNS.isRunning()) {
+        MDNS.announce();
+    }
+    return true;
+}
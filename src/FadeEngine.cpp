@@ -0,0 +1,118 @@
+#include "FadeEngine.h"
+
+FadeEngine::FadeEngine() {
+    // Gamma 2.2, computed once so fades only need integer maths
+    for (int i = 0; i <= 256; i++) {
+        float x = i < 256 ? i / 255.0f : 1.0f;
+        gammaTable[i] = static_cast<uint16_t>(powf(x, 2.2f) * PWM_RANGE + 0.5f);
+    }
+}
+
+FadeEngine::Output* FadeEngine::find(int pin) {
+    for (auto& output : outputs) {
+        if (output.pin == pin) {
+            return &output;
+        }
+    }
+    return nullptr;
+}
+
+const FadeEngine::Output* FadeEngine::find(int pin) const {
+    return const_cast<FadeEngine*>(this)->find(pin);
+}
+
+void FadeEngine::attach(int pin, bool gamma, uint8_t level) {
+    Output* output = find(pin);
+    if (!output) {
+        outputs.push_back(Output());
+        output = &outputs.back();
+    } else if (output->fading) {
+        activeFades--;
+    }
+    uint16_t current = level << 8;
+    *output = Output{pin, gamma, current, current, current, 0, 0, 0, false};
+    write(*output, true);
+}
+
+void FadeEngine::clear() {
+    outputs.clear();
+    activeFades = 0;
+}
+
+void FadeEngine::fadeTo(int pin, uint8_t level, unsigned long durationMs) {
+    Output* output = find(pin);
+    if (!output) {
+        return;
+    }
+    uint16_t target = level << 8;
+    if (durationMs == 0 || target == output->current) {
+        if (output->fading) {
+            output->fading = false;
+            activeFades--;
+        }
+        output->current = target;
+        write(*output, durationMs == 0);
+        return;
+    }
+    if (!output->fading) {
+        output->fading = true;
+        activeFades++;
+    }
+    output->from = output->current;
+    output->to = target;
+    output->start = millis();
+    output->duration = durationMs < FADE_MAX_MS ? durationMs : FADE_MAX_MS;
+}
+
+bool FadeEngine::update() {
+    if (activeFades == 0) {
+        return false;
+    }
+    unsigned long now = millis();
+    for (auto& output : outputs) {
+        if (!output.fading) {
+            continue;
+        }
+        unsigned long elapsed = now - output.start;
+        if (elapsed >= output.duration) {
+            output.current = output.to;
+            output.fading = false;
+            activeFades--;
+        } else {
+            // Q15 fraction of the fade; the product of a Q8 level delta and it fits in 31 bits
+            int32_t fraction = static_cast<int32_t>((elapsed << 15) / output.duration);
+            int32_t delta = static_cast<int32_t>(output.to) - output.from;
+            output.current = static_cast<uint16_t>(output.from + ((delta * fraction) >> 15));
+        }
+        write(output, false);
+    }
+    return activeFades > 0;
+}
+
+uint8_t FadeEngine::level(int pin) const {
+    const Output* output = find(pin);
+    return output ? output->current >> 8 : 0;
+}
+
+uint8_t FadeEngine::target(int pin) const {
+    const Output* output = find(pin);
+    return output ? (output->fading ? output->to : output->current) >> 8 : 0;
+}
+
+uint16_t FadeEngine::pwmValue(const Output& output) const {
+    if (!output.gamma) {
+        return static_cast<uint16_t>((static_cast<uint32_t>(output.current) * PWM_RANGE + (255 << 7)) / (255 << 8));
+    }
+    // Interpolate between table entries with the fractional byte of the level
+    uint16_t low = gammaTable[output.current >> 8];
+    uint16_t high = gammaTable[(output.current >> 8) + 1];
+    return low + (((high - low) * (output.current & 0xFF)) >> 8);
+}
+
+void FadeEngine::write(Output& output, bool force) {
+    uint16_t value = pwmValue(output);
+    if (force || value != output.written) {
+        analogWrite(output.pin, value);
+        output.written = value;
+    }
+}
@@ -9,12 +9,8 @@ bool writeFileJson(const char* path, JsonObject& jsonObj) {
         return false;
     }
 
-    // Serialize JSON object to string
-    String jsonString;
-    serializeJson(jsonObj, jsonString);
-
-    // Write JSON string to the file
-    if (file.print(jsonString)) {
+    // Serialize straight into the file, without a copy of the whole document in RAM
+    if (serializeJson(jsonObj, file) == measureJson(jsonObj)) {
         file.close();
         return true;
     } else {
@@ -0,0 +1,66 @@
+#include "GpioScene.h"
+
+#include <esp8266_peri.h>
+
+void GpioScene::write(uint8_t pin, bool level) {
+    if (!open()) {
+        digitalWrite(pin, level ? HIGH : LOW);
+        return;
+    }
+    if (pin < 16) {
+        uint32_t bit = 1u << pin;
+        setMask = level ? setMask | bit : setMask & ~bit;
+        clearMask = level ? clearMask & ~bit : clearMask | bit;
+    } else if (pin == 16) {
+        gpio16 = level;
+    } else {
+        for (auto& other : others) {
+            if (other.pin == pin) {
+                other.level = level;
+                return;
+            }
+        }
+        others.push_back({pin, level});
+    }
+}
+
+bool GpioScene::level(uint8_t pin) const {
+    if (pin < 16 && ((setMask | clearMask) & (1u << pin))) {
+        return setMask & (1u << pin);
+    }
+    if (pin == 16 && gpio16 >= 0) {
+        return gpio16;
+    }
+    for (const auto& other : others) {
+        if (other.pin == pin) {
+            return other.level;
+        }
+    }
+    return digitalRead(pin) == HIGH;
+}
+
+void GpioScene::commit() {
+    if (depth == 0 || --depth > 0) {
+        return;
+    }
+    if (setMask) {
+        GPOS = setMask;
+    }
+    if (clearMask) {
+        GPOC = clearMask;
+    }
+    if (gpio16 >= 0) {
+        if (gpio16) {
+            GP16O |= 1;
+        } else {
+            GP16O &= ~1;
+        }
+    }
+    for (const auto& other : others) {
+        digitalWrite(other.pin, other.level ? HIGH : LOW);
+    }
+    setMask = 0;
+    clearMask = 0;
+    gpio16 = -1;
+    others.clear();
+}
@@ -0,0 +1,129 @@
+#include "GroupControl.h"
+
+#include <algorithm>
+
+static uint16_t readU16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+static uint32_t readU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+           static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+static void writeU16(uint8_t* data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value;
+}
+
+static void writeU32(uint8_t* data, uint32_t value) {
+    writeU16(data, value >> 16);
+    writeU16(data + 2, value);
+}
+
+bool GroupControl::begin() {
+    IPAddress address;
+    address.fromString(GROUP_MULTICAST_ADDRESS);
+    if (!udp.listenMulticast(address, GROUP_PORT)) {
+        Serial.println("Group control failed to listen");
+        return false;
+    }
+    udp.onPacket([this](AsyncUDPPacket& packet) { onPacket(packet); });
+    Serial.print("Group control on ");
+    Serial.print(GROUP_MULTICAST_ADDRESS);
+    Serial.print(":");
+    Serial.println(GROUP_PORT);
+    return true;
+}
+
+bool GroupControl::decode(const uint8_t* data, size_t length, GroupFrame& frame) {
+    if (length < GROUP_FRAME_SIZE || data[0] != 'I' || data[1] != 'G' || data[2] != GROUP_VERSION) {
+        return false;
+    }
+    frame.op = static_cast<GroupOp>(data[3]);
+    frame.group = readU16(data + 4);
+    frame.seq = readU32(data + 6);
+    frame.level = data[10];
+    frame.flags = data[11];
+    frame.fadeMs = readU16(data + 12);
+    return frame.op == GROUP_OP_SET || frame.op == GROUP_OP_ACTION || frame.op == GROUP_OP_ACK;
+}
+
+size_t GroupControl::encode(const GroupFrame& frame, uint8_t* data) {
+    data[0] = 'I';
+    data[1] = 'G';
+    data[2] = GROUP_VERSION;
+    data[3] = frame.op;
+    writeU16(data + 4, frame.group);
+    writeU32(data + 6, frame.seq);
+    data[10] = frame.level;
+    data[11] = frame.flags;
+    writeU16(data + 12, frame.fadeMs);
+    return GROUP_FRAME_SIZE;
+}
+
+// lwIP context: only checks and copies the frame; loop() applies it
+void GroupControl::onPacket(AsyncUDPPacket& packet) {
+    GroupFrame frame;
+    if (!decode(packet.data(), packet.length(), frame) || frame.op == GROUP_OP_ACK) {
+        droppedCount++;
+        return;
+    }
+    if (queued == GROUP_QUEUE_SIZE) {
+        droppedCount++;
+        return;
+    }
+    queue[(head + queued) % GROUP_QUEUE_SIZE] = Pending{frame, packet.remoteIP(), packet.remotePort()};
+    queued = queued + 1;
+    receivedCount++;
+    if (activityHandler) {
+        activityHandler();
+    }
+}
+
+const GroupControl::Recent* GroupControl::findRecent(uint32_t sender, uint32_t seq) const {
+    for (size_t i = 0; i < recentCount; i++) {
+        if (recent[i].sender == sender && recent[i].seq == seq) {
+            return &recent[i];
+        }
+    }
+    return nullptr;
+}
+
+void GroupControl::handlePackets() {
+    while (queued > 0) {
+        Pending pending = queue[head];
+        head = (head + 1) % GROUP_QUEUE_SIZE;
+        queued = queued - 1;
+
+        const GroupFrame& frame = pending.frame;
+        uint8_t reached;
+        const Recent* seen = findRecent(pending.sender, frame.seq);
+        if (seen) {
+            duplicateCount++;
+            reached = seen->reached;
+        } else {
+            unsigned long fadeMs = std::min<unsigned long>(frame.fadeMs, FADE_MAX_MS);
+            size_t count = devices.controlGroup(frame.group, frame.op == GROUP_OP_SET, frame.level, fadeMs);
+            reached = std::min<size_t>(count, 255);
+            recent[recentNext] = Recent{pending.sender, frame.seq, reached};
+            recentNext = (recentNext + 1) % GROUP_RECENT_FRAMES;
+            recentCount = std::min<size_t>(recentCount + 1, GROUP_RECENT_FRAMES);
+        }
+        if (frame.flags & GROUP_FLAG_ACK) {
+            sendAck(pending, reached);
+        }
+    }
+}
+
+// Unicast to the sender's address and port
+void GroupControl::sendAck(const Pending& pending, uint8_t reached) {
+    GroupFrame ack = pending.frame;
+    ack.op = GROUP_OP_ACK;
+    ack.level = reached;
+    ack.flags = 0;
+    ack.fadeMs = 0;
+    uint8_t data[GROUP_ACK_SIZE];
+    writeU32(data + encode(ack, data), ESP.getChipId());
+    udp.writeTo(data, sizeof(data), pending.sender, pending.port);
+}
@@ -0,0 +1,681 @@
+#include "HttpServer.h"
+
+namespace {
+
+const size_t kMaxHeaders = 32;
+
+String urlDecode(const String& text) {
+    String decoded;
+    for (unsigned int i = 0; i < text.length(); i++) {
+        char c = text[i];
+        if (c == '+') {
+            decoded += ' ';
+        } else if (c == '%' && i + 2 < text.length()) {
+            decoded += static_cast<char>(strtol(text.substring(i + 1, i + 3).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += c;
+        }
+    }
+    return decoded;
+}
+
+void parseArgs(const String& query, std::vector<std::pair<String, String>>& args) {
+    unsigned int start = 0;
+    while (start < query.length()) {
+        int end = query.indexOf('&', start);
+        if (end < 0) {
+            end = query.length();
+        }
+        String pair = query.substring(start, end);
+        int equals = pair.indexOf('=');
+        if (equals < 0) {
+            args.push_back(std::make_pair(urlDecode(pair), String()));
+        } else {
+            args.push_back(std::make_pair(urlDecode(pair.substring(0, equals)), urlDecode(pair.substring(equals + 1))));
+        }
+        start = end + 1;
+    }
+}
+
+HttpMethod parseMethod(const String& method) {
+    if (method == "GET") return HTTP_GET;
+    if (method == "HEAD") return HTTP_HEAD;
+    if (method == "POST") return HTTP_POST;
+    if (method == "PUT") return HTTP_PUT;
+    if (method == "PATCH") return HTTP_PATCH;
+    if (method == "DELETE") return HTTP_DELETE;
+    if (method == "OPTIONS") return HTTP_OPTIONS;
+    return HTTP_ANY;
+}
+
+const char* reasonPhrase(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "";
+    }
+}
+
+const String emptyString;
+
+}  // namespace
+
+bool HttpRequest::hasArg(const String& name) const {
+    if (name == "plain") {
+        return !formBody && body.length() > 0;
+    }
+    for (const auto& arg : args) {
+        if (arg.first == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const String& HttpRequest::arg(const String& name) const {
+    if (name == "plain") {
+        return formBody ? emptyString : body;
+    }
+    for (const auto& arg : args) {
+        if (arg.first == name) {
+            return arg.second;
+        }
+    }
+    return emptyString;
+}
+
+bool HttpRequest::hasHeader(const String& name) const {
+    for (const auto& header : headers) {
+        if (header.first.equalsIgnoreCase(name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const String& HttpRequest::header(const String& name) const {
+    for (const auto& header : headers) {
+        if (header.first.equalsIgnoreCase(name)) {
+            return header.second;
+        }
+    }
+    return emptyString;
+}
+
+void HttpRequest::addHeader(const String& name, const String& value) {
+    responseHeaders.reserve(responseHeaders.length() + name.length() + value.length() + 4);
+    responseHeaders += name;
+    responseHeaders += ": ";
+    responseHeaders += value;
+    responseHeaders += "\r\n";
+}
+
+void HttpRequest::send(int code, const char* contentType, const String& content) {
+    beginResponse(code, contentType);
+    responseBody = content;
+}
+
+Print& HttpRequest::beginResponse(int code, const char* contentType) {
+    responseCode = code;
+    responseType = contentType ? contentType : "";
+    responseBody = String();
+    responseStream.restart();
+    responseFiller = nullptr;
+    responseLength = -1;
+    return responseStream;
+}
+
+void HttpRequest::beginStream(int code, const char* contentType, HttpFiller filler, long length) {
+    beginResponse(code, contentType);
+    responseFiller = filler;
+    responseLength = length;
+}
+
+bool HttpRequest::ResponseBody::grow(size_t size) {
+    size_t needed = target.length() + size;
+    if (needed <= reserved) {
+        return true;
+    }
+    reserved = needed * 2 < 128 ? 128 : needed * 2;
+    return target.reserve(reserved);
+}
+
+void HttpRequest::reset() {
+    requestMethod = HTTP_ANY;
+    requestUrl = String();
+    args.clear();
+    headers.clear();
+    body = String();
+    formBody = false;
+    responseCode = 0;
+    responseType = String();
+    responseHeaders = String();
+    responseBody = String();
+    responseStream.restart();
+    responseFiller = nullptr;
+    responseLength = -1;
+    disconnectHandler = nullptr;
+}
+
+HttpServer::HttpServer(uint16_t port) : tcpServer(port) {}
+
+HttpServer::~HttpServer() {
+    tcpServer.end();
+    for (Connection* connection : incoming) {
+        connections.push_back(connection);
+    }
+    for (Connection* connection : connections) {
+        if (!connection->disconnected) {
+            connection->client->onDisconnect(nullptr);
+            delete connection->client;
+        }
+        delete connection;
+    }
+}
+
+void HttpServer::on(const char* uri, HttpMethod method, HttpHandler handler, HttpBodyHandler bodyHandler) {
+    routes.push_back(Route{uri, method, handler, bodyHandler});
+}
+
+void HttpServer::begin() {
+    tcpServer.onClient([this](void*, AsyncClient* client) { accept(client); }, nullptr);
+    tcpServer.setNoDelay(true);
+    tcpServer.begin();
+}
+
+// Runs in lwIP context: only bookkeeping that cannot race with handleClients().
+// The client waits in incoming until admit() gives it a slot
+void HttpServer::accept(AsyncClient* client) {
+    Connection* connection = new Connection();
+    connection->client = client;
+    connection->server = this;
+    client->setNoDelay(true);
+    client->setRxTimeout(HTTP_KEEP_ALIVE_TIMEOUT);
+    client->onData(
+        [](void* arg, AsyncClient* c, void* data, size_t len) {
+            Connection* connection = static_cast<Connection*>(arg);
+            connection->received.concat(static_cast<const char*>(data), len);
+            c->ackLater();  // The window reopens as handleClients() consumes the bytes
+            if (connection->server->activityHandler) {
+                connection->server->activityHandler();
+            }
+        },
+        connection);
+    client->onTimeout(
+        [](void* arg, AsyncClient* c, uint32_t) {
+            Connection* connection = static_cast<Connection*>(arg);
+            if (connection->waiting) {
+                return;  // Its bytes wait unread, so it has not gone quiet
+            }
+            if (connection->state == REQUEST_LINE && connection->received.length() == 0) {
+                c->close();  // Idle keep-alive
+            } else if (connection->state == REQUEST_LINE || connection->state == HEADERS ||
+                       connection->state == BODY) {
+                c->close(true);  // A client that stopped sending mid-request
+            }
+        },
+        connection);
+    client->onDisconnect(
+        [](void* arg, AsyncClient* c) {
+            static_cast<Connection*>(arg)->disconnected = true;
+            delete c;
+        },
+        connection);
+    incoming.push_back(connection);
+    if (activityHandler) {
+        activityHandler();
+    }
+}
+
+// Lets waiting clients in, in the order they connected, as slots free up
+void HttpServer::admit() {
+    for (auto it = incoming.begin(); it != incoming.end();) {
+        if ((*it)->disconnected) {
+            delete *it;
+            it = incoming.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (!incoming.empty() && (connectionCount() < HTTP_MAX_CONNECTIONS || evictIdle())) {
+        Connection* connection = incoming.front();
+        incoming.erase(incoming.begin());
+        connection->waiting = false;
+        connection->idleSince = millis();
+        connections.push_back(connection);
+    }
+}
+
+// Makes room for a waiting client by closing, with a FIN, a keep-alive
+// connection that has sat between requests for HTTP_EVICT_IDLE_MS; its client
+// reconnects for the next one
+bool HttpServer::evictIdle() {
+    unsigned long now = millis();
+    for (Connection* connection : connections) {
+        if (!connection->disconnected && connection->state == REQUEST_LINE && connection->received.length() == 0 &&
+            now - connection->idleSince >= HTTP_EVICT_IDLE_MS) {
+            connection->state = CLOSING;
+            connection->client->close();
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t HttpServer::connectionCount() const {
+    size_t count = 0;
+    for (const Connection* connection : connections) {
+        count += connection->disconnected || connection->state == CLOSING ? 0 : 1;
+    }
+    return count;
+}
+
+// Connections waiting for more bytes from their client are not busy; the
+// bytes arriving raise onActivity instead
+bool HttpServer::busy() const {
+    if (!incoming.empty()) {
+        return true;
+    }
+    for (const Connection* connection : connections) {
+        if (connection->disconnected || connection->state == READY || connection->state == RESPONDING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpServer::handleClients() {
+    admit();
+
+    // Rotate which connection may run a handler first so a busy client cannot starve the others
+    bool dispatched = false;
+    size_t count = connections.size();
+    size_t first = nextDispatch;
+    for (size_t i = 0; i < count; i++) {
+        Connection* connection = connections[(first + i) % count];
+        if (!connection->disconnected && advance(connection, !dispatched)) {
+            dispatched = true;
+            nextDispatch = (first + i + 1) % count;
+        }
+    }
+
+    for (auto it = connections.begin(); it != connections.end();) {
+        if ((*it)->disconnected) {
+            abandon(*it);
+            delete *it;
+            it = connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Parses whatever has arrived and pushes out pending response bytes; returns
+// true if a handler ran
+bool HttpServer::advance(Connection* connection, bool mayDispatch) {
+    while (true) {
+        switch (connection->state) {
+            case REQUEST_LINE:
+            case HEADERS:
+            case CHUNK_SIZE:
+            case CHUNK_TRAILER: {
+                int end = connection->received.indexOf('\n');
+                if (end < 0) {
+                    if (connection->received.length() > HTTP_MAX_LINE) {
+                        fail(connection, 431);
+                        break;
+                    }
+                    return false;
+                }
+                // Copied into a buffer the connection keeps, not a new String per line
+                String& line = connection->line;
+                line.remove(0);
+                line.concat(connection->received.c_str(),
+                            end > 0 && connection->received[end - 1] == '\r' ? end - 1 : end);
+                consume(connection, end + 1);
+                if (connection->state == REQUEST_LINE) {
+                    if (line.length() > 0 && !parseRequestLine(connection, line)) {
+                        fail(connection, 400);
+                    }
+                } else if (connection->state == CHUNK_SIZE) {
+                    if (line.length() > 0) {  // Empty: the CRLF that ends the previous chunk
+                        parseChunkSize(connection, line);
+                    }
+                } else if (connection->state == CHUNK_TRAILER) {
+                    if (line.length() == 0) {
+                        bodyComplete(connection);
+                    }
+                } else if (line.length() == 0) {
+                    headersComplete(connection);
+                } else if (connection->request.headers.size() >= kMaxHeaders) {
+                    fail(connection, 431);
+                } else {
+                    parseHeader(connection, line);
+                }
+                break;
+            }
+            case BODY: {
+                size_t left = connection->chunked ? connection->chunkLeft
+                                                  : connection->contentLength - connection->bodyReceived;
+                size_t length = connection->received.length();
+                if (length > left) {
+                    length = left;
+                }
+                if (length == 0) {
+                    return false;
+                }
+                if (connection->route && connection->route->bodyHandler) {
+                    connection->route->bodyHandler(&connection->request,
+                                                   reinterpret_cast<const uint8_t*>(connection->received.c_str()),
+                                                   length, connection->bodyReceived,
+                                                   connection->chunked ? 0 : connection->contentLength);
+                } else {
+                    connection->request.body.concat(connection->received.c_str(), length);
+                }
+                connection->bodyReceived += length;
+                consume(connection, length);
+                if (connection->chunked) {
+                    connection->chunkLeft -= length;
+                    if (connection->chunkLeft == 0) {
+                        connection->state = CHUNK_SIZE;
+                    }
+                } else if (connection->bodyReceived == connection->contentLength) {
+                    bodyComplete(connection);
+                }
+                break;
+            }
+            case READY:
+                if (!mayDispatch) {
+                    return false;
+                }
+                dispatch(connection);
+                pump(connection);
+                return true;
+            case RESPONDING:
+                if (!pump(connection)) {
+                    return false;
+                }
+                break;
+            case CLOSING:
+                return false;
+        }
+    }
+}
+
+bool HttpServer::parseRequestLine(Connection* connection, const String& line) {
+    int firstSpace = line.indexOf(' ');
+    int secondSpace = line.indexOf(' ', firstSpace + 1);
+    if (firstSpace <= 0 || secondSpace <= firstSpace + 1) {
+        return false;
+    }
+    String version = line.substring(secondSpace + 1);
+    if (!version.startsWith("HTTP/1.")) {
+        return false;
+    }
+
+    HttpRequest& request = connection->request;
+    request.reset();
+    request.requestMethod = parseMethod(line.substring(0, firstSpace));
+    String target = line.substring(firstSpace + 1, secondSpace);
+    int query = target.indexOf('?');
+    if (query >= 0) {
+        parseArgs(target.substring(query + 1), request.args);
+        target.remove(query);
+    }
+    request.requestUrl = urlDecode(target);
+    connection->keepAlive = version != "HTTP/1.0";
+    connection->contentLength = 0;
+    connection->bodyReceived = 0;
+    connection->chunked = false;
+    connection->chunkLeft = 0;
+    connection->state = HEADERS;
+    return request.requestMethod != HTTP_ANY;
+}
+
+void HttpServer::parseHeader(Connection* connection, const String& line) {
+    int colon = line.indexOf(':');
+    if (colon <= 0) {
+        return;
+    }
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    value.trim();
+    if (name.equalsIgnoreCase("Content-Length")) {
+        connection->contentLength = strtoul(value.c_str(), nullptr, 10);
+    } else if (name.equalsIgnoreCase("Connection")) {
+        if (value.equalsIgnoreCase("close")) {
+            connection->keepAlive = false;
+        } else if (value.equalsIgnoreCase("keep-alive")) {
+            connection->keepAlive = true;
+        }
+    }
+    connection->request.headers.emplace_back(std::move(name), std::move(value));
+}
+
+void HttpServer::headersComplete(Connection* connection) {
+    HttpRequest& request = connection->request;
+    connection->route = nullptr;
+    for (const Route& route : routes) {
+        if (route.uri == request.requestUrl && (route.method == HTTP_ANY || route.method == request.requestMethod)) {
+            connection->route = &route;
+            break;
+        }
+    }
+
+    if (request.hasHeader("Transfer-Encoding")) {
+        if (!request.header("Transfer-Encoding").equalsIgnoreCase("chunked")) {
+            fail(connection, 501);
+            return;
+        }
+        connection->chunked = true;
+        connection->state = CHUNK_SIZE;
+        return;
+    }
+    if (connection->contentLength == 0) {
+        bodyComplete(connection);
+        return;
+    }
+    bool streamed = connection->route && connection->route->bodyHandler;
+    if (!streamed) {
+        if (connection->contentLength > HTTP_MAX_BODY) {
+            fail(connection, 413);
+            return;
+        }
+        request.body.reserve(connection->contentLength);
+    }
+    connection->state = BODY;
+}
+
+// "<hex size>[;extensions]"; a buffered body is held to HTTP_MAX_BODY in total
+void HttpServer::parseChunkSize(Connection* connection, const String& line) {
+    char* end;
+    size_t size = strtoul(line.c_str(), &end, 16);
+    if (end == line.c_str()) {
+        fail(connection, 400);
+        return;
+    }
+    if (size == 0) {
+        connection->state = CHUNK_TRAILER;
+        return;
+    }
+    bool streamed = connection->route && connection->route->bodyHandler;
+    if (!streamed && connection->bodyReceived + size > HTTP_MAX_BODY) {
+        fail(connection, 413);
+        return;
+    }
+    connection->chunkLeft = size;
+    connection->state = BODY;
+}
+
+void HttpServer::bodyComplete(Connection* connection) {
+    HttpRequest& request = connection->request;
+    if (request.header("Content-Type").startsWith("application/x-www-form-urlencoded")) {
+        request.formBody = true;
+        parseArgs(request.body, request.args);
+    }
+    connection->state = READY;
+}
+
+void HttpServer::dispatch(Connection* connection) {
+    HttpRequest* request = &connection->request;
+    request->disconnectHandler = nullptr;  // The handler runs, so it finishes what the body handler began
+    if (connection->route) {
+        connection->route->handler(request);
+    } else if (notFoundHandler) {
+        notFoundHandler(request);
+    } else {
+        request->send(404, "text/plain", "Not Found");
+    }
+    if (request->responseCode == 0) {
+        request->send(500, "text/plain", "No response");
+    }
+    finishResponse(connection);
+}
+
+// Answers with an error and closes the connection once the response is out;
+// the rest of the request is never parsed
+void HttpServer::fail(Connection* connection, int code) {
+    abandon(connection);
+    HttpRequest& request = connection->request;
+    request.responseHeaders = String();
+    request.send(code, "text/plain", reasonPhrase(code));
+    connection->keepAlive = false;
+    finishResponse(connection);
+}
+
+// Tells a request that will never reach its handler, once
+void HttpServer::abandon(Connection* connection) {
+    HttpRequest& request = connection->request;
+    if (request.disconnectHandler) {
+        std::function<void()> handler = std::move(request.disconnectHandler);
+        request.disconnectHandler = nullptr;
+        handler();
+    }
+}
+
+void HttpServer::finishResponse(Connection* connection) {
+    HttpRequest& request = connection->request;
+    String& head = connection->head;
+    head = "HTTP/1.1 ";
+    head += request.responseCode;
+    head += ' ';
+    head += reasonPhrase(request.responseCode);
+    // A 204 or 304 never has a body, so neither its type nor its length is sent
+    bool bodyless = request.responseCode == 204 || request.responseCode == 304;
+    if (!bodyless) {
+        head += "\r\nContent-Type: ";
+        head += request.responseType;
+        if (!request.responseFiller) {
+            head += "\r\nContent-Length: ";
+            head += request.responseBody.length();
+        } else if (request.responseLength >= 0) {
+            head += "\r\nContent-Length: ";
+            head += request.responseLength;
+        } else {
+            head += "\r\nTransfer-Encoding: chunked";
+        }
+    }
+    head += "\r\n";
+    head += request.responseHeaders;
+    // Once the slots are nearly taken or a client waits, this one gives its slot back
+    if (!incoming.empty() || connectionCount() > HTTP_KEEP_ALIVE_CONNECTIONS) {
+        connection->keepAlive = false;
+    }
+    head += connection->keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (bodyless || request.requestMethod == HTTP_HEAD) {
+        request.responseBody = String();
+        request.responseFiller = nullptr;
+    }
+    connection->headSent = 0;
+    connection->bodySent = 0;
+    connection->state = RESPONDING;
+}
+
+// Replaces the queued piece of a streamed body with the next one, framed as a
+// chunk unless the length was given
+void HttpServer::fillBody(Connection* connection) {
+    HttpRequest& request = connection->request;
+    bool chunked = request.responseLength < 0;
+    request.responseBody.remove(0);
+    request.responseStream.restart();
+    bool more = request.responseFiller(request.responseStream);
+    if (chunked && request.responseBody.length() > 0) {
+        String size(static_cast<unsigned int>(request.responseBody.length()), HEX);
+        size += "\r\n";
+        request.responseBody = size + request.responseBody + "\r\n";
+    }
+    if (!more) {
+        request.responseFiller = nullptr;
+        if (chunked) {
+            request.responseBody += "0\r\n\r\n";
+        }
+    }
+    connection->bodySent = 0;
+}
+
+// Writes as much of the response as the send buffer takes; returns true once
+// all of it is queued and the connection is ready for the next request
+bool HttpServer::pump(Connection* connection) {
+    AsyncClient* client = connection->client;
+    const String& head = connection->head;
+    const String& body = connection->request.responseBody;
+    bool queued = false;
+    while (connection->headSent < head.length() || connection->bodySent < body.length() ||
+           connection->request.responseFiller) {
+        size_t space = client->space();
+        if (space == 0) {
+            break;
+        }
+        if (connection->headSent == head.length() && connection->bodySent == body.length()) {
+            fillBody(connection);
+            continue;
+        }
+        size_t written;
+        if (connection->headSent < head.length()) {
+            size_t length = head.length() - connection->headSent;
+            written = client->add(head.c_str() + connection->headSent, length < space ? length : space);
+            connection->headSent += written;
+        } else {
+            size_t length = body.length() - connection->bodySent;
+            written = client->add(body.c_str() + connection->bodySent, length < space ? length : space);
+            connection->bodySent += written;
+        }
+        if (written == 0) {
+            break;
+        }
+        queued = true;
+    }
+    if (queued) {
+        client->send();
+    }
+    if (connection->headSent < head.length() || connection->bodySent < body.length() ||
+        connection->request.responseFiller) {
+        return false;
+    }
+
+    connection->head.remove(0);  // Keeps its buffer for the next response
+    connection->request.reset();
+    connection->idleSince = millis();
+    if (!connection->keepAlive) {
+        connection->state = CLOSING;
+        client->close();
+        return false;
+    }
+    connection->state = REQUEST_LINE;
+    return true;
+}
+
+void HttpServer::consume(Connection* connection, size_t length) {
+    connection->received.remove(0, length);
+    connection->client->ack(length);
+}
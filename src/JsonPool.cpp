@@ -0,0 +1,98 @@
+#include "JsonPool.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+const size_t kAlign = alignof(std::max_align_t);
+
+size_t alignUp(size_t bytes) {
+    return (bytes + kAlign - 1) & ~(kAlign - 1);
+}
+
+alignas(std::max_align_t) uint8_t storage[JSON_POOL_SIZE];
+
+}  // namespace
+
+JsonPool* JsonPool::instance() {
+    static JsonPool pool(storage, sizeof(storage));
+    return &pool;
+}
+
+JsonPool::JsonPool(void* buffer, size_t size) : buffer(static_cast<uint8_t*>(buffer)), size(size) {}
+
+size_t JsonPool::stride(size_t size) {
+    return alignUp(sizeof(Header)) + alignUp(size);
+}
+
+JsonPool::Header* JsonPool::headerOf(void* pointer) const {
+    return reinterpret_cast<Header*>(static_cast<uint8_t*>(pointer) - alignUp(sizeof(Header)));
+}
+
+void* JsonPool::allocate(size_t bytes) {
+    if (stride(bytes) <= size - top) {
+        Header* header = reinterpret_cast<Header*>(buffer + top);
+        header->size = bytes;
+        top += stride(bytes);
+        live++;
+        highWater = std::max(highWater, top);
+        return reinterpret_cast<uint8_t*>(header) + alignUp(sizeof(Header));
+    }
+    void* pointer = malloc(bytes);
+    if (pointer) {
+        heapLive++;
+        heapAllocations++;
+    }
+    return pointer;
+}
+
+// Only the top block gives its bytes back right away; the rest come back
+// together when the pool starts over
+void JsonPool::deallocate(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    if (!owns(pointer)) {
+        free(pointer);
+        heapLive--;
+        return;
+    }
+    Header* header = headerOf(pointer);
+    size_t offset = reinterpret_cast<uint8_t*>(header) - buffer;
+    if (offset + stride(header->size) == top) {
+        top = offset;
+    }
+    if (--live == 0) {
+        top = 0;
+    }
+}
+
+void* JsonPool::reallocate(void* pointer, size_t bytes) {
+    if (!pointer) {
+        return allocate(bytes);
+    }
+    if (!owns(pointer)) {
+        return realloc(pointer, bytes);
+    }
+    Header* header = headerOf(pointer);
+    size_t offset = reinterpret_cast<uint8_t*>(header) - buffer;
+    if (offset + stride(header->size) == top && stride(bytes) <= size - offset) {
+        header->size = bytes;
+        top = offset + stride(bytes);
+        highWater = std::max(highWater, top);
+        return pointer;
+    }
+    if (bytes <= header->size) {
+        return pointer;  // The tail stays taken until the pool starts over
+    }
+    void* moved = allocate(bytes);
+    if (!moved) {
+        return nullptr;
+    }
+    memcpy(moved, pointer, header->size);
+    deallocate(pointer);
+    return moved;
+}
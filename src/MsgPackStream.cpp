@@ -0,0 +1,228 @@
+#include "MsgPackStream.h"
+
+#include <math.h>
+
+void MsgPackToJson::begin(Print& target) {
+    out = &target;
+    depth = 0;
+    headLength = 0;
+    headNeeded = 0;
+    stringLeft = 0;
+    done = false;
+    failed = false;
+}
+
+bool MsgPackToJson::feed(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length && !failed; i++) {
+        consume(data[i]);
+    }
+    return !failed;
+}
+
+void MsgPackToJson::consume(uint8_t c) {
+    if (stringLeft > 0) {
+        stringByte(c);
+        if (--stringLeft == 0) {
+            out->write('"');
+            completed();
+        }
+        return;
+    }
+    if (headLength == 0) {
+        int extra = headerBytes(c);
+        if (done || extra < 0) {
+            failed = true;  // Data after the value, or a type JSON cannot hold
+            return;
+        }
+        headNeeded = extra;
+    }
+    head[headLength++] = c;
+    if (headLength > headNeeded) {
+        decode();
+        headLength = 0;
+    }
+}
+
+// Bytes after the type byte, or -1 for bin, ext and the unused 0xc1
+int MsgPackToJson::headerBytes(uint8_t type) const {
+    if (type <= 0xc0 || type >= 0xe0 || type == 0xc2 || type == 0xc3) {
+        return 0;
+    }
+    switch (type) {
+        case 0xcc:
+        case 0xd0:
+        case 0xd9:
+            return 1;
+        case 0xcd:
+        case 0xd1:
+        case 0xda:
+        case 0xdc:
+        case 0xde:
+            return 2;
+        case 0xca:
+        case 0xce:
+        case 0xd2:
+        case 0xdb:
+        case 0xdd:
+        case 0xdf:
+            return 4;
+        case 0xcb:
+        case 0xcf:
+        case 0xd3:
+            return 8;
+        default:
+            return -1;
+    }
+}
+
+void MsgPackToJson::decode() {
+    uint8_t type = head[0];
+    uint64_t n = 0;
+    for (uint8_t i = 1; i <= headNeeded; i++) {
+        n = n << 8 | head[i];
+    }
+    bool isString = (type >= 0xa0 && type <= 0xbf) || (type >= 0xd9 && type <= 0xdb);
+    if (atKey() && !isString) {
+        failed = true;
+        return;
+    }
+    separator();
+
+    if (type <= 0x7f) {
+        writeUnsigned(type);
+    } else if (type >= 0xe0) {
+        writeSigned(static_cast<int8_t>(type));
+    } else if (type <= 0x8f) {
+        open(true, type & 0x0f);
+        return;
+    } else if (type <= 0x9f) {
+        open(false, type & 0x0f);
+        return;
+    } else if (isString) {
+        beginString(type <= 0xbf ? type & 0x1f : static_cast<uint32_t>(n));
+        return;
+    } else if (type == 0xc0) {
+        out->print("null");
+    } else if (type == 0xc2 || type == 0xc3) {
+        out->print(type == 0xc3 ? "true" : "false");
+    } else if (type == 0xca) {
+        uint32_t bits = n;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        writeFloat(value);
+    } else if (type == 0xcb) {
+        double value;
+        memcpy(&value, &n, sizeof(value));
+        writeFloat(value);
+    } else if (type >= 0xcc && type <= 0xcf) {
+        writeUnsigned(n);
+    } else if (type >= 0xd0 && type <= 0xd3) {
+        // Sign-extend from the width that was sent
+        int shift = 64 - 8 * headNeeded;
+        writeSigned(static_cast<int64_t>(n << shift) >> shift);
+    } else {
+        open(type >= 0xde, static_cast<uint32_t>(n));
+        return;
+    }
+    if (!failed) {
+        completed();
+    }
+}
+
+void MsgPackToJson::separator() {
+    if (depth == 0) {
+        return;
+    }
+    Level& level = stack[depth - 1];
+    if (level.map && level.left % 2 == 1) {
+        out->write(':');
+    } else if (!level.first) {
+        out->write(',');
+    }
+    level.first = false;
+}
+
+void MsgPackToJson::open(bool map, uint32_t count) {
+    if (depth == MSGPACK_MAX_DEPTH || (map && count > 0x7fffffff)) {
+        failed = true;
+        return;
+    }
+    out->write(map ? '{' : '[');
+    if (count == 0) {
+        out->write(map ? '}' : ']');
+        completed();
+        return;
+    }
+    stack[depth++] = Level{map ? count * 2 : count, map, true};
+}
+
+void MsgPackToJson::beginString(uint32_t length) {
+    out->write('"');
+    stringLeft = length;
+    if (length == 0) {
+        out->write('"');
+        completed();
+    }
+}
+
+// UTF-8 passes through; quotes, backslashes and control characters are escaped
+void MsgPackToJson::stringByte(uint8_t c) {
+    if (c == '"' || c == '\\') {
+        out->write('\\');
+        out->write(c);
+    } else if (c < 0x20) {
+        static const char shortEscapes[] = "btn\0fr";  // \b to \r, where JSON has a short form
+        static const char hex[] = "0123456789abcdef";
+        out->write('\\');
+        if (c >= '\b' && c <= '\r' && shortEscapes[c - '\b']) {
+            out->write(shortEscapes[c - '\b']);
+        } else {
+            out->print("u00");
+            out->write(hex[c >> 4]);
+            out->write(hex[c & 0x0f]);
+        }
+    } else {
+        out->write(c);
+    }
+}
+
+void MsgPackToJson::writeUnsigned(uint64_t value) {
+    char digits[21];
+    size_t at = sizeof(digits);
+    digits[--at] = '\0';
+    do {
+        digits[--at] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    out->print(digits + at);
+}
+
+void MsgPackToJson::writeSigned(int64_t value) {
+    if (value < 0) {
+        out->write('-');
+        writeUnsigned(0 - static_cast<uint64_t>(value));
+    } else {
+        writeUnsigned(value);
+    }
+}
+
+void MsgPackToJson::writeFloat(double value) {
+    if (!isfinite(value)) {
+        failed = true;  // JSON has no NaN or infinity
+        return;
+    }
+    out->print(value, 6);
+}
+
+// A value ended; so do the containers it was the last item of
+void MsgPackToJson::completed() {
+    while (depth > 0) {
+        Level& level = stack[depth - 1];
+        if (--level.left > 0) {
+            return;
+        }
+        out->write(level.map ? '}' : ']');
+        depth--;
+    }
+    done = true;
+}
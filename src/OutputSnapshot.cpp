@@ -0,0 +1,117 @@
+#include "OutputSnapshot.h"
+
+#include <coredecls.h>
+
+namespace {
+
+const uint32_t kMagic = 0x4F555431;  // "OUT1"
+
+}  // namespace
+
+OutputSnapshot::OutputSnapshot() {
+    clear();
+}
+
+uint32_t OutputSnapshot::checksum(const Image& image) {
+    return crc32(&image.count, sizeof(image.count) + image.count * sizeof(OutputEntry));
+}
+
+bool OutputSnapshot::valid() const {
+    return image.magic == kMagic && image.count <= OUTPUT_SNAPSHOT_MAX && image.crc == checksum(image);
+}
+
+// After a power cycle RTC memory holds garbage, which the CRC rejects
+bool OutputSnapshot::loadRtc() {
+    if (!ESP.rtcUserMemoryRead(OUTPUT_SNAPSHOT_RTC_OFFSET, reinterpret_cast<uint32_t*>(&image), sizeof(image)) ||
+        !valid()) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool OutputSnapshot::loadFile() {
+    File file = LittleFS.open(OUTPUT_SNAPSHOT_FILE, "r");
+    if (!file) {
+        clear();
+        return false;
+    }
+    size_t read = file.read(reinterpret_cast<uint8_t*>(&image), sizeof(image));
+    file.close();
+    if (read < offsetof(Image, entries) || !valid() || read < offsetof(Image, entries) + image.count * sizeof(OutputEntry)) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+void OutputSnapshot::saveRtc() {
+    image.crc = checksum(image);
+    ESP.rtcUserMemoryWrite(OUTPUT_SNAPSHOT_RTC_OFFSET, reinterpret_cast<uint32_t*>(&image), sizeof(image));
+}
+
+bool OutputSnapshot::saveFile() {
+    Image off = image;
+    for (uint32_t i = 0; i < off.count; i++) {
+        off.entries[i].level = 0;
+    }
+    off.crc = checksum(off);
+    size_t length = offsetof(Image, entries) + off.count * sizeof(OutputEntry);
+
+    Image saved;
+    File file = LittleFS.open(OUTPUT_SNAPSHOT_FILE, "r");
+    if (file) {
+        bool same = file.size() == length && file.read(reinterpret_cast<uint8_t*>(&saved), length) == length &&
+                    memcmp(&saved, &off, length) == 0;
+        file.close();
+        if (same) {
+            return true;
+        }
+    }
+    file = LittleFS.open(OUTPUT_SNAPSHOT_FILE, "w");
+    if (!file) {
+        Serial.println("Failed to open " OUTPUT_SNAPSHOT_FILE " for writing");
+        return false;
+    }
+    bool written = file.write(reinterpret_cast<const uint8_t*>(&off), length) == length;
+    file.close();
+    return written;
+}
+
+void OutputSnapshot::clear() {
+    memset(&image, 0, sizeof(image));
+    image.magic = kMagic;
+}
+
+void OutputSnapshot::add(int pin, uint8_t level, uint8_t flags) {
+    if (image.count >= OUTPUT_SNAPSHOT_MAX || pin < 0 || pin > 255 || find(pin)) {
+        return;
+    }
+    image.entries[image.count++] = OutputEntry{static_cast<uint8_t>(pin), level, flags, 0};
+}
+
+const OutputEntry* OutputSnapshot::find(int pin) const {
+    for (const OutputEntry& entry : *this) {
+        if (entry.pin == pin) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void OutputSnapshot::setLevel(int pin, uint8_t level) {
+    OutputEntry* entry = const_cast<OutputEntry*>(find(pin));
+    if (entry && entry->level != level) {
+        entry->level = level;
+        saveRtc();
+    }
+}
+
+void OutputSnapshot::setPulsing(int pin, bool pulsing) {
+    OutputEntry* entry = const_cast<OutputEntry*>(find(pin));
+    uint8_t flags = entry ? (pulsing ? entry->flags | OUTPUT_PULSE : entry->flags & ~OUTPUT_PULSE) : 0;
+    if (entry && entry->flags != flags) {
+        entry->flags = flags;
+        saveRtc();
+    }
+}
@@ -0,0 +1,237 @@
+#include "PowerManagement.h"
+
+#include <coredecls.h>
+
+#include "JsonPool.h"
+
+namespace {
+
+const char* const kModeNames[] = {"on", "modem", "light"};
+const char* const kSleepNames[] = {"none", "wait", "modem", "light"};
+const char* const kWakeNames[] = {"none", "deadline", "gpio", "network"};
+
+bool parseMode(const String& name, PowerMode& mode) {
+    for (int i = POWER_ALWAYS_ON; i <= POWER_LIGHT_SLEEP; i++) {
+        if (name == kModeNames[i]) {
+            mode = static_cast<PowerMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+PowerManager* PowerManager::instance = nullptr;
+
+PowerManager::PowerManager(Scheduler& scheduler) : runner(scheduler) {
+    instance = this;
+}
+
+PowerManager::~PowerManager() {
+    if (instance == this) {
+        instance = nullptr;
+    }
+}
+
+void PowerManager::loadConfig() {
+    String content = readFile("/power.json");
+    JsonDocument doc(JsonPool::instance());
+    PowerMode mode = POWER_DEFAULT_MODE;
+    if (content.length() > 0 && !deserializeJson(doc, content) && !parseMode(doc["mode"] | "", mode)) {
+        Serial.println("Invalid power mode in /power.json, using the default");
+    }
+    setMode(mode);
+}
+
+void PowerManager::setMode(PowerMode mode) {
+    powerMode = mode;
+    applySleepType(mode == POWER_ALWAYS_ON ? WIFI_NONE_SLEEP : WIFI_MODEM_SLEEP);
+    Serial.print("Power mode: ");
+    Serial.println(kModeNames[mode]);
+}
+
+void PowerManager::watch(Task& task) {
+    watched.push_back(&task);
+}
+
+void PowerManager::setWakePins(const std::vector<int>& pins) {
+    for (int pin : wakePins) {
+        detachInterrupt(digitalPinToInterrupt(pin));
+    }
+    wakePins.clear();
+    for (int pin : pins) {
+        if (pin < 0 || pin > 15) {
+            continue;  // GPIO16 and A0 have no edge interrupt and cannot wake light sleep
+        }
+        attachInterrupt(digitalPinToInterrupt(pin), onPinEdge, CHANGE);
+        wakePins.push_back(pin);
+    }
+}
+
+void IRAM_ATTR PowerManager::onPinEdge() {
+    if (instance) {
+        instance->wake(WAKE_GPIO);
+    }
+}
+
+// A level interrupt fires for as long as the level holds, so the first one
+// disarms every pin until idle() attaches CHANGE again; detachInterrupt() is in IRAM
+void IRAM_ATTR PowerManager::onWakeLevel() {
+    if (instance) {
+        for (int pin : instance->wakePins) {
+            detachInterrupt(digitalPinToInterrupt(pin));
+        }
+        instance->wake(WAKE_GPIO);
+    }
+}
+
+void IRAM_ATTR PowerManager::wake(WakeReason reason) {
+    if (wakeReason == WAKE_NONE) {
+        wakeReason = reason;
+    }
+    esp_schedule();  // Ends esp_delay() early
+}
+
+SleepPlan PowerManager::plan(const IdleState& state) const {
+    if (powerMode == POWER_ALWAYS_ON || state.busy) {
+        return {SLEEP_NONE, 0};
+    }
+    unsigned long duration = state.untilDeadlineMs < 0 || state.untilDeadlineMs > POWER_IDLE_MAX_MS
+                                 ? POWER_IDLE_MAX_MS
+                                 : static_cast<unsigned long>(state.untilDeadlineMs);
+    if (duration < POWER_IDLE_MIN_MS) {
+        return {SLEEP_NONE, 0};
+    }
+    if (state.softAP) {
+        return {SLEEP_WAIT, duration};  // The AP has to keep beaconing
+    }
+    if (powerMode == POWER_LIGHT_SLEEP && duration >= POWER_LIGHT_MIN_MS) {
+        return {SLEEP_LIGHT, duration};
+    }
+    return {SLEEP_MODEM, duration};
+}
+
+long PowerManager::untilDeadline() {
+    long until = -1;
+    for (Task* task : watched) {
+        long next = runner.timeUntilNextIteration(*task);  // -1 while disabled
+        if (next >= 0 && (until < 0 || next < until)) {
+            until = next;
+        }
+    }
+    return until;
+}
+
+// A wake that arrived while loop() was running is still pending here, so the
+// wait ends at once and the edge or request is handled on the next pass
+WakeReason PowerManager::idle(bool busy) {
+    IdleState state{untilDeadline(), busy, (WiFi.getMode() & WIFI_AP) != 0};
+    SleepPlan sleep = plan(state);
+    if (sleep.type == SLEEP_NONE) {
+        return WAKE_NONE;
+    }
+
+    bool light = sleep.type == SLEEP_LIGHT;
+    if (light) {
+        applySleepType(WIFI_LIGHT_SLEEP);
+        armWakePins(true);
+    }
+    unsigned long start = millis();
+    esp_delay(sleep.durationMs, [this]() { return wakeReason == WAKE_NONE; });
+    unsigned long slept = millis() - start;
+    if (light) {
+        armWakePins(false);
+        applySleepType(WIFI_MODEM_SLEEP);
+    }
+
+    WakeReason reason = wakeReason == WAKE_NONE ? WAKE_DEADLINE : static_cast<WakeReason>(wakeReason);
+    wakeReason = WAKE_NONE;
+    idleTotals[sleep.type] += slept;
+    sleepCounts[sleep.type]++;
+    wakeCounts[reason]++;
+
+    if (reason == WAKE_GPIO && gpioWakeHandler) {
+        gpioWakeHandler();
+    }
+    return reason;
+}
+
+void PowerManager::applySleepType(WiFiSleepType_t type) {
+    if (WiFi.getSleepMode() != type) {
+        WiFi.setSleepMode(type);
+    }
+}
+
+// Light sleep only wakes on a level, so for the sleep each pin's CHANGE
+// interrupt gives way to a level one (with wake enabled) for the opposite of
+// what it reads now; afterwards CHANGE is attached again
+void PowerManager::armWakePins(bool light) {
+    for (int pin : wakePins) {
+        detachInterrupt(digitalPinToInterrupt(pin));
+        if (light) {
+            attachInterrupt(digitalPinToInterrupt(pin), onWakeLevel, digitalRead(pin) ? ONLOW_WE : ONHIGH_WE);
+        } else {
+            attachInterrupt(digitalPinToInterrupt(pin), onPinEdge, CHANGE);
+        }
+    }
+}
+
+void PowerManager::resetStats() {
+    for (int i = 0; i < SLEEP_TYPE_COUNT; i++) {
+        idleTotals[i] = 0;
+        sleepCounts[i] = 0;
+    }
+    for (int i = 0; i < WAKE_REASON_COUNT; i++) {
+        wakeCounts[i] = 0;
+    }
+    statsSince = millis();
+}
+
+void PowerManager::handleGetPower(HttpRequest* request) {
+    JsonDocument doc(JsonPool::instance());
+    doc["mode"] = kModeNames[powerMode];
+    unsigned long elapsed = millis() - statsSince;
+    unsigned long idle = 0;
+    JsonObject idleMs = doc["idleMs"].to<JsonObject>();
+    JsonObject sleeps = doc["sleeps"].to<JsonObject>();
+    for (int i = SLEEP_WAIT; i < SLEEP_TYPE_COUNT; i++) {
+        idleMs[kSleepNames[i]] = idleTotals[i];
+        sleeps[kSleepNames[i]] = sleepCounts[i];
+        idle += idleTotals[i];
+    }
+    doc["idlePercent"] = elapsed ? static_cast<int>(100ULL * idle / elapsed) : 0;
+    JsonObject wakes = doc["wakes"].to<JsonObject>();
+    for (int i = WAKE_DEADLINE; i < WAKE_REASON_COUNT; i++) {
+        wakes[kWakeNames[i]] = wakeCounts[i];
+    }
+    JsonArray pins = doc["wakePins"].to<JsonArray>();
+    for (int pin : wakePins) {
+        pins.add(pin);
+    }
+    serializeJson(doc, request->beginResponse(200, "application/json"));
+}
+
+// {"mode":"on"|"modem"|"light"}; the mode is kept in /power.json
+void PowerManager::handleSetPower(HttpRequest* request) {
+    Serial.println("Handling /power request...");
+    JsonDocument doc(JsonPool::instance());
+    if (!request->hasArg("plain") || deserializeJson(doc, request->arg("plain"))) {
+        request->send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+        return;
+    }
+    PowerMode mode;
+    if (!parseMode(doc["mode"] | "", mode)) {
+        request->send(400, "application/json", "{\"error\":\"Invalid mode\"}");
+        return;
+    }
+    setMode(mode);
+
+    JsonDocument savedDoc(JsonPool::instance());
+    savedDoc["mode"] = kModeNames[mode];
+    JsonObject saved = savedDoc.as<JsonObject>();
+    if (!writeFileJson("/power.json", saved)) {
+        Serial.println("Failed to save power mode");
+    }
+    handleGetPower(request);
+}
@@ -0,0 +1,142 @@
+#include "RulesEngine.h"
+
+#include "TimeManagement.h"
+
+RulesEngine::RulesEngine() {
+    clock = []() { return TimeManagement::minuteOfDay(); };
+}
+
+void RulesEngine::begin(uint16_t inputCount) {
+    rules.clear();
+    inputList.clear();
+    targetList.clear();
+    windows.clear();
+    dependentStart.clear();
+    dependents.clear();
+    changed.clear();
+    inputs = inputCount;
+    inputBits.assign((inputCount + 31) / 32, 0);
+}
+
+bool RulesEngine::addRule(const uint16_t* ruleInputs, uint8_t inputCount, const uint16_t* targets, uint8_t targetCount,
+                          RuleTrigger trigger, RuleOp op, uint16_t durationMs, const RuleWindow* window) {
+    // Table offsets are 16 bit
+    if (inputList.size() + inputCount > UINT16_MAX || targetList.size() + targetCount > UINT16_MAX ||
+        rules.size() >= UINT16_MAX || inputCount == 0 || inputCount > RULE_MAX_INPUTS || targetCount == 0 ||
+        targetCount > RULE_MAX_TARGETS || op == RULE_NONE) {
+        return false;
+    }
+    for (uint8_t i = 0; i < inputCount; i++) {
+        if (ruleInputs[i] >= inputs) {
+            return false;
+        }
+    }
+
+    Rule rule;
+    rule.firstInput = inputList.size();
+    rule.firstTarget = targetList.size();
+    rule.durationMs = durationMs;
+    rule.stamp = 0;
+    rule.window = -1;
+    rule.inputCount = inputCount;
+    rule.targetCount = targetCount;
+    rule.trigger = op == RULE_FOLLOW ? RULE_ON_CHANGE : trigger;
+    rule.op = op;
+    rule.condition = false;
+    if (window) {
+        rule.window = windows.size();
+        windows.push_back(*window);
+    }
+    inputList.insert(inputList.end(), ruleInputs, ruleInputs + inputCount);
+    targetList.insert(targetList.end(), targets, targets + targetCount);
+    rules.push_back(rule);
+    return true;
+}
+
+void RulesEngine::end() {
+    // Counting sort of (input, rule) pairs into one array indexed by input
+    dependentStart.assign(inputs + 1, 0);
+    for (uint16_t input : inputList) {
+        dependentStart[input + 1]++;
+    }
+    for (uint16_t i = 0; i < inputs; i++) {
+        dependentStart[i + 1] += dependentStart[i];
+    }
+    dependents.assign(inputList.size(), 0);
+    std::vector<uint16_t> fill(dependentStart.begin(), dependentStart.end() - 1);
+    for (uint16_t r = 0; r < rules.size(); r++) {
+        for (uint8_t i = 0; i < rules[r].inputCount; i++) {
+            dependents[fill[inputList[rules[r].firstInput + i]]++] = r;
+        }
+    }
+}
+
+void RulesEngine::setInput(uint16_t input, bool state) {
+    if (input >= inputs || inputState(input) == state) {
+        return;
+    }
+    inputBits[input >> 5] ^= 1UL << (input & 31);
+    changed.push_back(input);
+}
+
+bool RulesEngine::inWindow(const RuleWindow& window, int minute) const {
+    if (minute < 0) {
+        return false;
+    }
+    if (window.start <= window.end) {
+        return minute >= window.start && minute <= window.end;
+    }
+    return minute >= window.start || minute <= window.end;
+}
+
+void RulesEngine::evaluate() {
+    if (changed.empty()) {
+        return;
+    }
+    if (++generation == 0) {  // Stamps wrapped; clear them so no rule looks already visited
+        for (auto& rule : rules) {
+            rule.stamp = 0;
+        }
+        generation = 1;
+    }
+
+    int minute = -2;  // Looked up once, and only if a windowed rule fires
+    for (uint16_t input : changed) {
+        if (dependentStart.empty()) {
+            break;
+        }
+        for (uint16_t d = dependentStart[input]; d < dependentStart[input + 1]; d++) {
+            Rule& rule = rules[dependents[d]];
+            if (rule.stamp == generation) {
+                continue;
+            }
+            rule.stamp = generation;
+
+            bool condition = true;
+            for (uint8_t i = 0; i < rule.inputCount && condition; i++) {
+                condition = inputState(inputList[rule.firstInput + i]);
+            }
+            if (condition == rule.condition) {
+                continue;
+            }
+            rule.condition = condition;
+            if ((rule.trigger == RULE_ON_RISE && !condition) || (rule.trigger == RULE_ON_FALL && condition)) {
+                continue;
+            }
+            if (rule.window >= 0) {
+                if (minute == -2) {
+                    minute = clock();
+                }
+                if (!inWindow(windows[rule.window], minute)) {
+                    continue;
+                }
+            }
+            if (actionHandler) {
+                for (uint8_t t = 0; t < rule.targetCount; t++) {
+                    actionHandler(targetList[rule.firstTarget + t], rule.op, condition, rule.durationMs);
+                }
+            }
+        }
+    }
+    changed.clear();
+}
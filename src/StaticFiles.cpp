@@ -0,0 +1,92 @@
+#include "StaticFiles.h"
+
+#include <coredecls.h>
+
+namespace {
+
+struct ContentType {
+    const char* extension;
+    const char* type;
+};
+
+const ContentType kContentTypes[] = {
+    {".html", "text/html"},       {".js", "application/javascript"}, {".css", "text/css"},
+    {".json", "application/json"}, {".svg", "image/svg+xml"},         {".png", "image/png"},
+    {".ico", "image/x-icon"},
+};
+
+}  // namespace
+
+const char* StaticFiles::contentType(const String& url) {
+    for (const ContentType& entry : kContentTypes) {
+        if (url.endsWith(entry.extension)) {
+            return entry.type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Read once per file and boot; a file of another size is read again
+uint32_t StaticFiles::etagOf(const String& path, File& file) {
+    for (const Etag& etag : etags) {
+        if (etag.path == path && etag.size == file.size()) {
+            return etag.crc;
+        }
+    }
+    uint8_t buffer[128];
+    uint32_t crc = 0xffffffff;
+    size_t read;
+    while ((read = file.read(buffer, sizeof(buffer))) > 0) {
+        crc = crc32(buffer, read, crc);
+    }
+    file.seek(0);
+    etags.push_back(Etag{path, file.size(), crc});
+    return crc;
+}
+
+bool StaticFiles::serve(HttpRequest* request) {
+    if (request->method() != HTTP_GET && request->method() != HTTP_HEAD) {
+        return false;
+    }
+    String url = request->url();
+    if (url.endsWith("/")) {
+        url += "index.html";
+    }
+    if (url.indexOf("..") >= 0) {
+        return false;
+    }
+    String path = root + url + ".gz";
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char etag[11];
+    snprintf(etag, sizeof(etag), "\"%08x\"", static_cast<unsigned>(etagOf(path, file)));
+    request->addHeader("ETag", etag);
+    request->addHeader("Cache-Control", url.endsWith(".html") ? WEB_PAGE_CACHE : WEB_ASSET_CACHE);
+    if (request->header("If-None-Match").indexOf(etag) >= 0) {
+        file.close();
+        request->send(304, nullptr, String());
+        return true;
+    }
+
+    // Sent compressed whatever Accept-Encoding says: the device has no way
+    // to inflate, and every browser takes gzip
+    request->addHeader("Content-Encoding", "gzip");
+    long length = file.size();
+    request->beginStream(
+        200, contentType(url),
+        [file](Print& out) mutable {
+            uint8_t buffer[WEB_CHUNK_BYTES];
+            size_t read = file.read(buffer, sizeof(buffer));
+            out.write(buffer, read);
+            if (read < sizeof(buffer)) {
+                file.close();
+                return false;
+            }
+            return true;
+        },
+        length);
+    return true;
+}
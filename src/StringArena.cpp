@@ -0,0 +1,18 @@
+#include "StringArena.h"
+
+void StringArena::clear() {
+    std::vector<char>().swap(data);  // Releases the block instead of keeping its capacity
+}
+
+StringRef StringArena::intern(const char* str) {
+    size_t length = str ? strlen(str) : 0;
+    if (data.empty()) {
+        data.push_back('\0');  // Offset 0
+    }
+    if (length == 0 || data.size() + length + 1 > 0xFFFF) {
+        return 0;
+    }
+    StringRef ref = static_cast<StringRef>(data.size());
+    data.insert(data.end(), str, str + length + 1);
+    return ref;
+}
@@ -0,0 +1,335 @@
+#include "Telemetry.h"
+
+#include <coredecls.h>
+
+#include "TimeManagement.h"
+
+namespace {
+
+const uint16_t kMaxValue = 1023;
+const uint32_t kPresent = 0x80000000UL;
+const uint8_t kEscape = 15;  // Nibble before a 12-bit delta
+
+const size_t kRecordsPerFile = TELEMETRY_FLASH_HOURS / 2;
+
+const char* const kResolutionNames[] = {"raw", "1m", "15m", "1h"};
+
+}  // namespace
+
+TelemetrySeries::TelemetrySeries(const char* name, uint16_t sampleMs)
+    : seriesId(idOf(name)), rawSampleMs(sampleMs) {
+    const uint32_t resolutions[] = {60, 900, 3600};
+    uint32_t* slots[] = {minutes, quarters, nullptr};
+    const uint16_t sizes[] = {TELEMETRY_MINUTES, TELEMETRY_QUARTERS, 0};
+    for (int i = 0; i < 3; i++) {
+        levels[i] = Level{resolutions[i], slots[i], sizes[i], 0, 0, 0, Bucket{0, 0, 0, 0, 0}};
+    }
+}
+
+uint32_t TelemetrySeries::idOf(const char* name) {
+    return crc32(name, strlen(name));
+}
+
+void TelemetrySeries::setSampleMs(uint16_t ms) {
+    if (ms != rawSampleMs) {
+        rawSampleMs = ms;
+        blocksStarted = 0;
+    }
+}
+
+String TelemetrySeries::filePath(bool old) const {
+    char path[24];
+    snprintf(path, sizeof(path), TELEMETRY_FILE_PREFIX "%08x.%s", static_cast<unsigned>(seriesId), old ? "old" : "bin");
+    return String(path);
+}
+
+void TelemetrySeries::removeFiles() const {
+    LittleFS.remove(filePath(false));
+    LittleFS.remove(filePath(true));
+}
+
+uint32_t TelemetrySeries::seconds(TelemetryResolution resolution) {
+    const uint32_t resolutions[] = {0, 60, 900, 3600};
+    return resolutions[resolution];
+}
+
+const char* TelemetrySeries::resolutionName(TelemetryResolution resolution) {
+    return kResolutionNames[resolution];
+}
+
+bool TelemetrySeries::parseResolution(const char* name, TelemetryResolution& resolution) {
+    for (uint8_t i = 0; i < 4; i++) {
+        if (strcmp(name, kResolutionNames[i]) == 0) {
+            resolution = static_cast<TelemetryResolution>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TelemetrySeries::add(uint16_t value, unsigned long at, unsigned long now) {
+    if (value > kMaxValue) {
+        value = kMaxValue;
+    }
+    addRaw(value, at);
+    for (Level& level : levels) {
+        uint32_t start = now - now % level.seconds;
+        if (level.open.count && level.open.start != start) {
+            close(level);
+        }
+        Bucket& open = level.open;
+        if (!open.count) {
+            open = Bucket{start, 0, 0, value, value};
+        }
+        open.count++;
+        open.sum += value;
+        open.min = value < open.min ? value : open.min;
+        open.max = value > open.max ? value : open.max;
+    }
+    return pendingHours > 0;
+}
+
+void TelemetrySeries::spill() {
+    for (uint8_t i = 0; i < pendingHours; i++) {
+        append(pending[i]);
+    }
+    pendingHours = 0;
+}
+
+size_t TelemetrySeries::rawSamples() const {
+    size_t samples = 0;
+    uint32_t first = blocksStarted > TELEMETRY_RAW_BLOCKS ? blocksStarted - TELEMETRY_RAW_BLOCKS : 0;
+    for (uint32_t b = first; b < blocksStarted; b++) {
+        samples += blocks[b % TELEMETRY_RAW_BLOCKS].count;
+    }
+    return samples;
+}
+
+uint32_t TelemetrySeries::pack(const Bucket& bucket) {
+    uint32_t avg = bucket.sum / bucket.count;
+    return kPresent | avg << 20 | static_cast<uint32_t>(bucket.max) << 10 | bucket.min;
+}
+
+// A sample off the grid of the newest block, e.g. after the loop stalled,
+// starts a new block
+void TelemetrySeries::addRaw(uint16_t value, unsigned long at) {
+    int32_t delta = static_cast<int32_t>(value) - lastValue;
+    uint32_t zigzag = static_cast<uint32_t>(delta) << 1 ^ static_cast<uint32_t>(delta >> 31);
+    size_t needed = zigzag < kEscape ? 1 : 4;
+    lastValue = value;
+
+    RawBlock* block = blocksStarted ? &blocks[(blocksStarted - 1) % TELEMETRY_RAW_BLOCKS] : nullptr;
+    if (!block || at != block->start + static_cast<unsigned long>(block->count) * rawSampleMs ||
+        block->count == 255 || block->nibbles + needed > kBlockNibbles) {
+        block = &blocks[blocksStarted++ % TELEMETRY_RAW_BLOCKS];
+        block->start = at;
+        block->first = value;
+        block->count = 1;
+        block->nibbles = 0;
+        return;
+    }
+    if (needed == 1) {
+        putNibble(*block, zigzag);
+    } else {
+        putNibble(*block, kEscape);
+        putNibble(*block, zigzag >> 8);
+        putNibble(*block, (zigzag >> 4) & 0x0F);
+        putNibble(*block, zigzag & 0x0F);
+    }
+    block->count++;
+}
+
+void TelemetrySeries::putNibble(RawBlock& block, uint8_t nibble) {
+    uint8_t& byte = block.data[block.nibbles / 2];
+    byte = block.nibbles % 2 ? (byte & 0x0F) | nibble << 4 : nibble;
+    block.nibbles++;
+}
+
+// Moves the open bucket into the ring, after an empty bucket for each step
+// without samples; a gap longer than the ring, or a clock set backwards,
+// starts the ring over. Hours queue for spill(), but seconds since boot
+// would mean nothing after the next boot, so they wait for the clock.
+void TelemetrySeries::close(Level& level) {
+    uint32_t start = level.open.start;
+    uint32_t packed = pack(level.open);
+    level.open.count = 0;
+    if (!level.slots) {
+        if (start < TIME_MIN_VALID) {
+            return;
+        }
+        if (pendingHours == TELEMETRY_PENDING_HOURS) {
+            memmove(pending, pending + 1, sizeof(pending) - sizeof(Hour));
+            pendingHours--;
+        }
+        pending[pendingHours++] = Hour{start, packed};
+        return;
+    }
+    if (level.used && (start < level.end || (start - level.end) / level.seconds >= level.size)) {
+        level.used = 0;
+    }
+    if (level.used) {
+        for (uint32_t t = level.end; t < start; t += level.seconds) {
+            level.slots[level.next] = 0;
+            level.next = (level.next + 1) % level.size;
+            level.used = level.used < level.size ? level.used + 1 : level.size;
+        }
+    }
+    level.slots[level.next] = packed;
+    level.next = (level.next + 1) % level.size;
+    level.used = level.used < level.size ? level.used + 1 : level.size;
+    level.end = start + level.seconds;
+}
+
+void TelemetrySeries::append(const Hour& hour) {
+    String path = filePath(false);
+    File file = LittleFS.open(path, "a");
+    if (file && file.size() >= kRecordsPerFile * sizeof(Hour)) {
+        file.close();
+        String old = filePath(true);
+        LittleFS.remove(old);
+        LittleFS.rename(path.c_str(), old.c_str());
+        file = LittleFS.open(path, "a");
+    }
+    if (!file) {
+        Serial.print("Failed to open ");
+        Serial.println(path);
+        return;
+    }
+    file.write(reinterpret_cast<const uint8_t*>(&hour), sizeof(hour));
+    file.close();
+}
+
+uint32_t TelemetrySeries::packedAt(const Level& level, uint32_t start) const {
+    if (level.open.count && level.open.start == start) {
+        return pack(level.open);
+    }
+    if (!level.used || start >= level.end || level.end - start > static_cast<uint32_t>(level.used) * level.seconds) {
+        return 0;
+    }
+    uint32_t back = (level.end - start) / level.seconds;  // 1 for the newest
+    return level.slots[(level.next + level.size - back) % level.size];
+}
+
+uint32_t TelemetrySeries::oldest(const Level& level) const {
+    return level.used ? level.end - level.used * level.seconds : level.open.start;
+}
+
+TelemetryCursor::TelemetryCursor(std::shared_ptr<TelemetrySeries> series, TelemetryResolution resolution,
+                                 unsigned long from, unsigned long to)
+    : series(series), resolution(resolution), from(from), to(to), next(0) {
+    if (resolution == TELEMETRY_RAW) {
+        next = series->blocksStarted > TELEMETRY_RAW_BLOCKS ? series->blocksStarted - TELEMETRY_RAW_BLOCKS : 0;
+    } else if (resolution != TELEMETRY_HOUR) {
+        const TelemetrySeries::Level& level = series->levels[resolution - 1];
+        next = from - from % level.seconds;
+        uint32_t oldest = series->oldest(level);
+        next = next < oldest ? oldest : next;
+    }
+}
+
+bool TelemetryCursor::print(Print& out) {
+    if (resolution == TELEMETRY_RAW) {
+        return printRaw(out);
+    }
+    return resolution == TELEMETRY_HOUR ? printSpilled(out) : printRing(out);
+}
+
+// A block at a time; a block overwritten since the walk started is skipped
+bool TelemetryCursor::printRaw(Print& out) {
+    TelemetrySeries& s = *series;
+    if (next + TELEMETRY_RAW_BLOCKS < s.blocksStarted) {
+        next = s.blocksStarted - TELEMETRY_RAW_BLOCKS;
+    }
+    if (next >= s.blocksStarted) {
+        return false;
+    }
+    const TelemetrySeries::RawBlock& block = s.blocks[next % TELEMETRY_RAW_BLOCKS];
+    next++;
+    uint64_t at = TimeManagement::timestampMillis(block.start);
+    uint64_t fromMs = static_cast<uint64_t>(from) * 1000;
+    uint64_t toMs = static_cast<uint64_t>(to) * 1000;
+    int32_t value = block.first;
+    uint8_t nibble = 0;
+    for (uint8_t i = 0; i < block.count; i++, at += s.rawSampleMs) {
+        if (i > 0) {
+            uint32_t zigzag = 0;
+            uint8_t digits = 1;
+            for (uint8_t d = 0; d < digits; d++, nibble++) {
+                uint8_t n = block.data[nibble / 2] >> (nibble % 2 ? 4 : 0) & 0x0F;
+                if (d == 0 && n == kEscape) {
+                    digits = 4;
+                } else {
+                    zigzag = zigzag << 4 | n;
+                }
+            }
+            value += static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        }
+        if (at < fromMs || at >= toMs) {
+            continue;
+        }
+        out.print(printed++ ? ",[" : "[");
+        out.printf("%lu.%03u,%d]", static_cast<unsigned long>(at / 1000), static_cast<unsigned>(at % 1000),
+                   static_cast<int>(value));
+    }
+    return next < s.blocksStarted;
+}
+
+// The ring and then the open bucket; empty buckets print nothing
+bool TelemetryCursor::printRing(Print& out) {
+    const TelemetrySeries::Level& level = series->levels[resolution - 1];
+    uint32_t end = level.open.count ? level.open.start + level.seconds : level.end;
+    end = end < to ? end : to;
+    for (size_t points = 0; points < TELEMETRY_POINTS_PER_PIECE && next < end; next += level.seconds) {
+        if (next >= level.end && level.open.count && next < level.open.start) {
+            next = level.open.start;  // Across a gap, which the ring only fills in on close
+        }
+        uint32_t packed = series->packedAt(level, next);
+        if (packed) {
+            printBucket(out, next, packed);
+            points++;
+        }
+    }
+    return next < end;
+}
+
+bool TelemetryCursor::printSpilled(Print& out) {
+    const TelemetrySeries::Level& level = series->levels[TELEMETRY_HOUR - 1];
+    if (file == 2) {
+        for (uint8_t i = 0; i < series->pendingHours; i++) {
+            const TelemetrySeries::Hour& hour = series->pending[i];
+            if (hour.start < to && hour.start + level.seconds > from) {
+                printBucket(out, hour.start, hour.packed);
+            }
+        }
+        if (level.open.count && level.open.start < to && level.open.start + level.seconds > from) {
+            printBucket(out, level.open.start, TelemetrySeries::pack(level.open));
+        }
+        return false;
+    }
+
+    TelemetrySeries::Hour records[TELEMETRY_POINTS_PER_PIECE];
+    size_t count = 0;
+    File spilled = LittleFS.open(series->filePath(file == 0), "r");
+    if (spilled) {
+        spilled.seek(next * sizeof(records[0]));
+        count = spilled.read(reinterpret_cast<uint8_t*>(records), sizeof(records)) / sizeof(records[0]);
+        spilled.close();
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].start < to && records[i].start + level.seconds > from) {
+            printBucket(out, records[i].start, records[i].packed);
+        }
+    }
+    next += count;
+    if (count < TELEMETRY_POINTS_PER_PIECE) {
+        file++;
+        next = 0;
+    }
+    return true;
+}
+
+void TelemetryCursor::printBucket(Print& out, uint32_t start, uint32_t packed) {
+    out.print(printed++ ? ",[" : "[");
+    out.printf("%lu,%u,%u,%u]", static_cast<unsigned long>(start), static_cast<unsigned>(packed & 0x3FF),
+               static_cast<unsigned>(packed >> 10 & 0x3FF), static_cast<unsigned>(packed >> 20 & 0x3FF));
+}
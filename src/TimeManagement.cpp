@@ -1,26 +1,201 @@
 #include "TimeManagement.h"
 
+#include <coredecls.h>
+#include <sys/time.h>
+
+#include "JsonPool.h"
+
+namespace {
+
+// Re-anchoring this often keeps millis() wrapping (49 days) out of the offset
+const unsigned long kRebaseMs = 86400000UL;
+
+const char* const kSourceNames[] = {"none", "saved", "manual", "ntp"};
+
+}  // namespace
+
+unsigned long TimeManagement::anchorEpoch = 0;
+unsigned long TimeManagement::anchorMillis = 0;
+TimeSource TimeManagement::timeSource = TIME_NONE;
+String TimeManagement::timeZone = TIME_DEFAULT_TZ;
+struct tm TimeManagement::cachedTime = {};
+unsigned long TimeManagement::cachedMinute = 0;
+bool TimeManagement::cacheValid = false;
+unsigned long TimeManagement::lastSave = 0;
+
+void TimeManagement::begin() {
+    anchorEpoch = 0;
+    anchorMillis = 0;
+    timeSource = TIME_NONE;
+    cacheValid = false;
+    lastSave = 0;
+    timeZone = TIME_DEFAULT_TZ;
+
+    JsonDocument doc(JsonPool::instance());
+    String content = readFile("/time.json");
+    if (content.length() > 0 && !deserializeJson(doc, content)) {
+        timeZone = doc["timezone"] | TIME_DEFAULT_TZ;
+        unsigned long saved = doc["currentTime"] | 0UL;
+        if (saved >= TIME_MIN_VALID) {
+            setTime(saved, TIME_SAVED);  // Behind by however long we were off, until SNTP answers
+            Serial.println("Restored time " + formatTimestamp(saved));
+        }
+    }
+
+    settimeofday_cb(onTimeSet);
+    configTime(timeZone.c_str(), TIME_NTP_SERVER_1, TIME_NTP_SERVER_2);  // Sets TZ and starts SNTP
+    Serial.println("Time zone " + timeZone + ", waiting for SNTP in the background");
+}
+
 unsigned long TimeManagement::getCurrentTimestamp() {
-    time_t now;
-    time(&now);
-    return static_cast<unsigned long>(now);
+    unsigned long elapsed = millis() - anchorMillis;
+    if (elapsed >= kRebaseMs) {
+        anchorEpoch += elapsed / 1000;
+        anchorMillis += elapsed / 1000 * 1000;
+        elapsed %= 1000;
+    }
+    return anchorEpoch + elapsed / 1000;
+}
+
+uint64_t TimeManagement::timestampMillis(unsigned long at) {
+    getCurrentTimestamp();  // Rebases the anchor if due
+    return static_cast<uint64_t>(anchorEpoch) * 1000 + static_cast<int32_t>(at - anchorMillis);
 }
 
 String TimeManagement::formatTimestamp(unsigned long timestamp) {
     char buffer[20];
-    struct tm* tm_info;
-    tm_info = localtime((time_t*)&timestamp);
-    strftime(buffer, 20, "%Y-%m-%d %H:%M:%S", tm_info);
+    struct tm tm_info;
+    time_t t = static_cast<time_t>(timestamp);
+    localtime_r(&t, &tm_info);
+    strftime(buffer, 20, "%Y-%m-%d %H:%M:%S", &tm_info);
     return String(buffer);
 }
 
-void TimeManagement::initializeTime(const char* ntpServer, long gmtOffset_sec, int daylightOffset_sec) {
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-    Serial.print("Waiting for NTP time sync");
-    while (!time(nullptr)) {
-        Serial.print(".");
-        delay(1000);
+const struct tm* TimeManagement::localTime() {
+    if (!isValid()) {
+        return nullptr;
+    }
+    unsigned long now = getCurrentTimestamp();
+    // Unsigned, so a clock set backwards recomputes too
+    if (!cacheValid || now - cachedMinute >= 60) {
+        time_t t = static_cast<time_t>(now);
+        localtime_r(&t, &cachedTime);
+        cachedMinute = now - cachedTime.tm_sec;
+        cacheValid = true;
+    }
+    return &cachedTime;
+}
+
+int TimeManagement::minuteOfDay() {
+    const struct tm* local = localTime();
+    return local ? local->tm_hour * 60 + local->tm_min : -1;
+}
+
+unsigned long TimeManagement::millisUntilNextMinute() {
+    if (!isValid()) {
+        return 60000;
+    }
+    getCurrentTimestamp();  // Rebases the anchor if due
+    return 60000 - ((anchorEpoch % 60) * 1000 + (millis() - anchorMillis)) % 60000;
+}
+
+void TimeManagement::setTime(time_t epoch, TimeSource source) {
+    struct timeval tv = {epoch, 0};
+    settimeofday(&tv, nullptr);
+    anchor(source);
+}
+
+void TimeManagement::setTimezone(const String& tz) {
+    timeZone = tz;
+    setenv("TZ", timeZone.c_str(), 1);
+    tzset();
+    cacheValid = false;
+}
+
+// Reads the system clock once and ties it to millis()
+void TimeManagement::anchor(TimeSource source) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    anchorMillis = millis() - tv.tv_usec / 1000;
+    anchorEpoch = static_cast<unsigned long>(tv.tv_sec);
+    timeSource = source;
+    cacheValid = false;
+}
+
+// Runs from loop() after lwIP's SNTP client set the clock
+void TimeManagement::onTimeSet(bool fromSntp) {
+    if (!fromSntp) {
+        return;  // Our own settimeofday(), already anchored
+    }
+    bool first = timeSource != TIME_NTP;
+    anchor(TIME_NTP);
+    unsigned long now = getCurrentTimestamp();
+    if (first) {
+        Serial.println("Time synchronized successfully: " + formatTimestamp(now));
+    }
+    if (first || now - lastSave >= TIME_SAVE_INTERVAL_S) {
+        saveTime();
+    }
+}
+
+bool TimeManagement::saveTime() {
+    JsonDocument doc(JsonPool::instance());
+    if (isValid()) {
+        doc["currentTime"] = getCurrentTimestamp();
+    }
+    doc["timezone"] = timeZone;
+
+    JsonObject jsonObject = doc.as<JsonObject>();
+    if (!writeFileJson("/time.json", jsonObject)) {
+        Serial.println("Failed to save time config");
+        return false;
+    }
+    lastSave = getCurrentTimestamp();
+    return true;
+}
+
+void TimeManagement::handleGetTime(HttpRequest* request) {
+    JsonDocument doc(JsonPool::instance());
+    unsigned long now = getCurrentTimestamp();
+    doc["currentTime"] = now;
+    if (isValid()) {
+        doc["local"] = formatTimestamp(now);
+    }
+    doc["timezone"] = timeZone;
+    doc["source"] = kSourceNames[timeSource];
+    serializeJson(doc, request->beginResponse(200, "application/json"));
+}
+
+// {"currentTime": <epoch>, "timezone": "<POSIX TZ>"}, either or both; SNTP
+// overrides a manual time at its next answer
+void TimeManagement::handleSetTime(HttpRequest* request) {
+    Serial.println("Handling /time request...");
+    JsonDocument doc(JsonPool::instance());
+    if (!request->hasArg("plain") || deserializeJson(doc, request->arg("plain"))) {
+        request->send(400, "application/json", "{\"error\":\"Invalid JSON\"}");
+        return;
+    }
+    JsonVariant currentTime = doc["currentTime"];
+    JsonVariant tz = doc["timezone"];
+    if (currentTime.isNull() && tz.isNull()) {
+        request->send(400, "application/json", "{\"error\":\"Missing fields\"}");
+        return;
+    }
+    if ((!currentTime.isNull() && (currentTime.as<unsigned long>() < TIME_MIN_VALID)) ||
+        (!tz.isNull() && String(tz | "").length() == 0)) {
+        request->send(400, "application/json", "{\"error\":\"Invalid currentTime or timezone\"}");
+        return;
+    }
+
+    if (!tz.isNull()) {
+        setTimezone(tz.as<String>());
+    }
+    if (!currentTime.isNull()) {
+        setTime(static_cast<time_t>(currentTime.as<unsigned long>()), TIME_MANUAL);
+    }
+    if (!saveTime()) {
+        request->send(500, "application/json", "{\"error\":\"Failed to save time config\"}");
+        return;
     }
-    Serial.println();
-    Serial.println("Time synchronized successfully");
+    handleGetTime(request);
 }
@@ -1,7 +1,35 @@
 #include "WiFiManagement.h"
 
+#include "ApiFormat.h"
+#include "Discovery.h"
+#include "JsonPool.h"
 #include "TaskDefinitions.h"
 
+namespace {
+
+// How often a connection attempt in progress is checked
+const unsigned long kAttemptPollMs = 50;
+
+String formatBssid(const uint8_t* bssid) {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", bssid[0], bssid[1], bssid[2], bssid[3],
+             bssid[4], bssid[5]);
+    return String(buffer);
+}
+
+bool parseBssid(const char* text, uint8_t* bssid) {
+    unsigned int b[6];
+    if (sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        bssid[i] = static_cast<uint8_t>(b[i]);
+    }
+    return true;
+}
+
+}  // namespace
+
 WiFiManager::WiFiManager() {}
 
 void WiFiManager::startAPMode() {
@@ -13,18 +41,34 @@ void WiFiManager::startAPMode() {
     Serial.println(WiFi.softAPIP());
 }
 
-void WiFiManager::handleRoot(ESP8266WebServer* server) {
-    String message = "ESP8266 WiFi Manager\n";
-    message += "Available endpoints:\n";
-    message += "/scan - Scan for WiFi networks\n";
-    message += "/connect - Connect to WiFi\n";
-    message += "/status - Get WiFi status\n";
-    server->send(200, "text/plain", message);
+void WiFiManager::stopAPMode() {
+    WiFi.softAPdisconnect(true);
+    Serial.println("AP Mode Stopped");
+}
+
+// Only reached when the filesystem image has no web UI
+void WiFiManager::handleRoot(HttpRequest* request) {
+    request->send(200, "text/plain",
+                  "ESP8266 WiFi Manager\n"
+                  "Available endpoints:\n"
+                  "/scan - Scan for WiFi networks\n"
+                  "/connect - Connect to WiFi\n"
+                  "/status - Get WiFi status\n");
 }
 
-void WiFiManager::handleScan(ESP8266WebServer* server) {
-    int n = WiFi.scanNetworks();
-    JsonDocument doc;
+// Scans run in the background; clients poll until the results are ready
+void WiFiManager::handleScan(HttpRequest* request) {
+    int n = WiFi.scanComplete();
+    if (n == WIFI_SCAN_FAILED) {
+        WiFi.scanNetworks(true);
+        n = WIFI_SCAN_RUNNING;
+    }
+    if (n == WIFI_SCAN_RUNNING) {
+        ApiFormat::sendMessage(request, 202, "status", "scanning");
+        return;
+    }
+
+    JsonDocument doc(JsonPool::instance());
     JsonArray networks = doc.to<JsonArray>();
 
     for (int i = 0; i < n; ++i) {
@@ -33,55 +77,115 @@ void WiFiManager::handleScan(ESP8266WebServer* server) {
         network["rssi"] = WiFi.RSSI(i);
         network["encryptionType"] = WiFi.encryptionType(i);
     }
+    WiFi.scanDelete();
 
-    String response;
-    serializeJson(doc, response);
-    server->send(200, "application/json", response);
+    ApiFormat::send(request, 200, doc);
 }
 
-void WiFiManager::handleConnect(ESP8266WebServer* server) {
-    if (server->hasArg("ssid") && server->hasArg("password")) {
-        String ssid = server->arg("ssid");
-        String password = server->arg("password");
+// Starts the connection and answers right away; taskConnectWiFi saves the
+// credentials once the station is up and clients follow along on /status.
+// Optional "ip", "gateway", "subnet" and "dns" give the station a static address.
+void WiFiManager::handleConnect(HttpRequest* request) {
+    WiFiCredentials config;
+    if (request->hasArg("ssid") && request->hasArg("password") && parseStaticIp(request, config)) {
+        pendingSsid = request->arg("ssid");
+        pendingPassword = request->arg("password");
+        pendingConfig = config;
+        attempting = false;
 
-        WiFi.begin(ssid.c_str(), password.c_str());
+        Serial.println("Connecting to WiFi... SSID: " + pendingSsid + " - PASS: " + pendingPassword);
+        applyStaticIp(config);
+        WiFi.begin(pendingSsid.c_str(), pendingPassword.c_str());
+        taskConnectWiFi.restartDelayed();
 
-        int counter = 0;
-        while (WiFi.status() != WL_CONNECTED && counter < 20) {
-            delay(500);
-            Serial.println("Connecting to WiFi... SSID: " + ssid + " - PASS: " + password );
-            counter++;
-        }
+        request->send(202, "text/plain", "Connecting to WiFi");
+    } else {
+        request->send(400, "text/plain", "Bad Request");
+    }
+}
 
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("Connected to WiFi");
-            saveWiFiCredentials(ssid.c_str(), password.c_str());
-            server->send(200, "text/plain", "Connected to WiFi");
-        } else {
-            Serial.println("Failed to connect to WiFi");
-            server->send(500, "text/plain", "Failed to connect to WiFi");
-        }
+bool WiFiManager::parseStaticIp(HttpRequest* request, WiFiCredentials& config) {
+    if (!request->hasArg("ip")) {
+        return true;
+    }
+    config.subnet = IPAddress(255, 255, 255, 0);
+    if (!config.ip.fromString(request->arg("ip")) || !config.gateway.fromString(request->arg("gateway")) ||
+        (request->hasArg("subnet") && !config.subnet.fromString(request->arg("subnet")))) {
+        return false;
+    }
+    config.dns = config.gateway;
+    return !request->hasArg("dns") || config.dns.fromString(request->arg("dns"));
+}
+
+// A static address skips DHCP, a few hundred ms of every connection
+void WiFiManager::applyStaticIp(const WiFiCredentials& config) {
+    if (config.ip.isSet()) {
+        WiFi.config(config.ip, config.gateway, config.subnet, config.dns);
     } else {
-        server->send(400, "text/plain", "Bad Request");
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());  // Back to DHCP
     }
 }
 
-void WiFiManager::handleStatus(ESP8266WebServer* server) {
-    JsonDocument doc;
+void WiFiManager::checkConnection() {
+    if (WiFi.status() == WL_CONNECTED) {
+        Serial.println("Connected to WiFi");
+        credentials = pendingConfig;
+        saveWiFiCredentials(pendingSsid.c_str(), pendingPassword.c_str());
+        pendingSsid = String();
+        pendingPassword = String();
+        failures = 0;
+        taskConnectWiFi.disable();
+        taskReconnectWiFi.restartDelayed(WIFI_CHECK_MS);
+    } else if (taskConnectWiFi.isLastIteration()) {
+        Serial.println("Failed to connect to WiFi");
+        pendingSsid = String();
+        pendingPassword = String();
+    } else {
+        Serial.println("Connecting to WiFi...");
+    }
+}
+
+void WiFiManager::handleStatus(HttpRequest* request) {
+    JsonDocument doc(JsonPool::instance());
     doc["status"] = WiFi.status();
+    doc["hostname"] = Discovery::hostname();
+    doc["firmware"] = FIRMWARE_VERSION;
     doc["ssid"] = WiFi.SSID();
     doc["ip"] = WiFi.localIP().toString();
-
-    String response;
-    serializeJson(doc, response);
-    server->send(200, "application/json", response);
+    doc["channel"] = WiFi.channel();
+    doc["bssid"] = WiFi.BSSIDstr();
+    doc["reconnects"] = reconnects;
+    doc["lastConnectMs"] = lastConnectMs;
+    doc["failures"] = failures;
+    doc["jsonPoolPeak"] = JsonPool::instance()->peak();
+    doc["jsonPoolOverflows"] = JsonPool::instance()->overflows();
+    ApiFormat::send(request, 200, doc);
 }
 
+// Also records the channel and BSSID of the access point we are joined to,
+// so the next connection can skip the scan
 bool WiFiManager::saveWiFiCredentials(const char* ssid, const char* password) {
-    // Define a StaticJsonDocument with an appropriate size
-    JsonDocument doc;
+    credentials.ssid = ssid;
+    credentials.password = password;
+    if (WiFi.status() == WL_CONNECTED) {
+        credentials.channel = WiFi.channel();
+        memcpy(credentials.bssid, WiFi.BSSID(), sizeof(credentials.bssid));
+    }
+    credentialsLoaded = true;
+
+    JsonDocument doc(JsonPool::instance());
     doc["ssid"] = ssid;
     doc["password"] = password;
+    if (credentials.channel != 0) {
+        doc["channel"] = credentials.channel;
+        doc["bssid"] = formatBssid(credentials.bssid);
+    }
+    if (credentials.ip.isSet()) {
+        doc["ip"] = credentials.ip.toString();
+        doc["gateway"] = credentials.gateway.toString();
+        doc["subnet"] = credentials.subnet.toString();
+        doc["dns"] = credentials.dns.toString();
+    }
 
     JsonObject jsonObject = doc.as<JsonObject>();
 
@@ -94,7 +198,14 @@ bool WiFiManager::saveWiFiCredentials(const char* ssid, const char* password) {
     return result;
 }
 
-bool WiFiManager::loadWiFiCredentials(String& ssid, String& password) {
+// Reads /wifi.json on the first call only; later calls answer from RAM
+bool WiFiManager::loadWiFiCredentials() {
+    if (credentialsLoaded) {
+        return credentials.ssid.length() > 0;
+    }
+    credentialsLoaded = true;
+    credentials = WiFiCredentials();
+
     String fileContent = readFile("/wifi.json");
 
     if (fileContent.length() == 0) {
@@ -102,8 +213,7 @@ bool WiFiManager::loadWiFiCredentials(String& ssid, String& password) {
         return false;
     }
 
-    // Define a StaticJsonDocument with an appropriate size
-    JsonDocument doc;
+    JsonDocument doc(JsonPool::instance());
     DeserializationError error = deserializeJson(doc, fileContent);
 
     if (error) {
@@ -113,13 +223,12 @@ bool WiFiManager::loadWiFiCredentials(String& ssid, String& password) {
     }
 
     // Extract SSID and password
-    if (doc.containsKey("ssid") && doc.containsKey("password")) {
-        ssid = doc["ssid"].as<String>();
-        password = doc["password"].as<String>();
-    } else {
+    if (!doc.containsKey("ssid") || !doc.containsKey("password")) {
         Serial.println("JSON does not contain ssid or password fields.");
         return false;
     }
+    String ssid = doc["ssid"].as<String>();
+    String password = doc["password"].as<String>();
 
     // Check if the strings are empty
     if (ssid.length() == 0 || password.length() == 0) {
@@ -127,48 +236,118 @@ bool WiFiManager::loadWiFiCredentials(String& ssid, String& password) {
         return false;
     }
 
+    credentials.ssid = ssid;
+    credentials.password = password;
+    // Written by earlier firmware without these; a bad BSSID just means scanning
+    if (parseBssid(doc["bssid"] | "", credentials.bssid)) {
+        credentials.channel = doc["channel"] | 0;
+    }
+    if (credentials.ip.fromString(doc["ip"] | "") && !credentials.gateway.fromString(doc["gateway"] | "")) {
+        credentials.ip = IPAddress();
+    }
+    credentials.subnet.fromString(doc["subnet"] | "255.255.255.0");
+    if (!credentials.dns.fromString(doc["dns"] | "")) {
+        credentials.dns = credentials.gateway;
+    }
     return true;
 }
 
-void WiFiManager::reconnectWiFi() {
-    if (WiFi.status() != WL_CONNECTED && !reconnecting) {
-        unsigned long currentMillis = millis();
-        if (currentMillis - lastReconnectAttempt >= reconnectInterval) {
-            lastReconnectAttempt = currentMillis;
-
-            Serial.println("Attempting to reconnect...");
-            String ssid, password;
-            if (loadWiFiCredentials(ssid, password)) {
-                Serial.println("SSID: " + ssid + " - PASS: " + password);
-                WiFi.begin(ssid.c_str(), password.c_str());
-                reconnectCounter = 0;
-                reconnecting = true;
-            } else {
-                Serial.println("No saved WiFi credentials found.");
+// Starts a connection with the saved credentials, straight to the saved
+// channel and BSSID when there are some
+void WiFiManager::startAttempt() {
+    attempting = true;
+    attemptStart = millis();
+    fastAttempt = credentials.channel != 0 && !skipFastPath;
+    skipFastPath = false;
+
+    applyStaticIp(credentials);
+    if (fastAttempt) {
+        Serial.printf("Attempting to reconnect to %s on channel %d\n", credentials.ssid.c_str(),
+                      static_cast<int>(credentials.channel));
+        WiFi.begin(credentials.ssid.c_str(), credentials.password.c_str(), credentials.channel, credentials.bssid);
+    } else {
+        Serial.println("Attempting to reconnect to " + credentials.ssid);
+        WiFi.begin(credentials.ssid.c_str(), credentials.password.c_str());
+    }
+}
+
+// Exponential backoff with equal jitter: half of each delay is fixed and the
+// other half random, so devices that lost the same AP come back out of step
+unsigned long WiFiManager::retryDelay() {
+    unsigned long ceiling = WIFI_RETRY_MIN_MS;
+    for (unsigned long i = 1; i < failures && ceiling < WIFI_RETRY_MAX_MS; i++) {
+        ceiling *= 2;
+    }
+    ceiling = std::min<unsigned long>(ceiling, WIFI_RETRY_MAX_MS);
+    return ceiling / 2 + random(ceiling / 2 + 1);
+}
+
+unsigned long WiFiManager::reconnectWiFi() {
+    if (taskConnectWiFi.isEnabled()) {
+        return WIFI_CHECK_MS;  // A connection requested through /connect is in progress
+    }
+
+    wl_status_t status = WiFi.status();
+    if (status == WL_CONNECTED) {
+        // Not before this check, so a client that sent /connect over the AP can still read /status
+        if (WiFi.getMode() & WIFI_AP) {
+            stopAPMode();
+        }
+        if (attempting) {
+            attempting = false;
+            lastConnectMs = millis() - attemptStart;
+            failures = 0;
+            reconnects++;
+            Serial.printf("Reconnected to WiFi in %lu ms\n", lastConnectMs);
+            if (WiFi.channel() != credentials.channel ||
+                memcmp(WiFi.BSSID(), credentials.bssid, sizeof(credentials.bssid)) != 0) {
+                saveWiFiCredentials(credentials.ssid.c_str(), credentials.password.c_str());
             }
         }
-    } else if (reconnecting) {
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("Reconnected to WiFi");
-            reconnecting = false;
-        } else if (reconnectCounter < maxReconnectAttempts) {
-            reconnectCounter++;
-            Serial.println("Reconnecting to WiFi...");
-        } else {
-            Serial.println("Failed to reconnect to WiFi");
-            reconnecting = false;
+        return WIFI_CHECK_MS;
+    }
+
+    if (attempting) {
+        bool failed = status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED || status == WL_WRONG_PASSWORD;
+        if (!failed && millis() - attemptStart < WIFI_CONNECT_TIMEOUT_MS) {
+            return kAttemptPollMs;
         }
+        attempting = false;
+        if (fastAttempt) {
+            // The AP may have moved to another channel; scan for it right away
+            Serial.println("Saved channel and BSSID did not answer");
+            skipFastPath = true;
+            startAttempt();
+            return kAttemptPollMs;
+        }
+        failures++;
+        if (failures == WIFI_AP_AFTER_FAILURES && !(WiFi.getMode() & WIFI_AP)) {
+            startAPMode();
+        }
+        unsigned long wait = retryDelay();
+        Serial.printf("Failed to reconnect to WiFi (status %d), retrying in %lu ms\n", static_cast<int>(status), wait);
+        return wait;
     }
+
+    if (!loadWiFiCredentials()) {
+        Serial.println("No saved WiFi credentials found.");
+        return WIFI_RETRY_MAX_MS;
+    }
+    startAttempt();
+    return kAttemptPollMs;
 }
 
 void WiFiManager::begin() {
-    String ssid, password;
-    if (loadWiFiCredentials(ssid, password)) {
-        WiFi.begin(ssid.c_str(), password.c_str());
-        taskReconnectWiFi.enableDelayed();
+    WiFi.persistent(false);        // /wifi.json is the only copy; spares the SDK's flash sector
+    WiFi.setAutoReconnect(false);  // Retries follow our backoff, not the SDK's
+    randomSeed(ESP.getChipId() ^ micros());
+
+    if (loadWiFiCredentials()) {
+        startAttempt();
+        taskReconnectWiFi.restartDelayed(kAttemptPollMs);
         Serial.println("Attempting to connect to WiFi with saved credentials...");
     } else {
         taskReconnectWiFi.disable();
         Serial.println("No saved WiFi credentials found.");
     }
-}
\ No newline at end of file
+}
@@ -2,65 +2,208 @@
 
 #include "Arduino.h"
 #include "ArduinoJson.h"
+#include "BootProfiler.h"
 #include "DeviceManagement.h"
-#include "ESP8266WebServer.h"
+#include "Discovery.h"
 #include "ESP8266WiFi.h"
 #include "ESP8266mDNS.h"
+#include "GroupControl.h"
+#include "HttpServer.h"
 #include "LittleFS.h"
+#include "PowerManagement.h"
+#include "StaticFiles.h"
 #include "TaskDefinitions.h"
 #include "TaskScheduler.h"
 #include "WiFiManagement.h"
 
-ESP8266WebServer server(80);  // Create a web server on port 80
+HttpServer server(80);  // Create a web server on port 80
 DeviceManager deviceManager;
 WiFiManager wifiManager;
 Scheduler runner;  // Define the Scheduler
+PowerManager powerManager(runner);
+GroupControl groupControl(deviceManager);
+StaticFiles staticFiles;
 
 // Define the tasks and assign them to the scheduler
+// Sleeps until the next poll bucket is due instead of waking every 10 ms
 Task taskReadSensors(
-    10, TASK_FOREVER, []() { deviceManager.readSensorsAndHandleBehaviors(); },
+    DEFAULT_POLL_MS, TASK_FOREVER, []() {
+        unsigned long wait = deviceManager.readSensorsAndHandleBehaviors();
+        if (wait) {
+            taskReadSensors.delay(wait);
+        } else {
+            taskReadSensors.forceNextIteration();
+        }
+    },
     &runner, true);
 
+// Watches the station link; polls quickly during an attempt and backs off after failures
 Task taskReconnectWiFi(
-    5000, TASK_FOREVER, []() { wifiManager.reconnectWiFi(); }, &runner);
+    WIFI_CHECK_MS, TASK_FOREVER, []() { taskReconnectWiFi.delay(wifiManager.reconnectWiFi()); }, &runner);
+
+// Advances every running fade; enabled by the first fade and idle once the last one ends
+Task taskFade(
+    FADE_STEP_MS, TASK_FOREVER, []() {
+        if (!deviceManager.updateFades()) {
+            taskFade.disable();
+        }
+    },
+    &runner);
+
+// Switches pulsed outputs off; delayed to the earliest pending end and idle otherwise
+Task taskPulse(
+    TASK_IMMEDIATE, TASK_FOREVER, []() {
+        unsigned long wait = deviceManager.endPulses();
+        if (wait) {
+            taskPulse.delay(wait);
+        } else {
+            taskPulse.disable();
+        }
+    },
+    &runner);
+
+// Applies "scheduled" behaviors at the start of every minute
+Task taskSchedule(
+    60000, TASK_FOREVER, []() {
+        deviceManager.checkScheduler();
+        taskSchedule.delay(TimeManagement::millisUntilNextMinute());
+    },
+    &runner, true);
+
+// Announces the state summary over mDNS once outputs have changed, at most once per DISCOVERY_ANNOUNCE_MS
+Task taskAnnounce(
+    DISCOVERY_ANNOUNCE_MS, TASK_ONCE,
+    []() { Discovery::update(deviceManager.componentCount(), deviceManager.stateHash()); }, &runner);
+
+// Appends the hours analog inputs have closed to flash; started by the sample that closes one
+Task taskTelemetry(
+    TASK_IMMEDIATE, TASK_ONCE, []() { deviceManager.spillTelemetry(); }, &runner);
+
+// Follows a /connect request for up to 10 seconds
+Task taskConnectWiFi(
+    500, 20, []() { wifiManager.checkConnection(); }, &runner);
 
 void setup() {
-    Serial.begin(9600);
+    BootProfiler::begin();
+
+    // Outputs go back to their levels before anything slower runs: from RTC
+    // memory after a reset, which needs neither flash nor the config, else
+    // off from /outputs.bin once LittleFS is mounted
+    SnapshotSource restored = deviceManager.restoreOutputs(SNAPSHOT_RTC) ? SNAPSHOT_RTC : SNAPSHOT_NONE;
+    if (restored) {
+        BootProfiler::outputsReady(restored);
+    }
+    BootProfiler::mark("rtc");
+
+    Serial.begin(115200);
     Serial.println("Starting up...");
 
     if (!LittleFS.begin()) {
         Serial.println("LittleFS Mount Failed");
         return;
     }
+    BootProfiler::mark("mount");
+
+    if (!restored && deviceManager.restoreOutputs(SNAPSHOT_FLASH)) {
+        BootProfiler::outputsReady(SNAPSHOT_FLASH);
+        BootProfiler::mark("outputs");
+    }
+
+    TimeManagement::begin();  // Saved time until SNTP answers in the background
+    BootProfiler::mark("time");
 
     deviceManager.loadConfig();
+    BootProfiler::mark("config");
     deviceManager.configureDevices();
     deviceManager.populateFunctionPointers();
+    BootProfiler::outputsReady(SNAPSHOT_NONE);  // First boot, or no snapshot was readable
+    BootProfiler::mark("devices");
 
+    // loop() sleeps until the next of these tasks is due, or an input edge
+    // or a client wakes it; an edge polls the inputs right away
+    powerManager.loadConfig();
+    for (Task* task : {&taskReadSensors, &taskReconnectWiFi, &taskFade, &taskPulse, &taskConnectWiFi, &taskSchedule,
+                        &taskAnnounce, &taskTelemetry}) {
+        powerManager.watch(*task);
+    }
+    powerManager.setWakePins(deviceManager.inputPins());
+    powerManager.onGpioWake([]() {
+        deviceManager.pollNow();
+        taskReadSensors.forceNextIteration();
+    });
+    server.onActivity([]() { powerManager.wake(WAKE_NETWORK); });
+    BootProfiler::mark("power");
 
+    // The hostname has to be set before the station connects, so DHCP registers it too
     wifiManager.startAPMode();
+    Discovery::begin(80);
+    Discovery::update(deviceManager.componentCount(), deviceManager.stateHash());
+    deviceManager.onOutputChange([]() {
+        if (!taskAnnounce.isEnabled()) {
+            taskAnnounce.restartDelayed();
+        }
+    });
+    BootProfiler::mark("mdns");
+
     wifiManager.begin();
+    BootProfiler::mark("wifi");
 
-    MDNS.begin("myesp");
-    Serial.println("Address: http://myesp.local");
+    // One multicast frame switches a group of components on every device
+    groupControl.onActivity([]() { powerManager.wake(WAKE_NETWORK); });
+    groupControl.begin();
+    BootProfiler::mark("groups");
 
     // Wifi Manager Routes
-    server.on("/", HTTP_GET, []() { wifiManager.handleRoot(&server); });
-    server.on("/scan", HTTP_GET, []() { wifiManager.handleScan(&server); });
+    // The web UI, with the endpoint list in its place on an image without one
+    server.on("/", HTTP_GET, [](HttpRequest* request) {
+        if (!staticFiles.serve(request)) {
+            wifiManager.handleRoot(request);
+        }
+    });
+    server.on("/scan", HTTP_GET, [](HttpRequest* request) { wifiManager.handleScan(request); });
     server.on("/connect", HTTP_POST,
-              []() { wifiManager.handleConnect(&server); });
-    server.on("/status", HTTP_GET, []() { wifiManager.handleStatus(&server); });
+              [](HttpRequest* request) { wifiManager.handleConnect(request); });
+    server.on("/status", HTTP_GET, [](HttpRequest* request) { wifiManager.handleStatus(request); });
 
     // Device Manager Routes
-    server.on("/config", HTTP_POST,
-              []() { deviceManager.handleConfig(&server); });
+    server.on(
+        "/config", HTTP_POST,
+        [](HttpRequest* request) {
+            deviceManager.handleConfig(request);
+            powerManager.setWakePins(deviceManager.inputPins());
+        },
+        [](HttpRequest* request, const uint8_t* data, size_t len, size_t index, size_t total) {
+            deviceManager.handleConfigBody(request, data, len, index, total);
+        });
     server.on("/control", HTTP_POST,
-              []() { deviceManager.handleControl(&server); });
+              [](HttpRequest* request) { deviceManager.handleControl(request); });
     server.on("/devices", HTTP_GET,
-              []() { deviceManager.handleGetDevices(&server); });
+              [](HttpRequest* request) { deviceManager.handleGetDevices(request); });
+    server.on("/telemetry", HTTP_GET,
+              [](HttpRequest* request) { deviceManager.handleGetTelemetry(request); });
+
+    // Time Management Routes
+    server.on("/time", HTTP_GET, [](HttpRequest* request) { TimeManagement::handleGetTime(request); });
+    server.on("/time", HTTP_POST, [](HttpRequest* request) { TimeManagement::handleSetTime(request); });
+
+    // Power Management Routes
+    server.on("/power", HTTP_GET, [](HttpRequest* request) { powerManager.handleGetPower(request); });
+    server.on("/power", HTTP_POST, [](HttpRequest* request) { powerManager.handleSetPower(request); });
+
+    // Boot Profiler Routes
+    server.on("/boot", HTTP_GET, [](HttpRequest* request) { BootProfiler::handleGetBoot(request); });
+
+    // Everything else the web UI is made of
+    server.onNotFound([](HttpRequest* request) {
+        if (!staticFiles.serve(request)) {
+            request->send(404, "text/plain", "Not Found");
+        }
+    });
 
     server.begin();
     Serial.println("HTTP server started");
+    BootProfiler::mark("http");
+    BootProfiler::print();
 
     runner.startNow();  // Start the task scheduler
 }
@@ -68,5 +211,7 @@ void setup() {
 void loop() {
     runner.execute();  // Execute scheduled tasks
     MDNS.update();
-    server.handleClient();
+    server.handleClients();
+    groupControl.handlePackets();
+    powerManager.idle(server.busy() || groupControl.busy());
 }
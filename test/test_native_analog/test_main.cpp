@@ -0,0 +1,111 @@
+// AnalogInput: decimation, oversampling, hysteresis and EMA filtering.
+//
+//   pio test -e native -f test_native_analog
+
+#include <Arduino.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include "AnalogInput.h"
+
+namespace {
+
+const int kPin = 17;
+
+AnalogSettings settings(uint16_t sampleMs, uint8_t oversample, uint8_t emaShift) {
+    AnalogSettings analog;
+    analog.sampleMs = sampleMs;
+    analog.oversample = oversample;
+    analog.emaShift = emaShift;
+    analog.high = 560;
+    analog.low = 464;
+    return analog;
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+}
+
+void tearDown(void) {}
+
+void test_samples_only_once_per_period(void) {
+    AnalogInput input(settings(100, 4, 0));
+    input.read(kPin);
+    TEST_ASSERT_EQUAL(4, native::analogReads());
+
+    for (int t = 0; t < 9; t++) {
+        native::advanceMillis(10);
+        input.read(kPin);
+    }
+    TEST_ASSERT_EQUAL(4, native::analogReads());
+    native::advanceMillis(10);
+    input.read(kPin);
+    TEST_ASSERT_EQUAL(8, native::analogReads());
+}
+
+void test_late_read_keeps_sampling_grid(void) {
+    AnalogInput input(settings(100, 1, 0));
+    input.read(kPin);
+    native::advanceMillis(103);  // Polled late once
+    input.read(kPin);
+    native::advanceMillis(97);  // Next poll back on time, 200 ms after the first sample
+    input.read(kPin);
+    TEST_ASSERT_EQUAL(3, native::analogReads());
+}
+
+void test_hysteresis_holds_between_thresholds(void) {
+    AnalogInput input(settings(1, 1, 0));
+    const int levels[] = {300, 520, 600, 520, 470, 464, 520};
+    const bool expected[] = {false, false, true, true, true, false, false};
+    for (int i = 0; i < 7; i++) {
+        native::setAnalogInput(kPin, levels[i]);
+        native::advanceMillis(1);
+        TEST_ASSERT_EQUAL_MESSAGE(expected[i], input.read(kPin), "level step");
+    }
+}
+
+void test_oversampling_keeps_fractional_level(void) {
+    AnalogInput input(settings(1, 16, 0));
+    native::setAnalogInput(kPin, 513);
+    input.read(kPin);
+    TEST_ASSERT_EQUAL(513, input.level());
+}
+
+void test_ema_smooths_a_spike(void) {
+    AnalogInput input(settings(1, 1, 3));
+    native::setAnalogInput(kPin, 400);
+    input.read(kPin);
+    native::setAnalogInput(kPin, 1000);  // One noisy sample
+    native::advanceMillis(1);
+    TEST_ASSERT_FALSE(input.read(kPin));
+    TEST_ASSERT_EQUAL(475, input.level());
+
+    for (int t = 0; t < 80; t++) {
+        native::advanceMillis(1);
+        input.read(kPin);
+    }
+    TEST_ASSERT_TRUE(input.read(kPin));
+    TEST_ASSERT_INT_WITHIN(2, 1000, input.level());
+}
+
+void test_settings_validation(void) {
+    TEST_ASSERT_TRUE(AnalogSettings().isValid());
+    TEST_ASSERT_FALSE(settings(100, 3, 0).isValid());
+    TEST_ASSERT_FALSE(settings(0, 4, 0).isValid());
+    AnalogSettings inverted = settings(100, 4, 0);
+    inverted.low = 600;
+    TEST_ASSERT_FALSE(inverted.isValid());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_samples_only_once_per_period);
+    RUN_TEST(test_late_read_keeps_sampling_grid);
+    RUN_TEST(test_hysteresis_holds_between_thresholds);
+    RUN_TEST(test_oversampling_keeps_fractional_level);
+    RUN_TEST(test_ema_smooths_a_spike);
+    RUN_TEST(test_settings_validation);
+    return UNITY_END();
+}
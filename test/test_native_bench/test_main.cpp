@@ -0,0 +1,502 @@
+// DeviceManager benchmarks for the native environment.
+//
+// Each benchmark sweeps the component count and prints one row per size.
+// Absolute host timings do not translate to the ESP8266, so the assertions
+// only check that the cost per component does not grow with the component
+// count; a quadratic regression fails the suite regardless of host speed.
+//
+//   pio test -e native -f test_native_bench -v
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP8266WiFi.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "ApiFormat.h"
+#include "DeviceManagement.h"
+#include "HttpServer.h"
+#include "JsonPool.h"
+#include "RulesEngine.h"
+
+void setup();
+void loop();
+extern HttpServer server;
+
+#ifndef BENCH_MAX_SCALING
+#define BENCH_MAX_SCALING 4.0
+#endif
+
+namespace {
+
+const int kComponentCounts[] = {1, 10, 25, 50, 100, 200};
+const int kSizes = sizeof(kComponentCounts) / sizeof(kComponentCounts[0]);
+const int kRounds = 5;
+
+// Component i reads pin i and drives pin 128 + i, wrapping so pins stay in range
+int inputPin(int i) { return i % 128; }
+int outputPin(int i) { return 128 + i % 128; }
+
+// Timed components stand in for slow sensors and poll once a second; analog
+// ones poll at their default sampleMs and the rest at DEFAULT_POLL_MS
+String buildConfig(int components) {
+    static const char* behaviors[] = {"\"toggle\"", "\"toggle\",\"scheduled\"", "\"timed\"", "\"pulse\""};
+    String json = "{\"devices\":[{\"components\":[";
+    char buffer[384];
+    for (int i = 0; i < components; i++) {
+        snprintf(buffer, sizeof(buffer),
+                 "%s{\"componentName\":\"component_%d\",\"componentType\":\"%s\",\"componentPin\":%d,%s"
+                 "\"actionType\":\"digital\",\"actionPin\":%d,\"behaviors\":[%s],"
+                 "\"schedule\":{\"startTime\":{\"hour\":8,\"minute\":30},\"endTime\":{\"hour\":17,\"minute\":45}}}",
+                 i ? "," : "", i, i % 5 == 4 ? "analog" : "digital", inputPin(i), i % 4 == 2 ? "\"pollMs\":1000," : "",
+                 outputPin(i), behaviors[i % 4]);
+        json += buffer;
+    }
+    json += "]}]}";
+    return json;
+}
+
+// Best-of-rounds average wall time of fn in microseconds
+double measureMicros(int repeats, const std::function<void()>& fn) {
+    double best = 1e300;
+    for (int round = 0; round < kRounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++) {
+            fn();
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / repeats);
+    }
+    return best;
+}
+
+// At 115200 baud one byte takes ~87 us on the wire; Serial.print blocks once the UART FIFO is full
+double uartMillis(unsigned long bytes) { return bytes * 10.0 / 115.2; }
+
+void routes(HttpServer& server, DeviceManager& manager) {
+    server.on(
+        "/config", HTTP_POST, [&manager](HttpRequest* request) { manager.handleConfig(request); },
+        [&manager](HttpRequest* request, const uint8_t* data, size_t len, size_t index, size_t total) {
+            manager.handleConfigBody(request, data, len, index, total);
+        });
+    server.on("/devices", HTTP_GET, [&manager](HttpRequest* request) { manager.handleGetDevices(request); });
+    server.begin();
+}
+
+struct Response {
+    int code = 0;
+    String body;
+    unsigned long serverAllocations = 0;  // Made while the server ran, the client's own excluded
+};
+
+// One request over a keep-alive loopback connection, pumping the server until the response is complete
+Response exchange(HttpServer& server, native::LoopbackClient& client, const char* method, const char* path,
+                  const String& body = String(), const char* headers = "") {
+    std::string request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: bench\r\n" + headers;
+    if (body.length()) {
+        request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.length()) + "\r\n";
+    }
+    request += "\r\n";
+    request.append(body.c_str(), body.length());
+    client.send(request);
+
+    std::string raw;
+    Response response;
+    while (client.connected()) {
+        unsigned long allocations = native::heapStats().allocations;
+        native::pollNetwork();
+        server.handleClients();
+        response.serverAllocations += native::heapStats().allocations - allocations;
+        raw += client.receive();
+        size_t headerEnd = raw.find("\r\n\r\n");
+        size_t lengthHeader = raw.find("Content-Length: ");
+        if (headerEnd == std::string::npos || lengthHeader == std::string::npos) {
+            continue;
+        }
+        size_t length = strtoul(raw.c_str() + lengthHeader + 16, nullptr, 10);
+        if (raw.size() >= headerEnd + 4 + length) {
+            response.code = atoi(raw.c_str() + 9);
+            response.body = String(raw.data() + headerEnd + 4, length);  // MessagePack may hold NULs
+            break;
+        }
+    }
+    return response;
+}
+
+int componentCount(const String& devicesResponse) {
+    JsonDocument doc;
+    if (deserializeJson(doc, devicesResponse)) {
+        return -1;
+    }
+    int count = 0;
+    for (JsonObject device : doc["devices"].as<JsonArray>()) {
+        count += device["components"].as<JsonArray>().size();
+    }
+    return count;
+}
+
+// Fails when the per-component cost at the largest size exceeds the cost at
+// the reference size by more than BENCH_MAX_SCALING.
+void assertLinear(const char* name, const double* costs) {
+    const int reference = 2;  // 25 components: large enough to amortise fixed overhead
+    double referenceCost = costs[reference] / kComponentCounts[reference];
+    double largestCost = costs[kSizes - 1] / kComponentCounts[kSizes - 1];
+    char message[160];
+    snprintf(message, sizeof(message), "%s: %.3f us/component at %d vs %.3f at %d", name, largestCost,
+             kComponentCounts[kSizes - 1], referenceCost, kComponentCounts[reference]);
+    TEST_ASSERT_TRUE_MESSAGE(largestCost <= referenceCost * BENCH_MAX_SCALING, message);
+}
+
+// Fails when the cost at the largest size exceeds the cost at the reference
+// size by more than BENCH_MAX_SCALING, for work that should not grow at all.
+void assertFlat(const char* name, const double* costs) {
+    const int reference = 2;
+    char message[160];
+    snprintf(message, sizeof(message), "%s: %.3f us at %d vs %.3f at %d", name, costs[kSizes - 1],
+             kComponentCounts[kSizes - 1], costs[reference], kComponentCounts[reference]);
+    TEST_ASSERT_TRUE_MESSAGE(costs[kSizes - 1] <= costs[reference] * BENCH_MAX_SCALING, message);
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+}
+
+void tearDown(void) {}
+
+void test_load_config_boot_time(void) {
+    double costs[kSizes];
+    printf("\n%-12s %12s %14s %16s\n", "components", "boot_us", "serial_bytes", "uart_ms@115200");
+    for (int s = 0; s < kSizes; s++) {
+        int n = kComponentCounts[s];
+        String config = buildConfig(n);
+        unsigned long serialBefore = native::serialBytes();
+        {
+            DeviceManager manager;
+            native::bootConfig(manager, config.c_str());
+        }
+        unsigned long serialBytes = native::serialBytes() - serialBefore;
+        costs[s] = measureMicros(20, [&]() {
+            DeviceManager manager;
+            native::bootConfig(manager, config.c_str());
+        });
+        printf("%-12d %12.1f %14lu %16.1f\n", n, costs[s], serialBytes, uartMillis(serialBytes));
+    }
+    assertLinear("loadConfig", costs);
+}
+
+// Every tick is 10 ms of virtual time, the period taskReadSensors used to run at
+// for all components; poll buckets decide which inputs are actually read.
+void test_read_sensors_tick(void) {
+    double quietCosts[kSizes];
+    double edgeCosts[kSizes];
+    printf("\n%-12s %12s %14s %16s %12s %12s\n", "components", "tick_us", "edge_tick_us", "blocked_ms/tick",
+           "reads/s", "adc_reads/s");
+    for (int s = 0; s < kSizes; s++) {
+        int n = kComponentCounts[s];
+        DeviceManager manager;
+        native::bootConfig(manager, buildConfig(n).c_str());
+
+        quietCosts[s] = measureMicros(2000, [&]() {
+            native::advanceMillis(10);
+            manager.readSensorsAndHandleBehaviors();
+        });
+
+        // One second of ticks shows how often inputs and the ADC are actually sampled
+        unsigned long readsBefore = native::digitalReads() + native::analogReads();
+        unsigned long adcReadsBefore = native::analogReads();
+        for (int t = 0; t < 100; t++) {
+            native::advanceMillis(10);
+            manager.readSensorsAndHandleBehaviors();
+        }
+        unsigned long reads = native::digitalReads() + native::analogReads() - readsBefore;
+        unsigned long adcReads = native::analogReads() - adcReadsBefore;
+
+        // Every tick raises or lowers one input in eight, so each component sees an edge every 8 ticks
+        int tick = 0;
+        uint64_t blockedBefore = native::blockedMicros();
+        edgeCosts[s] = measureMicros(200, [&]() {
+            for (int i = tick % 8; i < n; i += 8) {
+                native::setDigitalInput(inputPin(i), (tick / 8) % 2 == 0 ? HIGH : LOW);
+                native::setAnalogInput(inputPin(i), (tick / 8) % 2 == 0 ? 1023 : 0);
+            }
+            native::advanceMillis(10);
+            manager.readSensorsAndHandleBehaviors();
+            tick++;
+        });
+        double blockedPerTick = (native::blockedMicros() - blockedBefore) / 1000.0 / tick;
+        printf("%-12d %12.3f %14.3f %16.1f %12lu %12lu\n", n, quietCosts[s], edgeCosts[s], blockedPerTick, reads,
+               adcReads);
+    }
+    assertLinear("readSensorsAndHandleBehaviors", quietCosts);
+    assertLinear("readSensorsAndHandleBehaviors (edges)", edgeCosts);
+}
+
+// n inputs and 4n rules: each input toggles its neighbours and ANDs with the
+// next one. One input changes per tick, so the cost should not grow with n.
+void test_rule_evaluation(void) {
+    double costs[kSizes];
+    printf("\n%-12s %12s %14s\n", "inputs", "rules", "eval_us");
+    for (int s = 0; s < kSizes; s++) {
+        uint16_t n = kComponentCounts[s];
+        RulesEngine engine;
+        unsigned long actions = 0;
+        engine.onAction([&actions](uint16_t, RuleOp, bool, uint16_t) { actions++; });
+        engine.begin(n);
+        for (uint16_t i = 0; i < n; i++) {
+            uint16_t pair[] = {i, static_cast<uint16_t>((i + 1) % n)};
+            uint16_t targets[] = {static_cast<uint16_t>((i + 1) % n), static_cast<uint16_t>((i + 2) % n)};
+            engine.addRule(&i, 1, targets, 2, RULE_ON_RISE, RULE_TOGGLE);
+            engine.addRule(&i, 1, targets, 1, RULE_ON_FALL, RULE_OFF);
+            engine.addRule(pair, 2, targets, 1, RULE_ON_RISE, RULE_FOLLOW);
+            engine.addRule(&i, 1, &i, 1, RULE_ON_CHANGE, RULE_PULSE, 100);
+        }
+        engine.end();
+
+        int tick = 0;
+        costs[s] = measureMicros(20000, [&]() {
+            uint16_t input = tick % n;
+            engine.setInput(input, (tick / n) % 2 == 0);
+            engine.evaluate();
+            tick++;
+        });
+        printf("%-12d %12u %14.3f\n", n, static_cast<unsigned>(engine.ruleCount()), costs[s]);
+        TEST_ASSERT_TRUE(actions > 0);
+    }
+    assertFlat("RulesEngine::evaluate", costs);
+}
+
+void test_handle_config(void) {
+    double costs[kSizes];
+    printf("\n%-12s %12s %14s %16s\n", "components", "config_us", "body_bytes", "uart_ms@115200");
+    for (int s = 0; s < kSizes; s++) {
+        int n = kComponentCounts[s];
+        String config = buildConfig(n);
+        DeviceManager manager;
+        HttpServer server(80);
+        routes(server, manager);
+        native::bootConfig(manager, config.c_str());
+        native::LoopbackClient client(80);
+
+        unsigned long serialBefore = native::serialBytes();
+        TEST_ASSERT_EQUAL(200, exchange(server, client, "POST", "/config", config).code);
+        unsigned long serialBytes = native::serialBytes() - serialBefore;
+
+        costs[s] = measureMicros(10, [&]() { exchange(server, client, "POST", "/config", config); });
+        printf("%-12d %12.1f %14u %16.1f\n", n, costs[s], config.length(), uartMillis(serialBytes));
+    }
+    assertLinear("handleConfig", costs);
+}
+
+void test_handle_get_devices(void) {
+    double costs[kSizes];
+    printf("\n%-12s %12s %14s\n", "components", "devices_us", "response_bytes");
+    for (int s = 0; s < kSizes; s++) {
+        int n = kComponentCounts[s];
+        DeviceManager manager;
+        HttpServer server(80);
+        routes(server, manager);
+        native::bootConfig(manager, buildConfig(n).c_str());
+        native::LoopbackClient client(80);
+
+        Response response = exchange(server, client, "GET", "/devices");
+        TEST_ASSERT_EQUAL(200, response.code);
+        TEST_ASSERT_EQUAL(n, componentCount(response.body));
+        unsigned int responseBytes = response.body.length();
+
+        costs[s] = measureMicros(50, [&]() { exchange(server, client, "GET", "/devices"); });
+        printf("%-12d %12.1f %14u\n", n, costs[s], responseBytes);
+    }
+    assertLinear("handleGetDevices", costs);
+}
+
+// The same /devices document as JSON and as MessagePack, and a /control body
+// read both ways. Host timings only compare the two paths; the sizes are
+// what goes over the air.
+void test_msgpack_vs_json(void) {
+    double packCosts[kSizes];
+    const char* accept = "Accept: " MSGPACK_CONTENT_TYPE "\r\n";
+    printf("\n%-12s %12s %14s %12s %14s\n", "components", "json_bytes", "msgpack_bytes", "json_us", "msgpack_us");
+    for (int s = 0; s < kSizes; s++) {
+        int n = kComponentCounts[s];
+        DeviceManager manager;
+        HttpServer server(80);
+        routes(server, manager);
+        native::bootConfig(manager, buildConfig(n).c_str());
+        native::LoopbackClient client(80);
+
+        Response json = exchange(server, client, "GET", "/devices");
+        Response packed = exchange(server, client, "GET", "/devices", String(), accept);
+        JsonDocument doc;
+        TEST_ASSERT_FALSE(deserializeMsgPack(doc, packed.body));
+        String repacked;
+        serializeJson(doc, repacked);
+        TEST_ASSERT_EQUAL_STRING(json.body.c_str(), repacked.c_str());
+        TEST_ASSERT_TRUE(packed.body.length() < json.body.length());
+
+        double jsonCost = measureMicros(50, [&]() { exchange(server, client, "GET", "/devices"); });
+        packCosts[s] = measureMicros(50, [&]() { exchange(server, client, "GET", "/devices", String(), accept); });
+        printf("%-12d %12u %14u %12.1f %14.1f\n", n, json.body.length(), packed.body.length(), jsonCost,
+               packCosts[s]);
+    }
+    assertLinear("handleGetDevices (MessagePack)", packCosts);
+
+    JsonDocument control;
+    control["componentName"] = "sensor_led_touch_3";
+    control["action"] = "control";
+    control["level"] = 128;
+    control["fadeMs"] = 1500;
+    String json;
+    String packed;
+    serializeJson(control, json);
+    serializeMsgPack(control, packed);
+    JsonDocument doc;
+    double jsonDecode = measureMicros(20000, [&]() { deserializeJson(doc, json); });
+    double packDecode = measureMicros(20000, [&]() { deserializeMsgPack(doc, packed); });
+    printf("\n%-12s %12s %14s %12s %14s\n", "body", "json_bytes", "msgpack_bytes", "json_us", "msgpack_us");
+    printf("%-12s %12u %14u %12.3f %14.3f\n", "/control", json.length(), packed.length(), jsonDecode, packDecode);
+    TEST_ASSERT_TRUE(packed.length() < json.length());
+}
+
+// Heap held by the loaded config, and what one POST /config allocates on the
+// way. Names are as long as real ones, past the small-string buffer. Fails
+// when a loaded component costs a heap block of its own again: every one is
+// another hole to fragment the device heap once the config is replaced.
+void test_config_heap(void) {
+    printf("\n%-12s %12s %14s %16s %18s\n", "components", "held_blocks", "held_bytes", "config_allocs",
+           "allocs/component");
+    size_t baseBlocks = 0;
+    for (int s = 0; s < kSizes; s++) {
+        int n = kComponentCounts[s];
+        String config = buildConfig(n);
+        config.replace("component_", "sensor_led_touch_");
+        HttpServer server(80);
+        native::LoopbackClient client(80);
+
+        native::HeapStats before = native::heapStats();
+        DeviceManager manager;
+        native::bootConfig(manager, config.c_str());
+        native::HeapStats held = native::heapStats();
+        routes(server, manager);
+        exchange(server, client, "GET", "/devices");  // Connection and response buffers are reused after this
+
+        native::HeapStats posting = native::heapStats();
+        TEST_ASSERT_EQUAL(200, exchange(server, client, "POST", "/config", config).code);
+        unsigned long allocations = native::heapStats().allocations - posting.allocations;
+        size_t heldBlocks = held.liveBlocks - before.liveBlocks;
+        printf("%-12d %12zu %14zu %16lu %18.1f\n", n, heldBlocks, held.blockBytes - before.blockBytes,
+               allocations, static_cast<double>(allocations) / n);
+        if (s == 0) {
+            baseBlocks = heldBlocks;  // The device and component vectors, rules and the arena
+        } else {
+            TEST_ASSERT_TRUE_MESSAGE(heldBlocks - baseBlocks < static_cast<size_t>(n) / 2,
+                                     "heap blocks held per component");
+        }
+    }
+}
+
+// Weeks of requests compressed: every route that builds a JsonDocument, over
+// and over on the firmware's own server, with loop() and virtual time running
+// in between. The heap must hold exactly what it held after the first round,
+// and the JSON pool must start over empty after every request without ever
+// spilling to the heap.
+void test_request_soak(void) {
+    const int kSoakRounds = 1000;
+    String config = buildConfig(25);
+    config.replace("component_", "sensor_led_touch_");
+    native::fsWrite("/config.json", config.c_str());
+    native::wifiAddNetwork("bench", "password", 6);
+    setup();
+    native::LoopbackClient client(80);
+
+    struct Step {
+        const char* method;
+        const char* path;
+        String body;
+        const char* headers = "";
+    } steps[] = {
+        {"POST", "/config", config},
+        {"POST", "/control", "{\"componentName\":\"sensor_led_touch_3\",\"action\":\"control\",\"level\":128}"},
+        {"POST", "/control", "{\"componentName\":\"sensor_led_touch_5\",\"action\":\"toggle\"}"},
+        {"GET", "/devices", String()},
+        {"GET", "/devices", String(), "Accept: " MSGPACK_CONTENT_TYPE "\r\n"},
+        {"GET", "/status", String()},
+        {"GET", "/scan", String()},
+        {"GET", "/time", String()},
+        {"GET", "/power", String()},
+        {"GET", "/boot", String()},
+    };
+    const int kSteps = sizeof(steps) / sizeof(steps[0]);
+
+    JsonPool* pool = JsonPool::instance();
+    pool->resetPeak();
+    uint32_t overflows = pool->overflows();  // The large configs above do not fit and spill, as they should
+    native::HeapStats settled = native::heapStats();
+    unsigned long allocations = 0;
+    unsigned long serverAllocations[kSteps] = {};
+    printf("\n%-10s %12s %12s %12s %14s %18s\n", "requests", "live_blocks", "live_bytes", "pool_peak",
+           "pool_overflows", "heap_allocs/req");
+    for (int round = 0; round < kSoakRounds; round++) {
+        native::HeapStats before = native::heapStats();
+        for (int i = 0; i < kSteps; i++) {
+            const Step& step = steps[i];
+            Response response = exchange(server, client, step.method, step.path, step.body, step.headers);
+            int code = response.code;
+            TEST_ASSERT_TRUE_MESSAGE(code == 200 || code == 202, step.path);
+            if (round >= 2) {
+                serverAllocations[i] += response.serverAllocations;
+            }
+            TEST_ASSERT_EQUAL_MESSAGE(0, pool->liveBlocks(), step.path);
+            TEST_ASSERT_EQUAL_MESSAGE(0, pool->used(), step.path);
+        }
+        native::advanceMillis(5000);
+        loop();
+        // Everything has run to completion once by the second round; /scan only answers with results then
+        if (round < 2) {
+            settled = native::heapStats();
+            continue;
+        }
+        allocations += native::heapStats().allocations - before.allocations;
+        if (round % 200 == 0 || round == kSoakRounds - 1) {
+            native::HeapStats now = native::heapStats();
+            double perRequest = static_cast<double>(allocations) / ((round - 1) * kSteps);
+            printf("%-10d %12zu %12zu %12zu %14u %18.1f\n", (round + 1) * kSteps, now.liveBlocks, now.liveBytes,
+                   pool->peak(), pool->overflows() - overflows, perRequest);
+        }
+    }
+    // The totals above include building each request on the client side; this
+    // is what the server itself allocated, transport and JSON library included
+    printf("\n%-8s %-10s %18s\n", "method", "route", "server_allocs/req");
+    for (int i = 0; i < kSteps; i++) {
+        printf("%-8s %-10s %18.1f\n", steps[i].method, steps[i].path,
+               static_cast<double>(serverAllocations[i]) / (kSoakRounds - 2));
+    }
+    native::HeapStats end = native::heapStats();
+    TEST_ASSERT_EQUAL_MESSAGE(settled.liveBlocks, end.liveBlocks, "heap blocks grew over the soak");
+    TEST_ASSERT_EQUAL_MESSAGE(settled.liveBytes, end.liveBytes, "heap bytes grew over the soak");
+    TEST_ASSERT_EQUAL_MESSAGE(overflows, pool->overflows(), "JSON_POOL_SIZE too small for these requests");
+    TEST_ASSERT_TRUE(pool->peak() <= pool->capacity());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_load_config_boot_time);
+    RUN_TEST(test_read_sensors_tick);
+    RUN_TEST(test_rule_evaluation);
+    RUN_TEST(test_handle_config);
+    RUN_TEST(test_handle_get_devices);
+    RUN_TEST(test_msgpack_vs_json);
+    RUN_TEST(test_config_heap);
+    RUN_TEST(test_request_soak);
+    return UNITY_END();
+}
@@ -0,0 +1,236 @@
+// Boot: outputs restored from RTC memory after a reset and from /outputs.bin
+// after a power cycle, before the config is parsed, and the /boot profile.
+//
+//   pio test -e native -f test_native_boot
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "BootProfiler.h"
+#include "DeviceManagement.h"
+#include "HttpServer.h"
+#include "TaskDefinitions.h"
+
+void setup();
+extern HttpServer server;
+
+namespace {
+
+const int kInputPin = 4;
+const int kRelayPin = 5;
+const int kDimmerPin = 14;
+
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"relay\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"]},"
+    "{\"componentName\":\"dimmer\",\"componentType\":\"digital\",\"componentPin\":12,"
+    "\"actionType\":\"pwm\",\"actionPin\":14,\"gamma\":true,\"behaviors\":[\"toggle\"]}]}]}";
+
+// Turns both outputs on the way a button press would
+void pressButtons(DeviceManager& manager) {
+    native::setDigitalInput(kInputPin, HIGH);
+    native::setDigitalInput(12, HIGH);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager.readSensorsAndHandleBehaviors();
+}
+
+// Records the level each pin is first written with
+int firstWrite[native::kPinCount];
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite("/config.json", kConfig);
+    for (int& level : firstWrite) {
+        level = -1;
+    }
+    native::setPinWriteHook([](int pin, int value) {
+        if (firstWrite[pin] < 0) {
+            firstWrite[pin] = value;
+        }
+    });
+}
+
+void tearDown(void) {
+    native::setPinWriteHook(nullptr);
+}
+
+void test_nothing_to_restore_on_first_boot(void) {
+    DeviceManager manager;
+    TEST_ASSERT_FALSE(manager.restoreOutputs(SNAPSHOT_RTC));
+    TEST_ASSERT_FALSE(manager.restoreOutputs(SNAPSHOT_FLASH));
+
+    native::bootConfig(manager);
+    std::string saved;
+    TEST_ASSERT_TRUE(native::fsRead(OUTPUT_SNAPSHOT_FILE, saved));
+    TEST_ASSERT_TRUE(manager.restoreOutputs(SNAPSHOT_RTC));
+}
+
+void test_reset_restores_levels_from_rtc(void) {
+    {
+        DeviceManager manager;
+        native::bootConfig(manager);
+        pressButtons(manager);
+        TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+        TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(kDimmerPin));
+    }
+    ESP.restart();
+    for (int& level : firstWrite) {
+        level = -1;
+    }
+
+    DeviceManager manager;
+    TEST_ASSERT_TRUE(manager.restoreOutputs(SNAPSHOT_RTC));
+    TEST_ASSERT_EQUAL(OUTPUT, native::pinMode(kRelayPin));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+    TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(kDimmerPin));
+
+    // The config agrees, so configureDevices() keeps the levels without a glitch
+    native::bootConfig(manager);
+    TEST_ASSERT_EQUAL(HIGH, firstWrite[kRelayPin]);
+    TEST_ASSERT_EQUAL(PWM_RANGE, firstWrite[kDimmerPin]);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+    TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(kDimmerPin));
+
+    // And the restored state is what the next press toggles
+    native::setDigitalInput(kInputPin, LOW);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager.readSensorsAndHandleBehaviors();
+    pressButtons(manager);
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kRelayPin));
+}
+
+// Nothing ends a pulse after a reset, so a door strike in the middle of one must come back off
+void test_reset_mid_pulse_restores_the_output_off(void) {
+    const int kStrikePin = 15;
+    const int kLockPin = 16;
+    native::fsWrite("/config.json",
+                    "{\"devices\":[{\"components\":["
+                    "{\"componentName\":\"relay\",\"componentType\":\"digital\",\"componentPin\":4,"
+                    "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"]},"
+                    "{\"componentName\":\"strike\",\"componentType\":\"digital\",\"componentPin\":13,"
+                    "\"actionType\":\"digital\",\"actionPin\":15,\"behaviors\":[\"pulse\"]},"
+                    "{\"componentName\":\"lock\",\"componentType\":\"digital\",\"componentPin\":0,"
+                    "\"actionType\":\"digital\",\"actionPin\":16,\"behaviors\":[]}]}],"
+                    "\"rules\":[{\"when\":[\"relay\"],\"do\":\"pulse\",\"ms\":2000,\"targets\":[\"lock\"]}]}");
+    {
+        DeviceManager manager;
+        native::bootConfig(manager);
+        native::setDigitalInput(kInputPin, HIGH);
+        native::setDigitalInput(13, HIGH);
+        native::advanceMillis(DEFAULT_POLL_MS);
+        manager.readSensorsAndHandleBehaviors();
+        TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+        TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kStrikePin));
+        TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kLockPin));
+        native::advanceMillis(100);
+    }
+    ESP.restart();
+    for (int& level : firstWrite) {
+        level = -1;
+    }
+
+    DeviceManager manager;
+    TEST_ASSERT_TRUE(manager.restoreOutputs(SNAPSHOT_RTC));
+    TEST_ASSERT_EQUAL(LOW, firstWrite[kStrikePin]);
+    TEST_ASSERT_EQUAL(LOW, firstWrite[kLockPin]);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+    native::bootConfig(manager);
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kStrikePin));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kLockPin));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+
+    // A pulse that ended before the reset leaves nothing behind
+    native::setDigitalInput(13, LOW);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager.readSensorsAndHandleBehaviors();
+    native::setDigitalInput(13, HIGH);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager.readSensorsAndHandleBehaviors();
+    native::advanceMillis(600);
+    manager.endPulses();
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kStrikePin));
+    OutputSnapshot snapshot;
+    TEST_ASSERT_TRUE(snapshot.loadRtc());
+    TEST_ASSERT_EQUAL(0, snapshot.find(kStrikePin)->flags & OUTPUT_PULSE);
+}
+
+void test_power_cycle_restores_outputs_off_from_flash(void) {
+    {
+        DeviceManager manager;
+        native::bootConfig(manager);
+        pressButtons(manager);
+    }
+    std::string saved;
+    TEST_ASSERT_TRUE(native::fsRead(OUTPUT_SNAPSHOT_FILE, saved));
+    native::reset();  // Power cycle: RTC memory and the flash image are lost here, so put the file back
+    LittleFS.begin();
+    native::fsWrite(OUTPUT_SNAPSHOT_FILE, saved);
+
+    DeviceManager manager;
+    TEST_ASSERT_FALSE(manager.restoreOutputs(SNAPSHOT_RTC));
+    TEST_ASSERT_TRUE(manager.restoreOutputs(SNAPSHOT_FLASH));
+    TEST_ASSERT_EQUAL(OUTPUT, native::pinMode(kRelayPin));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kRelayPin));
+    TEST_ASSERT_EQUAL(OUTPUT, native::pinMode(kDimmerPin));
+    TEST_ASSERT_EQUAL(0, native::analogOutput(kDimmerPin));
+}
+
+void test_corrupt_snapshot_is_ignored(void) {
+    {
+        DeviceManager manager;
+        native::bootConfig(manager);
+    }
+    std::string saved;
+    native::fsRead(OUTPUT_SNAPSHOT_FILE, saved);
+    saved[saved.size() - 1] ^= 0x40;
+    native::fsWrite(OUTPUT_SNAPSHOT_FILE, saved);
+    uint32_t garbage[4] = {0xDEADBEEF, 1, 2, 3};
+    ESP.rtcUserMemoryWrite(OUTPUT_SNAPSHOT_RTC_OFFSET, garbage, sizeof(garbage));
+
+    DeviceManager manager;
+    TEST_ASSERT_FALSE(manager.restoreOutputs(SNAPSHOT_RTC));
+    TEST_ASSERT_FALSE(manager.restoreOutputs(SNAPSHOT_FLASH));
+}
+
+void test_outputs_ready_within_100ms_of_reset(void) {
+    native::setMicros(60000);  // The SDK's own startup before setup()
+    setup();
+    native::setDigitalInput(kInputPin, HIGH);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    deviceManager.readSensorsAndHandleBehaviors();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+
+    // Reset, with the UART charged its real transmit time this boot
+    ESP.restart();
+    native::setMicros(60000);
+    native::setSerialTiming(true);
+    setup();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kRelayPin));
+    TEST_ASSERT_TRUE(BootProfiler::outputsReadyUs() < 100000);
+
+    std::string response =
+        native::httpExchange("GET /boot HTTP/1.1\r\nHost: test\r\n\r\n", [] { server.handleClients(); });
+    TEST_ASSERT_TRUE(response.find("\"outputsSource\":\"rtc\"") != std::string::npos);
+    TEST_ASSERT_TRUE(response.find("\"name\":\"config\"") != std::string::npos);
+    TEST_ASSERT_TRUE(response.find("\"sdkUs\":60000") != std::string::npos);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_nothing_to_restore_on_first_boot);
+    RUN_TEST(test_reset_restores_levels_from_rtc);
+    RUN_TEST(test_reset_mid_pulse_restores_the_output_off);
+    RUN_TEST(test_power_cycle_restores_outputs_off_from_flash);
+    RUN_TEST(test_corrupt_snapshot_is_ignored);
+    RUN_TEST(test_outputs_ready_within_100ms_of_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,247 @@
+// Streaming /config: uploads parsed a component at a time while they are
+// copied to flash, validation part-way through, and the live config
+// running on until an upload is accepted.
+//
+//   pio test -e native -f test_native_config
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "DeviceManagement.h"
+#include "HttpServer.h"
+#include "JsonPool.h"
+
+namespace {
+
+HttpServer* server;
+DeviceManager* manager;
+
+// Component i reads pin i % 16 and drives pin 32 + i % 16
+String buildConfig(int components, const char* extra = "") {
+    String json = "{\"devices\":[{\"components\":[";
+    char buffer[320];
+    for (int i = 0; i < components; i++) {
+        snprintf(buffer, sizeof(buffer),
+                 "%s{\"componentName\":\"sensor_led_touch_%d\",\"componentType\":\"digital\",\"componentPin\":%d,"
+                 "\"actionType\":\"digital\",\"actionPin\":%d,\"behaviors\":[\"toggle\",\"scheduled\"],",
+                 i ? "," : "", i, i % 16, 32 + i % 16);
+        json += buffer;
+        if (i == components - 1) {
+            json += extra;
+        }
+        json += "\"schedule\":{\"startTime\":{\"hour\":8,\"minute\":30},\"endTime\":{\"hour\":17,\"minute\":45}}}";
+    }
+    json += "]}],\"rules\":[{\"when\":[\"sensor_led_touch_0\"],\"do\":\"on\",\"targets\":[\"sensor_led_touch_1\"]}]}";
+    return json;
+}
+
+void pump(int passes = 4) {
+    for (int i = 0; i < passes; i++) {
+        native::pollNetwork();
+        server->handleClients();
+    }
+}
+
+// Sends body as HTTP chunks of chunkSize bytes, pumping the server after each
+std::string upload(native::LoopbackClient& client, const String& body, size_t chunkSize = 256) {
+    client.send("POST /config HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: chunked\r\n\r\n");
+    for (size_t at = 0; at < body.length(); at += chunkSize) {
+        size_t length = std::min(chunkSize, body.length() - at);
+        char size[16];
+        snprintf(size, sizeof(size), "%zx\r\n", length);
+        client.send(std::string(size) + std::string(body.c_str() + at, length) + "\r\n");
+        pump(2);
+    }
+    client.send("0\r\n\r\n");
+    pump();
+    return client.receive();
+}
+
+int componentCount() {
+    std::string response =
+        native::httpExchange("GET /devices HTTP/1.1\r\nHost: test\r\n\r\n", [] { server->handleClients(); }, 64);
+    int count = 0;
+    for (size_t at = response.find("\"componentName\""); at != std::string::npos;
+         at = response.find("\"componentName\"", at + 1)) {
+        count++;
+    }
+    return count;
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    manager = new DeviceManager();
+    native::bootConfig(*manager, buildConfig(2).c_str());
+    server = new HttpServer(80);
+    server->on(
+        "/config", HTTP_POST, [](HttpRequest* request) { manager->handleConfig(request); },
+        [](HttpRequest* request, const uint8_t* data, size_t len, size_t index, size_t total) {
+            manager->handleConfigBody(request, data, len, index, total);
+        });
+    server->on("/devices", HTTP_GET, [](HttpRequest* request) { manager->handleGetDevices(request); });
+    server->begin();
+}
+
+void tearDown(void) {
+    delete server;
+    delete manager;
+}
+
+void test_upload_larger_than_a_buffered_body(void) {
+    String config = buildConfig(120);
+    TEST_ASSERT_TRUE(config.length() > HTTP_MAX_BODY);
+    native::LoopbackClient client;
+    std::string response = upload(client, config);
+    TEST_ASSERT_TRUE(response.find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_EQUAL(120, componentCount());
+
+    // The text on flash is the upload as sent
+    std::string saved;
+    TEST_ASSERT_TRUE(native::fsRead(CONFIG_FILE, saved));
+    TEST_ASSERT_EQUAL_STRING(config.c_str(), saved.c_str());
+    TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_UPLOAD_FILE));
+
+    // And it boots
+    DeviceManager rebooted;
+    rebooted.loadConfig();
+    TEST_ASSERT_EQUAL(120, rebooted.inputPins().size());
+}
+
+void test_peak_memory_does_not_grow_with_the_upload(void) {
+    JsonPool* pool = JsonPool::instance();
+    size_t peaks[2];
+    const int sizes[2] = {10, 200};
+    for (int i = 0; i < 2; i++) {
+        native::LoopbackClient client;
+        pool->resetPeak();
+        TEST_ASSERT_TRUE(upload(client, buildConfig(sizes[i])).find("HTTP/1.1 200") == 0);
+        peaks[i] = pool->peak();
+    }
+    // One component's document at a time, or the rules; never the whole config
+    TEST_ASSERT_EQUAL(peaks[0], peaks[1]);
+    TEST_ASSERT_EQUAL(0, pool->used());
+}
+
+void test_invalid_component_rejects_the_upload(void) {
+    std::string before;
+    native::fsRead(CONFIG_FILE, before);
+    native::LoopbackClient client;
+    std::string response = upload(client, buildConfig(40, "\"pollMs\":0,"));
+    TEST_ASSERT_TRUE(response.find("HTTP/1.1 400") == 0);
+    TEST_ASSERT_TRUE(response.find("{\"error\":\"Invalid pollMs\"}") != std::string::npos);
+
+    // Nothing changed, and the connection is ready for the next request
+    TEST_ASSERT_EQUAL(2, componentCount());
+    std::string after;
+    native::fsRead(CONFIG_FILE, after);
+    TEST_ASSERT_EQUAL_STRING(before.c_str(), after.c_str());
+    TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_UPLOAD_FILE));
+    TEST_ASSERT_TRUE(upload(client, buildConfig(3)).find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_EQUAL(3, componentCount());
+}
+
+void test_malformed_uploads_are_rejected(void) {
+    std::string padding = "\"padding\":\"" + std::string(CONFIG_MAX_COMPONENT, 'x') + "\",";
+    struct {
+        String body;
+        const char* error;
+    } cases[] = {
+        {"{\"devices\":{}}", "Invalid JSON structure"},
+        {"{\"rules\":[]}", "Invalid JSON structure"},
+        {"{\"devices\":[{\"components\":[{\"componentName\":\"a\"}]}]}", "Missing fields"},
+        {"{\"devices\":[{}]}", "Invalid JSON structure"},
+        {buildConfig(5).substring(0, 300), "Invalid JSON"},
+        {buildConfig(5) + "]", "Invalid JSON"},
+        {buildConfig(5, padding.c_str()), "Component too large"},
+        {buildConfig(5, "\"analog\":{\"sampleMs\":70000},"), "Invalid analog settings"},
+        {buildConfig(5, "\"analog\":{\"high\":-5},"), "Invalid analog settings"},
+        {buildConfig(5, "\"analog\":{\"oversample\":\"4\"},"), "Invalid analog settings"},
+        {buildConfig(5, "\"analog\":[100],"), "Invalid analog settings"},
+        {"{\"devices\":[{\"components\":[]}],\"rules\":[{\"when\":[\"missing\"],\"do\":\"on\",\"targets\":[]}]}",
+         "Invalid rules"},
+    };
+    for (const auto& c : cases) {
+        native::LoopbackClient client;
+        std::string response = upload(client, c.body, 64);
+        TEST_ASSERT_TRUE_MESSAGE(response.find("HTTP/1.1 400") == 0, c.error);
+        TEST_ASSERT_TRUE_MESSAGE(response.find(std::string("{\"error\":\"") + c.error + "\"}") != std::string::npos,
+                                 c.error);
+        TEST_ASSERT_EQUAL(2, componentCount());
+    }
+}
+
+void test_live_config_runs_during_an_upload(void) {
+    String config = buildConfig(30);
+    size_t half = config.length() / 2;
+    native::LoopbackClient client;
+    client.send("POST /config HTTP/1.1\r\nHost: test\r\nContent-Length: " + std::to_string(config.length()) +
+                "\r\n\r\n" + std::string(config.c_str(), half));
+    pump();
+
+    // The old config still answers inputs while the new one is staged
+    native::setDigitalInput(0, HIGH);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager->readSensorsAndHandleBehaviors();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(32));
+    TEST_ASSERT_EQUAL(2, componentCount());
+
+    client.send(std::string(config.c_str() + half));
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_EQUAL(30, componentCount());
+}
+
+// A client that goes away mid-upload leaves nothing staged or open behind
+void test_abandoned_upload_is_discarded(void) {
+    String config = buildConfig(30);
+    size_t half = config.length() / 2;
+    {
+        native::LoopbackClient client;
+        client.send("POST /config HTTP/1.1\r\nHost: test\r\nContent-Length: " + std::to_string(config.length()) +
+                    "\r\n\r\n" + std::string(config.c_str(), half));
+        pump();
+        TEST_ASSERT_TRUE(LittleFS.exists(CONFIG_UPLOAD_FILE));
+        client.close();
+        pump();
+    }
+    TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_UPLOAD_FILE));
+    TEST_ASSERT_EQUAL(2, componentCount());
+
+    native::LoopbackClient client;
+    TEST_ASSERT_TRUE(upload(client, buildConfig(3)).find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_EQUAL(3, componentCount());
+}
+
+// A config already on flash defaults what it can instead of being refused
+void test_boot_defaults_invalid_settings(void) {
+    native::fsWrite(CONFIG_FILE, buildConfig(4, "\"pollMs\":0,").c_str());
+    DeviceManager rebooted;
+    rebooted.loadConfig();
+    rebooted.configureDevices();
+    TEST_ASSERT_EQUAL(4, rebooted.inputPins().size());
+
+    native::fsWrite(CONFIG_FILE, "{\"devices\":[{\"components\":[");
+    DeviceManager truncated;
+    truncated.loadConfig();
+    TEST_ASSERT_EQUAL(0, truncated.inputPins().size());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_upload_larger_than_a_buffered_body);
+    RUN_TEST(test_peak_memory_does_not_grow_with_the_upload);
+    RUN_TEST(test_invalid_component_rejects_the_upload);
+    RUN_TEST(test_malformed_uploads_are_rejected);
+    RUN_TEST(test_live_config_runs_during_an_upload);
+    RUN_TEST(test_abandoned_upload_is_discarded);
+    RUN_TEST(test_boot_defaults_invalid_settings);
+    return UNITY_END();
+}
@@ -0,0 +1,133 @@
+// Discovery: the chip-ID hostname, the _intellios._tcp service and its TXT
+// records, and announcements of a changed state.
+//
+//   pio test -e native -f test_native_discovery
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "DeviceManagement.h"
+#include "Discovery.h"
+#include "HttpServer.h"
+#include "TaskDefinitions.h"
+
+void setup();
+void loop();
+extern HttpServer server;
+extern DeviceManager deviceManager;
+
+namespace {
+
+const char* kService = "_intellios._tcp";
+
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"relay\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"]},"
+    "{\"componentName\":\"dimmer\",\"componentType\":\"digital\",\"componentPin\":12,"
+    "\"actionType\":\"pwm\",\"actionPin\":14,\"behaviors\":[\"toggle\"]}]}]}";
+
+void run(unsigned long ms) {
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += 10) {
+        native::advanceMillis(10);
+        native::pollNetwork();
+        loop();
+    }
+}
+
+void control(const char* body) {
+    std::string request = std::string("POST /control HTTP/1.1\r\nHost: test\r\nContent-Length: ") +
+                          std::to_string(strlen(body)) + "\r\n\r\n" + body;
+    std::string response = native::httpExchange(request, [] { server.handleClients(); });
+    TEST_ASSERT_TRUE(response.find("HTTP/1.1 200") == 0);
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite(CONFIG_FILE, kConfig);
+    setup();
+}
+
+void tearDown(void) {}
+
+void test_hostname_and_service(void) {
+    TEST_ASSERT_EQUAL_STRING("intellios-c0ffee", Discovery::hostname());
+    TEST_ASSERT_EQUAL_STRING("intellios-c0ffee", MDNS.hostname().c_str());
+    TEST_ASSERT_EQUAL_STRING("intellios-c0ffee", WiFi.hostname().c_str());
+
+    TEST_ASSERT_EQUAL(1, MDNS.services().size());
+    TEST_ASSERT_EQUAL_STRING(kService, MDNS.services()[0].c_str());
+    TEST_ASSERT_EQUAL(80, MDNS.port(kService));
+    TEST_ASSERT_EQUAL_STRING("intellios-c0ffee", MDNS.instanceName(kService).c_str());
+}
+
+void test_txt_records_summarize_the_device(void) {
+    TEST_ASSERT_EQUAL_STRING(FIRMWARE_VERSION, MDNS.txt(kService, "fw").c_str());
+    TEST_ASSERT_EQUAL_STRING("2", MDNS.txt(kService, "components").c_str());
+    char state[9];
+    snprintf(state, sizeof(state), "%08x", Discovery::state());
+    TEST_ASSERT_EQUAL_STRING(state, MDNS.txt(kService, "state").c_str());
+    TEST_ASSERT_EQUAL_UINT32(deviceManager.stateHash(), Discovery::state());
+}
+
+void test_output_change_is_announced_once(void) {
+    uint32_t before = Discovery::state();
+    unsigned long announced = MDNS.announcements();
+
+    control("{\"componentName\":\"relay\",\"action\":\"toggle\"}");
+    control("{\"componentName\":\"dimmer\",\"action\":\"control\",\"level\":128,\"fadeMs\":500}");
+    // Both changes go out together after DISCOVERY_ANNOUNCE_MS; the fade counts at its target
+    TEST_ASSERT_EQUAL_UINT32(before, Discovery::state());
+    run(DISCOVERY_ANNOUNCE_MS + 20);
+    TEST_ASSERT_EQUAL(announced + 1, MDNS.announcements());
+    uint32_t after = Discovery::state();
+    TEST_ASSERT_FALSE(after == before);
+    run(1000);  // The fade ends without another announcement
+    TEST_ASSERT_EQUAL(announced + 1, MDNS.announcements());
+    TEST_ASSERT_FALSE(taskAnnounce.isEnabled());
+
+    // Writing the level an output already has is not a change
+    control("{\"componentName\":\"dimmer\",\"action\":\"control\",\"level\":128}");
+    run(DISCOVERY_ANNOUNCE_MS + 20);
+    TEST_ASSERT_EQUAL(announced + 1, MDNS.announcements());
+
+    // Back where it started, back to the same hash
+    control("{\"componentName\":\"relay\",\"action\":\"toggle\"}");
+    control("{\"componentName\":\"dimmer\",\"action\":\"control\",\"level\":0}");
+    run(DISCOVERY_ANNOUNCE_MS + 20);
+    TEST_ASSERT_EQUAL(announced + 2, MDNS.announcements());
+    TEST_ASSERT_EQUAL_UINT32(before, Discovery::state());
+}
+
+void test_config_change_updates_components(void) {
+    const char* config =
+        "{\"devices\":[{\"components\":["
+        "{\"componentName\":\"relay\",\"componentType\":\"digital\",\"componentPin\":4,"
+        "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"]}]}]}";
+    native::LoopbackClient client;
+    client.send(std::string("POST /config HTTP/1.1\r\nHost: test\r\nContent-Length: ") +
+                std::to_string(strlen(config)) + "\r\n\r\n" + config);
+    run(20);
+    TEST_ASSERT_TRUE(client.receive().find("HTTP/1.1 200") == 0);
+    run(DISCOVERY_ANNOUNCE_MS);
+    TEST_ASSERT_EQUAL_STRING("1", MDNS.txt(kService, "components").c_str());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hostname_and_service);
+    RUN_TEST(test_txt_records_summarize_the_device);
+    RUN_TEST(test_output_change_is_announced_once);
+    RUN_TEST(test_config_change_updates_components);
+    return UNITY_END();
+}
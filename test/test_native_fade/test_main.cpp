@@ -0,0 +1,179 @@
+// FadeEngine interpolation, gamma and write suppression, and /control driving
+// a PWM output through DeviceManager.
+//
+//   pio test -e native -f test_native_fade
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "DeviceManagement.h"
+#include "FadeEngine.h"
+#include "HttpServer.h"
+#include "TaskDefinitions.h"
+
+namespace {
+
+const int kPin = 5;
+
+// Steps the engine at FADE_STEP_MS for ms milliseconds
+void runFor(FadeEngine& engine, unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += FADE_STEP_MS) {
+        native::advanceMillis(FADE_STEP_MS);
+        engine.update();
+    }
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+}
+
+void tearDown(void) {}
+
+void test_fade_interpolates_and_lands_on_target(void) {
+    FadeEngine engine;
+    engine.attach(kPin, false);
+    engine.fadeTo(kPin, 255, 1000);
+    TEST_ASSERT_TRUE(engine.active());
+    runFor(engine, 500);
+    TEST_ASSERT_INT_WITHIN(1, 127, engine.level(kPin));
+    TEST_ASSERT_INT_WITHIN(4, PWM_RANGE / 2, native::analogOutput(kPin));
+    runFor(engine, 500);
+    TEST_ASSERT_FALSE(engine.active());
+    TEST_ASSERT_EQUAL(255, engine.level(kPin));
+    TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(kPin));
+}
+
+void test_late_step_catches_up(void) {
+    FadeEngine engine;
+    engine.attach(kPin, false);
+    engine.fadeTo(kPin, 200, 1000);
+    native::advanceMillis(750);  // loop() blocked for most of the fade
+    engine.update();
+    TEST_ASSERT_INT_WITHIN(1, 150, engine.level(kPin));
+}
+
+void test_unchanged_pwm_values_are_not_written(void) {
+    FadeEngine engine;
+    engine.attach(kPin, false);
+    engine.fadeTo(kPin, 2, 2000);  // 100 steps across 8 PWM counts
+    unsigned long writesBefore = native::pinWrites();
+    runFor(engine, 2000);
+    TEST_ASSERT_EQUAL(8, native::pinWrites() - writesBefore);
+    TEST_ASSERT_EQUAL(8, native::analogOutput(kPin));
+}
+
+void test_gamma_curve(void) {
+    FadeEngine engine;
+    engine.attach(kPin, true);
+    engine.fadeTo(kPin, 128, 0);
+    TEST_ASSERT_INT_WITHIN(2, 223, native::analogOutput(kPin));  // 1023 * (128/255)^2.2
+    engine.fadeTo(kPin, 255, 0);
+    TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(kPin));
+    engine.fadeTo(kPin, 0, 0);
+    TEST_ASSERT_EQUAL(0, native::analogOutput(kPin));
+}
+
+void test_retarget_starts_from_current_level(void) {
+    FadeEngine engine;
+    engine.attach(kPin, false);
+    engine.fadeTo(kPin, 200, 1000);
+    runFor(engine, 500);
+    uint8_t midway = engine.level(kPin);
+    engine.fadeTo(kPin, 0, 1000);
+    native::advanceMillis(1);
+    engine.update();
+    TEST_ASSERT_INT_WITHIN(1, midway, engine.level(kPin));
+}
+
+void test_many_fades_share_one_update(void) {
+    FadeEngine engine;
+    for (int pin = 0; pin < 64; pin++) {
+        engine.attach(pin, pin % 2 == 0);
+        engine.fadeTo(pin, 255, 100 + pin * 10);
+    }
+    int updates = 0;
+    while (engine.active()) {
+        native::advanceMillis(FADE_STEP_MS);
+        engine.update();
+        updates++;
+    }
+    TEST_ASSERT_EQUAL((100 + 63 * 10 + FADE_STEP_MS - 1) / FADE_STEP_MS, updates);  // Until the longest one ends
+    for (int pin = 0; pin < 64; pin++) {
+        TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(pin));
+    }
+}
+
+void test_control_fades_the_action_pin(void) {
+    DeviceManager manager;
+    native::bootConfig(manager,
+                       "{\"devices\":[{\"components\":["
+                       "{\"componentName\":\"lamp\",\"componentType\":\"digital\",\"componentPin\":4,"
+                       "\"actionType\":\"pwm\",\"actionPin\":14,\"behaviors\":[\"toggle\"]}]}]}");
+    HttpServer server(80);
+    server.on("/control", HTTP_POST, [&manager](HttpRequest* request) { manager.handleControl(request); });
+    server.begin();
+
+    std::string body = "{\"componentName\":\"lamp\",\"action\":\"control\",\"level\":255,\"fadeMs\":400}";
+    std::string request =
+        "POST /control HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::string response = native::httpExchange(request, [&server] { server.handleClients(); });
+    TEST_ASSERT_TRUE(response.find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_EQUAL(0, native::analogOutput(4));  // Not the input pin
+    TEST_ASSERT_TRUE(taskFade.isEnabled());
+
+    for (int t = 0; t < 400; t += FADE_STEP_MS) {
+        native::advanceMillis(FADE_STEP_MS);
+        manager.updateFades();
+    }
+    TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(14));
+    TEST_ASSERT_FALSE(manager.updateFades());
+}
+
+void test_devices_flag_pwm_outputs(void) {
+    DeviceManager manager;
+    native::bootConfig(manager,
+                       "{\"devices\":[{\"components\":["
+                       "{\"componentName\":\"relay\",\"componentType\":\"digital\",\"componentPin\":4,"
+                       "\"actionType\":\"digital\",\"actionPin\":12,\"behaviors\":[\"toggle\"]},"
+                       "{\"componentName\":\"lamp\",\"componentType\":\"digital\",\"componentPin\":5,"
+                       "\"actionType\":\"pwm\",\"actionPin\":14,\"behaviors\":[\"toggle\"]},"
+                       "{\"componentName\":\"light\",\"componentType\":\"analog\",\"componentPin\":17,"
+                       "\"actionType\":\"digital\",\"actionPin\":13,\"behaviors\":[]}]}]}");
+    HttpServer server(80);
+    server.on("/devices", HTTP_GET, [&manager](HttpRequest* request) { manager.handleGetDevices(request); });
+    server.begin();
+
+    std::string response =
+        native::httpExchange("GET /devices HTTP/1.1\r\n\r\n", [&server] { server.handleClients(); }, 64);
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, response.substr(response.find("\r\n\r\n") + 4)));
+    JsonArray components = doc["devices"][0]["components"];
+    TEST_ASSERT_EQUAL(3, components.size());
+    TEST_ASSERT_FALSE(components[0]["pwm"].as<bool>());
+    TEST_ASSERT_TRUE(components[1]["pwm"].as<bool>());
+    // An analog input drives its output with PWM whatever its actionType says
+    TEST_ASSERT_TRUE(components[2]["pwm"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING("digital", components[2]["actionType"].as<const char*>());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fade_interpolates_and_lands_on_target);
+    RUN_TEST(test_late_step_catches_up);
+    RUN_TEST(test_unchanged_pwm_values_are_not_written);
+    RUN_TEST(test_gamma_curve);
+    RUN_TEST(test_retarget_starts_from_current_level);
+    RUN_TEST(test_many_fades_share_one_update);
+    RUN_TEST(test_control_fades_the_action_pin);
+    RUN_TEST(test_devices_flag_pwm_outputs);
+    return UNITY_END();
+}
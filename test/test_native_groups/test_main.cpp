@@ -0,0 +1,233 @@
+// Group control: multicast frames applied to the components of a group,
+// repeats suppressed, acks, and one frame reaching several devices. Frames
+// travel over real loopback multicast, as between simulators.
+//
+//   pio test -e native -f test_native_groups
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <ESPAsyncUDP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "DeviceManagement.h"
+#include "GroupControl.h"
+#include "HttpServer.h"
+
+void setup();
+void loop();
+extern HttpServer server;
+extern GroupControl groupControl;
+
+namespace {
+
+const int kHallPin = 5;
+const int kStairsPin = 13;
+const int kDimmerPin = 14;
+
+// hall and stairs are lights (group 1), the dimmer is in groups 1 and 7
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"hall\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"],\"groups\":[1]},"
+    "{\"componentName\":\"stairs\",\"componentType\":\"digital\",\"componentPin\":12,"
+    "\"actionType\":\"digital\",\"actionPin\":13,\"behaviors\":[\"toggle\"],\"groups\":[1,3]},"
+    "{\"componentName\":\"dimmer\",\"componentType\":\"digital\",\"componentPin\":0,"
+    "\"actionType\":\"pwm\",\"actionPin\":14,\"behaviors\":[\"toggle\"],\"groups\":[7,1]},"
+    "{\"componentName\":\"fan\",\"componentType\":\"digital\",\"componentPin\":2,"
+    "\"actionType\":\"digital\",\"actionPin\":15,\"behaviors\":[\"toggle\"]}]}]}";
+
+IPAddress groupAddress() {
+    IPAddress address;
+    address.fromString(GROUP_MULTICAST_ADDRESS);
+    return address;
+}
+
+std::string frame(GroupOp op, uint16_t group, uint32_t seq, uint8_t level, bool ack, uint16_t fadeMs = 0) {
+    uint8_t data[GROUP_FRAME_SIZE];
+    uint8_t flags = ack ? GROUP_FLAG_ACK : 0;
+    size_t length = GroupControl::encode(GroupFrame{op, group, seq, level, flags, fadeMs}, data);
+    return std::string(reinterpret_cast<char*>(data), length);
+}
+
+// Lets loopback deliver, then runs loop() passes to apply what arrived
+void run(int passes = 5) {
+    for (int i = 0; i < passes; i++) {
+        delay(1);
+        native::pollNetwork();
+        loop();
+    }
+}
+
+std::string post(const char* path, const std::string& body) {
+    return native::httpExchange(std::string("POST ") + path + " HTTP/1.1\r\nHost: test\r\nContent-Length: " +
+                                    std::to_string(body.size()) + "\r\n\r\n" + body,
+                                [] { server.handleClients(); });
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite(CONFIG_FILE, kConfig);
+    setup();
+}
+
+void tearDown(void) {}
+
+void test_frame_round_trip(void) {
+    std::string encoded = frame(GROUP_OP_SET, 0x1234, 0xA1B2C3D4, 200, true, 1500);
+    TEST_ASSERT_EQUAL(GROUP_FRAME_SIZE, encoded.size());
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(encoded.data());
+    TEST_ASSERT_EQUAL(0x12, bytes[4]);  // Big-endian on the wire
+    TEST_ASSERT_EQUAL(0xA1, bytes[6]);
+
+    GroupFrame decoded;
+    TEST_ASSERT_TRUE(GroupControl::decode(bytes, encoded.size(), decoded));
+    TEST_ASSERT_EQUAL(GROUP_OP_SET, decoded.op);
+    TEST_ASSERT_EQUAL(0x1234, decoded.group);
+    TEST_ASSERT_EQUAL_UINT32(0xA1B2C3D4, decoded.seq);
+    TEST_ASSERT_EQUAL(200, decoded.level);
+    TEST_ASSERT_EQUAL(GROUP_FLAG_ACK, decoded.flags);
+    TEST_ASSERT_EQUAL(1500, decoded.fadeMs);
+
+    TEST_ASSERT_FALSE(GroupControl::decode(bytes, encoded.size() - 1, decoded));
+    std::string corrupt = encoded;
+    corrupt[2] = GROUP_VERSION + 1;
+    TEST_ASSERT_FALSE(GroupControl::decode(reinterpret_cast<const uint8_t*>(corrupt.data()), corrupt.size(), decoded));
+    corrupt = encoded;
+    corrupt[3] = 9;
+    TEST_ASSERT_FALSE(GroupControl::decode(reinterpret_cast<const uint8_t*>(corrupt.data()), corrupt.size(), decoded));
+}
+
+void test_set_reaches_the_group_and_is_acked(void) {
+    native::UdpPeer controller;
+    TEST_ASSERT_TRUE(controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_SET, 1, 1, 255, true)));
+    run();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kHallPin));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kStairsPin));
+    TEST_ASSERT_EQUAL(PWM_RANGE, native::analogOutput(kDimmerPin));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(15));  // The fan is in no group
+
+    std::vector<std::string> acks = controller.receive(100);
+    TEST_ASSERT_EQUAL(1, acks.size());
+    TEST_ASSERT_EQUAL(GROUP_ACK_SIZE, acks[0].size());
+    GroupFrame ack;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(acks[0].data());
+    TEST_ASSERT_TRUE(GroupControl::decode(bytes, acks[0].size(), ack));
+    TEST_ASSERT_EQUAL(GROUP_OP_ACK, ack.op);
+    TEST_ASSERT_EQUAL(1, ack.group);
+    TEST_ASSERT_EQUAL_UINT32(1, ack.seq);
+    TEST_ASSERT_EQUAL(3, ack.level);  // Components reached
+    TEST_ASSERT_EQUAL_UINT32(ESP.getChipId(), (uint32_t)bytes[14] << 24 | bytes[15] << 16 | bytes[16] << 8 | bytes[17]);
+
+    // Group 3 is only the stairs; without the flag there is no ack
+    controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_SET, 3, 2, 0, false));
+    run();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kHallPin));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kStairsPin));
+    TEST_ASSERT_EQUAL(0, controller.receive(20).size());
+}
+
+void test_repeats_are_acked_but_applied_once(void) {
+    native::UdpPeer controller;
+    unsigned long duplicates = groupControl.duplicates();
+    // A toggle applied twice would leave the lights off
+    for (int i = 0; i < 3; i++) {
+        controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_ACTION, 1, 42, 0, true));
+    }
+    run();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kHallPin));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(kStairsPin));
+    TEST_ASSERT_EQUAL(duplicates + 2, groupControl.duplicates());
+    std::vector<std::string> acks = controller.receive(100);
+    TEST_ASSERT_EQUAL(3, acks.size());
+    TEST_ASSERT_EQUAL(3, static_cast<uint8_t>(acks[2][10]));  // The repeat reports what the first one reached
+
+    // A new seq is a new command
+    controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_ACTION, 1, 43, 0, false));
+    run();
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kHallPin));
+}
+
+void test_group_zero_reaches_every_component(void) {
+    native::UdpPeer controller;
+    controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_SET, 0, 7, 128, true, 400));
+    run();
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(15));
+    std::vector<std::string> acks = controller.receive(100);
+    TEST_ASSERT_EQUAL(1, acks.size());
+    TEST_ASSERT_EQUAL(4, static_cast<uint8_t>(acks[0][10]));
+
+    // The dimmer fades like a /control request with fadeMs would
+    int start = native::analogOutput(kDimmerPin);
+    TEST_ASSERT_TRUE(start < PWM_RANGE / 4);
+    for (int i = 0; i < 50; i++) {
+        native::advanceMillis(10);
+        loop();
+    }
+    TEST_ASSERT_TRUE(native::analogOutput(kDimmerPin) > start);
+}
+
+void test_malformed_frames_are_dropped(void) {
+    native::UdpPeer controller;
+    unsigned long dropped = groupControl.dropped();
+    controller.send(groupAddress(), GROUP_PORT, "hello");
+    controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_ACK, 1, 5, 255, true));
+    run();
+    TEST_ASSERT_EQUAL(dropped + 2, groupControl.dropped());
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(kHallPin));
+    TEST_ASSERT_EQUAL(0, controller.receive(20).size());
+}
+
+void test_one_frame_reaches_the_fleet(void) {
+    // A second device on the same host, as a second simulator would be
+    DeviceManager otherDevices;
+    native::bootConfig(otherDevices);
+    GroupControl other(otherDevices);
+    TEST_ASSERT_TRUE(other.begin());
+
+    native::UdpPeer controller;
+    controller.send(groupAddress(), GROUP_PORT, frame(GROUP_OP_SET, 7, 99, 255, true));
+    run();
+    other.handlePackets();
+    TEST_ASSERT_EQUAL(1, other.received());
+    std::vector<std::string> acks = controller.receive(100);
+    TEST_ASSERT_EQUAL(2, acks.size());
+    TEST_ASSERT_EQUAL(1, static_cast<uint8_t>(acks[0][10]));
+    TEST_ASSERT_EQUAL(1, static_cast<uint8_t>(acks[1][10]));
+}
+
+void test_groups_in_config(void) {
+    std::string devices =
+        native::httpExchange("GET /devices HTTP/1.1\r\nHost: test\r\n\r\n", [] { server.handleClients(); });
+    TEST_ASSERT_TRUE(devices.find("\"groups\":[1,3]") != std::string::npos);
+    TEST_ASSERT_TRUE(devices.find("\"groups\":[7,1]") != std::string::npos);
+
+    const char* invalid[] = {"[0]", "[65536]", "[1,2,3,4,5]", "7", "[\"lights\"]"};
+    for (const char* groups : invalid) {
+        std::string config = std::string(
+                                 "{\"devices\":[{\"components\":["
+                                 "{\"componentName\":\"hall\",\"componentType\":\"digital\",\"componentPin\":4,"
+                                 "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"],\"groups\":") +
+                             groups + "}]}]}";
+        std::string response = post("/config", config);
+        TEST_ASSERT_TRUE_MESSAGE(response.find("{\"error\":\"Invalid groups\"}") != std::string::npos, groups);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_round_trip);
+    RUN_TEST(test_set_reaches_the_group_and_is_acked);
+    RUN_TEST(test_repeats_are_acked_but_applied_once);
+    RUN_TEST(test_group_zero_reaches_every_component);
+    RUN_TEST(test_malformed_frames_are_dropped);
+    RUN_TEST(test_one_frame_reaches_the_fleet);
+    RUN_TEST(test_groups_in_config);
+    return UNITY_END();
+}
@@ -0,0 +1,304 @@
+// HttpServer behaviour over in-memory loopback connections: keep-alive,
+// pipelining, fairness between clients and request limits.
+//
+//   pio test -e native -f test_native_http
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <memory>
+#include <string>
+
+#include "HttpServer.h"
+
+namespace {
+
+HttpServer* server;
+int handled;
+
+void pump(int passes = 4) {
+    for (int i = 0; i < passes; i++) {
+        native::pollNetwork();
+        server->handleClients();
+    }
+}
+
+std::string get(const char* path, const char* extraHeaders = "") {
+    return std::string("GET ") + path + " HTTP/1.1\r\nHost: test\r\n" + extraHeaders + "\r\n";
+}
+
+int countResponses(const std::string& raw) {
+    int count = 0;
+    for (size_t at = raw.find("HTTP/1.1 "); at != std::string::npos; at = raw.find("HTTP/1.1 ", at + 1)) {
+        count++;
+    }
+    return count;
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    handled = 0;
+    server = new HttpServer(80);
+    server->on("/hello", HTTP_GET, [](HttpRequest* request) {
+        handled++;
+        request->send(200, "text/plain", "hello " + request->arg("name"));
+    });
+    server->on("/echo", HTTP_POST, [](HttpRequest* request) {
+        handled++;
+        request->send(200, "text/plain", request->hasArg("plain") ? request->arg("plain") : request->arg("value"));
+    });
+    // 300 lines of 10 bytes, printed 25 lines at a time
+    server->on("/lines", HTTP_ANY, [](HttpRequest* request) {
+        handled++;
+        std::shared_ptr<int> line = std::make_shared<int>(0);
+        long length = request->hasArg("length") ? 3000 : -1;
+        request->beginStream(
+            200, "text/plain",
+            [line](Print& out) {
+                for (int i = 0; i < 25; i++, (*line)++) {
+                    out.printf("line %04d\n", *line);
+                }
+                return *line < 300;
+            },
+            length);
+    });
+    server->begin();
+}
+
+void tearDown(void) {
+    delete server;
+}
+
+void test_keep_alive_reuses_connection(void) {
+    native::LoopbackClient client;
+    client.send(get("/hello?name=a"));
+    pump();
+    std::string first = client.receive();
+    TEST_ASSERT_TRUE(first.find("Connection: keep-alive") != std::string::npos);
+    TEST_ASSERT_TRUE(first.find("hello a") != std::string::npos);
+
+    client.send(get("/hello?name=b"));
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("hello b") != std::string::npos);
+    TEST_ASSERT_TRUE(client.connected());
+    TEST_ASSERT_EQUAL(1, server->connectionCount());
+}
+
+void test_connection_close_is_honoured(void) {
+    native::LoopbackClient client;
+    client.send(get("/hello", "Connection: close\r\n"));
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("Connection: close") != std::string::npos);
+    TEST_ASSERT_FALSE(client.connected());
+    pump();
+    TEST_ASSERT_EQUAL(0, server->connectionCount());
+}
+
+void test_pipelined_requests_run_one_handler_per_pass(void) {
+    native::LoopbackClient client;
+    client.send(get("/hello") + get("/hello") + get("/hello"));
+    native::pollNetwork();
+    server->handleClients();
+    TEST_ASSERT_EQUAL(1, handled);
+    pump();
+    TEST_ASSERT_EQUAL(3, handled);
+    TEST_ASSERT_EQUAL(3, countResponses(client.receive()));
+}
+
+void test_slow_client_does_not_block_others(void) {
+    native::LoopbackClient slow;
+    native::LoopbackClient fast;
+    slow.send("POST /echo HTTP/1.1\r\nContent-Length: 10\r\n\r\n12345");
+    fast.send(get("/hello?name=fast"));
+    pump();
+    TEST_ASSERT_TRUE(fast.receive().find("hello fast") != std::string::npos);
+    TEST_ASSERT_EQUAL(0, countResponses(slow.receive()));
+
+    slow.send("67890");
+    pump();
+    TEST_ASSERT_TRUE(slow.receive().find("1234567890") != std::string::npos);
+}
+
+void test_form_body_becomes_args(void) {
+    native::LoopbackClient client;
+    client.send(
+        "POST /echo HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: 13\r\n\r\n"
+        "value=a%20b+c");
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("\r\n\r\na b c") != std::string::npos);
+}
+
+void test_oversized_body_is_rejected(void) {
+    native::LoopbackClient client;
+    std::string request = "POST /echo HTTP/1.1\r\nContent-Length: " + std::to_string(HTTP_MAX_BODY + 1) + "\r\n\r\n";
+    client.send(request);
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("HTTP/1.1 413") == 0);
+    TEST_ASSERT_FALSE(client.connected());
+    TEST_ASSERT_EQUAL(0, handled);
+}
+
+void test_chunked_body_is_decoded(void) {
+    std::string streamed;
+    size_t streamedTotal = 1;
+    server->on(
+        "/upload", HTTP_POST, [&](HttpRequest* request) { request->send(200, "text/plain", streamed.c_str()); },
+        [&](HttpRequest*, const uint8_t* data, size_t len, size_t index, size_t total) {
+            TEST_ASSERT_EQUAL(streamed.size(), index);
+            streamed.append(reinterpret_cast<const char*>(data), len);
+            streamedTotal = total;
+        });
+    native::LoopbackClient client;
+    client.send("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n");
+    pump();
+    client.send("7;ext=1\r\n, world\r\n0\r\n\r\n");
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("\r\n\r\nhello, world") != std::string::npos);
+
+    // Streamed to the body handler with an unknown total, on the same connection
+    client.send("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                "3\r\nabc\r\nA\r\n0123456789\r\n0\r\n\r\n");
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("\r\n\r\nabc0123456789") != std::string::npos);
+    TEST_ASSERT_EQUAL(0, streamedTotal);
+
+    // Other transfer codings are still refused
+    client.send("POST /echo HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n");
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("HTTP/1.1 501") == 0);
+}
+
+void test_streamed_body_is_sent_in_pieces(void) {
+    native::LoopbackClient client;
+    client.send(get("/lines"));
+    pump(8);
+    std::string raw = client.receive();
+    TEST_ASSERT_TRUE(raw.find("Transfer-Encoding: chunked") != std::string::npos);
+    TEST_ASSERT_TRUE(raw.find("Content-Length") == std::string::npos);
+    std::string body = native::dechunk(raw);
+    TEST_ASSERT_EQUAL(3000, body.size());
+    TEST_ASSERT_EQUAL_STRING("line 0000\n", body.substr(0, 10).c_str());
+    TEST_ASSERT_EQUAL_STRING("line 0299\n", body.substr(2990).c_str());
+
+    // With the length given it goes out as is, and the connection stays usable
+    client.send(get("/lines?length=1"));
+    pump(8);
+    raw = client.receive();
+    TEST_ASSERT_TRUE(raw.find("Content-Length: 3000\r\n") != std::string::npos);
+    TEST_ASSERT_EQUAL(3000, raw.size() - raw.find("\r\n\r\n") - 4);
+
+    client.send("HEAD /lines HTTP/1.1\r\nHost: test\r\n\r\n");
+    pump();
+    raw = client.receive();
+    TEST_ASSERT_TRUE(raw.find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_EQUAL(raw.size(), raw.find("\r\n\r\n") + 4);
+
+    client.send(get("/hello?name=after"));
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("hello after") != std::string::npos);
+}
+
+void test_unknown_route_is_404(void) {
+    native::LoopbackClient client;
+    client.send(get("/missing"));
+    pump();
+    TEST_ASSERT_TRUE(client.receive().find("HTTP/1.1 404") == 0);
+    TEST_ASSERT_TRUE(client.connected());
+}
+
+void test_idle_connection_times_out(void) {
+    native::LoopbackClient client;
+    client.send(get("/hello"));
+    pump();
+    client.receive();
+    native::advanceMillis(HTTP_KEEP_ALIVE_TIMEOUT * 1000UL);
+    pump();
+    TEST_ASSERT_FALSE(client.connected());
+    TEST_ASSERT_EQUAL(0, server->connectionCount());
+}
+
+// Only a connection idle for a while gives up its slot, and with a FIN
+void test_connection_limit_evicts_idle_clients(void) {
+    native::LoopbackClient clients[HTTP_MAX_CONNECTIONS];
+    pump();
+    native::LoopbackClient extra;
+    extra.send(get("/hello?name=extra"));
+    pump();
+    TEST_ASSERT_EQUAL(HTTP_MAX_CONNECTIONS, server->connectionCount());
+    TEST_ASSERT_TRUE(extra.connected());
+    TEST_ASSERT_EQUAL(0, extra.receive().size());
+    for (auto& client : clients) {
+        TEST_ASSERT_TRUE(client.connected());
+    }
+
+    native::advanceMillis(HTTP_EVICT_IDLE_MS);
+    pump();
+    int open = 0;
+    for (auto& client : clients) {
+        open += client.connected() ? 1 : 0;
+    }
+    TEST_ASSERT_EQUAL(HTTP_MAX_CONNECTIONS - 1, open);
+    TEST_ASSERT_TRUE(extra.receive().find("hello extra") != std::string::npos);
+}
+
+// A client beyond the limit waits instead of being reset, and the slots
+// hand themselves back while it does
+void test_connection_limit_waits_when_all_busy(void) {
+    native::LoopbackClient busy[HTTP_MAX_CONNECTIONS];
+    for (auto& client : busy) {
+        client.send("GET /hello HTTP/1.1\r\n");  // Request still in flight
+    }
+    pump();
+    native::LoopbackClient extra;
+    extra.send(get("/hello?name=extra"));
+    pump();
+    native::advanceMillis(HTTP_EVICT_IDLE_MS);
+    pump();
+    TEST_ASSERT_TRUE(extra.connected());
+    TEST_ASSERT_EQUAL(0, extra.receive().size());
+
+    busy[0].send("\r\n");
+    pump();
+    TEST_ASSERT_TRUE(busy[0].receive().find("Connection: close") != std::string::npos);
+    TEST_ASSERT_TRUE(extra.receive().find("hello extra") != std::string::npos);
+    for (int i = 1; i < HTTP_MAX_CONNECTIONS; i++) {
+        TEST_ASSERT_TRUE(busy[i].connected());
+    }
+}
+
+// Up to HTTP_KEEP_ALIVE_CONNECTIONS stay open; the next response asks its client to close
+void test_keep_alive_stops_when_slots_run_low(void) {
+    native::LoopbackClient clients[HTTP_KEEP_ALIVE_CONNECTIONS + 1];
+    for (auto& client : clients) {
+        client.send(get("/hello"));
+    }
+    pump(8);
+    int closing = 0;
+    for (auto& client : clients) {
+        closing += client.receive().find("Connection: close") != std::string::npos ? 1 : 0;
+    }
+    TEST_ASSERT_TRUE(closing >= 1);
+    TEST_ASSERT_EQUAL(HTTP_KEEP_ALIVE_CONNECTIONS, server->connectionCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_keep_alive_reuses_connection);
+    RUN_TEST(test_connection_close_is_honoured);
+    RUN_TEST(test_pipelined_requests_run_one_handler_per_pass);
+    RUN_TEST(test_slow_client_does_not_block_others);
+    RUN_TEST(test_form_body_becomes_args);
+    RUN_TEST(test_oversized_body_is_rejected);
+    RUN_TEST(test_chunked_body_is_decoded);
+    RUN_TEST(test_streamed_body_is_sent_in_pieces);
+    RUN_TEST(test_unknown_route_is_404);
+    RUN_TEST(test_idle_connection_times_out);
+    RUN_TEST(test_connection_limit_evicts_idle_clients);
+    RUN_TEST(test_connection_limit_waits_when_all_busy);
+    RUN_TEST(test_keep_alive_stops_when_slots_run_low);
+    return UNITY_END();
+}
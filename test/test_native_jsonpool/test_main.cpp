@@ -0,0 +1,123 @@
+// JsonPool: blocks carved from one buffer, the top one resized in place,
+// overflow to the heap, and the pool starting over between requests.
+//
+//   pio test -e native -f test_native_jsonpool
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <cstddef>
+
+#include "JsonPool.h"
+
+namespace {
+
+alignas(std::max_align_t) uint8_t buffer[512];
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+}
+
+void tearDown(void) {}
+
+void test_blocks_come_from_the_buffer(void) {
+    JsonPool pool(buffer, sizeof(buffer));
+    void* a = pool.allocate(40);
+    void* b = pool.allocate(8);
+    TEST_ASSERT_TRUE(a >= buffer && a < buffer + sizeof(buffer));
+    TEST_ASSERT_TRUE(b > a && b < buffer + sizeof(buffer));
+    TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(b) % alignof(std::max_align_t));
+    TEST_ASSERT_EQUAL(2, pool.liveBlocks());
+
+    // Freeing a lower block keeps its bytes until the last one goes
+    size_t used = pool.used();
+    pool.deallocate(a);
+    TEST_ASSERT_EQUAL(used, pool.used());
+    pool.deallocate(b);
+    TEST_ASSERT_EQUAL(0, pool.used());
+    TEST_ASSERT_EQUAL(used, pool.peak());
+    TEST_ASSERT_TRUE(pool.allocate(40) == a);
+}
+
+void test_top_block_resizes_in_place(void) {
+    JsonPool pool(buffer, sizeof(buffer));
+    pool.allocate(16);
+    char* text = static_cast<char*>(pool.allocate(31));
+    strcpy(text, "grown in place");
+    size_t used = pool.used();
+
+    TEST_ASSERT_TRUE(pool.reallocate(text, 200) == text);
+    TEST_ASSERT_TRUE(pool.used() > used);
+    TEST_ASSERT_TRUE(pool.reallocate(text, 15) == text);
+    TEST_ASSERT_TRUE(pool.used() < used);
+    TEST_ASSERT_EQUAL_STRING("grown in place", text);
+
+    // Releasing the top block hands its bytes straight back
+    size_t withText = pool.used();
+    pool.deallocate(text);
+    TEST_ASSERT_TRUE(pool.used() < withText);
+    TEST_ASSERT_EQUAL(1, pool.liveBlocks());
+}
+
+void test_lower_block_moves_when_it_grows(void) {
+    JsonPool pool(buffer, sizeof(buffer));
+    char* text = static_cast<char*>(pool.allocate(16));
+    strcpy(text, "copied");
+    pool.allocate(16);
+
+    char* moved = static_cast<char*>(pool.reallocate(text, 64));
+    TEST_ASSERT_TRUE(moved != text);
+    TEST_ASSERT_EQUAL_STRING("copied", moved);
+    TEST_ASSERT_EQUAL(2, pool.liveBlocks());
+    TEST_ASSERT_TRUE(pool.reallocate(moved, 8) == moved);
+}
+
+void test_overflow_goes_to_the_heap(void) {
+    JsonPool pool(buffer, sizeof(buffer));
+    void* inPool = pool.allocate(256);
+    void* spilled = pool.allocate(512);
+    TEST_ASSERT_TRUE(spilled != nullptr);
+    TEST_ASSERT_FALSE(spilled >= buffer && spilled < buffer + sizeof(buffer));
+    TEST_ASSERT_EQUAL(1, pool.overflows());
+    TEST_ASSERT_EQUAL(2, pool.liveBlocks());
+
+    // A block growing out of the pool keeps its contents
+    memset(inPool, 'x', 256);
+    char* grown = static_cast<char*>(pool.reallocate(inPool, 1024));
+    TEST_ASSERT_EQUAL('x', grown[255]);
+    TEST_ASSERT_EQUAL(2, pool.overflows());
+
+    pool.deallocate(spilled);
+    pool.deallocate(grown);
+    TEST_ASSERT_EQUAL(0, pool.liveBlocks());
+    TEST_ASSERT_EQUAL(0, pool.used());
+}
+
+void test_documents_release_the_pool(void) {
+    JsonPool* pool = JsonPool::instance();
+    TEST_ASSERT_EQUAL(JSON_POOL_SIZE, pool->capacity());
+    {
+        JsonDocument doc(pool);
+        TEST_ASSERT_FALSE(deserializeJson(doc, "{\"componentName\":\"relay\",\"action\":\"control\",\"level\":128}"));
+        TEST_ASSERT_TRUE(pool->used() > 0);
+        TEST_ASSERT_EQUAL_STRING("relay", doc["componentName"] | "");
+    }
+    TEST_ASSERT_EQUAL(0, pool->used());
+    TEST_ASSERT_EQUAL(0, pool->liveBlocks());
+    TEST_ASSERT_TRUE(pool->peak() > 0);
+    TEST_ASSERT_EQUAL(0, pool->overflows());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_blocks_come_from_the_buffer);
+    RUN_TEST(test_top_block_resizes_in_place);
+    RUN_TEST(test_lower_block_moves_when_it_grows);
+    RUN_TEST(test_overflow_goes_to_the_heap);
+    RUN_TEST(test_documents_release_the_pool);
+    return UNITY_END();
+}
@@ -0,0 +1,267 @@
+// MessagePack on the REST API: Accept picks the response format, Content-Type
+// the body's, and a MessagePack /config is rewritten as JSON on its way to
+// flash. Both formats must carry the same document.
+//
+//   pio test -e native -f test_native_msgpack
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP8266WiFi.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "ApiFormat.h"
+#include "DeviceManagement.h"
+#include "Discovery.h"
+#include "HttpServer.h"
+#include "MsgPackStream.h"
+
+void setup();
+void loop();
+extern HttpServer server;
+
+namespace {
+
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"relay\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[\"toggle\"]},"
+    "{\"componentName\":\"dimmer\",\"componentType\":\"digital\",\"componentPin\":12,"
+    "\"actionType\":\"pwm\",\"actionPin\":14,\"behaviors\":[\"toggle\"],\"groups\":[2]}]}]}";
+
+struct Response {
+    int code = 0;
+    std::string type;
+    std::string vary;
+    std::string body;
+};
+
+std::string headerValue(const std::string& head, const char* name) {
+    size_t at = head.find(std::string("\r\n") + name + ": ");
+    if (at == std::string::npos) {
+        return std::string();
+    }
+    at += strlen(name) + 4;
+    return head.substr(at, head.find("\r\n", at) - at);
+}
+
+Response exchange(const char* method, const char* path, const char* headers = "",
+                  const std::string& body = std::string()) {
+    std::string request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: test\r\n" + headers;
+    if (!body.empty()) {
+        request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    std::string raw = native::httpExchange(request + "\r\n" + body, [] { server.handleClients(); }, 64);
+
+    Response response;
+    size_t headEnd = raw.find("\r\n\r\n");
+    if (headEnd == std::string::npos) {
+        return response;
+    }
+    std::string head = raw.substr(0, headEnd + 2);
+    size_t length = strtoul(headerValue(head, "Content-Length").c_str(), nullptr, 10);
+    if (raw.size() >= headEnd + 4 + length) {
+        response.code = atoi(raw.c_str() + 9);
+        response.type = headerValue(head, "Content-Type");
+        response.vary = headerValue(head, "Vary");
+        response.body = raw.substr(headEnd + 4, length);
+    }
+    return response;
+}
+
+std::string toMsgPack(const char* json) {
+    JsonDocument doc;
+    deserializeJson(doc, json);
+    String packed;
+    serializeMsgPack(doc, packed);
+    return std::string(packed.c_str(), packed.length());
+}
+
+// A MessagePack response decoded and written as JSON, to compare with the JSON response
+std::string asJson(const std::string& packed) {
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeMsgPack(doc, packed.data(), packed.size()));
+    String json;
+    serializeJson(doc, json);
+    return json.c_str();
+}
+
+class TextSink : public Print {
+   public:
+    size_t write(uint8_t c) override {
+        text += static_cast<char>(c);
+        return 1;
+    }
+    std::string text;
+};
+
+// Feeds the bytes one at a time, as a body cut at every possible boundary
+bool transcode(const std::string& packed, std::string& json) {
+    TextSink sink;
+    MsgPackToJson decoder;
+    decoder.begin(sink);
+    for (char c : packed) {
+        uint8_t byte = c;
+        decoder.feed(&byte, 1);
+    }
+    json = sink.text;
+    return decoder.finish();
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite(CONFIG_FILE, kConfig);
+    setup();
+}
+
+void tearDown(void) {}
+
+void test_devices_in_either_format(void) {
+    Response json = exchange("GET", "/devices");
+    Response packed = exchange("GET", "/devices", "Accept: application/msgpack\r\n");
+    TEST_ASSERT_EQUAL(200, packed.code);
+    TEST_ASSERT_EQUAL_STRING("application/json", json.type.c_str());
+    TEST_ASSERT_EQUAL_STRING(MSGPACK_CONTENT_TYPE, packed.type.c_str());
+    TEST_ASSERT_EQUAL_STRING("Accept", packed.vary.c_str());
+    TEST_ASSERT_EQUAL_STRING(json.body.c_str(), asJson(packed.body).c_str());
+    TEST_ASSERT_TRUE(packed.body.size() < json.body.size());
+
+    // Listed among others, and the older type name
+    Response listed = exchange("GET", "/devices", "Accept: application/json;q=0.5, application/x-msgpack\r\n");
+    TEST_ASSERT_EQUAL_STRING(MSGPACK_CONTENT_TYPE, listed.type.c_str());
+}
+
+void test_status_and_scan_in_msgpack(void) {
+    Response status = exchange("GET", "/status", "Accept: application/msgpack\r\n");
+    TEST_ASSERT_EQUAL(200, status.code);
+    TEST_ASSERT_EQUAL_STRING(MSGPACK_CONTENT_TYPE, status.type.c_str());
+    TEST_ASSERT_TRUE(asJson(status.body).find("\"firmware\":\"" FIRMWARE_VERSION "\"") != std::string::npos);
+
+    native::wifiAddNetwork("home_wifi", "password", 6);
+    Response scanning = exchange("GET", "/scan", "Accept: application/msgpack\r\n");
+    TEST_ASSERT_EQUAL(202, scanning.code);
+    TEST_ASSERT_EQUAL_STRING("{\"status\":\"scanning\"}", asJson(scanning.body).c_str());
+    native::advanceMillis(5000);
+    Response scan = exchange("GET", "/scan", "Accept: application/msgpack\r\n");
+    TEST_ASSERT_EQUAL(200, scan.code);
+    TEST_ASSERT_TRUE(asJson(scan.body).find("\"ssid\":\"home_wifi\"") != std::string::npos);
+}
+
+void test_control_with_a_msgpack_body(void) {
+    std::string body = toMsgPack("{\"componentName\":\"relay\",\"action\":\"control\",\"level\":255}");
+    Response response = exchange("POST", "/control", "Content-Type: application/msgpack\r\n", body);
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("application/json", response.type.c_str());  // Nothing asked for MessagePack back
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(5));
+
+    // Errors come back in the format asked for
+    response = exchange("POST", "/control", "Content-Type: application/msgpack\r\nAccept: application/msgpack\r\n",
+                        std::string("\xc1", 1));
+    TEST_ASSERT_EQUAL(400, response.code);
+    TEST_ASSERT_EQUAL_STRING("{\"error\":\"Invalid MessagePack\"}", asJson(response.body).c_str());
+    response = exchange("POST", "/control", "Content-Type: application/msgpack\r\nAccept: application/msgpack\r\n",
+                        toMsgPack("{\"componentName\":\"missing\",\"action\":\"toggle\"}"));
+    TEST_ASSERT_EQUAL_STRING("{\"error\":\"Invalid component name\"}", asJson(response.body).c_str());
+
+    // A JSON body still works as before
+    response = exchange("POST", "/control", "Content-Type: application/json\r\n",
+                        "{\"componentName\":\"relay\",\"action\":\"control\",\"level\":0}");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(5));
+}
+
+void test_config_upload_in_msgpack(void) {
+    const char* config =
+        "{\"devices\":[{\"components\":["
+        "{\"componentName\":\"fan \\\"big\\\"\",\"componentType\":\"digital\",\"componentPin\":2,"
+        "\"actionType\":\"digital\",\"actionPin\":15,\"behaviors\":[\"toggle\"],\"pollMs\":70000}]}]}";
+    Response rejected = exchange("POST", "/config", "Content-Type: application/msgpack\r\n", toMsgPack(config));
+    TEST_ASSERT_EQUAL(400, rejected.code);
+    TEST_ASSERT_TRUE(rejected.body.find("Invalid pollMs") != std::string::npos);
+
+    std::string truncated = toMsgPack(kConfig);
+    truncated.resize(truncated.size() - 1);
+    Response response = exchange("POST", "/config", "Content-Type: application/msgpack\r\n", truncated);
+    TEST_ASSERT_EQUAL(400, response.code);
+    TEST_ASSERT_TRUE(response.body.find("Invalid MessagePack") != std::string::npos);
+
+    std::string packed = toMsgPack(
+        "{\"devices\":[{\"components\":["
+        "{\"componentName\":\"fan\",\"componentType\":\"digital\",\"componentPin\":2,"
+        "\"actionType\":\"digital\",\"actionPin\":15,\"behaviors\":[\"toggle\"],\"pollMs\":20}]}],"
+        "\"rules\":[{\"when\":[\"fan\"],\"do\":\"pulse\",\"ms\":250,\"targets\":[\"fan\"]}]}");
+    response = exchange("POST", "/config", "Content-Type: application/msgpack\r\n", packed);
+    TEST_ASSERT_EQUAL(200, response.code);
+
+    // Flash holds JSON, so the next boot reads it as it always has
+    std::string saved;
+    TEST_ASSERT_TRUE(native::fsRead(CONFIG_FILE, saved));
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, saved.c_str()));
+    TEST_ASSERT_EQUAL(20, doc["devices"][0]["components"][0]["pollMs"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("pulse", doc["rules"][0]["do"].as<const char*>());
+    TEST_ASSERT_TRUE(exchange("GET", "/devices").body.find("\"componentName\":\"fan\"") != std::string::npos);
+}
+
+void test_transcoder_types(void) {
+    std::string json;
+    const char* values[] = {
+        "{\"a\":[1,-1,127,-32,128,255,256,65535,65536,-129,-32769,4294967296,-4294967296],\"b\":null}",
+        "[true,false,\"\",\"tab\\tquote\\\"slash\\\\\",{},[],[[[]]]]",
+        "{\"utf8\":\"caf\xc3\xa9\",\"nested\":{\"x\":{\"y\":[0]}}}",
+        "\"just a string\"",
+        "\"ctrl\\u0001\\r\\n\"",
+        "42",
+    };
+    for (const char* value : values) {
+        TEST_ASSERT_TRUE_MESSAGE(transcode(toMsgPack(value), json), value);
+        TEST_ASSERT_EQUAL_STRING(value, json.c_str());
+    }
+
+    // Long strings and containers use the wider headers
+    std::string longText(300, 'x');
+    std::string longJson = "[\"" + longText + "\"";
+    for (int i = 0; i < 20; i++) {
+        longJson += "," + std::to_string(i);
+    }
+    longJson += "]";
+    TEST_ASSERT_TRUE(transcode(toMsgPack(longJson.c_str()), json));
+    TEST_ASSERT_EQUAL_STRING(longJson.c_str(), json.c_str());
+
+    TEST_ASSERT_TRUE(transcode(std::string("\xca\x3f\xc0\x00\x00", 5), json));  // float32 1.5
+    TEST_ASSERT_EQUAL_STRING("1.500000", json.c_str());
+}
+
+void test_transcoder_refuses_what_json_cannot_hold(void) {
+    std::string json;
+    const std::string invalid[] = {
+        std::string("\xc4\x01\x00", 3),                   // bin 8
+        std::string("\xd4\x01\x00", 3),                   // fixext 1
+        std::string("\x81\x01\x02", 3),                   // integer key
+        std::string("\x92\x01", 2),                       // array short of an item
+        std::string("\x01\x02", 2),                       // two values
+        std::string("\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00", 9),  // NaN
+        std::string(MSGPACK_MAX_DEPTH + 1, '\x91') + '\x00',  // too deep
+    };
+    for (const auto& packed : invalid) {
+        TEST_ASSERT_FALSE(transcode(packed, json));
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_devices_in_either_format);
+    RUN_TEST(test_status_and_scan_in_msgpack);
+    RUN_TEST(test_control_with_a_msgpack_body);
+    RUN_TEST(test_config_upload_in_msgpack);
+    RUN_TEST(test_transcoder_types);
+    RUN_TEST(test_transcoder_refuses_what_json_cannot_hold);
+    return UNITY_END();
+}
@@ -0,0 +1,116 @@
+// Poll buckets: components are read at their own pollMs and
+// readSensorsAndHandleBehaviors() reports when the next bucket is due.
+//
+//   pio test -e native -f test_native_poll
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include "DeviceManagement.h"
+
+namespace {
+
+const int kFastPin = 1;
+const int kSlowPin = 2;
+const int kAnalogPin = 3;
+
+// A 10 ms button, a 1 s digital input and an analog input left at its default pollMs
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"button\",\"componentType\":\"digital\",\"componentPin\":1,"
+    "\"actionType\":\"digital\",\"actionPin\":101,\"behaviors\":[\"toggle\"]},"
+    "{\"componentName\":\"door\",\"componentType\":\"digital\",\"componentPin\":2,\"pollMs\":1000,"
+    "\"actionType\":\"digital\",\"actionPin\":102,\"behaviors\":[\"toggle\"]},"
+    "{\"componentName\":\"light\",\"componentType\":\"analog\",\"componentPin\":3,"
+    "\"analog\":{\"sampleMs\":250,\"oversample\":1},"
+    "\"actionType\":\"digital\",\"actionPin\":103,\"behaviors\":[\"toggle\"]}"
+    "]}]}";
+
+// Runs the manager the way taskReadSensors does, sleeping for the returned wait
+void runFor(DeviceManager& manager, unsigned long ms) {
+    unsigned long end = millis() + ms;
+    while ((long)(millis() - end) < 0) {
+        unsigned long wait = manager.readSensorsAndHandleBehaviors();
+        native::advanceMillis(wait ? wait : 1);
+    }
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+}
+
+void tearDown(void) {}
+
+void test_wait_is_time_until_next_bucket(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, kConfig);
+    TEST_ASSERT_EQUAL(10, manager.readSensorsAndHandleBehaviors());
+    native::advanceMillis(4);
+    TEST_ASSERT_EQUAL(6, manager.readSensorsAndHandleBehaviors());
+}
+
+void test_components_are_read_at_their_own_period(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, kConfig);
+    unsigned long digitalBefore = native::digitalReads();
+    runFor(manager, 1000);
+    // 100 passes of the button plus one of the door, each a single digitalRead
+    TEST_ASSERT_EQUAL(101, native::digitalReads() - digitalBefore);
+    TEST_ASSERT_EQUAL(4, native::analogReads());
+}
+
+void test_slow_input_sees_edge_on_its_next_poll(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, kConfig);
+    runFor(manager, 100);
+    native::setDigitalInput(kFastPin, HIGH);
+    native::setDigitalInput(kSlowPin, HIGH);
+    runFor(manager, 10);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(101));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(102));
+    runFor(manager, 891);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(102));
+}
+
+void test_late_pass_does_not_shift_the_schedule(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, kConfig);
+    manager.readSensorsAndHandleBehaviors();
+    native::advanceMillis(13);  // Loop blocked past the 10 ms bucket
+    TEST_ASSERT_EQUAL(7, manager.readSensorsAndHandleBehaviors());
+    native::advanceMillis(30);  // Three periods missed: polled once, back on the grid
+    unsigned long digitalBefore = native::digitalReads();
+    TEST_ASSERT_EQUAL(7, manager.readSensorsAndHandleBehaviors());
+    TEST_ASSERT_EQUAL(1, native::digitalReads() - digitalBefore);
+}
+
+void test_invalid_poll_ms_falls_back_to_default(void) {
+    DeviceManager manager;
+    native::bootConfig(manager,
+         "{\"devices\":[{\"components\":["
+         "{\"componentName\":\"button\",\"componentType\":\"digital\",\"componentPin\":1,\"pollMs\":0,"
+         "\"actionType\":\"digital\",\"actionPin\":101,\"behaviors\":[\"toggle\"]}]}]}");
+    TEST_ASSERT_EQUAL(DEFAULT_POLL_MS, manager.readSensorsAndHandleBehaviors());
+}
+
+void test_no_components_sleeps_for_max_period(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, "{\"devices\":[]}");
+    TEST_ASSERT_EQUAL(MAX_POLL_MS, manager.readSensorsAndHandleBehaviors());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_wait_is_time_until_next_bucket);
+    RUN_TEST(test_components_are_read_at_their_own_period);
+    RUN_TEST(test_slow_input_sees_edge_on_its_next_poll);
+    RUN_TEST(test_late_pass_does_not_shift_the_schedule);
+    RUN_TEST(test_invalid_poll_ms_falls_back_to_default);
+    RUN_TEST(test_no_components_sleeps_for_max_period);
+    return UNITY_END();
+}
@@ -0,0 +1,265 @@
+// PowerManager: the sleep decision table, idling until the next task on the
+// virtual clock, early wakes from input edges and network activity, counters.
+//
+//   pio test -e native -f test_native_power
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include "DeviceManagement.h"
+#include "PowerManagement.h"
+#include "TaskDefinitions.h"
+#include "WiFiManagement.h"
+
+namespace {
+
+const int kInputPin = 4;
+
+int taskRuns = 0;
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    native::setDelayHook(nullptr);
+    LittleFS.begin();
+    WiFi.mode(WIFI_STA);  // Station only; the soft AP rules out modem and light sleep
+    taskRuns = 0;
+}
+
+void tearDown(void) {}
+
+void test_plan_decision_table(void) {
+    Scheduler scheduler;
+    PowerManager power(scheduler);
+    power.setMode(POWER_LIGHT_SLEEP);
+
+    SleepPlan sleep = power.plan({500, false, false});
+    TEST_ASSERT_EQUAL(SLEEP_LIGHT, sleep.type);
+    TEST_ASSERT_EQUAL(500, sleep.durationMs);
+    TEST_ASSERT_EQUAL(SLEEP_MODEM, power.plan({POWER_LIGHT_MIN_MS - 1, false, false}).type);
+    TEST_ASSERT_EQUAL(SLEEP_WAIT, power.plan({500, false, true}).type);  // Soft AP keeps the radio on
+    TEST_ASSERT_EQUAL(SLEEP_NONE, power.plan({500, true, false}).type);
+    TEST_ASSERT_EQUAL(SLEEP_NONE, power.plan({POWER_IDLE_MIN_MS - 1, false, false}).type);
+    TEST_ASSERT_EQUAL(POWER_IDLE_MAX_MS, power.plan({-1, false, false}).durationMs);  // No task enabled
+    TEST_ASSERT_EQUAL(POWER_IDLE_MAX_MS, power.plan({POWER_IDLE_MAX_MS * 5, false, false}).durationMs);
+
+    power.setMode(POWER_MODEM_SLEEP);
+    TEST_ASSERT_EQUAL(SLEEP_MODEM, power.plan({500, false, false}).type);
+    power.setMode(POWER_ALWAYS_ON);
+    TEST_ASSERT_EQUAL(SLEEP_NONE, power.plan({500, false, false}).type);
+    TEST_ASSERT_EQUAL(WIFI_NONE_SLEEP, WiFi.getSleepMode());
+}
+
+void test_sleeps_until_next_watched_task(void) {
+    Scheduler scheduler;
+    Task task(250, TASK_FOREVER, []() { taskRuns++; }, &scheduler, true);
+    PowerManager power(scheduler);
+    power.setMode(POWER_LIGHT_SLEEP);
+    power.watch(task);
+    scheduler.startNow();
+
+    scheduler.execute();
+    TEST_ASSERT_EQUAL(1, taskRuns);
+    TEST_ASSERT_EQUAL(WAKE_DEADLINE, power.idle(false));
+    TEST_ASSERT_EQUAL(250, millis());
+    TEST_ASSERT_EQUAL(WIFI_MODEM_SLEEP, WiFi.getSleepMode());  // Light sleep only while idle
+
+    scheduler.execute();
+    TEST_ASSERT_EQUAL(2, taskRuns);
+    TEST_ASSERT_EQUAL(250, power.idleMs(SLEEP_LIGHT));
+    TEST_ASSERT_EQUAL(1, power.wakeCount(WAKE_DEADLINE));
+    TEST_ASSERT_EQUAL(0, native::blockedMicros());
+}
+
+void test_does_not_sleep_while_busy(void) {
+    Scheduler scheduler;
+    Task task(250, TASK_FOREVER, []() {}, &scheduler, true);
+    PowerManager power(scheduler);
+    power.watch(task);
+    scheduler.startNow();
+    scheduler.execute();
+
+    TEST_ASSERT_EQUAL(WAKE_NONE, power.idle(true));
+    TEST_ASSERT_EQUAL(0, millis());
+}
+
+void test_input_edge_ends_light_sleep(void) {
+    Scheduler scheduler;
+    Task task(1000, TASK_FOREVER, []() {}, &scheduler, true);
+    PowerManager power(scheduler);
+    power.setMode(POWER_LIGHT_SLEEP);
+    power.watch(task);
+    power.setWakePins({kInputPin, 16, 17});  // GPIO16 and A0 cannot wake the chip
+    int gpioWakes = 0;
+    power.onGpioWake([&gpioWakes]() { gpioWakes++; });
+    scheduler.startNow();
+    scheduler.execute();
+
+    int armedLevel = -1;
+    native::setDelayHook([&armedLevel](uint64_t) {
+        if (millis() == 40) {
+            armedLevel = native::gpioWakeLevel(kInputPin);
+            native::setDigitalInput(kInputPin, HIGH);
+        }
+    });
+    TEST_ASSERT_EQUAL(WAKE_GPIO, power.idle(false));
+    TEST_ASSERT_EQUAL(40, millis());
+    TEST_ASSERT_EQUAL(HIGH, armedLevel);  // Pin read LOW, so it waits for HIGH
+    TEST_ASSERT_EQUAL(-1, native::gpioWakeLevel(kInputPin));
+    TEST_ASSERT_EQUAL(-1, native::gpioWakeLevel(16));
+    TEST_ASSERT_EQUAL(1, gpioWakes);
+    TEST_ASSERT_EQUAL(1, power.wakeCount(WAKE_GPIO));
+    TEST_ASSERT_EQUAL(40, power.idleMs(SLEEP_LIGHT));
+}
+
+// Arming swaps the edge interrupt for a level one; it has to come back after every sleep
+void test_input_edges_still_wake_after_light_sleep(void) {
+    Scheduler scheduler;
+    Task task(200, TASK_FOREVER, []() {}, &scheduler, true);
+    PowerManager power(scheduler);
+    power.setMode(POWER_LIGHT_SLEEP);
+    power.watch(task);
+    power.setWakePins({kInputPin});
+    scheduler.startNow();
+
+    scheduler.execute();
+    TEST_ASSERT_EQUAL(WAKE_DEADLINE, power.idle(false));
+    scheduler.execute();
+    native::setDigitalInput(kInputPin, HIGH);  // While loop() runs
+    TEST_ASSERT_EQUAL(WAKE_GPIO, power.idle(false));
+
+    native::setDelayHook([](uint64_t) {
+        if (millis() == 230) {
+            native::setDigitalInput(kInputPin, LOW);
+        }
+    });
+    scheduler.execute();
+    TEST_ASSERT_EQUAL(WAKE_GPIO, power.idle(false));
+    TEST_ASSERT_EQUAL(230, millis());
+    native::setDelayHook(nullptr);
+    TEST_ASSERT_EQUAL(-1, native::gpioWakeLevel(kInputPin));
+    native::setDigitalInput(kInputPin, HIGH);
+    native::setDigitalInput(kInputPin, LOW);
+    TEST_ASSERT_EQUAL(WAKE_GPIO, power.idle(false));
+    TEST_ASSERT_EQUAL(3, power.wakeCount(WAKE_GPIO));
+}
+
+void test_wake_during_loop_skips_the_next_sleep(void) {
+    Scheduler scheduler;
+    Task task(1000, TASK_FOREVER, []() {}, &scheduler, true);
+    PowerManager power(scheduler);
+    power.watch(task);
+    scheduler.startNow();
+    scheduler.execute();
+
+    power.wake(WAKE_NETWORK);  // e.g. bytes arrived after handleClients() ran
+    TEST_ASSERT_EQUAL(WAKE_NETWORK, power.idle(false));
+    TEST_ASSERT_EQUAL(0, millis());
+    TEST_ASSERT_EQUAL(WAKE_DEADLINE, power.idle(false));
+    TEST_ASSERT_EQUAL(1000, millis());
+    TEST_ASSERT_EQUAL(1000, power.idleMs(SLEEP_MODEM));
+}
+
+void test_disabled_tasks_do_not_bound_the_sleep(void) {
+    Scheduler scheduler;
+    Task idleTask(10, TASK_FOREVER, []() {}, &scheduler, false);
+    PowerManager power(scheduler);
+    power.watch(idleTask);
+    scheduler.startNow();
+
+    power.idle(false);
+    TEST_ASSERT_EQUAL(POWER_IDLE_MAX_MS, millis());
+
+    WiFi.mode(WIFI_AP_STA);
+    power.idle(false);
+    TEST_ASSERT_EQUAL(POWER_IDLE_MAX_MS, power.idleMs(SLEEP_WAIT));
+}
+
+void test_input_edge_polls_inputs_early(void) {
+    DeviceManager manager;
+    native::bootConfig(manager,
+                       "{\"devices\":[{\"components\":[{\"componentName\":\"button\",\"componentType\":\"digital\","
+                       "\"componentPin\":4,\"pollMs\":500,\"actionType\":\"digital\",\"actionPin\":12,"
+                       "\"behaviors\":[\"toggle\"]}]}]}");
+    std::vector<int> pins = manager.inputPins();
+    TEST_ASSERT_EQUAL(1, pins.size());
+    TEST_ASSERT_EQUAL(kInputPin, pins[0]);
+
+    manager.readSensorsAndHandleBehaviors();
+    native::advanceMillis(30);
+    native::setDigitalInput(kInputPin, HIGH);
+    TEST_ASSERT_EQUAL(470, manager.readSensorsAndHandleBehaviors());
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(12));
+
+    manager.pollNow();
+    TEST_ASSERT_EQUAL(500, manager.readSensorsAndHandleBehaviors());
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(12));
+}
+
+void test_mode_persists(void) {
+    native::fsWrite("/power.json", "{\"mode\":\"light\"}");
+    Scheduler scheduler;
+    PowerManager power(scheduler);
+    power.loadConfig();
+    TEST_ASSERT_EQUAL(POWER_LIGHT_SLEEP, power.mode());
+
+    native::fsWrite("/power.json", "{\"mode\":\"deep\"}");
+    power.loadConfig();
+    TEST_ASSERT_EQUAL(POWER_DEFAULT_MODE, power.mode());
+}
+
+// The setup AP keeps the radio on only until the station has joined
+void test_connected_station_sleeps(void) {
+    native::wifiClearNetworks();
+    native::wifiAddNetwork("home", "secret123", 6);
+    native::fsWrite("/wifi.json", "{\"ssid\":\"home\",\"password\":\"secret123\"}");
+    Scheduler scheduler;
+    Task task(500, TASK_FOREVER, []() {}, &scheduler, true);
+    PowerManager power(scheduler);
+    power.setMode(POWER_LIGHT_SLEEP);
+    power.watch(task);
+    scheduler.startNow();
+    WiFiManager wifi;
+    wifi.startAPMode();
+    wifi.begin();
+
+    scheduler.execute();
+    power.idle(false);
+    TEST_ASSERT_EQUAL(500, power.idleMs(SLEEP_WAIT));
+
+    while (WiFi.status() != WL_CONNECTED && millis() < 60000) {
+        native::advanceMillis(wifi.reconnectWiFi());
+    }
+    wifi.reconnectWiFi();
+    TEST_ASSERT_EQUAL(WIFI_STA, WiFi.getMode());
+    for (int pass = 0; pass < 200; pass++) {  // The task catches up on the runs it missed first
+        scheduler.execute();
+        power.idle(false);
+    }
+    TEST_ASSERT_TRUE(power.idleMs(SLEEP_LIGHT) > 0);
+
+    power.setMode(POWER_MODEM_SLEEP);
+    scheduler.execute();
+    power.idle(false);
+    TEST_ASSERT_TRUE(power.idleMs(SLEEP_MODEM) > 0);
+    TEST_ASSERT_EQUAL(500, power.idleMs(SLEEP_WAIT));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_plan_decision_table);
+    RUN_TEST(test_sleeps_until_next_watched_task);
+    RUN_TEST(test_does_not_sleep_while_busy);
+    RUN_TEST(test_input_edge_ends_light_sleep);
+    RUN_TEST(test_input_edges_still_wake_after_light_sleep);
+    RUN_TEST(test_wake_during_loop_skips_the_next_sleep);
+    RUN_TEST(test_disabled_tasks_do_not_bound_the_sleep);
+    RUN_TEST(test_input_edge_polls_inputs_early);
+    RUN_TEST(test_mode_persists);
+    RUN_TEST(test_connected_station_sleeps);
+    return UNITY_END();
+}
@@ -0,0 +1,202 @@
+// RulesEngine tables and DeviceManager rules from the config: cross-component
+// targets, AND conditions, schedule windows and non-blocking pulses.
+//
+//   pio test -e native -f test_native_rules
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "DeviceManagement.h"
+#include "RulesEngine.h"
+#include "TaskDefinitions.h"
+
+namespace {
+
+struct Fired {
+    uint16_t target;
+    RuleOp op;
+    bool condition;
+};
+
+std::vector<Fired> fired;
+
+void record(RulesEngine& engine) {
+    engine.onAction([](uint16_t target, RuleOp op, bool condition, uint16_t) { fired.push_back({target, op, condition}); });
+}
+
+// Button on pin 1 and door on pin 2; lamps on 11, 12 and 13
+const char* kComponents =
+    "{\"componentName\":\"button\",\"componentType\":\"digital\",\"componentPin\":1,"
+    "\"actionType\":\"digital\",\"actionPin\":21,\"behaviors\":[]},"
+    "{\"componentName\":\"door\",\"componentType\":\"digital\",\"componentPin\":2,"
+    "\"actionType\":\"digital\",\"actionPin\":22,\"behaviors\":[\"toggle\"]},"
+    "{\"componentName\":\"lamp_a\",\"componentType\":\"digital\",\"componentPin\":3,"
+    "\"actionType\":\"digital\",\"actionPin\":11,\"behaviors\":[]},"
+    "{\"componentName\":\"lamp_b\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":12,\"behaviors\":[]},"
+    "{\"componentName\":\"buzzer\",\"componentType\":\"digital\",\"componentPin\":5,"
+    "\"actionType\":\"digital\",\"actionPin\":13,\"behaviors\":[]}";
+
+String config(const char* rules) {
+    return String("{\"devices\":[{\"components\":[") + kComponents + "]}],\"rules\":" + rules + "}";
+}
+
+void tick(DeviceManager& manager) {
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager.readSensorsAndHandleBehaviors();
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    fired.clear();
+}
+
+void tearDown(void) {}
+
+void test_rise_fires_on_every_target(void) {
+    RulesEngine engine;
+    record(engine);
+    engine.begin(4);
+    uint16_t input = 0;
+    uint16_t targets[] = {2, 3};
+    TEST_ASSERT_TRUE(engine.addRule(&input, 1, targets, 2, RULE_ON_RISE, RULE_TOGGLE));
+    engine.end();
+
+    engine.setInput(0, true);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(2, fired.size());
+    TEST_ASSERT_EQUAL(2, fired[0].target);
+    TEST_ASSERT_EQUAL(3, fired[1].target);
+
+    engine.setInput(0, false);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(2, fired.size());  // Falling edge ignored
+}
+
+void test_and_condition_with_follow(void) {
+    RulesEngine engine;
+    record(engine);
+    engine.begin(3);
+    uint16_t inputs[] = {0, 1};
+    uint16_t target = 2;
+    engine.addRule(inputs, 2, &target, 1, RULE_ON_RISE, RULE_FOLLOW);
+    engine.end();
+
+    engine.setInput(0, true);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(0, fired.size());
+    engine.setInput(1, true);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(1, fired.size());
+    TEST_ASSERT_TRUE(fired[0].condition);
+    engine.setInput(0, false);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(2, fired.size());
+    TEST_ASSERT_FALSE(fired[1].condition);
+}
+
+void test_rule_seen_once_per_pass(void) {
+    RulesEngine engine;
+    record(engine);
+    engine.begin(2);
+    uint16_t inputs[] = {0, 1};
+    uint16_t target = 0;
+    engine.addRule(inputs, 2, &target, 1, RULE_ON_RISE, RULE_TOGGLE);
+    engine.end();
+
+    engine.setInput(0, true);
+    engine.setInput(1, true);  // Both inputs of the rule changed in the same tick
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(1, fired.size());
+}
+
+void test_schedule_window_wraps_midnight(void) {
+    RulesEngine engine;
+    record(engine);
+    int minute = 23 * 60;
+    engine.setClock([&minute]() { return minute; });
+    engine.begin(1);
+    uint16_t input = 0;
+    RuleWindow night = {22 * 60, 6 * 60};
+    engine.addRule(&input, 1, &input, 1, RULE_ON_CHANGE, RULE_PULSE, 100, &night);
+    engine.end();
+
+    engine.setInput(0, true);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(1, fired.size());
+    minute = 12 * 60;
+    engine.setInput(0, false);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(1, fired.size());
+    minute = -1;  // Time unknown: windowed rules stay quiet
+    engine.setInput(0, true);
+    engine.evaluate();
+    TEST_ASSERT_EQUAL(1, fired.size());
+}
+
+void test_config_rule_toggles_other_components(void) {
+    DeviceManager manager;
+    native::bootConfig(manager,
+                       config("[{\"when\":[\"button\"],\"do\":\"toggle\","
+                              "\"targets\":[\"lamp_a\",\"lamp_b\"]}]").c_str());
+    native::setDigitalInput(1, HIGH);
+    tick(manager);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(11));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(12));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(21));  // The button's own output has no rule
+}
+
+void test_legacy_behavior_still_applies(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, config("[]").c_str());
+    native::setDigitalInput(2, HIGH);
+    tick(manager);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(22));
+}
+
+void test_pulse_does_not_block(void) {
+    DeviceManager manager;
+    native::bootConfig(manager,
+                       config("[{\"when\":[\"door\"],\"do\":\"pulse\",\"ms\":300,\"targets\":[\"buzzer\"]}]").c_str());
+    native::setDigitalInput(2, HIGH);
+    tick(manager);
+    TEST_ASSERT_EQUAL(0, native::blockedMicros());
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(13));
+    TEST_ASSERT_TRUE(taskPulse.isEnabled());
+
+    native::advanceMillis(299);
+    TEST_ASSERT_EQUAL(1, manager.endPulses());
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(13));
+    native::advanceMillis(1);
+    TEST_ASSERT_EQUAL(0, manager.endPulses());
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(13));
+}
+
+void test_invalid_rules_keep_behaviors(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, config("[{\"when\":[\"nobody\"],\"do\":\"toggle\",\"targets\":[\"lamp_a\"]}]").c_str());
+    native::setDigitalInput(2, HIGH);
+    tick(manager);
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(22));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(11));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_rise_fires_on_every_target);
+    RUN_TEST(test_and_condition_with_follow);
+    RUN_TEST(test_rule_seen_once_per_pass);
+    RUN_TEST(test_schedule_window_wraps_midnight);
+    RUN_TEST(test_config_rule_toggles_other_components);
+    RUN_TEST(test_legacy_behavior_still_applies);
+    RUN_TEST(test_pulse_does_not_block);
+    RUN_TEST(test_invalid_rules_keep_behaviors);
+    return UNITY_END();
+}
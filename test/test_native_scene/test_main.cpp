@@ -0,0 +1,201 @@
+// GPIO scenes: digital outputs changed together written with one GPOS and
+// one GPOC write, GPIO16 on its own register, and the pins above it one by
+// one.
+//
+//   pio test -e native -f test_native_scene
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <esp8266_peri.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "DeviceManagement.h"
+#include "GpioScene.h"
+#include "TimeManagement.h"
+
+namespace {
+
+// 2024-03-01 11:59:30 UTC
+const unsigned long kEpoch = 1709294370UL;
+
+struct Write {
+    int pin;
+    int value;
+    unsigned long at;
+};
+
+std::vector<Write> writes;
+
+void recordWrites() {
+    writes.clear();
+    native::setPinWriteHook([](int pin, int value) { writes.push_back({pin, value, micros()}); });
+}
+
+// Four lights on 4, 5, 12 and 16 scheduled from 12:00 to 12:30 and in
+// group 1, a relay on 40 in group 1, and a button on pin 0 that toggles 4
+String config() {
+    String json = "{\"devices\":[{\"components\":[";
+    const int pins[] = {4, 5, 12, 16, 40};
+    char buffer[400];
+    for (int i = 0; i < 5; i++) {
+        snprintf(buffer, sizeof(buffer),
+                 "{\"componentName\":\"light_%d\",\"componentType\":\"digital\",\"componentPin\":%d,"
+                 "\"actionType\":\"digital\",\"actionPin\":%d,\"behaviors\":[\"%s\"],\"groups\":[1],"
+                 "\"schedule\":{\"startTime\":{\"hour\":12,\"minute\":0},\"endTime\":{\"hour\":12,\"minute\":30}}},",
+                 pins[i], 20 + i, pins[i], pins[i] == 40 ? "toggle" : "scheduled");
+        json += buffer;
+    }
+    json += "{\"componentName\":\"button\",\"componentType\":\"digital\",\"componentPin\":0,"
+            "\"actionType\":\"digital\",\"actionPin\":30,\"behaviors\":[]}]}],"
+            "\"rules\":[{\"when\":[\"button\"],\"do\":\"toggle\",\"targets\":[\"light_4\"]},"
+            "{\"when\":[\"button\"],\"do\":\"on\",\"targets\":[\"light_5\",\"light_12\"]}]}";
+    return json;
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+}
+
+void tearDown(void) {
+    native::setPinWriteHook(nullptr);
+}
+
+void test_masks_switch_pins_together(void) {
+    for (int pin : {4, 5, 12, 16}) {
+        pinMode(pin, OUTPUT);
+    }
+    digitalWrite(5, HIGH);
+    GpioScene scene;
+    recordWrites();
+    unsigned long before = native::pinWrites();
+
+    scene.begin();
+    scene.write(4, true);
+    scene.write(12, true);
+    scene.write(12, false);  // The last level staged wins
+    scene.write(5, false);
+    scene.write(16, true);
+    TEST_ASSERT_TRUE(scene.level(4));
+    TEST_ASSERT_FALSE(scene.level(5));
+    TEST_ASSERT_EQUAL(0, writes.size());  // Nothing is written until the commit
+    scene.commit();
+
+    TEST_ASSERT_EQUAL(3, native::pinWrites() - before);  // GPOS, GPOC and GP16O
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(4));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(5));
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(12));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(16));
+    TEST_ASSERT_EQUAL_UINT32(1u << 4, (uint32_t)GPOS);
+    TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)GP16O);
+
+    // Without an open scene a write goes straight to the pin
+    scene.write(16, false);
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(16));
+}
+
+void test_nested_scenes_write_once(void) {
+    for (int pin : {2, 3, 40}) {
+        pinMode(pin, OUTPUT);
+    }
+    GpioScene scene;
+    unsigned long before = native::pinWrites();
+    scene.begin();
+    scene.write(2, true);
+    scene.begin();
+    scene.write(3, true);
+    scene.write(40, true);  // No register above GPIO16
+    scene.commit();
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(3));
+    scene.commit();
+    TEST_ASSERT_EQUAL(2, native::pinWrites() - before);  // One GPOS write, one digitalWrite()
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(2));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(3));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(40));
+}
+
+void test_schedule_edge_is_one_commit(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, config().c_str());
+    TimeManagement::begin();
+    native::sntpSync(kEpoch);
+    manager.checkScheduler();
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(4));
+
+    native::advanceMillis(30000);  // 12:00
+    recordWrites();
+    unsigned long before = native::pinWrites();
+    manager.checkScheduler();
+    TEST_ASSERT_EQUAL(2, native::pinWrites() - before);  // GPOS for 4, 5 and 12, then GP16O
+    TEST_ASSERT_EQUAL(4, writes.size());
+    for (const auto& write : writes) {
+        TEST_ASSERT_EQUAL(HIGH, write.value);
+        TEST_ASSERT_EQUAL(writes[0].at, write.at);
+    }
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(16));
+
+    native::advanceMillis(31UL * 60000);  // 12:31, all off with one GPOC write
+    before = native::pinWrites();
+    manager.checkScheduler();
+    TEST_ASSERT_EQUAL(2, native::pinWrites() - before);
+    for (int pin : {4, 5, 12, 16}) {
+        TEST_ASSERT_EQUAL(LOW, native::digitalOutput(pin));
+    }
+}
+
+void test_rule_pass_is_one_commit(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, config().c_str());
+    native::setDigitalInput(0, HIGH);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    unsigned long before = native::pinWrites();
+    manager.readSensorsAndHandleBehaviors();
+    TEST_ASSERT_EQUAL(1, native::pinWrites() - before);  // The toggle and both ons in one GPOS write
+    for (int pin : {4, 5, 12}) {
+        TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(pin));
+    }
+
+    // The next press turns 4 off and rewrites the others: one GPOS, one GPOC
+    native::setDigitalInput(0, LOW);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    manager.readSensorsAndHandleBehaviors();
+    native::setDigitalInput(0, HIGH);
+    native::advanceMillis(DEFAULT_POLL_MS);
+    before = native::pinWrites();
+    manager.readSensorsAndHandleBehaviors();
+    TEST_ASSERT_EQUAL(2, native::pinWrites() - before);
+    TEST_ASSERT_EQUAL(LOW, native::digitalOutput(4));
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(5));
+}
+
+void test_group_commit_cost_does_not_grow(void) {
+    DeviceManager manager;
+    native::bootConfig(manager, config().c_str());
+    unsigned long before = native::pinWrites();
+    TEST_ASSERT_EQUAL(6, manager.controlGroup(0, true, 255, 0));
+    // GPOS for 4, 5 and 12, GP16O, then digitalWrite() for 30 and 40
+    TEST_ASSERT_EQUAL(4, native::pinWrites() - before);
+    for (int pin : {4, 5, 12, 16, 30, 40}) {
+        TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(pin));
+    }
+
+    before = native::pinWrites();
+    TEST_ASSERT_EQUAL(5, manager.controlGroup(1, true, 0, 0));
+    TEST_ASSERT_EQUAL(3, native::pinWrites() - before);  // GPOC, GP16O and 40
+    TEST_ASSERT_EQUAL(HIGH, native::digitalOutput(30));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_masks_switch_pins_together);
+    RUN_TEST(test_nested_scenes_write_once);
+    RUN_TEST(test_schedule_edge_is_one_commit);
+    RUN_TEST(test_rule_pass_is_one_commit);
+    RUN_TEST(test_group_commit_cost_does_not_grow);
+    return UNITY_END();
+}
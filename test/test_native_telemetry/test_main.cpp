@@ -0,0 +1,355 @@
+// Analog telemetry: delta-packed raw samples, min/max/avg rollups per
+// resolution, hourly rollups on flash, and /telemetry streaming a range.
+//
+//   pio test -e native -f test_native_telemetry
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <math.h>
+
+#include <memory>
+#include <string>
+
+#include "DeviceManagement.h"
+#include "HttpServer.h"
+#include "TaskDefinitions.h"
+#include "Telemetry.h"
+#include "TimeManagement.h"
+
+void setup();
+void loop();
+extern HttpServer server;
+extern DeviceManager deviceManager;
+
+namespace {
+
+// 2024-03-01 11:59:30 UTC
+const unsigned long kEpoch = 1709294370UL;
+const unsigned long kMinute = 1709294400UL;  // 12:00:00
+const int kAnalogPin = 17;
+
+// A light sensor sampled every 100 ms, and a button
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"light\",\"componentType\":\"analog\",\"componentPin\":17,"
+    "\"actionType\":\"digital\",\"actionPin\":5,\"behaviors\":[],\"analog\":{\"sampleMs\":100}},"
+    "{\"componentName\":\"button\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":12,\"behaviors\":[\"toggle\"]}]}]}";
+
+class Text : public Print {
+   public:
+    size_t write(uint8_t c) override {
+        text += static_cast<char>(c);
+        return 1;
+    }
+    std::string text;
+};
+
+// Every point of a walk, as a JSON array
+void walk(std::shared_ptr<TelemetrySeries> series, TelemetryResolution resolution, unsigned long from,
+          unsigned long to, JsonDocument& points) {
+    TelemetryCursor cursor(series, resolution, from, to);
+    Text out;
+    out.text = "[";
+    while (cursor.print(out)) {
+    }
+    out.text += "]";
+    TEST_ASSERT_FALSE(deserializeJson(points, out.text));
+}
+
+std::string request(const std::string& text) {
+    return native::httpExchange(text, [] { server.handleClients(); });
+}
+
+std::string get(const std::string& path) {
+    return request("GET " + path + " HTTP/1.1\r\nHost: test\r\n\r\n");
+}
+
+// Samples the input for ms of device time
+void run(unsigned long ms) {
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += 10) {
+        native::advanceMillis(10);
+        loop();
+    }
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite(CONFIG_FILE, kConfig);
+    TimeManagement::begin();
+}
+
+void tearDown(void) {}
+
+void test_slow_input_packs_two_samples_per_byte(void) {
+    std::shared_ptr<TelemetrySeries> series = std::make_shared<TelemetrySeries>("light", 100);
+    native::sntpSync(kEpoch);
+    int values[300];
+    int value = 500;
+    for (int i = 0; i < 300; i++) {
+        value += (i * 7) % 5 - 2;  // Steps of -2 to 2
+        values[i] = value;
+        series->add(value, millis(), TimeManagement::getCurrentTimestamp());
+        native::advanceMillis(100);
+    }
+    // 300 samples in 8 blocks of 32 bytes, where 16-bit samples would take 600
+    TEST_ASSERT_EQUAL(300, series->rawSamples());
+    TEST_ASSERT_TRUE(sizeof(TelemetrySeries) < 1100);  // With the rollup rings
+
+    JsonDocument points;
+    walk(series, TELEMETRY_RAW, 0, kEpoch + 60, points);
+    TEST_ASSERT_EQUAL(300, points.size());
+    for (int i = 0; i < 300; i++) {
+        TEST_ASSERT_EQUAL(values[i], points[i][1].as<int>());
+    }
+    TEST_ASSERT_TRUE(fabs(points[0][0].as<double>() - kEpoch) < 0.0005);
+    TEST_ASSERT_TRUE(fabs(points[299][0].as<double>() - (kEpoch + 29.9)) < 0.0005);
+
+    // The oldest blocks make way for new samples
+    for (int i = 0; i < 1000; i++) {
+        series->add(500, millis(), TimeManagement::getCurrentTimestamp());
+        native::advanceMillis(100);
+    }
+    TEST_ASSERT_TRUE(series->rawSamples() < 500);
+    TEST_ASSERT_TRUE(series->rawSamples() > 300);
+}
+
+void test_large_steps_and_breaks_round_trip(void) {
+    std::shared_ptr<TelemetrySeries> series = std::make_shared<TelemetrySeries>("light", 100);
+    native::sntpSync(kEpoch);
+    const int values[] = {0, 1023, 0, 7, -1, 8, 9, 2000, 512, 505, 519};
+    unsigned long at = millis();
+    for (int value : values) {
+        series->add(value < 0 ? 0 : value, at, kEpoch);
+        at += value == 8 ? 250 : 100;  // Off the grid once: a new block
+    }
+    JsonDocument points;
+    walk(series, TELEMETRY_RAW, 0, kEpoch + 60, points);
+    TEST_ASSERT_EQUAL(11, points.size());
+    const int expected[] = {0, 1023, 0, 7, 0, 8, 9, 1023, 512, 505, 519};
+    for (int i = 0; i < 11; i++) {
+        TEST_ASSERT_EQUAL(expected[i], points[i][1].as<int>());
+    }
+    TEST_ASSERT_TRUE(fabs(points[6][0].as<double>() - (kEpoch + 0.75)) < 0.0005);
+}
+
+void test_rollups_per_resolution(void) {
+    std::shared_ptr<TelemetrySeries> series = std::make_shared<TelemetrySeries>("light", 1000);
+    // 12:00:00 to 12:02:59, a sample a second: 100-159 in the first minute, 200-259, then 300-359
+    for (unsigned long t = 0; t < 180; t++) {
+        series->add((t / 60 + 1) * 100 + t % 60, t * 1000, kMinute + t);
+    }
+    JsonDocument points;
+    walk(series, TELEMETRY_MINUTE, 0, kMinute + 180, points);
+    TEST_ASSERT_EQUAL(3, points.size());
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(kMinute + i * 60, points[i][0].as<unsigned long>());
+        TEST_ASSERT_EQUAL((i + 1) * 100, points[i][1].as<int>());
+        TEST_ASSERT_EQUAL((i + 1) * 100 + 59, points[i][2].as<int>());
+        TEST_ASSERT_EQUAL((i + 1) * 100 + 29, points[i][3].as<int>());
+    }
+
+    // A range takes the buckets that overlap it
+    walk(series, TELEMETRY_MINUTE, kMinute + 90, kMinute + 120, points);
+    TEST_ASSERT_EQUAL(1, points.size());
+    TEST_ASSERT_EQUAL(kMinute + 60, points[0][0].as<unsigned long>());
+
+    walk(series, TELEMETRY_QUARTER, 0, kMinute + 180, points);
+    TEST_ASSERT_EQUAL(1, points.size());
+    TEST_ASSERT_EQUAL(kMinute, points[0][0].as<unsigned long>());
+    TEST_ASSERT_EQUAL(100, points[0][1].as<int>());
+    TEST_ASSERT_EQUAL(359, points[0][2].as<int>());
+    TEST_ASSERT_EQUAL(229, points[0][3].as<int>());
+
+    // Minutes without samples leave no points, and the ring keeps its last hour
+    for (unsigned long t = 600; t < 7200; t += 30) {
+        series->add(400, t * 1000, kMinute + t);
+    }
+    walk(series, TELEMETRY_MINUTE, 0, kMinute + 7200, points);
+    TEST_ASSERT_EQUAL(TELEMETRY_MINUTES + 1, points.size());  // And the open minute
+    TEST_ASSERT_EQUAL(kMinute + 7140 - TELEMETRY_MINUTES * 60, points[0][0].as<unsigned long>());
+    walk(series, TELEMETRY_QUARTER, 0, kMinute + 7200, points);
+    TEST_ASSERT_EQUAL(8, points.size());
+    TEST_ASSERT_EQUAL(100, points[0][1].as<int>());
+    TEST_ASSERT_EQUAL(400, points[0][2].as<int>());
+    TEST_ASSERT_EQUAL(400, points[1][1].as<int>());
+}
+
+void test_hours_spill_to_flash_and_rotate(void) {
+    std::shared_ptr<TelemetrySeries> series = std::make_shared<TelemetrySeries>("light", 1000);
+    // Before the clock is set nothing reaches flash
+    for (unsigned long t = 0; t < 3 * 3600; t += 600) {
+        TEST_ASSERT_FALSE(series->add(100, t * 1000, t));
+    }
+    series->spill();
+    TEST_ASSERT_FALSE(LittleFS.exists(series->filePath(false)));
+
+    // Sixteen days of a sample every 10 minutes, rising by one an hour,
+    // spilled as taskTelemetry would
+    const unsigned long hours = 16 * 24;
+    for (unsigned long t = 0; t < hours * 3600; t += 600) {
+        if (series->add(t / 3600 % 1000, t * 1000, kMinute + t)) {
+            series->spill();
+        }
+    }
+    std::string current;
+    std::string old;
+    TEST_ASSERT_TRUE(native::fsRead(series->filePath(false).c_str(), current));
+    TEST_ASSERT_TRUE(native::fsRead(series->filePath(true).c_str(), old));
+    TEST_ASSERT_EQUAL(TELEMETRY_FLASH_HOURS / 2 * 8, old.size());
+    TEST_ASSERT_TRUE(current.size() <= TELEMETRY_FLASH_HOURS / 2 * 8);
+
+    JsonDocument points;
+    walk(series, TELEMETRY_HOUR, 0, kMinute + hours * 3600, points);
+    size_t count = points.size();
+    TEST_ASSERT_TRUE(count > TELEMETRY_FLASH_HOURS / 2);
+    TEST_ASSERT_TRUE(count <= TELEMETRY_FLASH_HOURS + 1);
+    // Consecutive hours up to the open one
+    for (size_t i = 1; i < count; i++) {
+        TEST_ASSERT_EQUAL(points[i - 1][0].as<unsigned long>() + 3600, points[i][0].as<unsigned long>());
+        TEST_ASSERT_EQUAL(points[i - 1][3].as<int>() + 1, points[i][3].as<int>());
+    }
+    TEST_ASSERT_EQUAL(kMinute + (hours - 1) * 3600, points[count - 1][0].as<unsigned long>());
+    TEST_ASSERT_EQUAL(hours - 1, points[count - 1][1].as<int>());
+
+    // A range in the middle, from the old file into the current one
+    unsigned long from = points[TELEMETRY_FLASH_HOURS / 2 - 3][0].as<unsigned long>();
+    walk(series, TELEMETRY_HOUR, from, from + 6 * 3600, points);
+    TEST_ASSERT_EQUAL(6, points.size());
+    TEST_ASSERT_EQUAL(from, points[0][0].as<unsigned long>());
+}
+
+void test_polling_leaves_closed_hours_to_the_task(void) {
+    setup();
+    native::sntpSync(kMinute + 3599);  // A second before 13:00
+    native::setAnalogInput(kAnalogPin, 800);
+    TelemetrySeries light("light", 100);
+    for (int i = 0; i < 30; i++) {
+        native::advanceMillis(100);
+        deviceManager.readSensorsAndHandleBehaviors();
+    }
+    // The poll closed the hour but left it in RAM, where /telemetry still finds it
+    TEST_ASSERT_TRUE(taskTelemetry.isEnabled());
+    TEST_ASSERT_FALSE(LittleFS.exists(light.filePath(false)));
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(get("/telemetry?component=light&resolution=1h"))));
+    TEST_ASSERT_EQUAL(2, doc["points"].size());
+    TEST_ASSERT_EQUAL(kMinute, doc["points"][0][0].as<unsigned long>());
+    TEST_ASSERT_EQUAL(800, doc["points"][0][1].as<int>());
+
+    loop();
+    TEST_ASSERT_FALSE(taskTelemetry.isEnabled());
+    std::string hours;
+    TEST_ASSERT_TRUE(native::fsRead(light.filePath(false).c_str(), hours));
+    TEST_ASSERT_EQUAL(8, hours.size());
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(get("/telemetry?component=light&resolution=1h"))));
+    TEST_ASSERT_EQUAL(2, doc["points"].size());
+}
+
+void test_endpoint_streams_the_input(void) {
+    setup();
+    native::sntpSync(kMinute - 1);
+    native::setAnalogInput(kAnalogPin, 600);
+    run(61000);
+    native::setAnalogInput(kAnalogPin, 300);
+    run(10000);
+
+    std::string raw = get("/telemetry?component=light&resolution=1m");
+    TEST_ASSERT_TRUE(raw.find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_TRUE(raw.find("Transfer-Encoding: chunked") != std::string::npos);
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(raw)));
+    TEST_ASSERT_EQUAL_STRING("light", doc["component"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("1m", doc["resolution"].as<const char*>());
+    JsonArray points = doc["points"];
+    // Consecutive minutes from 11:59, the last one the open minute the level fell in
+    TEST_ASSERT_TRUE(points.size() >= 3);
+    for (size_t i = 0; i < points.size(); i++) {
+        TEST_ASSERT_EQUAL(kMinute - 60 + i * 60, points[i][0].as<unsigned long>());
+    }
+    TEST_ASSERT_EQUAL(600, points[1][1].as<int>());
+    TEST_ASSERT_EQUAL(600, points[1][2].as<int>());
+    JsonArray last = points[points.size() - 1];
+    TEST_ASSERT_EQUAL(300, last[1].as<int>());
+    TEST_ASSERT_EQUAL(600, last[2].as<int>());
+    TEST_ASSERT_TRUE(last[3].as<int>() > 300 && last[3].as<int>() < 600);
+
+    // The last two seconds of raw samples, one every 100 ms
+    std::string from = std::to_string(TimeManagement::getCurrentTimestamp() - 2);
+    raw = get("/telemetry?component=light&resolution=raw&from=" + from);
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(raw)));
+    TEST_ASSERT_EQUAL(100, doc["sampleMs"].as<int>());
+    points = doc["points"];
+    TEST_ASSERT_TRUE(points.size() >= 20 && points.size() <= 30);
+    for (JsonVariant point : points) {
+        TEST_ASSERT_EQUAL(300, point[1].as<int>());
+    }
+}
+
+void test_endpoint_errors(void) {
+    setup();
+    const char* paths[] = {"/telemetry?component=dark", "/telemetry?component=button",
+                           "/telemetry?component=light&resolution=5m", "/telemetry?component=light&from=10&to=10"};
+    const char* errors[] = {"Invalid component name", "Not an analog component", "Invalid resolution", "Invalid range"};
+    for (int i = 0; i < 4; i++) {
+        std::string raw = get(paths[i]);
+        TEST_ASSERT_TRUE_MESSAGE(raw.find("HTTP/1.1 400") == 0, paths[i]);
+        TEST_ASSERT_TRUE_MESSAGE(raw.find(errors[i]) != std::string::npos, paths[i]);
+    }
+}
+
+void test_history_is_kept_across_configs(void) {
+    setup();
+    native::sntpSync(kMinute);
+    native::setAnalogInput(kAnalogPin, 700);
+    run(120000);
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(get("/telemetry?component=light"))));
+    size_t minutes = doc["points"].size();
+    TEST_ASSERT_TRUE(minutes >= 2);
+    TelemetrySeries light("light", 100);
+    native::fsWrite(light.filePath(false).c_str(), "hours");
+    native::fsWrite(light.filePath(true).c_str(), "hours");
+
+    // The same input under its own name keeps its rollups; a new sampleMs drops the raw samples only
+    std::string config = kConfig;
+    config.replace(config.find("\"sampleMs\":100"), 14, "\"sampleMs\":200");
+    std::string raw = request("POST /config HTTP/1.1\r\nHost: test\r\nContent-Length: " +
+                              std::to_string(config.size()) + "\r\n\r\n" + config);
+    TEST_ASSERT_TRUE(raw.find("HTTP/1.1 200") == 0);
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(get("/telemetry?component=light"))));
+    TEST_ASSERT_EQUAL(minutes, doc["points"].size());
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(get("/telemetry?component=light&resolution=raw"))));
+    TEST_ASSERT_EQUAL(0, doc["points"].size());
+    TEST_ASSERT_TRUE(LittleFS.exists(light.filePath(false)));
+
+    config.replace(config.find("\"light\""), 7, "\"lux\"");
+    request("POST /config HTTP/1.1\r\nHost: test\r\nContent-Length: " + std::to_string(config.size()) + "\r\n\r\n" +
+            config);
+    TEST_ASSERT_FALSE(deserializeJson(doc, native::dechunk(get("/telemetry?component=lux"))));
+    TEST_ASSERT_EQUAL(0, doc["points"].size());
+    // The dropped name's hours go with it
+    TEST_ASSERT_FALSE(LittleFS.exists(light.filePath(false)));
+    TEST_ASSERT_FALSE(LittleFS.exists(light.filePath(true)));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_slow_input_packs_two_samples_per_byte);
+    RUN_TEST(test_large_steps_and_breaks_round_trip);
+    RUN_TEST(test_rollups_per_resolution);
+    RUN_TEST(test_hours_spill_to_flash_and_rotate);
+    RUN_TEST(test_polling_leaves_closed_hours_to_the_task);
+    RUN_TEST(test_endpoint_streams_the_input);
+    RUN_TEST(test_endpoint_errors);
+    RUN_TEST(test_history_is_kept_across_configs);
+    return UNITY_END();
+}
@@ -0,0 +1,128 @@
+// TimeManagement: background SNTP, the millis() offset, the saved time for
+// cold starts and the once-a-minute local time cache.
+//
+//   pio test -e native -f test_native_time
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "TimeManagement.h"
+
+namespace {
+
+// 2024-03-01 11:59:30 UTC
+const unsigned long kEpoch = 1709294370UL;
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+}
+
+void tearDown(void) {}
+
+void test_begin_does_not_wait_for_sntp(void) {
+    TimeManagement::begin();
+    TEST_ASSERT_EQUAL(0, millis());
+    TEST_ASSERT_EQUAL_STRING(TIME_NTP_SERVER_1, native::sntpServer());
+    TEST_ASSERT_FALSE(TimeManagement::isValid());
+    TEST_ASSERT_NULL(TimeManagement::localTime());
+    TEST_ASSERT_EQUAL(-1, TimeManagement::minuteOfDay());
+
+    native::advanceMillis(2500);
+    TEST_ASSERT_EQUAL(2, TimeManagement::getCurrentTimestamp());  // Seconds since boot
+}
+
+void test_sntp_answer_anchors_the_offset(void) {
+    TimeManagement::begin();
+    native::advanceMillis(700);
+    native::sntpSync(kEpoch);
+    TEST_ASSERT_EQUAL(TIME_NTP, TimeManagement::source());
+    TEST_ASSERT_EQUAL(kEpoch, TimeManagement::getCurrentTimestamp());
+
+    native::advanceMillis(999);
+    TEST_ASSERT_EQUAL(kEpoch, TimeManagement::getCurrentTimestamp());
+    native::advanceMillis(1);
+    TEST_ASSERT_EQUAL(kEpoch + 1, TimeManagement::getCurrentTimestamp());
+
+    native::advanceMillis(3UL * 86400000UL);  // Past the rebase interval
+    TEST_ASSERT_EQUAL(kEpoch + 1 + 3 * 86400, TimeManagement::getCurrentTimestamp());
+    TEST_ASSERT_EQUAL(time(nullptr), TimeManagement::getCurrentTimestamp());
+}
+
+void test_sntp_time_and_zone_survive_a_reboot(void) {
+    native::fsWrite("/time.json", "{\"timezone\":\"CET-1CEST,M3.5.0,M10.5.0/3\"}");
+    TimeManagement::begin();
+    native::sntpSync(kEpoch);
+
+    std::string saved;
+    TEST_ASSERT_TRUE(native::fsRead("/time.json", saved));
+    TEST_ASSERT_TRUE(saved.find("1709294370") != std::string::npos);
+
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite("/time.json", saved);
+    TimeManagement::begin();
+    TEST_ASSERT_EQUAL(TIME_SAVED, TimeManagement::source());
+    TEST_ASSERT_EQUAL(kEpoch, TimeManagement::getCurrentTimestamp());
+    TEST_ASSERT_EQUAL(12 * 60 + 59, TimeManagement::minuteOfDay());  // 11:59 UTC is 12:59 CET
+}
+
+void test_local_time_is_recomputed_once_a_minute(void) {
+    native::fsWrite("/time.json", "{\"timezone\":\"UTC0\"}");
+    TimeManagement::begin();
+    native::sntpSync(kEpoch);
+
+    const struct tm* local = TimeManagement::localTime();
+    TEST_ASSERT_EQUAL(11, local->tm_hour);
+    TEST_ASSERT_EQUAL(59, local->tm_min);
+    TEST_ASSERT_EQUAL(30, local->tm_sec);
+
+    native::advanceMillis(29000);
+    local = TimeManagement::localTime();
+    TEST_ASSERT_EQUAL(59, local->tm_min);
+    TEST_ASSERT_EQUAL(30, local->tm_sec);  // Cached from the minute's first call
+
+    native::advanceMillis(1000);
+    local = TimeManagement::localTime();
+    TEST_ASSERT_EQUAL(12, local->tm_hour);
+    TEST_ASSERT_EQUAL(0, local->tm_min);
+    TEST_ASSERT_EQUAL(0, local->tm_sec);
+}
+
+void test_setting_the_clock_back_refreshes_the_cache(void) {
+    TimeManagement::begin();
+    native::sntpSync(kEpoch);
+    TEST_ASSERT_EQUAL(11 * 60 + 59, TimeManagement::minuteOfDay());
+
+    TimeManagement::setTime(kEpoch - 3600, TIME_MANUAL);
+    TEST_ASSERT_EQUAL(10 * 60 + 59, TimeManagement::minuteOfDay());
+    TimeManagement::setTimezone("EST5");
+    TEST_ASSERT_EQUAL(5 * 60 + 59, TimeManagement::minuteOfDay());
+}
+
+void test_millis_until_next_minute(void) {
+    TimeManagement::begin();
+    TEST_ASSERT_EQUAL(60000, TimeManagement::millisUntilNextMinute());
+    native::sntpSync(kEpoch);
+    native::advanceMillis(250);
+    TEST_ASSERT_EQUAL(29750, TimeManagement::millisUntilNextMinute());
+    native::advanceMillis(29750);
+    TEST_ASSERT_EQUAL(60000, TimeManagement::millisUntilNextMinute());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_does_not_wait_for_sntp);
+    RUN_TEST(test_sntp_answer_anchors_the_offset);
+    RUN_TEST(test_sntp_time_and_zone_survive_a_reboot);
+    RUN_TEST(test_local_time_is_recomputed_once_a_minute);
+    RUN_TEST(test_setting_the_clock_back_refreshes_the_cache);
+    RUN_TEST(test_millis_until_next_minute);
+    return UNITY_END();
+}
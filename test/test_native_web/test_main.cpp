@@ -0,0 +1,164 @@
+// Web UI: gzip files under /www served as they are, with ETags and
+// Cache-Control, streamed from flash, and the endpoint list without them.
+//
+//   pio test -e native -f test_native_web
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+
+#include "DeviceManagement.h"
+#include "HttpServer.h"
+
+void setup();
+void loop();
+extern HttpServer server;
+
+namespace {
+
+const char* kConfig =
+    "{\"devices\":[{\"components\":["
+    "{\"componentName\":\"button\",\"componentType\":\"digital\",\"componentPin\":4,"
+    "\"actionType\":\"digital\",\"actionPin\":12,\"behaviors\":[\"toggle\"]}]}]}";
+
+// Stand-ins for what build_web.py writes; the server never looks inside
+const std::string kIndex = std::string("\x1f\x8b\x08\x00", 4) + "index";
+const std::string kScript = std::string("\x1f\x8b\x08\x00", 4) + "script";
+
+std::string request(const std::string& text) {
+    return native::httpExchange(text, [] { server.handleClients(); });
+}
+
+std::string get(const std::string& path, const std::string& headers = "") {
+    return request("GET " + path + " HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n");
+}
+
+std::string body(const std::string& raw) {
+    return raw.substr(raw.find("\r\n\r\n") + 4);
+}
+
+// The value of a response header, empty when it is missing
+std::string header(const std::string& raw, const std::string& name) {
+    size_t at = raw.find("\r\n" + name + ": ");
+    if (at == std::string::npos || at > raw.find("\r\n\r\n")) {
+        return "";
+    }
+    at += name.size() + 4;
+    return raw.substr(at, raw.find("\r\n", at) - at);
+}
+
+bool has(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::fsWrite(CONFIG_FILE, kConfig);
+    native::fsWrite("/www/index.html.gz", kIndex);
+    native::fsWrite("/www/app.0123abcd.js.gz", kScript);
+    setup();
+}
+
+void tearDown(void) {}
+
+void test_index_is_served_compressed_and_revalidated() {
+    std::string raw = get("/");
+    TEST_ASSERT_TRUE_MESSAGE(has(raw, "HTTP/1.1 200"), raw.c_str());
+    TEST_ASSERT_EQUAL_STRING("text/html", header(raw, "Content-Type").c_str());
+    TEST_ASSERT_EQUAL_STRING("gzip", header(raw, "Content-Encoding").c_str());
+    TEST_ASSERT_EQUAL_STRING("no-cache", header(raw, "Cache-Control").c_str());
+    TEST_ASSERT_EQUAL_STRING(std::to_string(kIndex.size()).c_str(), header(raw, "Content-Length").c_str());
+    TEST_ASSERT_TRUE(body(raw) == kIndex);
+    TEST_ASSERT_TRUE(get("/index.html") == raw);
+
+    std::string etag = header(raw, "ETag");
+    TEST_ASSERT_EQUAL(10, etag.size());
+    TEST_ASSERT_EQUAL('"', etag[0]);
+    raw = get("/", "If-None-Match: " + etag + "\r\n");
+    TEST_ASSERT_TRUE_MESSAGE(has(raw, "HTTP/1.1 304"), raw.c_str());
+    TEST_ASSERT_EQUAL_STRING(etag.c_str(), header(raw, "ETag").c_str());
+    TEST_ASSERT_EQUAL_STRING("", header(raw, "Content-Encoding").c_str());
+    TEST_ASSERT_EQUAL_STRING("", header(raw, "Content-Length").c_str());
+    TEST_ASSERT_EQUAL_STRING("", header(raw, "Content-Type").c_str());
+    TEST_ASSERT_EQUAL(0, body(raw).size());
+
+    // A new image changes the tag
+    native::fsWrite("/www/index.html.gz", kIndex + "v2");
+    raw = get("/", "If-None-Match: " + etag + "\r\n");
+    TEST_ASSERT_TRUE_MESSAGE(has(raw, "HTTP/1.1 200"), raw.c_str());
+    TEST_ASSERT_TRUE(header(raw, "ETag") != etag);
+}
+
+void test_assets_are_cached_for_good() {
+    std::string raw = get("/app.0123abcd.js");
+    TEST_ASSERT_TRUE_MESSAGE(has(raw, "HTTP/1.1 200"), raw.c_str());
+    TEST_ASSERT_EQUAL_STRING("application/javascript", header(raw, "Content-Type").c_str());
+    TEST_ASSERT_EQUAL_STRING("gzip", header(raw, "Content-Encoding").c_str());
+    TEST_ASSERT_EQUAL_STRING("public, max-age=31536000, immutable", header(raw, "Cache-Control").c_str());
+    TEST_ASSERT_TRUE(body(raw) == kScript);
+
+    raw = request("HEAD /app.0123abcd.js HTTP/1.1\r\nHost: test\r\n\r\n");
+    TEST_ASSERT_TRUE_MESSAGE(has(raw, "HTTP/1.1 200"), raw.c_str());
+    TEST_ASSERT_EQUAL_STRING(std::to_string(kScript.size()).c_str(), header(raw, "Content-Length").c_str());
+    TEST_ASSERT_EQUAL(0, body(raw).size());
+}
+
+void test_large_file_streams_from_flash() {
+    std::string image;
+    for (int i = 0; image.size() < 40000; i++) {
+        image += static_cast<char>(i * 7 + i / 251);
+    }
+    native::fsWrite("/www/big.bin.gz", image);
+
+    native::LoopbackClient client;
+    client.send("GET /big.bin HTTP/1.1\r\nHost: test\r\n\r\n");
+    native::pollNetwork();
+    size_t before = native::heapStats().liveBytes;
+    size_t peak = 0;
+    std::string raw;
+    for (int i = 0; i < 200 && raw.size() < image.size(); i++) {
+        server.handleClients();
+        size_t held = native::heapStats().liveBytes - raw.capacity();
+        peak = held > peak ? held : peak;
+        native::pollNetwork();
+        raw += client.receive();
+    }
+    TEST_ASSERT_EQUAL_STRING("application/octet-stream", header(raw, "Content-Type").c_str());
+    TEST_ASSERT_EQUAL_STRING("40000", header(raw, "Content-Length").c_str());
+    TEST_ASSERT_TRUE(body(raw) == image);
+    TEST_ASSERT_TRUE_MESSAGE(peak < before + image.size() / 4, std::to_string(peak - before).c_str());
+}
+
+void test_missing_files() {
+    TEST_ASSERT_TRUE(has(get("/nothing.js"), "HTTP/1.1 404"));
+    TEST_ASSERT_TRUE(has(get("/../config.json"), "HTTP/1.1 404"));
+    TEST_ASSERT_TRUE(has(request("POST /index.html HTTP/1.1\r\nHost: test\r\nContent-Length: 0\r\n\r\n"),
+                         "HTTP/1.1 404"));
+    // Routes come first
+    TEST_ASSERT_TRUE(has(get("/devices"), "button"));
+}
+
+void test_endpoint_list_without_a_web_ui() {
+    LittleFS.remove("/www/index.html.gz");
+    std::string raw = get("/");
+    TEST_ASSERT_TRUE_MESSAGE(has(raw, "HTTP/1.1 200"), raw.c_str());
+    TEST_ASSERT_EQUAL_STRING("text/plain", header(raw, "Content-Type").c_str());
+    TEST_ASSERT_TRUE(has(body(raw), "/scan - Scan for WiFi networks\n"));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_index_is_served_compressed_and_revalidated);
+    RUN_TEST(test_assets_are_cached_for_good);
+    RUN_TEST(test_large_file_streams_from_flash);
+    RUN_TEST(test_missing_files);
+    RUN_TEST(test_endpoint_list_without_a_web_ui);
+    return UNITY_END();
+}
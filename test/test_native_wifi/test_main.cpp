@@ -0,0 +1,179 @@
+// WiFiManager reconnects: credentials cached in RAM, the saved channel and
+// BSSID skipping the scan, static addresses skipping DHCP, and backoff.
+//
+//   pio test -e native -f test_native_wifi
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <NativeMock.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "TaskDefinitions.h"
+#include "WiFiManagement.h"
+
+namespace {
+
+const char* kCredentials = "{\"ssid\":\"home\",\"password\":\"secret123\"}";
+
+// Runs reconnectWiFi() as taskReconnectWiFi would until the station is up;
+// returns how long that took
+unsigned long connect(WiFiManager& manager, unsigned long limitMs = 60000) {
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < limitMs) {
+        native::advanceMillis(manager.reconnectWiFi());
+    }
+    manager.reconnectWiFi();  // Notices the connection
+    return millis() - start;
+}
+
+// Connects once with a full scan so /wifi.json gains the channel and BSSID
+void firstBoot(WiFiManager& manager) {
+    native::fsWrite("/wifi.json", kCredentials);
+    manager.begin();
+    connect(manager);
+}
+
+}  // namespace
+
+void setUp(void) {
+    native::reset();
+    LittleFS.begin();
+    native::wifiClearNetworks();
+    native::wifiAddNetwork("home", "secret123", 6);
+    WiFi.mode(WIFI_STA);
+}
+
+void tearDown(void) {}
+
+void test_credentials_are_read_once(void) {
+    WiFiManager manager;
+    native::fsWrite("/wifi.json", kCredentials);
+    TEST_ASSERT_TRUE(manager.loadWiFiCredentials());
+    native::fsWrite("/wifi.json", "{}");
+    TEST_ASSERT_TRUE(manager.loadWiFiCredentials());
+}
+
+void test_saves_channel_and_bssid_after_connecting(void) {
+    WiFiManager manager;
+    firstBoot(manager);
+    TEST_ASSERT_EQUAL(WL_CONNECTED, WiFi.status());
+
+    std::string saved;
+    TEST_ASSERT_TRUE(native::fsRead("/wifi.json", saved));
+    TEST_ASSERT_TRUE(saved.find("\"channel\":6") != std::string::npos);
+    TEST_ASSERT_TRUE(saved.find("\"bssid\":\"02:00:00:00:06:00\"") != std::string::npos);
+}
+
+void test_reconnect_skips_the_scan(void) {
+    WiFiManager booted;
+    native::fsWrite("/wifi.json", kCredentials);
+    booted.begin();
+    unsigned long scanned = connect(booted);
+
+    WiFiManager manager;  // A reboot: only /wifi.json carries over
+    manager.begin();
+    unsigned long fast = connect(manager);
+    TEST_ASSERT_EQUAL(WL_CONNECTED, WiFi.status());
+    TEST_ASSERT_TRUE_MESSAGE(scanned >= 2000, "full scan");
+    TEST_ASSERT_TRUE_MESSAGE(fast < 1000, "saved channel and BSSID");
+
+    native::wifiDropConnection();
+    unsigned long begins = native::wifiBeginCount();
+    TEST_ASSERT_TRUE(connect(manager) < 1000);
+    TEST_ASSERT_EQUAL(begins + 1, native::wifiBeginCount());
+}
+
+void test_static_ip_skips_dhcp(void) {
+    WiFiManager manager;
+    firstBoot(manager);
+    native::wifiDropConnection();
+    unsigned long dhcp = connect(manager);
+
+    std::string saved;
+    native::fsRead("/wifi.json", saved);
+    saved.insert(saved.size() - 1, ",\"ip\":\"192.168.1.60\",\"gateway\":\"192.168.1.1\"");
+    native::fsWrite("/wifi.json", saved);
+    WiFiManager rebooted;
+    rebooted.begin();
+    unsigned long fixed = connect(rebooted);
+    TEST_ASSERT_EQUAL_STRING("192.168.1.60", WiFi.localIP().toString().c_str());
+    TEST_ASSERT_TRUE(fixed + 300 < dhcp);
+    TEST_ASSERT_TRUE(fixed < 300);
+}
+
+void test_moved_access_point_falls_back_to_a_scan(void) {
+    WiFiManager manager;
+    firstBoot(manager);
+
+    native::wifiClearNetworks();
+    native::wifiAddNetwork("home", "secret123", 11);
+    unsigned long took = connect(manager);
+    TEST_ASSERT_EQUAL(WL_CONNECTED, WiFi.status());
+    TEST_ASSERT_EQUAL(2, native::wifiBeginCount());  // Saved channel, then a scan
+    TEST_ASSERT_TRUE(took < 4000);
+
+    std::string saved;
+    native::fsRead("/wifi.json", saved);
+    TEST_ASSERT_TRUE(saved.find("\"channel\":11") != std::string::npos);
+}
+
+void test_retries_back_off_with_jitter(void) {
+    WiFiManager manager;
+    firstBoot(manager);
+    native::wifiSetOnline(false);
+
+    // Each failed round is a fast attempt then a scan, then the backoff delay
+    std::vector<unsigned long> delays;
+    unsigned long ceiling = WIFI_RETRY_MIN_MS;
+    for (int round = 0; round < 12; round++) {
+        unsigned long wait;
+        do {
+            wait = manager.reconnectWiFi();
+            native::advanceMillis(wait);
+        } while (wait < WIFI_RETRY_MIN_MS / 2);
+        TEST_ASSERT_TRUE_MESSAGE(wait >= ceiling / 2 && wait <= ceiling, "delay within the backoff window");
+        delays.push_back(wait);
+        ceiling = std::min<unsigned long>(ceiling * 2, WIFI_RETRY_MAX_MS);
+    }
+    TEST_ASSERT_TRUE(delays.back() >= WIFI_RETRY_MAX_MS / 2);
+    TEST_ASSERT_EQUAL(24, native::wifiBeginCount() - 1);
+
+    native::wifiSetOnline(true);
+    TEST_ASSERT_TRUE(connect(manager) < 1000);
+}
+
+void test_soft_ap_stops_once_connected(void) {
+    WiFiManager manager;
+    manager.startAPMode();
+    firstBoot(manager);
+    TEST_ASSERT_EQUAL(WIFI_STA, WiFi.getMode());
+
+    // Back for setup when the network stays away
+    native::wifiSetOnline(false);
+    native::wifiDropConnection();
+    unsigned long start = millis();
+    while (WiFi.getMode() == WIFI_STA && millis() - start < 120000) {
+        native::advanceMillis(manager.reconnectWiFi());
+    }
+    TEST_ASSERT_EQUAL(WIFI_AP_STA, WiFi.getMode());
+
+    native::wifiSetOnline(true);
+    connect(manager, WIFI_RETRY_MAX_MS);
+    TEST_ASSERT_EQUAL(WIFI_STA, WiFi.getMode());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_credentials_are_read_once);
+    RUN_TEST(test_saves_channel_and_bssid_after_connecting);
+    RUN_TEST(test_reconnect_skips_the_scan);
+    RUN_TEST(test_static_ip_skips_dhcp);
+    RUN_TEST(test_moved_access_point_falls_back_to_a_scan);
+    RUN_TEST(test_retries_back_off_with_jitter);
+    RUN_TEST(test_soft_ap_stops_once_connected);
+    return UNITY_END();
+}
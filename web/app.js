@@ -0,0 +1,111 @@
+// Device page: components with their outputs, analog trends from
+// /telemetry, and the Wi-Fi connection. Everything goes through the same
+// JSON endpoints as rest.http.
+(function () {
+  const $ = (id) => document.getElementById(id);
+  const json = (url, options) => fetch(url, options).then((r) => r.json());
+
+  function control(name, level) {
+    return fetch('/control', {
+      method: 'POST',
+      headers: {'Content-Type': 'application/json'},
+      body: JSON.stringify({componentName: name, action: 'control', level: level}),
+    });
+  }
+
+  // Min-max band and average line of the last hour of 1-minute rollups
+  function trend(canvas, name) {
+    json('/telemetry?component=' + encodeURIComponent(name) + '&resolution=1m').then((data) => {
+      const points = data.points;
+      const ctx = canvas.getContext('2d');
+      const w = (canvas.width = canvas.clientWidth);
+      const h = (canvas.height = canvas.clientHeight);
+      ctx.clearRect(0, 0, w, h);
+      if (points.length < 2) return;
+      const t0 = points[0][0];
+      const span = points[points.length - 1][0] - t0 || 1;
+      const x = (p) => ((p[0] - t0) / span) * (w - 2) + 1;
+      const y = (v) => h - 1 - (v / 1023) * (h - 2);
+      ctx.fillStyle = '#1f3a5f33';
+      ctx.beginPath();
+      points.forEach((p) => ctx.lineTo(x(p), y(p[2])));
+      points.slice().reverse().forEach((p) => ctx.lineTo(x(p), y(p[1])));
+      ctx.fill();
+      ctx.strokeStyle = '#1f3a5f';
+      ctx.beginPath();
+      points.forEach((p) => ctx.lineTo(x(p), y(p[3])));
+      ctx.stroke();
+    });
+  }
+
+  function renderComponent(c) {
+    const row = document.createElement('div');
+    row.className = 'component';
+    const label = document.createElement('div');
+    label.innerHTML = '<div class="name"></div><div class="detail"></div>';
+    label.firstChild.textContent = c.componentName;
+    label.lastChild.textContent =
+      c.componentType + ' on ' + c.componentPin + (c.state.level !== undefined ? ', level ' + c.state.level : '');
+    row.appendChild(label);
+
+    const input = document.createElement('input');
+    if (c.pwm) {
+      input.type = 'range';
+      input.max = 255;
+      input.value = c.state.outputLevel;
+      input.onchange = () => control(c.componentName, +input.value);
+    } else {
+      input.type = 'checkbox';
+      input.checked = c.state.outputLevel > 0;
+      input.onchange = () => control(c.componentName, input.checked ? 255 : 0);
+    }
+    row.appendChild(input);
+
+    if (c.componentType === 'analog') {
+      const canvas = document.createElement('canvas');
+      row.appendChild(canvas);
+      requestAnimationFrame(() => trend(canvas, c.componentName));
+    }
+    return row;
+  }
+
+  function refresh() {
+    json('/devices').then((data) => {
+      const list = $('components');
+      list.textContent = '';
+      data.devices.forEach((d) => d.components.forEach((c) => list.appendChild(renderComponent(c))));
+      if (!list.firstChild) list.innerHTML = '<p class="muted">No components configured</p>';
+    });
+    json('/status').then((s) => {
+      $('host').textContent = s.hostname;
+      $('firmware').textContent = s.firmware;
+      $('wifi').textContent = s.ssid ? 'Connected to ' + s.ssid + ' as ' + s.ip : 'Not connected';
+    });
+  }
+
+  // /scan answers 202 until the results are in
+  function scan() {
+    fetch('/scan').then((r) => {
+      if (r.status === 202) return setTimeout(scan, 1000);
+      r.json().then((networks) => {
+        $('networks').innerHTML = '';
+        networks.forEach((n) => {
+          const option = document.createElement('option');
+          option.value = n.ssid;
+          $('networks').appendChild(option);
+        });
+      });
+    });
+  }
+
+  $('scan').onclick = scan;
+  $('connect').onsubmit = (e) => {
+    e.preventDefault();
+    fetch('/connect', {method: 'POST', body: new URLSearchParams(new FormData(e.target))});
+    $('wifi').textContent = 'Connecting...';
+    setTimeout(refresh, 5000);
+  };
+
+  refresh();
+  setInterval(refresh, 30000);
+})();